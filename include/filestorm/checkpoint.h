@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Bump whenever the layout of anything written to a checkpoint changes
+#define CHECKPOINT_VERSION 5
+#define CHECKPOINT_MAGIC "FSTMCKPT"
+
+/**
+ * @brief Writes a binary checkpoint atomically.
+ *
+ * Data go to "<path>.tmp" which is fsynced and renamed over <path> by commit(), so a crash at any moment leaves
+ * either the previous or the new checkpoint in place, never a partial one. Values are stored in host byte order,
+ * checkpoints are meant to be resumed on the same machine. The reader checks the magic and the version written in front
+ * of the data.
+ */
+class CheckpointWriter {
+public:
+  explicit CheckpointWriter(const std::string& path);
+  ~CheckpointWriter();
+
+  template <typename T> void write(const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be written directly");
+    _out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+  void write(const std::string& value) {
+    write<uint64_t>(value.size());
+    _out.write(value.data(), value.size());
+  }
+  template <typename T> void write(const std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable<T>::value, "Only vectors of trivially copyable values can be written directly");
+    write<uint64_t>(values.size());
+    _out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+  }
+
+  // Flush the data to disk and replace the previous checkpoint
+  void commit();
+
+private:
+  std::string _path;
+  std::string _tmp_path;
+  std::ofstream _out;
+  bool _committed = false;
+};
+
+class CheckpointReader {
+public:
+  explicit CheckpointReader(const std::string& path);
+
+  template <typename T> T read() {
+    static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be read directly");
+    T value;
+    readBytes(reinterpret_cast<char*>(&value), sizeof(T));
+    return value;
+  }
+  std::string readString() {
+    std::string value(readLength(1), '\0');
+    readBytes(value.data(), value.size());
+    return value;
+  }
+  template <typename T> std::vector<T> readVector() {
+    std::vector<T> values(readLength(sizeof(T)));
+    readBytes(reinterpret_cast<char*>(values.data()), values.size() * sizeof(T));
+    return values;
+  }
+
+private:
+  void readBytes(char* data, uint64_t size) {
+    if (size > _remaining || !_in.read(data, size)) {
+      throw std::runtime_error(fmt_error("unexpected end of file"));
+    }
+    _remaining -= size;
+  }
+  // Number of elements of a string or vector, a corrupt one would allocate more than the rest of the file holds
+  uint64_t readLength(uint64_t element_size) {
+    auto length = read<uint64_t>();
+    if (length > _remaining / element_size) {
+      throw std::runtime_error(fmt_error("corrupt length " + std::to_string(length)));
+    }
+    return length;
+  }
+  std::string fmt_error(const std::string& message) const { return "Checkpoint " + _path + ": " + message; }
+
+  std::string _path;
+  std::ifstream _in;
+  // Bytes left to read
+  uint64_t _remaining = 0;
+};
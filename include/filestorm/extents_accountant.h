@@ -0,0 +1,91 @@
+#pragma once
+
+#include <filestorm/filefrag.h>
+#include <filestorm/filetree.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief Keeps FileTree::total_extents_count up to date without scanning files in the measured loop.
+ *
+ * Files are marked dirty from the main loop and every dirty file is scanned at most once per batch, no matter how
+ * many times it was touched. The scans (FIEMAP) run on a pool of worker threads and their results are applied to the
+ * tree by collect(), so nodes and the total counter are only ever modified by the thread which owns the tree.
+ * With zero workers the scans are done synchronously in submit(), which matches the original behaviour.
+ * Only the byte ranges marked dirty on the node are rescanned (see FileTree::Node::markExtentsDirty), the rest of the
+ * cached extents is kept.
+ * Without fiemap_sync the scans don't flush the files (FIEMAP_FLAG_SYNC), so they don't start writeback competing with
+ * the measured I/O, delayed allocations are then counted as they are reported. scanAll() always flushes, the final
+ * count is exact.
+ */
+class ExtentsAccountant {
+public:
+  ExtentsAccountant(FileTree& tree, unsigned int workers, bool fiemap_sync = true);
+  ~ExtentsAccountant();
+
+  // Schedule the file for rescan. Repeated calls before the next submit() are coalesced.
+  void markDirty(FileTree::Nodeptr file);
+  // Stop tracking a file which is going to be removed and subtract its last known extents from the total.
+  void forget(FileTree::Nodeptr file);
+  // Hand all pending dirty files to the workers. Files which are still being scanned stay pending for the next batch.
+  void submit();
+  // Apply finished scans to the tree. Returns number of applied scans. Failed scans of files renamed since they were
+  // submitted are scheduled again.
+  size_t collect();
+  // Submit everything and block until all scans are applied.
+  void drain();
+  // Rescan every file in the tree completely, flushing it first, and return the exact total extents count.
+  int64_t scanAll();
+
+  size_t pendingCount() const;
+  unsigned int workers() const { return _workers.size(); }
+
+private:
+  // The workers open the file by its path, they must not walk the tree the main thread modifies. The parent and the
+  // name it had tell whether the file was renamed since.
+  struct Job {
+    FileTree::Nodeptr file;
+    FileTree::Nodeptr parent;
+    std::string name;
+    std::string path;
+    std::vector<FileTree::Node::Range> ranges;
+    bool sync;
+  };
+  struct Done {
+    FileTree::Nodeptr file;
+    FileTree::Nodeptr parent;
+    std::string name;
+    std::vector<FileTree::Node::Range> ranges;
+    std::vector<std::vector<extents>> file_extents;
+    bool failed;
+    std::string error;
+  };
+
+  void work();
+  Done scan(const Job& job);
+
+  FileTree& _tree;
+  bool _fiemap_sync;
+  // Set by scanAll(), the files it submits are flushed regardless of _fiemap_sync
+  bool _force_sync = false;
+  std::vector<std::thread> _workers;
+
+  mutable std::mutex _mutex;
+  std::condition_variable _jobs_cv;
+  std::condition_variable _done_cv;
+  bool _stopping = false;
+
+  std::unordered_map<FileTree::Node*, FileTree::Nodeptr> _pending;
+  std::unordered_set<FileTree::Node*> _inflight;
+  std::unordered_set<FileTree::Node*> _discarded;
+  std::deque<Job> _queue;
+  std::vector<Done> _done;
+};
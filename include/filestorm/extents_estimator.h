@@ -0,0 +1,51 @@
+#pragma once
+
+#include <filestorm/filefrag.h>
+#include <filestorm/filetree.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Estimates the total number of extents of a tree from a random sample of its files.
+ *
+ * The files are split into equally sized strata by their order of creation (FileTree::Node::_sequence, the file list
+ * itself is reordered by removals). Every stratum holds files of similar age, older files were altered more times and
+ * tend to be more fragmented, which makes the stratified estimate much tighter than a plain random sample of the same
+ * size. Every stratum gets a share of the sample proportional to its size and the files are scanned completely with
+ * FIEMAP.
+ */
+class ExtentsEstimator {
+public:
+  struct Estimate {
+    double total = 0;   // Estimated total extents count
+    double margin = 0;  // Half width of the 95% confidence interval
+    size_t sampled = 0;
+    size_t population = 0;
+    bool exact() const { return sampled == population; }
+  };
+
+  // Extents counts of the scanned files of one stratum and how many files the stratum has
+  struct Stratum {
+    size_t population = 0;
+    std::vector<double> samples;
+  };
+
+  ExtentsEstimator(size_t sample_size, size_t strata, bool fiemap_sync = true);
+
+  // Sample the files, scan them and return the estimate. Draws from the EXTENTS stream of Random.
+  Estimate estimate(const std::vector<FileTree::Nodeptr>& files);
+  // Combine already scanned strata into the estimate of the total
+  static Estimate combine(const std::vector<Stratum>& strata);
+
+  size_t sampleSize() const { return _sample_size; }
+
+private:
+  // Floyd's algorithm, picks count distinct indices from [0, population) without touching the whole range
+  static std::vector<size_t> pick(size_t population, size_t count);
+
+  size_t _sample_size;
+  size_t _strata;
+  bool _fiemap_sync;
+};
@@ -16,7 +16,9 @@
 #include <iostream>
 #include <vector>
 
+// Initial number of extents the fiemap buffer is sized for, it grows on demand up to MAX_FIEMAP_EXTENTS
 #define MAX_EXTENTS 32
+#define MAX_FIEMAP_EXTENTS 16384
 
 struct extents {
   uint64_t start;
@@ -24,4 +26,6 @@ struct extents {
   uint64_t flags;
 };
 
-std::vector<extents> get_extents(const char *file_path);
\ No newline at end of file
+std::vector<extents> get_extents(const char *file_path, bool sync = true);
+// Return only the extents intersecting the byte range [start, start + length) of the file.
+std::vector<extents> get_extents(const char *file_path, uint64_t start, uint64_t length, bool sync = true);
\ No newline at end of file
@@ -1,20 +1,31 @@
 #pragma once
 
+#include <filestorm/checkpoint.h>
 #include <filestorm/filefrag.h>
 #include <filestorm/utils.h>
+#include <filestorm/utils/fenwick_tree.h>
 #include <filestorm/utils/fs.h>
+#include <filestorm/utils/indexed_set.h>
 #include <filestorm/utils/logger.h>
+#include <filestorm/utils/pool_allocator.h>
+#include <filestorm/utils/range_set.h>
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <cstdint>
 #include <iostream>
-#include <map>
+#include <list>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 class FileTree {
 public:
-  enum class Type { FILE, DIRECTORY };
+  enum class Type : uint8_t { FILE, DIRECTORY };
   static std::atomic<int> directory_count;
   static std::atomic<int> file_count;
 
@@ -27,38 +38,98 @@ public:
   // using Nodeptr = std::shared_ptr<Node>;
   using Nodeptr = std::shared_ptr<Node>;
 
+  // Slots of the positions a node stores for the indexed sets it is in, directories are never punchable so the set of
+  // their level reuses the slot
+  enum SetSlot { NODES_SLOT, PUNCHABLE_SLOT, SLOT_COUNT, LEVEL_SLOT = PUNCHABLE_SLOT };
+
+  /**
+   * @brief Policy choosing the directory new files and directories go into, only directories above the maximal depth
+   * are chosen.
+   *
+   *  - walk: a random depth, then a random subdirectory on each level down to it, stopping early in directories without
+   *    subdirectories, directories of few siblings and shallow ones are preferred,
+   *  - uniform: every directory equally likely,
+   *  - depth: a random level, then a random directory of the level,
+   *  - fanout: uniform, avoiding directories with more entries than the fan-out cap,
+   *  - locality: one of the recently chosen directories with the locality probability, uniform otherwise.
+   */
+  enum class Placement : uint8_t { WALK, UNIFORM, DEPTH, FANOUT, LOCALITY };
+  struct PlacementConfig {
+    Placement policy = Placement::WALK;
+    size_t fanout = 1000;
+    double locality = 0.8;
+    size_t recent = 16;
+  };
+  static Placement parsePlacement(const std::string& name);
+  static const char* placementName(Placement placement);
+
+  /**
+   * @brief Children of a directory, a flat vector sorted by name.
+   *
+   * The vector is allocated with the first child and released with the last one, so files and empty directories only
+   * pay for a null pointer. Lookups are binary searches and the i-th child is picked in O(1).
+   */
+  class ChildMap {
+  public:
+    using const_iterator = std::vector<Nodeptr>::const_iterator;
+
+    const_iterator begin() const { return children().begin(); }
+    const_iterator end() const { return children().end(); }
+    size_t size() const { return _children ? _children->size() : 0; }
+    bool empty() const { return size() == 0; }
+    const Nodeptr& operator[](size_t index) const { return (*_children)[index]; }
+
+    const_iterator find(std::string_view name) const;
+    size_t count(std::string_view name) const { return find(name) != end() ? 1 : 0; }
+    // The child of the name or nullptr
+    Nodeptr get(std::string_view name) const;
+    // Returns false when there is a child of the same name already
+    bool insert(const Nodeptr& child);
+    // Returns false when there is no child of the name
+    bool erase(std::string_view name);
+
+  private:
+    const std::vector<Nodeptr>& children() const;
+    std::vector<Nodeptr>::iterator lowerBound(std::string_view name) const;
+
+    std::unique_ptr<std::vector<Nodeptr>> _children;
+  };
+
   class Node {
   public:
+    using Range = std::pair<uint64_t, uint64_t>;
+
+    // Generated names (file_<id>, dir_<id>) fit into the short string buffer and need no allocation
     std::string name;
-    Type type;
     Nodeptr parent;
-    int fallocated_count = 0;
-    std::map<std::string, Nodeptr> folders;
-    std::map<std::string, Nodeptr> files;
+    ChildMap folders;
+    ChildMap files;
     std::vector<extents> _extents;
+    std::vector<Range> _dirty_ranges;
+    // Punched and unwritten ranges of the file, allocated with the first one
+    std::unique_ptr<RangeSet> _holes;
+    uint64_t _size = 0;
+    int fallocated_count = 0;
+    // Order of creation in the tree (zipf selection) and the touch clock of the last data change (lru selection)
+    uint32_t _sequence = 0;
+    uint32_t _touched = 0;
+    // Position in all_files or all_directories and in files_for_fallocate, see IndexedSet
+    std::array<IndexedSet<Nodeptr>::Position, SLOT_COUNT> set_positions{IndexedSet<Nodeptr>::NPOS, IndexedSet<Nodeptr>::NPOS};
+    Type type;
+    bool _extents_valid = false;
+    bool _size_known = false;
 
-    Node(const std::string& n, Type t, Nodeptr p) : name(n), type(t), parent(p) {}
-    std::string path(bool include_root = false) const {
-      if (parent == nullptr) {
-        if (include_root) {
-          return name;
-        } else {
-          return "";
-        }
-      }
-      return parent->path(include_root) + "/" + name;
-    }
+    Node(const std::string& n, Type t, Nodeptr p) : name(n), parent(p), type(t) {}
+    // Built on every call, prefer the operations of FileTree relative to the parent directory on hot paths
+    std::string path(bool include_root = false) const;
 
     int getFallocationCount() { return fallocated_count; }
 
-    std::vector<extents> getExtents(bool update = true) {
+    std::vector<extents> getExtents(bool update = true, bool sync = true) {
       if (update) {
         if (type == Type::FILE) {
-          _extents.clear();
-          // extents_count = get_extents(path(true).c_str()).size();
-          for (auto extent : get_extents(path(true).c_str())) {
-            _extents.push_back(extent);
-          }
+          invalidateExtents();
+          refreshExtents(sync);
         } else {
           _extents.clear();
         }
@@ -66,12 +137,59 @@ public:
       return _extents;
     }
 
-    int getExtentsCount(bool update = true) { return getExtents(update).size(); }
+    int getExtentsCount(bool update = true) {
+      if (update) {
+        getExtents(true);
+      }
+      return _extents.size();
+    }
 
-    std::uintmax_t size() { return fs_utils::file_size(path(true)); }
+    void setExtents(std::vector<extents> new_extents) {
+      _extents = std::move(new_extents);
+      _extents_valid = true;
+    }
+
+    // Record that the byte range [start, end) of the file changed, only those ranges are rescanned on next refresh.
+    void markExtentsDirty(uint64_t start = 0, uint64_t end = UINT64_MAX) { _dirty_ranges.emplace_back(start, end); }
+    // Whole file changed (e.g. overwritten), next refresh rescans it completely.
+    void invalidateExtents() { markExtentsDirty(0, UINT64_MAX); }
+    bool extentsDirty() const { return !_extents_valid || !_dirty_ranges.empty(); }
+    // Take the ranges which have to be rescanned, extended over the cached extents they touch. Clears the dirty state.
+    std::vector<Range> takeRescanRanges();
+    // Replace cached extents of each range by the freshly scanned ones (rescanned[i] belongs to ranges[i]).
+    void applyRescan(const std::vector<Range>& ranges, std::vector<std::vector<extents>>& rescanned);
+    // Rescan only the dirty ranges synchronously.
+    void refreshExtents(bool sync = true);
+
+    // Shadow of the file state: size and holes are updated by the operations issued through EngineFile, so the hot
+    // paths don't stat the file. It's unknown for files loaded from a checkpoint and after a failed write, the next
+    // size() (stat) or FileTree::fileSize() (fstatat) or opening the file by EngineFile (fstat) reconciles it.
+    // The updates are ignored while the shadow is unknown.
+    std::uintmax_t size() {
+      if (!_size_known) {
+        setShadowSize(fs_utils::file_size(path(true)));
+      }
+      return _size;
+    }
+    bool shadowKnown() const { return _size_known; }
+    void forgetShadow() { _size_known = false; }
+    // Size found by a stat, holes past it are dropped
+    void setShadowSize(uint64_t size);
+    // Data written to [start, end), the file grows to end
+    void shadowWrite(uint64_t start, uint64_t end);
+    // fallocate of [start, end): holes in it and the part past the end become unwritten, the file grows to end
+    void shadowAllocate(uint64_t start, uint64_t end);
+    // Hole punched into [start, end), the size is kept
+    void shadowPunch(uint64_t start, uint64_t end);
+    void shadowTruncate(uint64_t size) { setShadowSize(size); }
+    // Bytes with blocks allocated: the size without the punched holes, not rounded to filesystem blocks
+    uint64_t allocatedBytes() { return size() - (_holes ? _holes->bytes(RangeSet::Kind::PUNCHED) : 0); }
+    const RangeSet* holes() const { return _holes.get(); }
 
-    std::tuple<size_t, size_t> getHoleAddress(size_t blocksize, bool increment) {
-      size_t start = 0, end = size() / 2;
+    std::tuple<size_t, size_t> getHoleAddress(size_t blocksize, bool increment) { return getHoleAddress(blocksize, increment, size()); }
+    // Same with the current size of the file known already (FileTree::fileSize)
+    std::tuple<size_t, size_t> getHoleAddress(size_t blocksize, bool increment, std::uintmax_t file_size) {
+      size_t start = 0, end = file_size / 2;
       for (int i = 0; i < fallocated_count; i++) {
         size_t length = end - start;
         start = end;
@@ -90,18 +208,19 @@ public:
       return std::make_tuple(start, end);
     }
 
-    bool isPunchable(size_t blocksize) {
+    bool isPunchable(size_t blocksize) { return isPunchable(blocksize, size()); }
+    bool isPunchable(size_t blocksize, std::uintmax_t file_size) {
       try {
-        getHoleAddress(blocksize, false);
+        getHoleAddress(blocksize, false, file_size);
         return true;
       } catch (const std::exception& e) {
         return false;
       }
     }
 
-    void truncate(std::uintmax_t blocksize, std::uintmax_t new_size) {
+    void truncate(std::uintmax_t blocksize, std::uintmax_t new_size) { truncate(blocksize, new_size, size()); }
+    void truncate(std::uintmax_t blocksize, std::uintmax_t new_size, std::uintmax_t old_size) {
       // There is the need to adjust the fallocation number according to new truncated size
-      std::uintmax_t old_size = size();
       if (new_size >= old_size) {
         return;
       }
@@ -124,9 +243,9 @@ public:
     }
   };
 
-  std::vector<Nodeptr> all_files;
-  std::vector<Nodeptr> all_directories;
-  std::vector<Nodeptr> files_for_fallocate;
+  IndexedSet<Nodeptr> all_files{NODES_SLOT};
+  IndexedSet<Nodeptr> all_directories{NODES_SLOT};
+  IndexedSet<Nodeptr> files_for_fallocate{PUNCHABLE_SLOT};
 
   int64_t total_extents_count = 0;
 
@@ -135,6 +254,7 @@ private:
 
 public:
   FileTree(const std::string& rootName, unsigned int max_depth = 0);
+  ~FileTree();
   Nodeptr addDirectory(Nodeptr parent, const std::string& dirName);
   void remove(Nodeptr node);
   FileTree::Nodeptr addFile(Nodeptr parent, const std::string& fileName);
@@ -142,8 +262,12 @@ public:
   Nodeptr mkdir(std::string path, bool recursively = false);
   Nodeptr mkfile(std::string path);
   void rm(std::string path, bool recursively = false);
+  // Move a file to the path (relative to the root), its directory has to exist and the name has to be free
+  void rename(Nodeptr file, std::string path);
 
   Nodeptr getNode(std::string path);
+  // Nodes are allocated from a pool shared by all trees, see FixedPool
+  static Nodeptr makeNode(const std::string& name, Type type, Nodeptr parent);
 
   void print() const;
 
@@ -152,15 +276,68 @@ public:
   int getDirectoryCount() const { return directory_count; }
   int getFileCount() const { return file_count; }
 
+  void setPlacement(PlacementConfig config);
+  const PlacementConfig& placement() const { return _placement; }
+  // Directory for a new file or directory chosen by the placement policy, O(1) (the levels are summed up)
+  Nodeptr placementDirectory();
   std::string newDirectoryPath();
   std::string newFilePath();
+  // Directories of the level, the root is the only one of level 0
+  size_t levelSize(size_t level) const { return level < _levels.size() ? _levels[level]->size() : 0; }
+
+  /**
+   * @brief Policy picking the files of an operation.
+   *
+   *  - uniform: every file equally likely,
+   *  - zipf: weight 1 / (n + 1)^s of the n-th created file, a few old files get most of the operations,
+   *  - size: weighted by the size of the file,
+   *  - extents: weighted by the cached extent count of the file,
+   *  - lru: the least recently touched of a few uniformly drawn files.
+   *
+   * The weights are kept in Fenwick trees parallel to the file sets, a pick and an update cost O(log n). Sizes and
+   * extent counts are refreshed by touch().
+   */
+  enum class Selection : uint8_t { UNIFORM, ZIPF, SIZE, EXTENTS, LRU };
+  static Selection parseSelection(const std::string& name);
+  static const char* selectionName(Selection selection);
+  // Maintain the weights of the selection from now on, O(n log n) for the files already in the tree
+  void enableSelection(Selection selection);
+  // Exponent s of the zipf selection, has to be set before it is enabled
+  void setZipfExponent(double exponent);
 
-  Nodeptr randomFile();
+  Nodeptr randomFile(Selection selection = Selection::UNIFORM);
   Nodeptr randomDirectory();
-  Nodeptr randomPunchableFile();
+  Nodeptr randomPunchableFile(Selection selection = Selection::UNIFORM);
+  // The file's data changed: it becomes the most recently touched one and its size and extents weights are refreshed
+  void touch(const Nodeptr& file);
   bool hasPunchableFiles();
   void removeFromPunchableFiles(Nodeptr file);
 
+  // Descriptor of the directory, opened relative to the descriptor of its parent. Descriptors are cached, the least
+  // recently used beyond the limit are closed by the next call of this or the filesystem operations below, a returned
+  // descriptor is valid until then. Meant for the thread driving the scenario only.
+  int directoryFd(const Nodeptr& directory);
+  int parentFd(const Nodeptr& node) { return directoryFd(node->parent); }
+  void setDirectoryFdLimit(size_t limit) { _directory_fd_limit = std::max<size_t>(limit, 1); }
+  size_t directoryFdCount() const { return _directory_fds.size(); }
+
+  // Filesystem operations on the nodes relative to their parent directory (fstatat, mkdirat, unlinkat, renameat), the
+  // kernel doesn't walk the whole path and the path string is built only for error messages. The suffix is appended
+  // to the name of the node, e.g. for the hardlink kept next to a file.
+  // From the shadow state of the file when it's known, see Node::size()
+  std::uintmax_t fileSize(const Nodeptr& file);
+  bool exists(const Nodeptr& node, const char* suffix = "");
+  void createDirectory(const Nodeptr& directory);
+  // Returns false when there was nothing to remove
+  bool unlink(const Nodeptr& node, const char* suffix = "");
+  // Move the file (or name + suffix) in the filesystem from the old parent and name to its current place in the tree
+  void renameFrom(const Nodeptr& old_parent, const std::string& old_name, const Nodeptr& file, const char* suffix = "");
+
+  // Store the whole tree with cached extents and the name counters to a checkpoint
+  void save(CheckpointWriter& out) const;
+  // Rebuild the tree stored by save(), the tree has to be empty
+  void load(CheckpointReader& in);
+
   void leafDirWalk(std::function<void(Nodeptr)> f);
   void bottomUpDirWalk(Nodeptr node, std::function<void(Nodeptr)> f);
 
@@ -176,4 +353,41 @@ public:
 
 private:
   void printRec(const Nodeptr node, int depth) const;
+  void trimDirectoryFds();
+  // directoryFd() without trimming the cache
+  int cachedDirectoryFd(const Nodeptr& directory);
+  void closeDirectoryFd(const Node* directory);
+  static size_t level(const Node* directory);
+  // Weighted selections keep a Fenwick tree for all_files and one for files_for_fallocate, by position in the set
+  struct SelectionWeights {
+    FenwickTree files;
+    FenwickTree punchable;
+  };
+  static constexpr size_t WEIGHTED_SELECTIONS = 3;
+  static bool weighted(Selection selection) { return selection == Selection::ZIPF || selection == Selection::SIZE || selection == Selection::EXTENTS; }
+  SelectionWeights* weights(Selection selection) const { return _weights[size_t(selection) - size_t(Selection::ZIPF)].get(); }
+  uint64_t selectionWeight(Selection selection, const Node& file) const;
+  Nodeptr pick(const IndexedSet<Nodeptr>& set, FenwickTree SelectionWeights::*weights_of, Selection selection);
+  // Mirror IndexedSet::erase, the last item moves into the gap
+  static void eraseWeight(FenwickTree& weights, size_t position);
+  void rebuildWeights();
+
+  std::array<std::unique_ptr<SelectionWeights>, WEIGHTED_SELECTIONS> _weights;
+  double _zipf_exponent = 1.0;
+  uint32_t _file_sequence = 0;
+  uint32_t _touch_clock = 0;
+  // Uniformly chosen directory of the levels below the maximal depth
+  Nodeptr uniformDirectory();
+
+  // Directories by their level, IndexedSet can't be moved
+  std::vector<std::unique_ptr<IndexedSet<Nodeptr>>> _levels;
+  PlacementConfig _placement;
+  // Ring of the recently chosen directories for the locality policy
+  std::vector<Nodeptr> _recent;
+  size_t _recent_next = 0;
+
+  // Cached directory descriptors, the most recently used first
+  std::list<Nodeptr> _directory_lru;
+  std::unordered_map<const Node*, std::pair<int, std::list<Nodeptr>::iterator>> _directory_fds;
+  size_t _directory_fd_limit = 256;
 };
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Free space extents of a filesystem obtained with GETFSMAP (XFS and ext4).
+ *
+ * Free extents are counted into a power of two histogram of their size in filesystem blocks (bucket i holds extents of
+ * [2^i, 2^(i+1)) blocks, as xfs_db freesp reports them) and into per group statistics, where a group is an XFS
+ * allocation group or an ext4 block group. The fragmentation index of a group is the share of its free space lying in
+ * extents shorter than the chunk size, i.e. the free space an allocation of chunk size bytes can't use contiguously.
+ * 0 means all free space is in large extents, 1 that none of it is.
+ */
+class FreeSpaceMap {
+public:
+  static constexpr int BUCKETS = 48;
+
+  struct Group {
+    uint64_t free_bytes = 0;
+    uint64_t free_extents = 0;
+    uint64_t largest_extent = 0;
+    uint64_t small_bytes = 0;  // Free bytes in extents shorter than the chunk size
+    double fragmentation() const { return free_bytes == 0 ? 0 : double(small_bytes) / double(free_bytes); }
+  };
+
+  struct Bucket {
+    uint64_t extents = 0;
+    uint64_t blocks = 0;
+  };
+
+  // group_size 0 treats the whole filesystem as one group
+  FreeSpaceMap(uint64_t block_size, uint64_t group_size, uint64_t chunk_size);
+
+  // Map the free space of the filesystem holding path. Needs CAP_SYS_ADMIN, throws when GETFSMAP isn't available.
+  static FreeSpaceMap collect(const std::string& path, uint64_t chunk_size);
+
+  // Account a free extent given in bytes from the start of the device, extents crossing a group boundary are split
+  void addFreeExtent(uint64_t offset, uint64_t length);
+
+  uint64_t blockSize() const { return _block_size; }
+  uint64_t groupSize() const { return _group_size; }
+  const std::array<Bucket, BUCKETS>& histogram() const { return _histogram; }
+  const std::vector<Group>& groups() const { return _groups; }
+  // Totals over all groups
+  Group total() const;
+  double fragmentationIndex() const { return total().fragmentation(); }
+
+  nlohmann::json toJson() const;
+
+private:
+  uint64_t _block_size;
+  uint64_t _group_size;
+  uint64_t _chunk_size;
+  std::array<Bucket, BUCKETS> _histogram{};
+  std::vector<Group> _groups;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Shape of an existing directory tree (`filestorm profile`), usable as an aging target and size histogram.
+ *
+ * The crawl lists directories with getdents64 and stats the entries relative to their directory with statx (fstatat
+ * where statx isn't available), workers take directories from a shared queue and keep their own histograms which are
+ * merged at the end. Mount points below the root are not crossed, symbolic links are not followed.
+ *
+ * File sizes, extents per file and fan-out are counted into power of two buckets (bucket 0 holds 0, bucket i the
+ * values of [2^(i-1), 2^i)), depth (directories between the root and a file) into one bucket per level. toJson()
+ * writes them in the format of AgingTarget (file_size, extents_per_file, depth, fanout) together with the totals, so
+ * the profile is passed to the aging scenario as --target and --sdist-profile as it is.
+ */
+class FsProfile {
+public:
+  static constexpr int BUCKETS = 65;
+
+  struct Options {
+    // Crawling threads, 0 for the number of CPUs
+    unsigned workers = 0;
+    // Count the extents of every file (FIEMAP), the slowest part of the crawl
+    bool extents = true;
+  };
+
+  static FsProfile crawl(const std::string& root, const Options& options);
+
+  // Power of two bucket of the value
+  static int bucket(uint64_t value);
+
+  // extents < 0 when they weren't counted
+  void addFile(uint64_t size, int depth, int64_t extents);
+  void addDirectory(uint64_t entries);
+  void addSkipped() { _skipped++; }
+  void merge(const FsProfile& other);
+
+  uint64_t files() const { return _files; }
+  uint64_t directories() const { return _directories; }
+  uint64_t bytes() const { return _bytes; }
+  // Directories which couldn't be listed
+  uint64_t skipped() const { return _skipped; }
+  const std::vector<uint64_t>& sizes() const { return _sizes; }
+  const std::vector<uint64_t>& extents() const { return _extents; }
+  const std::vector<uint64_t>& depths() const { return _depths; }
+  const std::vector<uint64_t>& fanouts() const { return _fanouts; }
+
+  nlohmann::json toJson() const;
+
+private:
+  uint64_t _files = 0;
+  uint64_t _directories = 0;
+  uint64_t _bytes = 0;
+  uint64_t _skipped = 0;
+  std::vector<uint64_t> _sizes = std::vector<uint64_t>(BUCKETS, 0);
+  std::vector<uint64_t> _extents = std::vector<uint64_t>(BUCKETS, 0);
+  std::vector<uint64_t> _fanouts = std::vector<uint64_t>(BUCKETS, 0);
+  // One bucket per level, grows with the deepest file
+  std::vector<uint64_t> _depths;
+};
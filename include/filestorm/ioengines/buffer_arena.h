@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Preallocated aligned I/O buffers of a scenario, one slot per request the engine may have in flight.
+ *
+ * The memory is mapped once, filled with random data (which faults all pages in) and optionally locked, so the measured
+ * operations don't pay for allocations and page faults. With hugepages the slots are backed by 2 MB pages, large block
+ * direct I/O then needs far fewer TLB entries. HUGETLB maps reserved hugepages (/proc/sys/vm/nr_hugepages) and falls
+ * back to THP when there are none, THP asks for transparent hugepages with madvise.
+ */
+class BufferArena {
+public:
+  enum class HugePages { NONE, THP, HUGETLB };
+  static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+  static constexpr size_t ALIGNMENT = 4096;
+
+  // Parse none, thp or hugetlb
+  static HugePages parseHugePages(const std::string& value);
+  static const char* hugePagesName(HugePages huge_pages);
+
+  BufferArena(size_t slot_size, size_t slots, HugePages huge_pages = HugePages::NONE, bool lock = false);
+  ~BufferArena();
+  BufferArena(const BufferArena&) = delete;
+  BufferArena& operator=(const BufferArena&) = delete;
+
+  size_t slotSize() const { return _slot_size; }
+  size_t slots() const { return _slots; }
+  void* slot(size_t index) const { return _memory + (index % _slots) * _stride; }
+  // Buffer of the next request, the slots are handed out round robin
+  void* next() { return slot(_next++); }
+  // Fill all slots with new random data
+  void fill();
+  // Make the data differ from the previously written one by stamping a counter into every 4 KiB block of the slots,
+  // much cheaper than generating new random data
+  void refresh();
+
+  // What the arena ended up backed by and whether it is locked in memory
+  HugePages hugePages() const { return _huge_pages; }
+  bool locked() const { return _locked; }
+
+private:
+  size_t _slot_size;
+  size_t _slots;
+  size_t _stride;
+  size_t _mapped = 0;
+  char* _memory = nullptr;
+  size_t _next = 0;
+  uint64_t _generation = 0;
+  HugePages _huge_pages;
+  bool _locked = false;
+};
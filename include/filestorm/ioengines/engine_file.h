@@ -0,0 +1,51 @@
+#pragma once
+
+#include <filestorm/filetree.h>
+#include <filestorm/ioengines/buffer_arena.h>
+#include <filestorm/ioengines/ioengine.h>
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief File opened through an IOEngine, closed when it goes out of scope.
+ *
+ * All data of the aging scenarios goes through it, so the engine and its queue depth apply to every state alike.
+ * Ranges are issued in whole blocks and the offset advances by the submitted size, asynchronous engines report the
+ * bytes of earlier requests only when they complete. Every request takes the next buffer of the arena, so requests in
+ * flight don't share one. The range methods return once all their I/O completed. The file is
+ * opened before and closed after the measured callback, so opening and closing aren't part of the measured times.
+ * A file opened as a tree node keeps the shadow state of the node (size, holes) up to date.
+ */
+class EngineFile {
+public:
+  EngineFile(IOEngine& engine, std::string path, int flags, bool direct_io);
+  // Open the file of the tree relative to the cached descriptor of its directory, the path is built only for messages
+  EngineFile(IOEngine& engine, FileTree& tree, const FileTree::Nodeptr& file, int flags, bool direct_io);
+  ~EngineFile() { close(); }
+  EngineFile(const EngineFile&) = delete;
+  EngineFile& operator=(const EngineFile&) = delete;
+
+  int fd() const { return _fd; }
+  std::string path() const;
+
+  // Write block_size bytes of the arena buffers to every block from offset until end is covered, the last block may
+  // reach past end. Returns the number of written bytes.
+  uint64_t write(BufferArena& buffers, uint64_t block_size, uint64_t offset, uint64_t end);
+  // Read blocks from offset until end is covered, returns the number of read bytes (less when the file ends earlier)
+  uint64_t read(BufferArena& buffers, uint64_t block_size, uint64_t offset, uint64_t end);
+  // Allocate the range, or punch a hole into it keeping the file size
+  void fallocate(uint64_t offset, uint64_t length, bool punch_hole = false);
+  void truncate(uint64_t size);
+  void sync() { _engine.sync(_fd); }
+  void close();
+
+private:
+  // Throw the error of the failed call, the shadow state of the file is unknown afterwards
+  [[noreturn]] void failed(const std::string& message);
+
+  IOEngine& _engine;
+  std::string _path;
+  FileTree::Nodeptr _file;
+  int _fd = -1;
+};
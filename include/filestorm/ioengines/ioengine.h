@@ -25,6 +25,8 @@ public:
   virtual ssize_t read(int fd, void* buf, size_t count, off_t offset) = 0;
   virtual ssize_t write(int fd, void* buf, size_t count, off_t offset) = 0;
   virtual ssize_t complete() = 0;
+  // Number of requests the engine keeps in flight, each of them needs its own buffer
+  virtual unsigned queue_depth() const { return 1; }
   virtual void sync(int fd) {
     if (fsync(fd) == -1) {
       perror("Error syncing file");
@@ -79,12 +81,13 @@ public:
     return "";
   };
 
-  int open_file(const char* path, int flags, bool direct_io) {
+  // A relative path is resolved against the directory dir_fd
+  int open_file(const char* path, int flags, bool direct_io, int dir_fd = AT_FDCWD) {
     int fd;
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
 #  error "Windows is not supported"
 #elif __APPLE__
-    fd = open(path, flags, S_IRWXU);
+    fd = openat(dir_fd, path, flags, S_IRWXU);
     if (direct_io && fd != -1) {
       if (fcntl(fd, F_NOCACHE, 1) == -1) {
         ::close(fd);
@@ -95,7 +98,7 @@ public:
     if (direct_io) {
       flags |= O_DIRECT;
     }
-    fd = open(path, flags, S_IRWXU);
+    fd = openat(dir_fd, path, flags, S_IRWXU);
 #else
 #  error "Unknown system"
 #endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <vector>
+
+/**
+ * @brief Histogram of latencies in nanoseconds with a bounded relative error.
+ *
+ * Values below 2^SUB_BUCKET_BITS are counted exactly, larger ones into 2^SUB_BUCKET_BITS linear sub-buckets per power
+ * of two, so a reported percentile is at most 1/2^SUB_BUCKET_BITS (~3%) above the real value. The memory doesn't grow
+ * with the number of recorded values, one histogram per thread is merged after a run.
+ */
+class LatencyHistogram {
+public:
+  static constexpr int SUB_BUCKET_BITS = 5;
+
+  LatencyHistogram();
+
+  void record(uint64_t nanoseconds);
+  void merge(const LatencyHistogram& other);
+
+  uint64_t count() const { return _count; }
+  uint64_t min() const { return _count == 0 ? 0 : _min; }
+  uint64_t max() const { return _max; }
+  double mean() const { return _count == 0 ? 0 : double(_sum) / double(_count); }
+  // Smallest value at least the given percent (0-100) of the recorded values are lower or equal to
+  uint64_t percentile(double percent) const;
+
+  // count, mean, min, p50, p90, p99, p99.9 and max
+  nlohmann::json toJson() const;
+
+private:
+  static size_t index(uint64_t value);
+  // Largest value counted into the bucket
+  static uint64_t upperBound(size_t index);
+
+  std::vector<uint64_t> _counts;
+  uint64_t _count = 0;
+  uint64_t _sum = 0;
+  uint64_t _min = UINT64_MAX;
+  uint64_t _max = 0;
+};
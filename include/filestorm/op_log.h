@@ -0,0 +1,103 @@
+#pragma once
+
+#include <filestorm/filetree.h>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+
+#define OP_LOG_VERSION 2
+#define OP_LOG_MAGIC "FSTMOPLG"
+// Name suffix of the hardlink the aging scenario keeps next to a linked file
+#define HARDLINK_SUFFIX ".lnk"
+
+/**
+ * @brief One resolved aging operation.
+ *
+ * Files and directories are referred to by ids assigned in the order they were created (0 is the root directory),
+ * so the path is stored only once, by the operation which creates the node.
+ */
+struct OpRecord {
+  enum Type : uint8_t {
+    CREATE_DIR,               // id, parent, name
+    CREATE_FILE,              // id, parent, name, length = size
+    CREATE_FILE_FALLOCATE,    // id, parent, name, length = size
+    CREATE_FILE_OVERWRITE,    // id, length = size
+    CREATE_FILE_READ,         // id, length = size
+    ALTER_SMALLER_TRUNCATE,   // id, length = new size
+    ALTER_SMALLER_FALLOCATE,  // id, offset, length of the punched hole
+    ALTER_BIGGER_FALLOCATE,   // id, offset, length of the allocated range
+    ALTER_BIGGER_WRITE,       // id, offset (first written byte), length (up to the new size)
+    DELETE_FILE,              // id
+    XATTR_SET,                // id, offset = attribute index, length = value size
+    XATTR_REMOVE,             // id, offset = attribute index
+    RENAME,                   // id, parent, name
+    LINK,                     // id, hardlink <path>.lnk is created
+    UNLINK,                   // id, hardlink <path>.lnk is removed
+    CHMOD,                    // id, offset = mode
+    UTIMES,                   // id, offset = access time (modification time is set to now)
+    END,                      // end of an iteration
+  };
+  Type type;
+  uint32_t id = 0;
+  uint32_t parent = 0;
+  std::string name;
+  uint64_t offset = 0;
+  uint64_t length = 0;
+};
+
+/**
+ * @brief Writes the operations of an aging run to a compact binary log.
+ *
+ * Numbers are stored as LEB128 varints. The log is flushed at the end of every iteration, a run which was killed
+ * leaves a log which can be replayed up to the last complete iteration.
+ */
+class OpLogWriter {
+public:
+  OpLogWriter(const std::string& path, uint64_t block_size);
+
+  // Operations creating a node assign it the next id
+  void createDirectory(const FileTree::Nodeptr& directory);
+  void createFile(OpRecord::Type type, const FileTree::Nodeptr& file, uint64_t size);
+  void fileOperation(OpRecord::Type type, const FileTree::Nodeptr& file, uint64_t offset, uint64_t length);
+  void deleteFile(const FileTree::Nodeptr& file);
+  // The file was moved to its current parent and name
+  void renameFile(const FileTree::Nodeptr& file);
+  void endIteration();
+  // Ends the iteration the run stopped in, the operations it performed are on disk already
+  void finish();
+
+  uint64_t count() const { return _count; }
+
+private:
+  uint32_t id(const FileTree::Nodeptr& node) const;
+  void create(OpRecord::Type type, const FileTree::Nodeptr& node);
+  void writeVarint(uint64_t value);
+
+  std::string _path;
+  std::ofstream _out;
+  std::unordered_map<const FileTree::Node*, uint32_t> _ids;
+  uint32_t _next_id = 1;
+  uint64_t _count = 0;
+  bool _in_iteration = false;
+};
+
+class OpLogReader {
+public:
+  explicit OpLogReader(const std::string& path);
+
+  // Read the next operation, returns false at the end of the log
+  bool next(OpRecord& record);
+  uint64_t blockSize() const { return _block_size; }
+  // The log ended in the middle of a record
+  bool truncated() const { return _truncated; }
+
+private:
+  uint64_t readVarint();
+
+  std::string _path;
+  std::ifstream _in;
+  uint64_t _block_size = 0;
+  bool _truncated = false;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <filestorm/filetree.h>
+#include <filestorm/ioengines/buffer_arena.h>
+#include <filestorm/ioengines/ioengine.h>
+
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <string>
+
+/**
+ * @brief Fixed reference workload run on the aged tree to get comparable performance-versus-age curves.
+ *
+ * A probe reads a fixed number of aged files sequentially, does a fixed number of small random reads in them and
+ * creates (and syncs) one file of a fixed size, which is removed again. The files are drawn by the PROBE stream of
+ * Random derived for the given seed, the streams of the aging run aren't touched, so probes don't change the aged state.
+ * Unless direct I/O is used, the page cache of the files is dropped before they are read.
+ */
+class PerformanceProbe {
+public:
+  struct Config {
+    int files = 8;
+    int random_reads = 1000;
+    uint64_t read_size = 4096;
+    uint64_t block_size = 64 * 1024;
+    uint64_t create_size = 64 * 1024 * 1024;
+    bool direct_io = false;
+  };
+
+  explicit PerformanceProbe(Config config) : _config(config) {}
+
+  // Run the workload on files of the tree, the slots of the buffers have to hold a block and a random read. The create
+  // part is skipped (null in the result) when less than its size is available. Returns sequential_read, random_read
+  // (with latency percentiles) and create statistics.
+  nlohmann::json run(IOEngine& ioengine, BufferArena& buffers, FileTree& tree, uint64_t available, uint32_t seed) const;
+
+private:
+  Config _config;
+};
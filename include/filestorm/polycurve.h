@@ -1,6 +1,8 @@
 #ifndef POLYCURVE_H
 #define POLYCURVE_H
 
+#include <filestorm/checkpoint.h>
+
 #include <Eigen/Dense>
 #include <cmath>
 #include <iostream>
@@ -56,6 +58,12 @@ public:
 
   bool isFitted() const { return fitted; };
 
+  // Store the points (including the partially filled subsampling buffer) to a checkpoint.
+  void save(CheckpointWriter& out) const;
+
+  // Replace the points by the ones stored by save(). The curve has to be fitted again.
+  void load(CheckpointReader& in);
+
 private:
   // Main data storage for points that will be used for fitting.
   std::vector<float> y_points;
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <filestorm/filetree.h>
+#include <filestorm/scenarios/aging_target.h>
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+/**
+ * @brief Placement of the holes punched into files by the aging scenario.
+ *
+ * The default halving strategy punches the middle half of the file first and then halves the remaining tail, the other
+ * strategies place holes of configurable lengths anywhere between the first and the last block of the file:
+ *  - random: uniformly distributed offsets,
+ *  - stride: offsets at multiples of the stride, so the holes form a regular pattern,
+ *  - clustered: a few blocks after a hole punched before, so holes gather in regions of the file,
+ *  - distribution: random offsets with lengths drawn from a size distribution.
+ *
+ * Holes never overlap the punched or unwritten ranges of the shadow state of the file (FileTree::Node::holes()), they
+ * are looked up by binary search, so picking a hole costs O(log n) in the number of holes of the file.
+ */
+class PunchStrategy {
+public:
+  enum class Kind { HALVING, RANDOM, STRIDE, CLUSTERED, DISTRIBUTION };
+
+  struct Config {
+    uint64_t block_size = 4096;
+    // Hole lengths of the random, stride and clustered strategies, rounded to blocks
+    uint64_t min_length = 4096;
+    uint64_t max_length = 1024 * 1024;
+    uint64_t stride = 1024 * 1024;
+    // Hole lengths of the distribution strategy
+    Distribution lengths;
+  };
+
+  static Kind parseKind(const std::string& name);
+  static const char* kindName(Kind kind);
+  static std::unique_ptr<PunchStrategy> create(Kind kind, Config config);
+
+  virtual ~PunchStrategy() = default;
+  Kind kind() const { return _kind; }
+
+  // Block aligned hole [start, end) for the file of the size, nullopt if none was found. The halving strategy counts the
+  // hole in the file.
+  virtual std::optional<FileTree::Node::Range> pick(FileTree::Node& file, uint64_t size) = 0;
+  // Whether a hole may still be found in the file of the size
+  virtual bool punchable(FileTree::Node& file, uint64_t size) const;
+
+protected:
+  PunchStrategy(Kind kind, Config config);
+
+  // Hole starting at start (rounded up to a block) of at most length bytes, cut at the next hole and before the last
+  // block, nullopt if the start lies in a hole or less than a block remains
+  std::optional<FileTree::Node::Range> fit(const FileTree::Node& file, uint64_t size, uint64_t start, uint64_t length) const;
+  // Block aligned offset in [block, size - block)
+  uint64_t randomOffset(uint64_t size) const;
+  // Block aligned length in [min_length, max_length]
+  uint64_t randomLength() const;
+
+  // Offsets drawn by the strategies may hit holes, they are redrawn this many times
+  static constexpr int ATTEMPTS = 8;
+
+  Kind _kind;
+  Config _config;
+};
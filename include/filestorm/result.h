@@ -1,5 +1,6 @@
 #pragma once
 
+#include <filestorm/checkpoint.h>
 #include <filestorm/data_sizes.h>
 #include <filestorm/filefrag.h>
 #include <filestorm/filetree.h>
@@ -39,6 +40,13 @@ public:
     ALTER_BIGGER,
     ALTER_BIGGER_WRITE,
     ALTER_BIGGER_FALLOCATE,
+    ALTER_METADATA_XATTR_SET,
+    ALTER_METADATA_XATTR_REMOVE,
+    ALTER_METADATA_RENAME,
+    ALTER_METADATA_LINK,
+    ALTER_METADATA_UNLINK,
+    ALTER_METADATA_CHMOD,
+    ALTER_METADATA_UTIMES,
     NONE,
   };
   enum Operation { WRITE, TRIM, OVERWRITE, READ, FALLOCATE };
@@ -46,6 +54,8 @@ public:
   static std::map<std::string, std::string> metas;
   static std::map<Action, std::chrono::nanoseconds> total_duration_per_action;
   static std::map<Action, DataSize<DataUnit::B>> total_size_per_action;
+  // Samples taken during the run next to the per operation results (e.g. free space maps), saved under their series name
+  static std::map<std::string, std::vector<nlohmann::json>> series;
 
 private:
   int _iteration;
@@ -54,8 +64,10 @@ private:
   std::string _path;
   DataSize<DataUnit::B> _size;
   std::chrono::nanoseconds _duration;
-  int64_t _total_extents_count;
-  int64_t _file_extent_count;
+  int64_t _total_extents_count = 0;
+  int64_t _file_extent_count = 0;
+  // Half width of the 95% confidence interval when the extents count is estimated, 0 for exact counts
+  double _extents_count_margin = 0;
 
 public:
   Result(int iteration, Action action, Operation operation, std::string path, DataSize<DataUnit::B> size, std::chrono::nanoseconds duration, int64_t extents_count, int64_t file_extent_count)
@@ -70,6 +82,7 @@ public:
   std::chrono::nanoseconds getDuration() const { return _duration; }
   int64_t getExtentsCount() const { return _total_extents_count; }
   int64_t getFileExtentCount() const { return _file_extent_count; }
+  double getExtentsCountMargin() const { return _extents_count_margin; }
   DataSize<DataUnit::B> getThroughput() const {
     if (_duration.count() == 0) {
       return DataSize<DataUnit::B>(0);
@@ -86,6 +99,7 @@ public:
   void setDuration(std::chrono::nanoseconds duration) { _duration = duration; }
   void setExtentsCount(int64_t extents_count) { _total_extents_count = extents_count; }
   void setFileExtentCount(int64_t file_extent_count) { _file_extent_count = file_extent_count; }
+  void setExtentsCountMargin(double margin) { _extents_count_margin = margin; }
 
   void commit() {
     results.push_back(*this);
@@ -123,6 +137,20 @@ public:
         return "ALTER_BIGGER_WRITE";
       case ALTER_BIGGER_FALLOCATE:
         return "ALTER_BIGGER_FALLOCATE";
+      case ALTER_METADATA_XATTR_SET:
+        return "ALTER_METADATA_XATTR_SET";
+      case ALTER_METADATA_XATTR_REMOVE:
+        return "ALTER_METADATA_XATTR_REMOVE";
+      case ALTER_METADATA_RENAME:
+        return "ALTER_METADATA_RENAME";
+      case ALTER_METADATA_LINK:
+        return "ALTER_METADATA_LINK";
+      case ALTER_METADATA_UNLINK:
+        return "ALTER_METADATA_UNLINK";
+      case ALTER_METADATA_CHMOD:
+        return "ALTER_METADATA_CHMOD";
+      case ALTER_METADATA_UTIMES:
+        return "ALTER_METADATA_UTIMES";
       case NONE:
         return "NONE";
       default:
@@ -130,6 +158,9 @@ public:
     }
   }
 
+  // Metadata operations move no data, they are reported by their latency instead of the throughput
+  static constexpr bool isMetadataAction(Action action) { return action >= ALTER_METADATA_XATTR_SET && action <= ALTER_METADATA_UTIMES; }
+
   static constexpr const char* operationToString(Operation operation) {
     switch (operation) {
       case WRITE:
@@ -160,6 +191,9 @@ public:
       }
       jsonResults["metas"] = jsonmetas;
       jsonResults["version"] = FILESTORM_VERSION;
+      for (const auto& [name, samples] : series) {
+        jsonResults[name] = samples;
+      }
       for (const auto& result : results) {
         nlohmann::json jsonResult;
         jsonResult["iteration"] = result.getIteration();
@@ -170,6 +204,7 @@ public:
         jsonResult["duration"] = result.getDuration().count();
         jsonResult["total_extents_count"] = result.getExtentsCount();
         jsonResult["file_extent_count"] = result.getFileExtentCount();
+        jsonResult["total_extents_count_margin"] = result.getExtentsCountMargin();
         jsonResults["results"].push_back(jsonResult);
       }
       file << jsonResults.dump(2);
@@ -177,7 +212,76 @@ public:
     }
   }
 
-  static void clear() { results.clear(); }
+  static void clear() {
+    results.clear();
+    series.clear();
+  }
+
+  // Store all results, metas and series to a checkpoint
+  static void saveState(CheckpointWriter& out) {
+    out.write<uint64_t>(results.size());
+    for (const auto& result : results) {
+      out.write<int32_t>(result._iteration);
+      out.write<int32_t>(result._action);
+      out.write<int32_t>(result._operation);
+      out.write(result._path);
+      out.write<uint64_t>(result._size.get_value());
+      out.write<int64_t>(result._duration.count());
+      out.write<int64_t>(result._total_extents_count);
+      out.write<int64_t>(result._file_extent_count);
+      out.write<double>(result._extents_count_margin);
+    }
+    out.write<uint64_t>(metas.size());
+    for (const auto& [key, value] : metas) {
+      out.write(key);
+      out.write(value);
+    }
+    out.write<uint64_t>(series.size());
+    for (const auto& [name, samples] : series) {
+      out.write(name);
+      out.write<uint64_t>(samples.size());
+      for (const auto& sample : samples) {
+        out.write(sample.dump());
+      }
+    }
+  }
+
+  // Replace all results and series by the ones stored by saveState() and add the stored metas, the per action totals are recomputed
+  static void loadState(CheckpointReader& in) {
+    results.clear();
+    total_duration_per_action.clear();
+    total_size_per_action.clear();
+    auto count = in.read<uint64_t>();
+    results.reserve(count);
+    for (uint64_t i = 0; i < count; i++) {
+      Result result;
+      result._iteration = in.read<int32_t>();
+      result._action = static_cast<Action>(in.read<int32_t>());
+      result._operation = static_cast<Operation>(in.read<int32_t>());
+      result._path = in.readString();
+      result._size = DataSize<DataUnit::B>(in.read<uint64_t>());
+      result._duration = std::chrono::nanoseconds(in.read<int64_t>());
+      result._total_extents_count = in.read<int64_t>();
+      result._file_extent_count = in.read<int64_t>();
+      result._extents_count_margin = in.read<double>();
+      result.commit();
+    }
+    auto meta_count = in.read<uint64_t>();
+    for (uint64_t i = 0; i < meta_count; i++) {
+      auto key = in.readString();
+      // Metas of the current run (e.g. its command line) take precedence
+      metas.emplace(key, in.readString());
+    }
+    series.clear();
+    auto series_count = in.read<uint64_t>();
+    for (uint64_t i = 0; i < series_count; i++) {
+      auto& samples = series[in.readString()];
+      auto sample_count = in.read<uint64_t>();
+      for (uint64_t j = 0; j < sample_count; j++) {
+        samples.push_back(nlohmann::json::parse(in.readString()));
+      }
+    }
+  }
 
   static std::set<Action> getUsedActions() {
     std::set<Action> usedActions;
@@ -192,20 +296,30 @@ public:
     tabulate::Table table;
     table.add_row({"Action", "Mean (MB/s)", "Min (MB/s)", "Q1 (MB/s)", "Median (MB/s)", "Q3 (MB/s)", "Max (MB/s)", "Stddev (MB/s)"});
 
+    tabulate::Table metadata_table;
+    metadata_table.add_row({"Action", "Mean (us)", "Min (us)", "Q1 (us)", "Median (us)", "Q3 (us)", "Max (us)", "Stddev (us)"});
+
     for (const auto& action : usedActions) {
       std::vector<Result> actionResults = getActionResults(action);
       if (actionResults.empty()) {
         continue;
       }
 
-      Statistics<double> stats_throughput = getStatistics<double>(actionResults, "throughput");
-
       auto formatNumber = [](double value) {
         std::ostringstream stream;
         stream << std::fixed << std::setprecision(2) << value;
         return stream.str();
       };
 
+      if (isMetadataAction(action)) {
+        Statistics<double> stats_latency = getStatistics<double>(actionResults, "duration");
+        metadata_table.add_row({actionToString(action), formatNumber(stats_latency.mean / 1000), formatNumber(stats_latency.min / 1000), formatNumber(stats_latency.q1 / 1000),
+                                formatNumber(stats_latency.median / 1000), formatNumber(stats_latency.q3 / 1000), formatNumber(stats_latency.max / 1000), formatNumber(stats_latency.stddev / 1000)});
+        continue;
+      }
+
+      Statistics<double> stats_throughput = getStatistics<double>(actionResults, "throughput");
+
       table.add_row({actionToString(action), formatNumber(stats_throughput.mean / (1024 * 1024)), formatNumber(stats_throughput.min / (1024 * 1024)), formatNumber(stats_throughput.q1 / (1024 * 1024)),
                      formatNumber(stats_throughput.median / (1024 * 1024)), formatNumber(stats_throughput.q3 / (1024 * 1024)), formatNumber(stats_throughput.max / (1024 * 1024)),
                      formatNumber(stats_throughput.stddev / (1024 * 1024))});
@@ -214,6 +328,10 @@ public:
     table.format().font_align(tabulate::FontAlign::center).border_left("|").border_right("|");
 
     std::cout << table << std::endl;
+    if (metadata_table.size() > 1) {
+      metadata_table.format().font_align(tabulate::FontAlign::center).border_left("|").border_right("|");
+      std::cout << metadata_table << std::endl;
+    }
     // print total duration and total size per action
     std::cout << "Total Duration per Action (seconds):" << std::endl;
     for (const auto& action : usedActions) {
@@ -279,6 +397,7 @@ public:
     return stats;
   }
 
+  static void addSample(const std::string& name, nlohmann::json sample) { series[name].push_back(std::move(sample)); }
   static void addMeta(const std::string& key, const std::string& value) { metas[key] = value; }
   static std::string getMeta(const std::string& key) {
     if (metas.find(key) != metas.end()) {
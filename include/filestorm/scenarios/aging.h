@@ -1,7 +1,18 @@
 #pragma once
 
+#include <filestorm/scenarios/aging_target.h>
 #include <filestorm/scenarios/register.h>
 #include <filestorm/scenarios/scenario.h>
+#include <filestorm/size_distribution.h>
+#include <filestorm/utils/fs.h>
+
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
 
 class AgingScenario : public Scenario {
 protected:
@@ -22,13 +33,89 @@ protected:
     ALTER_BIGGER_WRITE,
     ALTER_BIGGER_FALLOCATE,
     ALTER_METADATA,
+    ALTER_METADATA_XATTR,
+    ALTER_METADATA_RENAME,
+    ALTER_METADATA_LINK,
+    ALTER_METADATA_CHMOD,
+    ALTER_METADATA_UTIMES,
     DELETE_FILE,
     DELETE_DIR,
     END,
   };
 
+  // Transition probabilities, index to the flat array passed to CompiledStateMachine
+  enum Probability { pC, pD, pA, pAM, pAB, pABF, pABW, pAS, pAST, pASF, pAMX, pAMR, pAML, pAMC, pAMU, pDD, pDF, pCF, pCFF, pCD, pCFO, pCFR, pCFE, p1, PROBABILITY_COUNT };
+  using Probabilities = std::array<double, PROBABILITY_COUNT>;
+  static std::vector<std::string> probabilityKeys() {
+    return {"pC", "pD", "pA", "pAM", "pAB", "pABF", "pABW", "pAS", "pAST", "pASF", "pAMX", "pAMR", "pAML", "pAMC", "pAMU", "pDD", "pDF", "pCF", "pCFF", "pCD", "pCFO", "pCFR", "pCFE", "p1"};
+  }
+
+  // Everything the probabilities are computed from, they are recomputed only when one of these changes
+  struct ProbabilityInputs {
+    double caf = -1;
+    bool no_files = false;
+    bool punchable = false;
+    int directories = -1;
+    bool rapid_aging = false;
+    bool operator==(const ProbabilityInputs& other) const {
+      return caf == other.caf && no_files == other.no_files && punchable == other.punchable && directories == other.directories && rapid_aging == other.rapid_aging;
+    }
+  };
+  ProbabilityInputs probability_inputs;
+
+  // Parameters the loop reads in every iteration, parsed once instead of looked up by name each time. Aging profile
+  // states may override parameters, the settings are reloaded around such states.
+  struct Settings {
+    int iterations = -1;
+    bool direct_io = false;
+    bool sync = false;
+    uint64_t block_size = 0;
+    uint64_t min_file_size = 0;
+    uint64_t max_file_size = 0;
+    uint64_t safe_margin = 0;
+    bool punch_holes = true;
+    int ndirs = 1;
+    bool log_probabilities = false;
+    std::chrono::seconds rapid_aging_min_time{0};
+    int rapid_aging_threshold = 0;
+    // Negative when not set
+    std::chrono::seconds rapid_aging_max_time{-1};
+    int64_t rapid_aging_max_extents = -1;
+  };
+  Settings settings;
+  void load_settings();
+  // Safe margin plus one block, with less available space the filesystem is treated as full
+  uint64_t reserved_space = 0;
+
   bool rapid_aging = false;
-  void compute_probabilities(std::map<std::string, double>& probabilities, FileTree& tree, PolyCurve& curve);
+  // Whether the filesystem stores user extended attributes, probed once at the start of the run
+  bool xattrs = false;
+  // Free space tracked from the issued operations, see fs_utils::FreeSpaceModel
+  std::unique_ptr<fs_utils::FreeSpaceModel> free_space;
+  // Fragmentation index of the last free space map (see FreeSpaceMap), 0 until one is taken
+  double free_fragmentation = 0;
+  // State the run converges to (--target), null when it runs for the given time
+  std::unique_ptr<AgingTarget> target;
+  // Distribution of new file sizes (--sdist), set up at the start of the run
+  std::unique_ptr<SizeDistribution> size_distribution;
+  // Returns false when no input changed and the probabilities were left untouched
+  bool compute_probabilities(Probabilities& probabilities, FileTree& tree, PolyCurve& curve);
+  // Scale the built-in probabilities by the steering of the aging target, the groups still sum up to 1
+  static void steer_probabilities(Probabilities& probabilities, const AgingTarget::Steering& steering);
+  // Capacity awareness factor of the filesystem, treats it as full when less than reserved_space is available
+  double capacity_awareness(std::filesystem::space_info& fs_status);
+
+  // Actions and runtime variables available to aging profiles (see AgingProfile)
+  static std::map<std::string, int> profileActions();
+  static std::vector<std::string> profileVariables();
+  // Values of profileVariables() in the same order
+  std::vector<double> profile_variables(FileTree& tree, int iteration, double extents);
+  // Bring a tree loaded from a checkpoint saved at (unix time) in line with the directory, the run might have gone on
+  // after the checkpoint. Removes nodes of missing files and entries with filestorm's names the tree doesn't know (except
+  // the keep paths), returns files modified since the checkpoint whose extents have to be rescanned. Throws when the
+  // directory doesn't hold the checkpointed files or has entries filestorm didn't create. A base checkpoint (the
+  // directory isn't checked against the one it was written for) has to have files.
+  std::vector<FileTree::Nodeptr> reconcile_checkpoint(FileTree& tree, int64_t saved_at, const std::vector<std::string>& keep, bool base);
 
 public:
   AgingScenario();
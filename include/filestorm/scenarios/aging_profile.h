@@ -0,0 +1,71 @@
+#pragma once
+
+#include <filestorm/utils/expression.h>
+#include <filestorm/utils/psm.h>
+
+#include <map>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Aging state machine defined by a JSON profile instead of the built-in one.
+ *
+ * The profile has the following shape:
+ * @code{.json}
+ * {
+ *   "initial": "S",
+ *   "probabilities": { "c": "if(files == 0, 1, caf)", "pC": "c", "pD": "0.1 * (1 - c)" },
+ *   "states": {
+ *     "S": {},
+ *     "CREATE_FILE": { "action": "create_file", "parameters": { "maxfsize": "64MB" } },
+ *     "END": { "action": "end" }
+ *   },
+ *   "transitions": [ { "from": "S", "to": "CREATE_FILE", "probability": "pC" } ]
+ * }
+ * @endcode
+ * Probabilities are evaluated in the order they are written and can use runtime variables and the probabilities
+ * defined before them. A transition probability is either a name from "probabilities" or an inline expression.
+ * Every state runs one of the built-in actions ("none" when omitted) with the scenario parameters overridden by its
+ * "parameters" for the duration of the action.
+ */
+class AgingProfile {
+public:
+  struct State {
+    std::string name;
+    int action;
+    std::vector<std::pair<std::string, std::string>> parameters;
+  };
+
+  // actions maps action names to aging states, variables are the names of the runtime variables (in update() order)
+  AgingProfile(const nlohmann::ordered_json& profile, const std::map<std::string, int>& actions, const std::vector<std::string>& variables);
+  static AgingProfile fromFile(const std::string& path, const std::map<std::string, int>& actions, const std::vector<std::string>& variables);
+
+  // Set the runtime variables and reevaluate the probabilities which depend on a changed value.
+  // Returns false when nothing changed.
+  bool update(const std::vector<double>& variables);
+
+  // Values of all slots, runtime variables first and then the probabilities
+  const std::vector<double>& values() const { return _values; }
+  const std::vector<std::string>& slotNames() const { return _slot_names; }
+  const std::map<std::string, Transition>& transitions() const { return _transitions; }
+  const std::vector<State>& states() const { return _states; }
+  int initialState() const { return _initial; }
+
+private:
+  size_t addProbability(const std::string& name, const std::string& source);
+
+  size_t _variables;
+  std::vector<std::string> _slot_names;
+  std::map<std::string, size_t> _slots;
+  // Expression of slot _variables + i
+  std::vector<Expression> _expressions;
+  std::vector<double> _values;
+  std::vector<char> _changed;
+  bool _evaluated = false;
+
+  std::vector<State> _states;
+  std::map<std::string, Transition> _transitions;
+  int _initial = 0;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <filestorm/scenarios/register.h>
+#include <filestorm/scenarios/scenario.h>
+
+/**
+ * @brief Reproduces an operation log recorded by the aging scenario (--record).
+ *
+ * Operations run back to back in the recorded order with the recorded sizes and offsets. Nothing is drawn at random,
+ * no probabilities are computed and the free space isn't queried, so replays of one log on different filesystems
+ * issue identical operations. Results have the same shape as the ones of the aging scenario.
+ */
+class AgingReplayScenario : public Scenario {
+public:
+  AgingReplayScenario();
+  ~AgingReplayScenario();
+  void run(std::unique_ptr<IOEngine>& ioengine) override;
+};
+
+REGISTER_SCENARIO(AgingReplayScenario);
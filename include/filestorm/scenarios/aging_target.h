@@ -0,0 +1,132 @@
+#pragma once
+
+#include <filestorm/filetree.h>
+
+#include <array>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Histogram over ordered buckets given by their lower bounds.
+ *
+ * A value falls into the bucket with the largest lower bound not above it, values below the first bound into the
+ * first bucket.
+ */
+class Distribution {
+public:
+  Distribution() = default;
+  Distribution(std::vector<double> bounds, std::vector<double> weights);
+  // Parse {"<lower bound>": weight, ...}, with sizes the bounds may have units ("4K", "1MB")
+  static Distribution fromJson(const nlohmann::json& json, bool sizes);
+  nlohmann::json toJson() const;
+
+  // Same buckets, no weights
+  Distribution emptyCopy() const { return Distribution(_bounds, std::vector<double>(_bounds.size(), 0)); }
+  bool defined() const { return !_bounds.empty(); }
+  size_t size() const { return _bounds.size(); }
+  size_t bucket(double value) const;
+  void add(double value, double weight = 1) { _weights[bucket(value)] += weight; }
+  double total() const;
+  // Weights scaled to sum up to 1, uniform when there are none
+  std::vector<double> normalized() const;
+  const std::vector<double>& bounds() const { return _bounds; }
+  const std::vector<double>& weights() const { return _weights; }
+  // Values of bucket i, up to the next bound (the last bucket up to twice its bound)
+  std::pair<double, double> range(size_t i) const;
+
+  // KL(target || live), live is smoothed so buckets it doesn't have yet give a finite divergence
+  static double kl(const Distribution& target, const Distribution& live);
+  // Earth mover's distance over the bucket indices normalized to [0, 1]
+  static double emd(const Distribution& target, const Distribution& live);
+
+private:
+  std::vector<double> _bounds;
+  std::vector<double> _weights;
+};
+
+/**
+ * @brief Aged state the aging scenario converges to (--target) instead of running for a fixed time.
+ *
+ * The target is a JSON document with any of the distributions and the utilization:
+ * @code{.json}
+ * {
+ *   "metric": "kl",
+ *   "threshold": 0.05,
+ *   "utilization": 0.7,
+ *   "utilization_tolerance": 0.02,
+ *   "file_size": { "0": 0.1, "4K": 0.3, "64K": 0.3, "1M": 0.2, "16M": 0.1 },
+ *   "extents_per_file": { "1": 0.7, "2": 0.2, "8": 0.1 },
+ *   "depth": { "0": 0.1, "1": 0.3, "2": 0.6 },
+ *   "fanout": { "0": 0.1, "8": 0.6, "64": 0.3 }
+ * }
+ * @endcode
+ * Depth is the number of directories between the root and a file, fanout the number of entries of a directory.
+ * The state is converged when the divergence (KL or EMD) of every distribution is within the threshold and the
+ * utilization within its tolerance. Between the evaluations the controller steers the run towards the target:
+ * new file sizes are drawn from the size buckets the tree lacks most, deleted files are preferably taken from
+ * over-represented buckets and the create/delete, alter and directory probabilities follow steering().
+ */
+class AgingTarget {
+public:
+  enum Kind { FILE_SIZE, EXTENTS_PER_FILE, DEPTH, FANOUT, KIND_COUNT };
+  enum class Metric { KL, EMD };
+
+  // Multipliers of the built-in transition probabilities
+  struct Steering {
+    double create = 1;       // pC and pAB, pD and pAS are divided by it
+    double alter = 1;        // pA
+    double directories = 0;  // Odds of a directory against a file creation relative to 1:19, 0 keeps the built-in choice
+  };
+
+  struct Snapshot {
+    std::array<Distribution, KIND_COUNT> live;
+    std::array<double, KIND_COUNT> divergence{};
+    double utilization = 0;
+    bool converged = false;
+  };
+
+  explicit AgingTarget(const nlohmann::json& target);
+  static AgingTarget fromFile(const std::string& path);
+  static constexpr const char* kindName(Kind kind) {
+    switch (kind) {
+      case FILE_SIZE:
+        return "file_size";
+      case EXTENTS_PER_FILE:
+        return "extents_per_file";
+      case DEPTH:
+        return "depth";
+      case FANOUT:
+        return "fanout";
+      default:
+        return "unknown";
+    }
+  }
+
+  bool has(Kind kind) const { return _target[kind].defined(); }
+  bool hasUtilization() const { return _utilization >= 0; }
+  double threshold() const { return _threshold; }
+
+  // Measure the live distributions of the tree (extents from the cached counts) and compare them with the target.
+  // The snapshot is kept for steering.
+  const Snapshot& evaluate(FileTree& tree, double utilization);
+  const Snapshot& last() const { return _last; }
+  double divergence(const Distribution& target, const Distribution& live) const;
+  Steering steering() const;
+  // Size range of the bucket drawn proportionally to its deficit (target share - live share), from the TARGET stream of Random.
+  // Returns false without a file size target or when no bucket lacks files.
+  bool sizeRange(uint64_t& from, uint64_t& to) const;
+  // Whether files of the size are over-represented in the tree
+  bool surplusSize(uint64_t size) const;
+  nlohmann::json snapshotJson() const;
+
+private:
+  std::array<Distribution, KIND_COUNT> _target;
+  Metric _metric = Metric::KL;
+  double _threshold = 0.05;
+  double _utilization = -1;
+  double _utilization_tolerance = 0.02;
+  Snapshot _last;
+  bool _evaluated = false;
+};
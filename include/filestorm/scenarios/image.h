@@ -0,0 +1,34 @@
+#pragma once
+
+#include <filestorm/scenarios/register.h>
+#include <filestorm/scenarios/scenario.h>
+
+#include <map>
+#include <memory>
+#include <string>
+
+/**
+ * @brief Ages a filesystem once inside an image file and measures many times on its clones.
+ *
+ * In age mode a sparse image is created, formatted over a loop device, mounted and aged by the aging scenario, whose
+ * final state (the file tree) is saved next to the image as "<image>.tree". In measure mode the image is cloned
+ * (reflink when the filesystem under the image supports it, sparse copy otherwise), the clone is mounted and the
+ * selected scenario runs on it, so every measurement starts from the identical aged state.
+ */
+class ImageScenario : public Scenario {
+public:
+  ImageScenario();
+  ~ImageScenario();
+  void run(std::unique_ptr<IOEngine>& ioengine) override;
+  void save() override;
+  void print() override;
+
+protected:
+  // Set up the scenario run on the mounted image, forced parameters are applied when the scenario has them
+  void setup_inner(const std::string& name, const std::map<std::string, std::string>& forced);
+  std::string tree_path() const { return getParameter("image").get_string() + ".tree"; }
+
+  std::unique_ptr<Scenario> _inner;
+};
+
+REGISTER_SCENARIO(ImageScenario);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <filestorm/latency_histogram.h>
+#include <filestorm/scenarios/register.h>
+#include <filestorm/scenarios/scenario.h>
+
+#include <functional>
+#include <string>
+
+/**
+ * @brief Metadata rate benchmark in the style of mdtest.
+ *
+ * Every thread creates its files, then all threads stat, open and close, rename and unlink them, each phase starting
+ * only after the previous one finished on all threads. The files live either in one directory shared by all threads
+ * or in a directory per thread. Before each round the directories can be filled with background entries, so the
+ * rates can be compared for directories of growing size. Every phase reports its operations per second (over the
+ * wall time of all threads) and the latency percentiles of single operations. The operations are plain system calls,
+ * the I/O engine isn't used.
+ */
+class MetadataScenario : public Scenario {
+public:
+  MetadataScenario();
+  ~MetadataScenario();
+  void run(std::unique_ptr<IOEngine>& ioengine) override;
+  void print() override;
+
+  struct PhaseResult {
+    uint64_t ops = 0;
+    double seconds = 0;
+    LatencyHistogram latency;
+  };
+  // Run work(thread, latency) on the given number of threads, it returns the number of operations it did
+  static PhaseResult runThreads(int threads, const std::function<uint64_t(int, LatencyHistogram&)>& work);
+};
+
+REGISTER_SCENARIO(MetadataScenario);
@@ -28,6 +28,8 @@ public:
   void setup(int argc, char** argv);
   void addParameter(Parameter parameter);
   Parameter getParameter(const std::string& name) const;
+  bool hasParameter(const std::string& name) const;
+  void setParameter(const std::string& name, const std::string& value);
   virtual void run(std::unique_ptr<IOEngine>& ioengine);
   virtual void save();
   virtual void print();
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <filestorm/scenarios/aging_target.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+/**
+ * @brief Distribution the aging scenario draws the sizes of new and resized files from (--sdist).
+ *
+ *  - uniform: uniform in the requested range,
+ *  - normal: mean at half of the upper bound, the standard deviation half of the mean,
+ *  - lognormal: around the median with the shape sigma, the heavy right tail of file sizes on real filesystems,
+ *  - pareto: scale at the lower bound and shape alpha, few large files hold most of the bytes,
+ *  - bimodal: mixture of two lognormals around the two modes (e.g. small configuration files and large media files),
+ *  - empirical: histogram of sizes, typically captured from a real filesystem by `filestorm profile`.
+ *
+ * Draws come from the FILE_SIZE stream of Random and always lie in the requested range. The continuous distributions
+ * are truncated to it by redrawing, a draw which misses the range ATTEMPTS times is clamped to it. The empirical
+ * distribution only picks buckets overlapping the range, uniformly within the overlap.
+ */
+class SizeDistribution {
+public:
+  enum class Kind { UNIFORM, NORMAL, LOGNORMAL, PARETO, BIMODAL, EMPIRICAL };
+
+  struct Config {
+    // Median of the lognormal distribution in bytes
+    uint64_t median = 64 * 1024;
+    // Shape of the lognormal distribution and of both modes of the bimodal one
+    double sigma = 1.0;
+    // Shape of the pareto distribution, the smaller the heavier the tail
+    double alpha = 1.2;
+    // Medians of the two modes of the bimodal distribution and the share of the first one
+    std::pair<uint64_t, uint64_t> modes{4096, 16 * 1024 * 1024};
+    double mode_weight = 0.8;
+    // Sizes of the empirical distribution
+    Distribution histogram;
+  };
+
+  static Kind parseKind(const std::string& name);
+  static const char* kindName(Kind kind);
+  // File size histogram of a profile or aging target JSON ("file_size") or a bare {"<lower bound>": weight} object
+  static Distribution loadHistogram(const std::string& path);
+
+  SizeDistribution(Kind kind, Config config);
+  Kind kind() const { return _kind; }
+
+  // Size in [from, to]
+  uint64_t sample(uint64_t from, uint64_t to) const;
+
+private:
+  // Draw of the continuous distributions, not limited to the range
+  double draw(uint64_t from, uint64_t to) const;
+  uint64_t empirical(uint64_t from, uint64_t to) const;
+
+  // Continuous draws outside of the range are redrawn this many times
+  static constexpr int ATTEMPTS = 16;
+
+  Kind _kind;
+  Config _config;
+};
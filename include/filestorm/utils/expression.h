@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Arithmetic expression compiled to a postfix program over numbered variable slots.
+ *
+ * Supported are numbers, variables, + - * / ^, unary - and !, comparisons (< <= > >= == !=), && and || (with 0 as
+ * false) and the functions min(a, b), max(a, b), sqrt(x), abs(x), floor(x), ceil(x) and if(condition, then, else).
+ * Variable names are resolved to slots when the expression is compiled, evaluation only reads the values array.
+ */
+class Expression {
+public:
+  // Returns slot of the variable, throws std::invalid_argument for unknown names
+  using Resolver = std::function<size_t(const std::string&)>;
+
+  Expression() = default;
+  static Expression compile(const std::string& source, const Resolver& resolve);
+
+  double evaluate(const double* variables) const;
+  double evaluate(const std::vector<double>& variables) const { return evaluate(variables.data()); }
+
+  // Slots of all variables the expression reads
+  const std::vector<size_t>& variables() const { return _variables; }
+  const std::string& source() const { return _source; }
+
+private:
+  enum class Op : uint8_t { CONST, VAR, ADD, SUB, MUL, DIV, POW, NEG, NOT, LT, LE, GT, GE, EQ, NE, AND, OR, MIN, MAX, SQRT, ABS, FLOOR, CEIL, IF };
+  struct Instruction {
+    Op op;
+    double value;
+    size_t slot;
+  };
+  static constexpr size_t MAX_STACK = 64;
+
+  std::string _source;
+  std::vector<Instruction> _code;
+  std::vector<size_t> _variables;
+};
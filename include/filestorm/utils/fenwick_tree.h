@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Integer weights of items 0..n-1 with O(log n) updates and O(log n) weighted picks (binary indexed tree).
+ *
+ * Items are added and removed at the end only, callers mirror sets which move their last item into a gap by setting the
+ * weight of the gap and popping the last one.
+ */
+class FenwickTree {
+public:
+  size_t size() const { return _weights.size(); }
+  bool empty() const { return _weights.empty(); }
+  uint64_t total() const { return _total; }
+  uint64_t weight(size_t index) const { return _weights[index]; }
+
+  void push_back(uint64_t weight);
+  void pop_back();
+  void set(size_t index, uint64_t weight);
+  void clear();
+  void reserve(size_t size);
+
+  // Sum of the weights of the items before index
+  uint64_t prefix(size_t index) const;
+  // Item whose weight covers the value: prefix(i) <= value < prefix(i + 1), the value has to be below total()
+  size_t find(uint64_t value) const;
+
+private:
+  // One based, _tree[i] sums the weights of items (i - lowbit(i), i]
+  std::vector<uint64_t> _tree{0};
+  std::vector<uint64_t> _weights;
+  uint64_t _total = 0;
+};
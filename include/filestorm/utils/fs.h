@@ -1,8 +1,49 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
+#include <functional>
 
 namespace fs_utils {
   std::filesystem::space_info get_fs_status(const std::filesystem::path& path);
   std::uintmax_t file_size(const std::filesystem::path& path);
+
+  /**
+   * @brief In-process estimate of the filesystem free space.
+   *
+   * The model is updated from the sizes of the operations the caller issues and reconciled with the real filesystem
+   * status only every reconcile_ops operations or reconcile_interval, whichever comes first. The difference between
+   * the model and the filesystem found at each reconciliation is kept as drift.
+   */
+  class FreeSpaceModel {
+  public:
+    using Probe = std::function<std::filesystem::space_info(const std::filesystem::path&)>;
+
+    FreeSpaceModel(std::filesystem::path path, uint64_t reconcile_ops, std::chrono::milliseconds reconcile_interval, Probe probe = get_fs_status);
+
+    // Current estimate, reconciled first when due
+    std::filesystem::space_info status();
+    // Record an operation which allocated (positive) or released (negative) bytes on the filesystem
+    void account(int64_t bytes);
+    // Query the filesystem now and return the drift of the model (model available - real available)
+    int64_t reconcile();
+
+    int64_t lastDrift() const { return _last_drift; }
+    int64_t maxDrift() const { return _max_drift; }
+    uint64_t reconcileCount() const { return _reconciles; }
+
+  private:
+    std::filesystem::path _path;
+    uint64_t _reconcile_ops;
+    std::chrono::milliseconds _reconcile_interval;
+    Probe _probe;
+
+    std::filesystem::space_info _status{};
+    uint64_t _ops_since_reconcile = 0;
+    std::chrono::steady_clock::time_point _reconciled_at;
+    int64_t _last_drift = 0;
+    int64_t _max_drift = 0;  // Largest absolute drift seen
+    uint64_t _reconciles = 0;
+  };
 }  // namespace fs_utils
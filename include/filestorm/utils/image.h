@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs_utils {
+  // Create (or truncate) a sparse file of the given size
+  void create_sparse_file(const std::filesystem::path& path, uint64_t size);
+
+  enum class CloneMethod { REFLINK, SPARSE_COPY };
+  // Copy a file sharing its blocks (FICLONE) when the filesystem supports it, otherwise copy only its data ranges
+  // and keep the holes. Returns the method which was used.
+  CloneMethod clone_file(const std::filesystem::path& source, const std::filesystem::path& destination);
+
+  // Run a program (searched in PATH) and wait for it, throws when it can't be started or doesn't exit with 0
+  void run_command(const std::vector<std::string>& args);
+
+  /**
+   * @brief Loop device backed by an image file, detached when the object is destroyed.
+   */
+  class LoopDevice {
+  public:
+    explicit LoopDevice(const std::filesystem::path& image);
+    ~LoopDevice();
+    LoopDevice(const LoopDevice&) = delete;
+    LoopDevice& operator=(const LoopDevice&) = delete;
+
+    const std::string& path() const { return _path; }
+
+  private:
+    std::string _path;
+    int _fd = -1;
+  };
+
+  /**
+   * @brief Mounted filesystem, unmounted when the object is destroyed.
+   */
+  class Mount {
+  public:
+    Mount(const std::string& device, const std::filesystem::path& target, const std::string& fs_type, const std::string& options = "");
+    ~Mount();
+    Mount(const Mount&) = delete;
+    Mount& operator=(const Mount&) = delete;
+
+    const std::filesystem::path& target() const { return _target; }
+
+  private:
+    std::filesystem::path _target;
+  };
+}  // namespace fs_utils
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * @brief Unordered set of node pointers with O(1) insertion, removal and access by index.
+ *
+ * The items are kept in a vector and every item stores its position in it (item->set_positions[slot]), so one item can
+ * be in several sets using different slots. Removal moves the last item into the gap, the order of the items is the
+ * insertion order only until the first removal.
+ */
+template <typename Pointer> class IndexedSet {
+public:
+  // Positions are 32 bit to keep the items small, a set holds less than 2^32 - 1 items
+  using Position = uint32_t;
+  static constexpr Position NPOS = UINT32_MAX;
+
+  explicit IndexedSet(size_t slot) : _slot(slot) {}
+  // Items would share the stored positions with the copy
+  IndexedSet(const IndexedSet&) = delete;
+  IndexedSet& operator=(const IndexedSet&) = delete;
+
+  bool contains(const Pointer& item) const {
+    size_t position = item->set_positions[_slot];
+    return position < _items.size() && _items[position] == item;
+  }
+  // Returns false when the item is in the set already
+  bool insert(const Pointer& item) {
+    if (contains(item)) {
+      return false;
+    }
+    if (_items.size() >= NPOS) {
+      throw std::length_error("IndexedSet is full");
+    }
+    item->set_positions[_slot] = Position(_items.size());
+    _items.push_back(item);
+    return true;
+  }
+  // Returns false when the item isn't in the set
+  bool erase(const Pointer& item) {
+    if (!contains(item)) {
+      return false;
+    }
+    size_t position = item->set_positions[_slot];
+    if (position + 1 != _items.size()) {
+      _items[position] = std::move(_items.back());
+      _items[position]->set_positions[_slot] = Position(position);
+    }
+    _items.pop_back();
+    item->set_positions[_slot] = NPOS;
+    return true;
+  }
+  void clear() {
+    for (auto& item : _items) {
+      item->set_positions[_slot] = NPOS;
+    }
+    _items.clear();
+  }
+  void reserve(size_t size) { _items.reserve(size); }
+
+  size_t size() const { return _items.size(); }
+  bool empty() const { return _items.empty(); }
+  const Pointer& operator[](size_t index) const { return _items[index]; }
+  const Pointer& at(size_t index) const { return _items.at(index); }
+  typename std::vector<Pointer>::const_iterator begin() const { return _items.begin(); }
+  typename std::vector<Pointer>::const_iterator end() const { return _items.end(); }
+  const std::vector<Pointer>& items() const { return _items; }
+
+private:
+  size_t _slot;
+  std::vector<Pointer> _items;
+};
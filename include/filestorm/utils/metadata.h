@@ -0,0 +1,24 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs_utils {
+  // Whether the filesystem of the directory stores extended attributes in the user namespace
+  bool xattrs_supported(const std::filesystem::path& directory);
+  // Set the extended attribute, returns false when the filesystem has no room left for it (ENOSPC, E2BIG)
+  bool set_xattr(const std::filesystem::path& path, const std::string& name, const std::string& value);
+  void remove_xattr(const std::filesystem::path& path, const std::string& name);
+  // Names of the extended attributes of the file starting with the prefix
+  std::vector<std::string> list_xattrs(const std::filesystem::path& path, const std::string& prefix = "");
+
+  void hard_link(const std::filesystem::path& target, const std::filesystem::path& link);
+  uint64_t link_count(const std::filesystem::path& path);
+  void change_mode(const std::filesystem::path& path, mode_t mode);
+  // Set the access time (seconds since the epoch) and the modification time to now
+  void set_times(const std::filesystem::path& path, int64_t access_time);
+}  // namespace fs_utils
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+
+/**
+ * @brief Pool of equally sized blocks shared by all PoolAllocators of the same block size.
+ *
+ * Blocks are carved from large chunks and freed blocks are kept in a free list for reuse, so unlike malloc there is no
+ * header per block and blocks allocated one after another lie next to each other. Chunks are never returned, the pool
+ * only grows to the peak number of blocks. Allocation and deallocation are thread safe.
+ */
+template <size_t Size, size_t Align> class FixedPool {
+public:
+  static constexpr size_t BLOCK_BYTES = (std::max(Size, sizeof(void*)) + Align - 1) / Align * Align;
+  static constexpr size_t CHUNK_BYTES = size_t(1) << 20;
+
+  // The pool is never destroyed, blocks may be freed by static objects after main() returns
+  static FixedPool& instance() {
+    static FixedPool* pool = new FixedPool();
+    return *pool;
+  }
+
+  void* allocate() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_free != nullptr) {
+      void* block = _free;
+      _free = *static_cast<void**>(block);
+      return block;
+    }
+    if (_cursor + BLOCK_BYTES > _end) {
+      size_t size = std::max(CHUNK_BYTES, BLOCK_BYTES);
+      _cursor = static_cast<char*>(::operator new(size, std::align_val_t(std::max(Align, alignof(void*)))));
+      _end = _cursor + size;
+    }
+    void* block = _cursor;
+    _cursor += BLOCK_BYTES;
+    return block;
+  }
+
+  void deallocate(void* block) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    *static_cast<void**>(block) = _free;
+    _free = block;
+  }
+
+private:
+  FixedPool() = default;
+
+  std::mutex _mutex;
+  void* _free = nullptr;
+  char* _cursor = nullptr;
+  char* _end = nullptr;
+};
+
+/**
+ * @brief Allocator taking single objects from a FixedPool, arrays come from the global heap.
+ *
+ * Meant for std::allocate_shared and node based containers with millions of small objects.
+ */
+template <typename T> class PoolAllocator {
+public:
+  using value_type = T;
+
+  PoolAllocator() noexcept = default;
+  template <typename U> PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+  T* allocate(size_t n) {
+    if (n != 1) {
+      return std::allocator<T>().allocate(n);
+    }
+    return static_cast<T*>(FixedPool<sizeof(T), alignof(T)>::instance().allocate());
+  }
+
+  void deallocate(T* p, size_t n) noexcept {
+    if (n != 1) {
+      std::allocator<T>().deallocate(p, n);
+      return;
+    }
+    FixedPool<sizeof(T), alignof(T)>::instance().deallocate(p);
+  }
+
+  template <typename U> bool operator==(const PoolAllocator<U>&) const noexcept { return true; }
+  template <typename U> bool operator!=(const PoolAllocator<U>&) const noexcept { return false; }
+};
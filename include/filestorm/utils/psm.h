@@ -1,10 +1,15 @@
 #pragma once
 
+#include <filestorm/utils/random.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <map>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 class Transition {
@@ -28,7 +33,7 @@ public:
 
   void performTransition(std::map<std::string, double>& probabilities) {
     // Choose a transition based on probabilities
-    double randomValue = ((double)rand() / (double)(RAND_MAX));
+    double randomValue = Random::unit(Random::STATE_MACHINE);
     double cumulativeProbability = 0.0;
 
     for (const auto& transition : _transitions) {
@@ -52,3 +57,94 @@ private:
   std::map<std::string, Transition>& _transitions;
   int _currentState;
 };
+
+/**
+ * @brief ProbabilisticStateMachine compiled into dense tables.
+ *
+ * Probability keys are resolved to slots of a flat array once, when the machine is built. Outgoing transitions of
+ * every state are stored next to each other together with their cumulative probabilities, which are recomputed only
+ * for states using a probability that actually changed. Transitions keep the order of the source map, so for the same
+ * random sequence the machine walks the same path as ProbabilisticStateMachine.
+ */
+class CompiledStateMachine {
+public:
+  // keys[i] is the probability key stored in slot i
+  CompiledStateMachine(const std::map<std::string, Transition>& transitions, int init, const std::vector<std::string>& keys) : _currentState(init), _probabilities(keys.size(), 0.0) {
+    int max_state = init;
+    for (const auto& transition : transitions) {
+      max_state = std::max({max_state, transition.second.from(), transition.second.to()});
+    }
+    size_t states = max_state + 1;
+    std::vector<std::vector<std::pair<int, uint32_t>>> outgoing(states);
+    for (const auto& transition : transitions) {
+      auto key = std::find(keys.begin(), keys.end(), transition.second.probability_key());
+      if (key == keys.end()) {
+        throw std::runtime_error("Unknown probability key " + transition.second.probability_key());
+      }
+      outgoing[transition.second.from()].emplace_back(transition.second.to(), key - keys.begin());
+    }
+    _states_using_slot.resize(keys.size());
+    _first.push_back(0);
+    for (size_t state = 0; state < states; state++) {
+      for (auto& [to, slot] : outgoing[state]) {
+        _to.push_back(to);
+        _slot.push_back(slot);
+        if (_states_using_slot[slot].empty() || _states_using_slot[slot].back() != state) {
+          _states_using_slot[slot].push_back(state);
+        }
+      }
+      _first.push_back(_to.size());
+    }
+    _cumulative.resize(_to.size(), 0.0);
+    _dirty.assign(states, true);
+  }
+
+  void setProbability(size_t slot, double probability) {
+    if (_probabilities[slot] == probability) {
+      return;
+    }
+    _probabilities[slot] = probability;
+    for (auto state : _states_using_slot[slot]) {
+      _dirty[state] = true;
+    }
+  }
+  template <typename Container> void setProbabilities(const Container& probabilities) {
+    for (size_t slot = 0; slot < _probabilities.size(); slot++) {
+      setProbability(slot, probabilities[slot]);
+    }
+  }
+  double getProbability(size_t slot) const { return _probabilities[slot]; }
+
+  void performTransition() {
+    double randomValue = Random::unit(Random::STATE_MACHINE);
+    if (_dirty[_currentState]) {
+      double cumulativeProbability = 0.0;
+      for (uint32_t edge = _first[_currentState]; edge < _first[_currentState + 1]; edge++) {
+        cumulativeProbability += _probabilities[_slot[edge]];
+        _cumulative[edge] = cumulativeProbability;
+      }
+      _dirty[_currentState] = false;
+    }
+    // States have only a few outgoing transitions, linear scan beats binary search here
+    for (uint32_t edge = _first[_currentState]; edge < _first[_currentState + 1]; edge++) {
+      if (randomValue <= _cumulative[edge]) {
+        _currentState = _to[edge];
+        return;
+      }
+    }
+    throw std::runtime_error("No transitions from current state");
+  }
+
+  int getCurrentState() const { return _currentState; }
+
+private:
+  int _currentState;
+  std::vector<double> _probabilities;
+  std::vector<std::vector<uint32_t>> _states_using_slot;
+  // Outgoing transitions of state s are [_first[s], _first[s + 1])
+  std::vector<uint32_t> _first;
+  std::vector<int> _to;
+  std::vector<uint32_t> _slot;
+  std::vector<double> _cumulative;
+  std::vector<bool> _dirty;
+};
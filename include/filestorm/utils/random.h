@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+/**
+ * @brief xoshiro256** generator, usable with the standard distributions.
+ *
+ * The state is four words, seeded by splitmix64 from a single seed so that close seeds give unrelated sequences.
+ */
+class Xoshiro256 {
+public:
+  using result_type = uint64_t;
+  using State = std::array<uint64_t, 4>;
+
+  explicit Xoshiro256(uint64_t seed = 0) { reseed(seed); }
+  void reseed(uint64_t seed);
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return UINT64_MAX; }
+  result_type operator()() {
+    uint64_t result = rotl(_state[1] * 5, 7) * 9;
+    uint64_t t = _state[1] << 17;
+    _state[2] ^= _state[0];
+    _state[3] ^= _state[1];
+    _state[1] ^= _state[2];
+    _state[0] ^= _state[3];
+    _state[2] ^= t;
+    _state[3] = rotl(_state[3], 45);
+    return result;
+  }
+  // Uniform in [0, bound), 0 for a bound of 0 (multiply-shift, the bias is below 2^-64 * bound)
+  uint64_t below(uint64_t bound) { return static_cast<uint64_t>((static_cast<unsigned __int128>((*this)()) * bound) >> 64); }
+  // Uniform in [0, 1)
+  double unit() { return static_cast<double>((*this)() >> 11) * 0x1.0p-53; }
+
+  const State& state() const { return _state; }
+  void setState(const State& state) { _state = state; }
+
+  static uint64_t splitmix64(uint64_t& x);
+
+private:
+  static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+  State _state;
+};
+
+/**
+ * @brief Random numbers of the whole program, derived from one master seed (--seed).
+ *
+ * Every component draws from its own stream, so e.g. the sizes of new files don't shift when the tree picks one more
+ * directory. Every thread has its own generators of the streams, derived from the master seed, the stream and the
+ * worker index of the thread, there are no locks and no shared state apart from the seed. The first thread using the
+ * service (the one driving the scenario) is worker 0, the others are numbered in the order they first draw, threads
+ * which need to be reproducible set their worker index explicitly. Without --seed the master seed is 42, so runs are
+ * reproducible by default.
+ */
+class Random {
+public:
+  enum Stream : uint8_t {
+    STATE_MACHINE,  // Transitions of the aging state machine
+    TREE,           // Picks of files and directories and the placement of new ones
+    FILE_SIZE,      // Sizes of new and resized files
+    PUNCH,          // Placement of punched holes
+    METADATA,       // Extended attributes, modes and times
+    EXTENTS,        // Files sampled by the extents estimator
+    TARGET,         // Sizes steered towards the aging target
+    DATA,           // Contents written to files
+    OFFSETS,        // Offsets of random reads and writes
+    PROBE,          // Files and offsets of performance probes
+    GENERAL,        // Helpers not tied to a component (d_rand)
+    STREAM_COUNT
+  };
+  using State = std::array<Xoshiro256::State, STREAM_COUNT>;
+
+  // Restart every stream of every thread from the master seed, other threads pick it up with their next draw
+  static void seed(uint64_t master);
+  static uint64_t masterSeed();
+
+  // Generator of the stream for the calling thread
+  static Xoshiro256& get(Stream stream);
+  static uint64_t below(Stream stream, uint64_t bound) { return get(stream).below(bound); }
+  static double unit(Stream stream) { return get(stream).unit(); }
+
+  // Worker index of the calling thread, its streams restart from the derived seeds
+  static void setWorker(uint32_t worker);
+  // Generator of the stream for the worker, independent of all threads
+  static Xoshiro256 derive(Stream stream, uint64_t worker);
+
+  // Streams of the calling thread, stored in checkpoints so a resumed run continues the same sequences
+  static State save();
+  static void restore(const State& state);
+};
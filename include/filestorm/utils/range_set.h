@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Disjoint byte ranges of a file, each of a kind, everything not covered is data.
+ *
+ * Ranges are kept sorted in a vector, touching ranges of the same kind are merged. Files have a handful of holes at
+ * most, so the linear updates are cheaper than a tree, the lookups are binary searches.
+ */
+class RangeSet {
+public:
+  enum class Kind : uint8_t {
+    DATA,       // Written, not stored
+    PUNCHED,    // Hole without allocated blocks
+    UNWRITTEN,  // Allocated by fallocate, reads as zeros
+  };
+  struct Range {
+    uint64_t start;
+    uint64_t end;
+    Kind kind;
+    bool operator==(const Range& other) const { return start == other.start && end == other.end && kind == other.kind; }
+  };
+
+  // Make [start, end) of the kind, DATA removes the ranges
+  void assign(uint64_t start, uint64_t end, Kind kind);
+  // Change the ranges of the kind from within [start, end) to the kind to, from can't be DATA
+  void replace(uint64_t start, uint64_t end, Kind from, Kind to);
+  // Drop everything from size on
+  void truncate(uint64_t size);
+  void clear() { _ranges.clear(); }
+
+  // Range covering the position, null if it is data
+  const Range* containing(uint64_t position) const;
+  // Start of the first range at or after the position, UINT64_MAX if there is none
+  uint64_t nextStart(uint64_t position) const;
+
+  // Bytes covered by ranges of the kind
+  uint64_t bytes(Kind kind) const;
+  bool empty() const { return _ranges.empty(); }
+  size_t size() const { return _ranges.size(); }
+  const std::vector<Range>& ranges() const { return _ranges; }
+
+private:
+  std::vector<Range> _ranges;
+};
@@ -1,4 +1,5 @@
 #include <filestorm/actions/rw_actions.h>
+#include <filestorm/utils/random.h>
 
 #include <thread>
 
@@ -102,13 +103,8 @@ inline off_t RandomReadMonitoredAction::get_offset() {
   // Calculate the total number of blocks in the file
   ssize_t num_blocks = file_size_bytes / block_size_bytes;
 
-  // Use a random number generator to select a block index
-  std::random_device rd;   // Seed
-  std::mt19937 gen(rd());  // Standard mersenne_twister_engine
-  std::uniform_int_distribution<> distrib(0, num_blocks - 1);
-
-  // Generate a random block index
-  ssize_t block_index = distrib(gen);
+  // Select a random block index
+  ssize_t block_index = Random::below(Random::OFFSETS, num_blocks);
 
   // Calculate and return the offset
   return block_index * block_size_bytes;
@@ -130,13 +126,7 @@ inline off_t WriteMonitoredAction::get_offset() {
   }
   return offset;
 }
-inline void WriteMonitoredAction::generate_random_chunk(char* chunk, size_t size) {
-  static std::random_device rd;
-  static std::mt19937 gen(rd());
-  static std::uniform_int_distribution<> dis(0, 255);
-
-  std::generate_n(chunk, size, []() { return dis(gen); });
-}
+inline void WriteMonitoredAction::generate_random_chunk(char* chunk, size_t size) { ::generate_random_chunk(chunk, size); }
 void WriteMonitoredAction::work() {
   logger.debug("{}::work: file_path: {}", typeid(*this).name(), get_file_path());
   int fd;
@@ -231,13 +221,8 @@ inline off_t RandomWriteMonitoredAction::get_offset() {
   // Calculate the total number of blocks in the file
   ssize_t num_blocks = file_size_bytes / block_size_bytes;
 
-  // Use a random number generator to select a block index
-  std::random_device rd;   // Seed
-  std::mt19937 gen(rd());  // Standard mersenne_twister_engine
-  std::uniform_int_distribution<> distrib(0, num_blocks - 1);
-
-  // Generate a random block index
-  ssize_t block_index = distrib(gen);
+  // Select a random block index
+  ssize_t block_index = Random::below(Random::OFFSETS, num_blocks);
 
   // Calculate and return the offset
   return block_index * block_size_bytes;
@@ -0,0 +1,69 @@
+#include <fcntl.h>
+#include <filestorm/checkpoint.h>
+#include <fmt/format.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+
+namespace {
+  void fsync_path(const std::string& path, int flags) {
+    int fd = open(path.c_str(), flags);
+    if (fd == -1) {
+      throw std::runtime_error(fmt::format("Checkpoint: cannot open {} for fsync: {}", path, strerror(errno)));
+    }
+    int ret = fsync(fd);
+    close(fd);
+    if (ret == -1) {
+      throw std::runtime_error(fmt::format("Checkpoint: fsync of {} failed: {}", path, strerror(errno)));
+    }
+  }
+}  // namespace
+
+CheckpointWriter::CheckpointWriter(const std::string& path) : _path(path), _tmp_path(path + ".tmp"), _out(_tmp_path, std::ios::binary | std::ios::trunc) {
+  if (!_out.is_open()) {
+    throw std::runtime_error(fmt::format("Checkpoint: cannot create {}", _tmp_path));
+  }
+  _out.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC) - 1);
+  write<uint32_t>(CHECKPOINT_VERSION);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+  if (!_committed) {
+    _out.close();
+    std::error_code ec;
+    std::filesystem::remove(_tmp_path, ec);
+  }
+}
+
+void CheckpointWriter::commit() {
+  _out.flush();
+  if (!_out) {
+    throw std::runtime_error(fmt::format("Checkpoint: writing {} failed", _tmp_path));
+  }
+  _out.close();
+  fsync_path(_tmp_path, O_RDONLY);
+  std::filesystem::rename(_tmp_path, _path);
+  // Make the rename itself durable
+  auto directory = std::filesystem::absolute(_path).parent_path();
+  fsync_path(directory.string(), O_RDONLY | O_DIRECTORY);
+  _committed = true;
+}
+
+CheckpointReader::CheckpointReader(const std::string& path) : _path(path), _in(path, std::ios::binary) {
+  if (!_in.is_open()) {
+    throw std::runtime_error(fmt::format("Cannot open checkpoint {}", path));
+  }
+  std::error_code ec;
+  _remaining = std::filesystem::file_size(path, ec);
+  char magic[sizeof(CHECKPOINT_MAGIC) - 1];
+  if (ec || _remaining < sizeof(magic) || !_in.read(magic, sizeof(magic)) || std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0) {
+    throw std::runtime_error(fmt_error("not a filestorm checkpoint"));
+  }
+  _remaining -= sizeof(magic);
+  auto version = read<uint32_t>();
+  if (version != CHECKPOINT_VERSION) {
+    throw std::runtime_error(fmt_error(fmt::format("unsupported version {}, expected {}", version, CHECKPOINT_VERSION)));
+  }
+}
@@ -0,0 +1,179 @@
+#include <filestorm/extents_accountant.h>
+#include <filestorm/utils/logger.h>
+
+#include <algorithm>
+
+ExtentsAccountant::ExtentsAccountant(FileTree& tree, unsigned int workers, bool fiemap_sync) : _tree(tree), _fiemap_sync(fiemap_sync) {
+  for (unsigned int i = 0; i < workers; i++) {
+    _workers.emplace_back(&ExtentsAccountant::work, this);
+  }
+}
+
+ExtentsAccountant::~ExtentsAccountant() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _jobs_cv.notify_all();
+  for (auto& worker : _workers) {
+    worker.join();
+  }
+}
+
+void ExtentsAccountant::markDirty(FileTree::Nodeptr file) {
+  if (file->type != FileTree::Type::FILE) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(_mutex);
+  _pending.emplace(file.get(), file);
+}
+
+void ExtentsAccountant::forget(FileTree::Nodeptr file) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _pending.erase(file.get());
+    if (_inflight.count(file.get())) {
+      _discarded.insert(file.get());
+    }
+    // Drop results which already finished but weren't collected yet
+    _done.erase(std::remove_if(_done.begin(), _done.end(), [&](const Done& done) { return done.file == file; }), _done.end());
+  }
+  _tree.total_extents_count -= file->getExtentsCount(false);
+}
+
+void ExtentsAccountant::submit() {
+  std::vector<Job> jobs;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto it = _pending.begin(); it != _pending.end();) {
+      if (_inflight.count(it->first)) {
+        ++it;
+        continue;
+      }
+      auto ranges = it->second->takeRescanRanges();
+      if (!ranges.empty()) {
+        auto& file = it->second;
+        jobs.push_back({file, file->parent, file->name, file->path(true), std::move(ranges), _fiemap_sync || _force_sync});
+      }
+      it = _pending.erase(it);
+    }
+  }
+  if (_workers.empty()) {
+    for (auto& job : jobs) {
+      _done.push_back(scan(job));
+    }
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& job : jobs) {
+      _inflight.insert(job.file.get());
+      _queue.push_back(std::move(job));
+    }
+  }
+  _jobs_cv.notify_all();
+}
+
+size_t ExtentsAccountant::collect() {
+  std::vector<Done> done;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    done.swap(_done);
+  }
+  for (auto& result : done) {
+    if (result.failed && (result.file->parent != result.parent || result.file->name != result.name)) {
+      // Renamed while it was being scanned, the ranges still have to be scanned under the new path
+      for (auto& range : result.ranges) {
+        result.file->markExtentsDirty(range.first, range.second);
+      }
+      markDirty(result.file);
+      continue;
+    }
+    if (result.failed) {
+      logger.warn("Extents scan of {} failed: {}", result.file->path(true), result.error);
+      continue;
+    }
+    int64_t original_extents = result.file->getExtentsCount(false);
+    result.file->applyRescan(result.ranges, result.file_extents);
+    int64_t updated_extents = result.file->getExtentsCount(false);
+    if (logger.get_logger()->should_log(spdlog::level::debug)) {
+      logger.debug("File {} extents: {} -> {}", result.file->path(true), original_extents, updated_extents);
+    }
+    _tree.total_extents_count += updated_extents - original_extents;
+  }
+  return done.size();
+}
+
+void ExtentsAccountant::drain() {
+  while (true) {
+    submit();
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _done_cv.wait(lock, [this] { return _queue.empty() && _inflight.empty(); });
+    }
+    collect();
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_pending.empty()) {
+      break;
+    }
+  }
+}
+
+int64_t ExtentsAccountant::scanAll() {
+  for (auto& file : _tree.all_files) {
+    file->invalidateExtents();
+    markDirty(file);
+  }
+  _force_sync = true;
+  drain();
+  _force_sync = false;
+  return _tree.total_extents_count;
+}
+
+size_t ExtentsAccountant::pendingCount() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _pending.size() + _inflight.size();
+}
+
+void ExtentsAccountant::work() {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _jobs_cv.wait(lock, [this] { return _stopping || !_queue.empty(); });
+      if (_stopping && _queue.empty()) {
+        return;
+      }
+      job = std::move(_queue.front());
+      _queue.pop_front();
+      // The file was forgotten (removed) before the scan even started
+      if (_discarded.erase(job.file.get())) {
+        _inflight.erase(job.file.get());
+        _done_cv.notify_all();
+        continue;
+      }
+    }
+    Done done = scan(job);
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _inflight.erase(job.file.get());
+      if (_discarded.erase(job.file.get()) == 0) {
+        _done.push_back(std::move(done));
+      }
+    }
+    _done_cv.notify_all();
+  }
+}
+
+ExtentsAccountant::Done ExtentsAccountant::scan(const Job& job) {
+  Done done{job.file, job.parent, job.name, job.ranges, {}, false, ""};
+  try {
+    for (auto& range : job.ranges) {
+      done.file_extents.push_back(get_extents(job.path.c_str(), range.first, range.second - range.first, job.sync));
+    }
+  } catch (const std::exception& e) {
+    done.failed = true;
+    done.error = e.what();
+  }
+  return done;
+}
@@ -0,0 +1,106 @@
+#include <filestorm/extents_estimator.h>
+#include <filestorm/utils/logger.h>
+#include <filestorm/utils/random.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+#include <unordered_set>
+
+// z value of the two sided 95% confidence interval
+static constexpr double Z_95 = 1.959964;
+
+ExtentsEstimator::ExtentsEstimator(size_t sample_size, size_t strata, bool fiemap_sync) : _sample_size(sample_size), _strata(strata), _fiemap_sync(fiemap_sync) {
+  if (sample_size == 0) {
+    throw std::invalid_argument("Extents sample size must be at least 1");
+  }
+  if (strata == 0) {
+    throw std::invalid_argument("Extents sample needs at least one stratum");
+  }
+}
+
+ExtentsEstimator::Estimate ExtentsEstimator::estimate(const std::vector<FileTree::Nodeptr>& files) {
+  std::vector<Stratum> strata;
+  size_t strata_count = std::min(_strata, std::max<size_t>(1, std::min(files.size(), _sample_size)));
+  // Indices of the files by creation, only the stratum boundaries are put in place (O(n log strata))
+  std::vector<std::pair<uint32_t, size_t>> order(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+    order[i] = {files[i]->_sequence, i};
+  }
+  for (size_t h = 1; h < strata_count; h++) {
+    std::nth_element(order.begin() + files.size() * (h - 1) / strata_count, order.begin() + files.size() * h / strata_count, order.end());
+  }
+  for (size_t h = 0; h < strata_count; h++) {
+    size_t begin = files.size() * h / strata_count;
+    size_t end = files.size() * (h + 1) / strata_count;
+    Stratum stratum;
+    stratum.population = end - begin;
+    // Proportional allocation, at least two files so the variance of the stratum can be computed
+    size_t count = std::max<size_t>(2, (_sample_size * stratum.population + files.size() - 1) / std::max<size_t>(1, files.size()));
+    for (auto index : pick(stratum.population, count)) {
+      auto& file = files[order[begin + index].second];
+      try {
+        stratum.samples.push_back(get_extents(file->path(true).c_str(), _fiemap_sync).size());
+      } catch (const std::exception& e) {
+        logger.warn("Extents scan of {} failed: {}", file->path(true), e.what());
+      }
+    }
+    strata.push_back(std::move(stratum));
+  }
+  return combine(strata);
+}
+
+ExtentsEstimator::Estimate ExtentsEstimator::combine(const std::vector<Stratum>& strata) {
+  Estimate estimate;
+  double variance = 0;
+  for (auto& stratum : strata) {
+    estimate.population += stratum.population;
+    size_t n = stratum.samples.size();
+    if (n == 0) {
+      continue;
+    }
+    estimate.sampled += n;
+    double mean = 0;
+    for (auto value : stratum.samples) {
+      mean += value;
+    }
+    mean /= n;
+    double N = stratum.population;
+    estimate.total += N * mean;
+    if (n < 2 || n >= stratum.population) {
+      continue;  // Fully scanned strata are exact
+    }
+    double s2 = 0;
+    for (auto value : stratum.samples) {
+      s2 += (value - mean) * (value - mean);
+    }
+    s2 /= (n - 1);
+    // Variance of the stratum total with finite population correction
+    variance += N * N * (1.0 - n / N) * s2 / n;
+  }
+  estimate.margin = Z_95 * std::sqrt(variance);
+  return estimate;
+}
+
+std::vector<size_t> ExtentsEstimator::pick(size_t population, size_t count) {
+  std::vector<size_t> picked;
+  if (count >= population) {
+    picked.resize(population);
+    for (size_t i = 0; i < population; i++) {
+      picked[i] = i;
+    }
+    return picked;
+  }
+  std::unordered_set<size_t> chosen;
+  for (size_t j = population - count; j < population; j++) {
+    size_t t = Random::below(Random::EXTENTS, j + 1);
+    if (!chosen.insert(t).second) {
+      chosen.insert(j);
+      picked.push_back(j);
+    } else {
+      picked.push_back(t);
+    }
+  }
+  return picked;
+}
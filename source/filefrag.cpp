@@ -2,11 +2,46 @@
 #include <filestorm/utils/logger.h>
 #include <fmt/core.h>
 
-struct fiemap_extent_data {
-  struct fiemap *fiemap_ptr;
-};
+#include <algorithm>
 
-std::vector<extents> get_extents(const char *file_path) {
+#if defined(__linux__)
+namespace {
+  // Per thread fiemap buffer which is reused between calls. It starts small and grows whenever a single ioctl
+  // fills it completely, so files with thousands of extents are mapped in a few calls instead of hundreds.
+  class FiemapBuffer {
+  public:
+    struct fiemap *get() { return reinterpret_cast<struct fiemap *>(_storage.data()); }
+    uint32_t capacity() const { return _capacity; }
+    void reserve(uint32_t capacity) {
+      _capacity = std::min<uint32_t>(capacity, MAX_FIEMAP_EXTENTS);
+      size_t bytes = sizeof(struct fiemap) + sizeof(struct fiemap_extent) * _capacity;
+      // uint64_t storage keeps the struct properly aligned
+      _storage.resize((bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    }
+    void grow() {
+      if (_capacity < MAX_FIEMAP_EXTENTS) {
+        reserve(_capacity * 4);
+      }
+    }
+
+  private:
+    std::vector<uint64_t> _storage;
+    uint32_t _capacity = 0;
+  };
+
+  FiemapBuffer &fiemap_buffer() {
+    thread_local FiemapBuffer buffer;
+    if (buffer.capacity() == 0) {
+      buffer.reserve(MAX_EXTENTS);
+    }
+    return buffer;
+  }
+}  // namespace
+#endif
+
+std::vector<extents> get_extents(const char *file_path, bool sync) { return get_extents(file_path, 0, ~0ULL, sync); }
+
+std::vector<extents> get_extents(const char *file_path, uint64_t start, uint64_t length, bool sync) {
   // Check for null file path
   if (file_path == nullptr) {
     throw std::runtime_error("File path is null.");
@@ -27,33 +62,25 @@ std::vector<extents> get_extents(const char *file_path) {
     throw std::runtime_error(fmt::format("Error opening file [{}], for extents scan.", file_path));
   }
 
-  // Allocate enough memory for a fiemap struct plus MAX_EXTENTS fiemap_extents
-  const size_t fiemap_size = sizeof(struct fiemap) + sizeof(struct fiemap_extent) * MAX_EXTENTS;
-  struct fiemap *fiemap_ptr = (struct fiemap *)malloc(fiemap_size);
-  if (fiemap_ptr == NULL) {
-    perror("malloc");
-    close(fd);
-    throw std::runtime_error("Error allocating memory for fiemap.");
-  }
-
-  uint64_t start = 0;  // Start offset for fiemap scan
-  bool done = false;   // Loop control flag
+  FiemapBuffer &buffer = fiemap_buffer();
+  const uint64_t end = (length > ~0ULL - start) ? ~0ULL : start + length;
+  bool done = false;  // Loop control flag
 
-  // Loop until we've retrieved all extents
+  // Loop until we've retrieved all extents of the requested range
   while (!done) {
-    // Clear fiemap memory before each ioctl call
-    memset(fiemap_ptr, 0, fiemap_size);
+    struct fiemap *fiemap_ptr = buffer.get();
+    // Only the header has to be cleared, the kernel fills the extents
+    memset(fiemap_ptr, 0, sizeof(struct fiemap));
 
     // Set up fiemap request parameters
-    fiemap_ptr->fm_start = start;               // Start from the current offset
-    fiemap_ptr->fm_length = ~0ULL;              // Request all extents from 'start' onward
-    fiemap_ptr->fm_flags = FIEMAP_FLAG_SYNC;    // Make sure file is synced to disk before scanning
-    fiemap_ptr->fm_extent_count = MAX_EXTENTS;  // Maximum number of extents we can receive
+    fiemap_ptr->fm_start = start;                         // Start from the current offset
+    fiemap_ptr->fm_length = end - start;                  // Request extents up to the end of the range
+    fiemap_ptr->fm_flags = sync ? FIEMAP_FLAG_SYNC : 0;   // Optionally make sure file is synced to disk before scanning
+    fiemap_ptr->fm_extent_count = buffer.capacity();      // Maximum number of extents we can receive
 
     // Perform the ioctl call to get the file extents
     if (ioctl(fd, FS_IOC_FIEMAP, fiemap_ptr) == -1) {
       perror("ioctl");
-      free(fiemap_ptr);
       close(fd);
       throw std::runtime_error("Error getting file extents.");
     }
@@ -73,18 +100,21 @@ std::vector<extents> get_extents(const char *file_path) {
       });
     }
 
-    // Check if the last returned extent marks the end of the file
+    // Check if the last returned extent marks the end of the file or of the requested range
     auto &last_extent = fiemap_ptr->fm_extents[fiemap_ptr->fm_mapped_extents - 1];
-    if (last_extent.fe_flags & FIEMAP_EXTENT_LAST) {
+    uint64_t last_end = last_extent.fe_logical + last_extent.fe_length;
+    if (last_extent.fe_flags & FIEMAP_EXTENT_LAST || last_end >= end) {
       done = true;  // We're done
     } else {
+      if (fiemap_ptr->fm_mapped_extents == buffer.capacity()) {
+        // The buffer was too small for this file, use a bigger one for the rest of it (and for next files)
+        buffer.grow();
+      }
       // Update start offset to scan from the next byte after the last extent
-      start = last_extent.fe_logical + last_extent.fe_length;
+      start = last_end;
     }
   }
 
-  // Free allocated memory and close the file descriptor
-  free(fiemap_ptr);
   close(fd);
 
   // Return the collected extents
@@ -92,6 +122,9 @@ std::vector<extents> get_extents(const char *file_path) {
 
 #else
   // If not on Linux, log a warning once and return an empty list
+  (void)start;
+  (void)length;
+  (void)sync;
   static bool warning_printed = false;
   if (!warning_printed) {
     logger.warn("This code is for Linux only and the fragmentation monitoring won't be available on other platforms. {}", file_path);
@@ -1,8 +1,17 @@
+#include <fcntl.h>
 #include <filestorm/filetree.h>
 #include <filestorm/utils.h>
+#include <filestorm/utils/random.h>
 #include <fmt/format.h>  // Include the necessary header file
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
 #include <queue>
+#include <unordered_map>
 
 std::atomic<int> FileTree::directory_count(0);
 std::atomic<int> FileTree::file_count(0);
@@ -10,7 +19,68 @@ std::atomic<int> FileTree::file_count(0);
 std::atomic<int> FileTree::directory_id(0);
 std::atomic<int> FileTree::file_id(0);
 
-FileTree::FileTree(const std::string& rootName, unsigned int max_depth) : _max_depth(max_depth) { root = std::make_shared<Node>(rootName, Type::DIRECTORY, nullptr); }
+FileTree::FileTree(const std::string& rootName, unsigned int max_depth) : _max_depth(max_depth) {
+  root = makeNode(rootName, Type::DIRECTORY, nullptr);
+  _levels.push_back(std::make_unique<IndexedSet<Nodeptr>>(LEVEL_SLOT));
+  _levels[0]->insert(root);
+}
+
+FileTree::~FileTree() {
+  for (auto& [directory, entry] : _directory_fds) {
+    ::close(entry.first);
+  }
+}
+
+FileTree::Nodeptr FileTree::makeNode(const std::string& name, Type type, Nodeptr parent) { return std::allocate_shared<Node>(PoolAllocator<Node>(), name, type, std::move(parent)); }
+
+const std::vector<FileTree::Nodeptr>& FileTree::ChildMap::children() const {
+  static const std::vector<Nodeptr> none;
+  return _children ? *_children : none;
+}
+
+std::vector<FileTree::Nodeptr>::iterator FileTree::ChildMap::lowerBound(std::string_view name) const {
+  return std::lower_bound(_children->begin(), _children->end(), name, [](const Nodeptr& child, std::string_view name) { return child->name < name; });
+}
+
+FileTree::ChildMap::const_iterator FileTree::ChildMap::find(std::string_view name) const {
+  if (!_children) {
+    return end();
+  }
+  auto it = lowerBound(name);
+  return it != _children->end() && (*it)->name == name ? it : end();
+}
+
+FileTree::Nodeptr FileTree::ChildMap::get(std::string_view name) const {
+  auto it = find(name);
+  return it != end() ? *it : nullptr;
+}
+
+bool FileTree::ChildMap::insert(const Nodeptr& child) {
+  if (!_children) {
+    _children = std::make_unique<std::vector<Nodeptr>>();
+  }
+  auto it = lowerBound(child->name);
+  if (it != _children->end() && (*it)->name == child->name) {
+    return false;
+  }
+  _children->insert(it, child);
+  return true;
+}
+
+bool FileTree::ChildMap::erase(std::string_view name) {
+  if (!_children) {
+    return false;
+  }
+  auto it = lowerBound(name);
+  if (it == _children->end() || (*it)->name != name) {
+    return false;
+  }
+  _children->erase(it);
+  if (_children->empty()) {
+    _children.reset();
+  }
+  return true;
+}
 
 FileTree::Nodeptr FileTree::addDirectory(Nodeptr parent, const std::string& dirName) {
   if (parent->type == Type::FILE) {
@@ -19,10 +89,16 @@ FileTree::Nodeptr FileTree::addDirectory(Nodeptr parent, const std::string& dirN
   if (parent->folders.find(dirName) != parent->folders.end()) {
     throw std::runtime_error("Directory already exists!");
   }
-  parent->folders[dirName] = std::make_shared<Node>(dirName, Type::DIRECTORY, parent);
-  all_directories.push_back(parent->folders[dirName]);
+  auto directory = makeNode(dirName, Type::DIRECTORY, parent);
+  parent->folders.insert(directory);
+  all_directories.insert(directory);
+  auto directory_level = level(directory.get());
+  while (_levels.size() <= directory_level) {
+    _levels.push_back(std::make_unique<IndexedSet<Nodeptr>>(LEVEL_SLOT));
+  }
+  _levels[directory_level]->insert(directory);
   directory_count++;
-  return parent->folders[dirName];
+  return directory;
 }
 
 FileTree::Nodeptr FileTree::addFile(Nodeptr parent, const std::string& fileName) {
@@ -32,11 +108,21 @@ FileTree::Nodeptr FileTree::addFile(Nodeptr parent, const std::string& fileName)
   if (parent->files.find(fileName) != parent->files.end()) {
     throw std::runtime_error("File already registered!");
   }
-  parent->files[fileName] = std::make_shared<Node>(fileName, Type::FILE, parent);
-  all_files.push_back(parent->files[fileName]);
-  files_for_fallocate.push_back(parent->files[fileName]);
+  auto file = makeNode(fileName, Type::FILE, parent);
+  file->_sequence = _file_sequence++;
+  file->_touched = ++_touch_clock;
+  parent->files.insert(file);
+  all_files.insert(file);
+  files_for_fallocate.insert(file);
+  for (size_t i = 0; i < WEIGHTED_SELECTIONS; i++) {
+    if (_weights[i]) {
+      auto weight = selectionWeight(Selection(size_t(Selection::ZIPF) + i), *file);
+      _weights[i]->files.push_back(weight);
+      _weights[i]->punchable.push_back(weight);
+    }
+  }
   file_count++;
-  return parent->files[fileName];
+  return file;
 }
 
 void FileTree::print() const { printRec(root, 0); }
@@ -50,11 +136,11 @@ void FileTree::printRec(const Nodeptr node, int depth) const {
   std::cout << std::endl;
 
   for (const auto& child : node->folders) {
-    printRec(child.second, depth + 1);
+    printRec(child, depth + 1);
   }
   for (const auto& child : node->files) {
     for (int i = 0; i < depth + 1; ++i) std::cout << "--";
-    std::cout << child.second->name << std::endl;
+    std::cout << child->name << std::endl;
   }
 }
 
@@ -64,16 +150,26 @@ void FileTree::remove(Nodeptr node) {
   }
   // recursively remove all children and optionally parent
   while (!node->folders.empty() || !node->files.empty()) {
-    if (!node->folders.empty()) remove(node->folders.begin()->second);
-    if (!node->files.empty()) remove(node->files.begin()->second);
+    if (!node->folders.empty()) remove(*node->folders.begin());
+    if (!node->files.empty()) remove(*node->files.begin());
   }
   if (node->type == Type::DIRECTORY) {
-    all_directories.erase(std::remove(all_directories.begin(), all_directories.end(), node), all_directories.end());
+    closeDirectoryFd(node.get());
+    all_directories.erase(node);
+    _levels[level(node.get())]->erase(node);
     node->parent->folders.erase(node->name);
     directory_count--;
   } else {
-    all_files.erase(std::remove(all_files.begin(), all_files.end(), node), all_files.end());
-    files_for_fallocate.erase(std::remove(files_for_fallocate.begin(), files_for_fallocate.end(), node), files_for_fallocate.end());
+    for (auto& weights : _weights) {
+      if (weights) {
+        eraseWeight(weights->files, node->set_positions[NODES_SLOT]);
+        if (files_for_fallocate.contains(node)) {
+          eraseWeight(weights->punchable, node->set_positions[PUNCHABLE_SLOT]);
+        }
+      }
+    }
+    all_files.erase(node);
+    files_for_fallocate.erase(node);
     node->parent->files.erase(node->name);
     file_count--;
   }
@@ -103,7 +199,7 @@ FileTree::Nodeptr FileTree::mkdir(std::string path, bool recursively) {
       if (part == pathParts.back()) {
         throw std::runtime_error("Directory already registered!");
       }
-      current = current->folders[part];
+      current = current->folders.get(part);
     }
   }
   return current;
@@ -129,7 +225,7 @@ FileTree::Nodeptr FileTree::mkfile(std::string path) {
         throw std::runtime_error("Directory isn't registered!");
       }
     } else {
-      current = current->folders[part];
+      current = current->folders.get(part);
     }
   }
   throw std::runtime_error("mkfile error: File probably already registered!");
@@ -150,15 +246,15 @@ FileTree::Nodeptr FileTree::getNode(std::string path) {
     if (part == "") {
       throw std::runtime_error("Path contains empty part!");
     }
-    if (current->files.find(part) != current->files.end()) {
+    if (auto file = current->files.get(part)) {
       if (part == pathParts.back()) {
-        return current->files[part];
+        return file;
       } else {
         throw std::runtime_error("Node doesn't exist! (File)");
       }
     }
-    if (current->folders.find(part) != current->folders.end()) {
-      current = current->folders[part];
+    if (auto directory = current->folders.get(part)) {
+      current = directory;
     } else {
       throw std::runtime_error("Node doesn't exist! (Folder)");
     }
@@ -198,67 +294,186 @@ void FileTree::rm(std::string path, bool recursively) {
   }
 }
 
-std::string FileTree::newDirectoryPath() {
-  std::string new_dir_name = fmt::format("dir_{}", directory_id++);
-  unsigned int depth = 0;
-  unsigned int rand_selected_depth = rand() % _max_depth;
-
-  Nodeptr current_root = root;
+FileTree::Placement FileTree::parsePlacement(const std::string& name) {
+  auto lower = toLower(name);
+  if (lower == "walk") {
+    return Placement::WALK;
+  }
+  if (lower == "uniform") {
+    return Placement::UNIFORM;
+  }
+  if (lower == "depth") {
+    return Placement::DEPTH;
+  }
+  if (lower == "fanout") {
+    return Placement::FANOUT;
+  }
+  if (lower == "locality") {
+    return Placement::LOCALITY;
+  }
+  throw std::invalid_argument(fmt::format("Unknown placement {}, use walk, uniform, depth, fanout or locality", name));
+}
 
-  while (depth < rand_selected_depth) {
-    auto current_dir_count = current_root->folders.size();
-    if (current_dir_count == 0) {
-      break;
-    }
-    auto selected_dir_index = rand() % current_dir_count;
-    auto selected_dir = current_root->folders.begin();
-    std::advance(selected_dir, selected_dir_index);
-    current_root = selected_dir->second;
-    depth++;
+const char* FileTree::placementName(Placement placement) {
+  switch (placement) {
+    case Placement::UNIFORM:
+      return "uniform";
+    case Placement::DEPTH:
+      return "depth";
+    case Placement::FANOUT:
+      return "fanout";
+    case Placement::LOCALITY:
+      return "locality";
+    default:
+      return "walk";
   }
+}
 
-  return fmt::format("{}/{}", current_root->path(), new_dir_name);
+void FileTree::setPlacement(PlacementConfig config) {
+  if (config.locality < 0 || config.locality > 1) {
+    throw std::invalid_argument(fmt::format("Placement locality has to be between 0 and 1, got {}", config.locality));
+  }
+  config.fanout = std::max<size_t>(config.fanout, 1);
+  config.recent = std::max<size_t>(config.recent, 1);
+  _placement = config;
+  _recent.clear();
+  _recent_next = 0;
 }
 
-std::string FileTree::newFilePath() {
-  std::string new_file_name = fmt::format("file_{}", file_id++);
-  unsigned int depth = 0;
-  unsigned int rand_selected_depth = rand() % _max_depth;
+size_t FileTree::level(const Node* directory) {
+  size_t result = 0;
+  for (; directory->parent != nullptr; directory = directory->parent.get()) {
+    result++;
+  }
+  return result;
+}
 
-  Nodeptr current_root = root;
+FileTree::Nodeptr FileTree::uniformDirectory() {
+  size_t levels = std::min<size_t>(std::max(_max_depth, 1u), _levels.size());
+  size_t count = 0;
+  for (size_t i = 0; i < levels; i++) {
+    count += _levels[i]->size();
+  }
+  size_t index = Random::below(Random::TREE, count);
+  for (size_t i = 0;; i++) {
+    if (index < _levels[i]->size()) {
+      return (*_levels[i])[index];
+    }
+    index -= _levels[i]->size();
+  }
+}
 
-  while (depth < rand_selected_depth) {
-    auto current_dir_count = current_root->folders.size();
-    if (current_dir_count == 0) {
-      break;
+FileTree::Nodeptr FileTree::placementDirectory() {
+  switch (_placement.policy) {
+    case Placement::UNIFORM:
+      return uniformDirectory();
+    case Placement::DEPTH: {
+      // Levels emptied by removals are skipped, the root level never is
+      size_t levels = std::min<size_t>(std::max(_max_depth, 1u), _levels.size());
+      size_t chosen;
+      do {
+        chosen = Random::below(Random::TREE, levels);
+      } while (_levels[chosen]->empty());
+      return (*_levels[chosen])[Random::below(Random::TREE, _levels[chosen]->size())];
+    }
+    case Placement::FANOUT: {
+      // Rejection sampling keeps a pick O(1), once all tries hit full directories the least full one is taken
+      Nodeptr best = nullptr;
+      for (int attempt = 0; attempt < 8; attempt++) {
+        auto directory = uniformDirectory();
+        if (directory->folders.size() + directory->files.size() < _placement.fanout) {
+          return directory;
+        }
+        if (best == nullptr || directory->folders.size() + directory->files.size() < best->folders.size() + best->files.size()) {
+          best = directory;
+        }
+      }
+      return best;
+    }
+    case Placement::LOCALITY: {
+      Nodeptr directory = nullptr;
+      if (!_recent.empty() && Random::unit(Random::TREE) < _placement.locality) {
+        directory = _recent[Random::below(Random::TREE, _recent.size())];
+        // Removed since it was chosen
+        if (directory != root && !all_directories.contains(directory)) {
+          directory = nullptr;
+        }
+      }
+      if (directory == nullptr) {
+        directory = uniformDirectory();
+      }
+      if (_recent.size() < _placement.recent) {
+        _recent.push_back(directory);
+      } else {
+        _recent[_recent_next] = directory;
+        _recent_next = (_recent_next + 1) % _recent.size();
+      }
+      return directory;
+    }
+    default: {
+      unsigned int depth = 0;
+      unsigned int rand_selected_depth = Random::below(Random::TREE, _max_depth);
+
+      Nodeptr current_root = root;
+
+      while (depth < rand_selected_depth) {
+        auto current_dir_count = current_root->folders.size();
+        if (current_dir_count == 0) {
+          break;
+        }
+        current_root = current_root->folders[Random::below(Random::TREE, current_dir_count)];
+        depth++;
+      }
+      return current_root;
     }
-    auto selected_dir_index = rand() % current_dir_count;
-    auto selected_dir = current_root->folders.begin();
-    std::advance(selected_dir, selected_dir_index);
-    current_root = selected_dir->second;
-    depth++;
   }
+}
 
-  return fmt::format("{}/{}", current_root->path(), new_file_name);
+std::string FileTree::newDirectoryPath() {
+  std::string new_dir_name = fmt::format("dir_{}", directory_id++);
+  return fmt::format("{}/{}", placementDirectory()->path(), new_dir_name);
 }
 
-FileTree::Nodeptr FileTree::randomFile() {
+void FileTree::rename(Nodeptr file, std::string path) {
+  if (file->type != Type::FILE) {
+    throw std::runtime_error("Only files can be renamed!");
+  }
+  path = strip(path, '/');
+  if (path.empty()) {
+    throw std::runtime_error("Path is empty!");
+  }
+  auto slash = path.rfind('/');
+  std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+  Nodeptr parent = slash == std::string::npos ? root : getNode(path.substr(0, slash));
+  if (parent->type != Type::DIRECTORY) {
+    throw std::runtime_error("Rename target isn't in a directory!");
+  }
+  if (parent->files.find(name) != parent->files.end() || parent->folders.find(name) != parent->folders.end()) {
+    throw std::runtime_error("Rename target already exists!");
+  }
+  file->parent->files.erase(file->name);
+  file->name = name;
+  file->parent = parent;
+  parent->files.insert(file);
+}
+
+std::string FileTree::newFilePath() {
+  std::string new_file_name = fmt::format("file_{}", file_id++);
+  return fmt::format("{}/{}", placementDirectory()->path(), new_file_name);
+}
+
+FileTree::Nodeptr FileTree::randomFile(Selection selection) {
   if (all_files.size() == 0) {
     throw std::runtime_error("No files in the tree!");
   }
-
-  auto random_file = all_files.begin();
-  std::advance(random_file, rand() % all_files.size());
-  return *random_file;
+  return pick(all_files, &SelectionWeights::files, selection);
 }
 
 FileTree::Nodeptr FileTree::randomDirectory() {
   if (all_directories.size() == 0) {
     throw std::runtime_error("No directories in the tree!");
   }
-  auto random_dir = all_directories.begin();
-  std::advance(random_dir, rand() % all_directories.size());
-  return *random_dir;
+  return all_directories[Random::below(Random::TREE, all_directories.size())];
 }
 
 void FileTree::leafDirWalk(std::function<void(Nodeptr)> f) {
@@ -272,7 +487,7 @@ void FileTree::leafDirWalk(std::function<void(Nodeptr)> f) {
       f(current);
     } else {
       for (const auto& child : current->folders) {
-        q.push(child.second);
+        q.push(child);
       }
     }
   }
@@ -285,7 +500,7 @@ void FileTree::bottomUpDirWalk(Nodeptr node, std::function<void(Nodeptr)> f) {
     }
   } else {
     for (const auto& child : node->folders) {
-      bottomUpDirWalk(child.second, f);
+      bottomUpDirWalk(child, f);
     }
     if (node != root) {
       f(node);
@@ -293,17 +508,467 @@ void FileTree::bottomUpDirWalk(Nodeptr node, std::function<void(Nodeptr)> f) {
   }
 }
 
-FileTree::Nodeptr FileTree::randomPunchableFile() {
+FileTree::Nodeptr FileTree::randomPunchableFile(Selection selection) {
   // return random item from punchable files list
   if (files_for_fallocate.empty()) {
     throw std::runtime_error("No punchable files in the tree!");
   }
-  // return files_for_fallocate.at(0);
-  auto random_file = files_for_fallocate.begin();
-  std::advance(random_file, rand() % files_for_fallocate.size());
-  return *random_file;
+  return pick(files_for_fallocate, &SelectionWeights::punchable, selection);
 }
 
 bool FileTree::hasPunchableFiles() { return files_for_fallocate.size() > 0; }
 
-void FileTree::removeFromPunchableFiles(Nodeptr file) { files_for_fallocate.erase(std::remove(files_for_fallocate.begin(), files_for_fallocate.end(), file), files_for_fallocate.end()); }
+void FileTree::removeFromPunchableFiles(Nodeptr file) {
+  if (!files_for_fallocate.contains(file)) {
+    return;
+  }
+  for (auto& weights : _weights) {
+    if (weights) {
+      eraseWeight(weights->punchable, file->set_positions[PUNCHABLE_SLOT]);
+    }
+  }
+  files_for_fallocate.erase(file);
+}
+
+FileTree::Selection FileTree::parseSelection(const std::string& name) {
+  auto lower = toLower(name);
+  if (lower == "uniform") {
+    return Selection::UNIFORM;
+  }
+  if (lower == "zipf") {
+    return Selection::ZIPF;
+  }
+  if (lower == "size") {
+    return Selection::SIZE;
+  }
+  if (lower == "extents") {
+    return Selection::EXTENTS;
+  }
+  if (lower == "lru") {
+    return Selection::LRU;
+  }
+  throw std::invalid_argument(fmt::format("Unknown file selection {}, use uniform, zipf, size, extents or lru", name));
+}
+
+const char* FileTree::selectionName(Selection selection) {
+  switch (selection) {
+    case Selection::ZIPF:
+      return "zipf";
+    case Selection::SIZE:
+      return "size";
+    case Selection::EXTENTS:
+      return "extents";
+    case Selection::LRU:
+      return "lru";
+    default:
+      return "uniform";
+  }
+}
+
+void FileTree::setZipfExponent(double exponent) {
+  if (exponent < 0) {
+    throw std::invalid_argument(fmt::format("Zipf exponent can't be negative, got {}", exponent));
+  }
+  if (weights(Selection::ZIPF) != nullptr) {
+    throw std::runtime_error("Zipf exponent has to be set before the zipf selection is enabled");
+  }
+  _zipf_exponent = exponent;
+}
+
+void FileTree::enableSelection(Selection selection) {
+  if (!weighted(selection) || weights(selection) != nullptr) {
+    return;
+  }
+  auto& slot = _weights[size_t(selection) - size_t(Selection::ZIPF)];
+  slot = std::make_unique<SelectionWeights>();
+  slot->files.reserve(all_files.size());
+  for (auto& file : all_files) {
+    slot->files.push_back(selectionWeight(selection, *file));
+  }
+  slot->punchable.reserve(files_for_fallocate.size());
+  for (auto& file : files_for_fallocate) {
+    slot->punchable.push_back(selectionWeight(selection, *file));
+  }
+}
+
+void FileTree::rebuildWeights() {
+  for (size_t i = 0; i < WEIGHTED_SELECTIONS; i++) {
+    if (_weights[i]) {
+      _weights[i].reset();
+      enableSelection(Selection(size_t(Selection::ZIPF) + i));
+    }
+  }
+}
+
+uint64_t FileTree::selectionWeight(Selection selection, const Node& file) const {
+  switch (selection) {
+    case Selection::ZIPF:
+      // Integer weights don't drift with updates, the scale keeps 1 / n^s distinguishable for millions of files
+      return std::max<uint64_t>(1, std::llround(double(uint64_t(1) << 32) / std::pow(double(file._sequence) + 1, _zipf_exponent)));
+    case Selection::SIZE:
+      // Unknown until the file is touched, a new file starts with the least weight
+      return std::max<uint64_t>(1, file._size_known ? file._size : 0);
+    case Selection::EXTENTS:
+      return std::max<uint64_t>(1, file._extents.size());
+    default:
+      return 1;
+  }
+}
+
+FileTree::Nodeptr FileTree::pick(const IndexedSet<Nodeptr>& set, FenwickTree SelectionWeights::*weights_of, Selection selection) {
+  if (selection == Selection::LRU) {
+    // Sampled, keeping the files ordered by their last touch would cost a list node per file
+    Nodeptr oldest = set[Random::below(Random::TREE, set.size())];
+    for (int sample = 1; sample < 8; sample++) {
+      const auto& file = set[Random::below(Random::TREE, set.size())];
+      if (file->_touched < oldest->_touched) {
+        oldest = file;
+      }
+    }
+    return oldest;
+  }
+  if (!weighted(selection)) {
+    return set[Random::below(Random::TREE, set.size())];
+  }
+  auto selection_weights = weights(selection);
+  if (selection_weights == nullptr) {
+    throw std::runtime_error(fmt::format("File selection {} isn't enabled", selectionName(selection)));
+  }
+  auto& tree = selection_weights->*weights_of;
+  return set[tree.find(Random::below(Random::TREE, tree.total()))];
+}
+
+void FileTree::eraseWeight(FenwickTree& weights, size_t position) {
+  weights.set(position, weights.weight(weights.size() - 1));
+  weights.pop_back();
+}
+
+void FileTree::touch(const Nodeptr& file) {
+  file->_touched = ++_touch_clock;
+  for (auto selection : {Selection::SIZE, Selection::EXTENTS}) {
+    if (auto selection_weights = weights(selection)) {
+      auto weight = selectionWeight(selection, *file);
+      if (all_files.contains(file)) {
+        selection_weights->files.set(file->set_positions[NODES_SLOT], weight);
+      }
+      if (files_for_fallocate.contains(file)) {
+        selection_weights->punchable.set(file->set_positions[PUNCHABLE_SLOT], weight);
+      }
+    }
+  }
+}
+
+std::string FileTree::Node::path(bool include_root) const {
+  // Sized first so the string is allocated once, then filled from the end
+  size_t length = 0;
+  const Node* top = this;
+  for (; top->parent != nullptr; top = top->parent.get()) {
+    length += top->name.size() + 1;
+  }
+  size_t prefix = include_root ? top->name.size() : 0;
+  std::string result(prefix + length, '/');
+  size_t position = result.size();
+  for (const Node* node = this; node->parent != nullptr; node = node->parent.get()) {
+    position -= node->name.size();
+    result.replace(position, node->name.size(), node->name);
+    position--;
+  }
+  if (include_root) {
+    result.replace(0, prefix, top->name);
+  }
+  return result;
+}
+
+std::vector<FileTree::Node::Range> FileTree::Node::takeRescanRanges() {
+  std::vector<Range> ranges;
+  if (!_extents_valid) {
+    ranges.emplace_back(0, UINT64_MAX);
+    _dirty_ranges.clear();
+    return ranges;
+  }
+  ranges.swap(_dirty_ranges);
+  // FIEMAP reports whole extents and the filesystem may split or merge extents around the changed range,
+  // so every range is extended over the cached extents it overlaps or touches.
+  for (auto& range : ranges) {
+    auto it = std::upper_bound(_extents.begin(), _extents.end(), range.first, [](uint64_t value, const extents& e) { return value < e.start; });
+    if (it != _extents.begin()) {
+      --it;
+    }
+    for (; it != _extents.end() && it->start <= range.second; ++it) {
+      uint64_t extent_end = it->start + it->length;
+      if (extent_end < range.first) {
+        continue;
+      }
+      range.first = std::min(range.first, it->start);
+      range.second = std::max(range.second, extent_end);
+    }
+  }
+  // Merge overlapping ranges so no part of the file is scanned twice
+  std::sort(ranges.begin(), ranges.end());
+  std::vector<Range> merged;
+  for (auto& range : ranges) {
+    if (!merged.empty() && range.first <= merged.back().second) {
+      merged.back().second = std::max(merged.back().second, range.second);
+    } else {
+      merged.push_back(range);
+    }
+  }
+  return merged;
+}
+
+void FileTree::Node::applyRescan(const std::vector<Range>& ranges, std::vector<std::vector<extents>>& rescanned) {
+  for (size_t i = 0; i < ranges.size(); i++) {
+    auto& fresh = rescanned.at(i);
+    // Fresh extents may reach out of the scanned range, everything cached in the covered span is stale
+    uint64_t cover_start = ranges[i].first, cover_end = ranges[i].second;
+    if (!fresh.empty()) {
+      cover_start = std::min(cover_start, fresh.front().start);
+      cover_end = std::max(cover_end, fresh.back().start + fresh.back().length);
+    }
+    auto stale = [&](const extents& extent) { return extent.start < cover_end && extent.start + extent.length > cover_start; };
+    auto kept = std::remove_if(_extents.begin(), _extents.end(), stale);
+    // Sized exactly, millions of cached vectors mustn't carry the slack of push_back growth
+    std::vector<extents> merged;
+    merged.reserve(std::distance(_extents.begin(), kept) + fresh.size());
+    std::merge(_extents.begin(), kept, fresh.begin(), fresh.end(), std::back_inserter(merged), [](const extents& a, const extents& b) { return a.start < b.start; });
+    _extents.swap(merged);
+  }
+  _extents_valid = true;
+}
+
+void FileTree::Node::setShadowSize(uint64_t size) {
+  _size = size;
+  _size_known = true;
+  if (_holes) {
+    _holes->truncate(size);
+  }
+}
+
+void FileTree::Node::shadowWrite(uint64_t start, uint64_t end) {
+  if (!_size_known) {
+    return;
+  }
+  if (_holes) {
+    _holes->assign(start, end, RangeSet::Kind::DATA);
+  }
+  _size = std::max(_size, end);
+}
+
+void FileTree::Node::shadowAllocate(uint64_t start, uint64_t end) {
+  if (!_size_known || start >= end) {
+    return;
+  }
+  if (_holes) {
+    _holes->replace(start, std::min(end, _size), RangeSet::Kind::PUNCHED, RangeSet::Kind::UNWRITTEN);
+  }
+  if (end > _size) {
+    if (!_holes) {
+      _holes = std::make_unique<RangeSet>();
+    }
+    _holes->assign(std::max(start, _size), end, RangeSet::Kind::UNWRITTEN);
+    _size = end;
+  }
+}
+
+void FileTree::Node::shadowPunch(uint64_t start, uint64_t end) {
+  if (!_size_known || start >= std::min(end, _size)) {
+    return;
+  }
+  if (!_holes) {
+    _holes = std::make_unique<RangeSet>();
+  }
+  _holes->assign(start, std::min(end, _size), RangeSet::Kind::PUNCHED);
+}
+
+void FileTree::Node::refreshExtents(bool sync) {
+  if (type != Type::FILE || !extentsDirty()) {
+    return;
+  }
+  auto ranges = takeRescanRanges();
+  auto file_path = path(true);
+  std::vector<std::vector<extents>> rescanned;
+  for (auto& range : ranges) {
+    rescanned.push_back(get_extents(file_path.c_str(), range.first, range.second - range.first, sync));
+  }
+  applyRescan(ranges, rescanned);
+}
+
+void FileTree::save(CheckpointWriter& out) const {
+  out.write<int32_t>(directory_id);
+  out.write<int32_t>(file_id);
+  out.write<int64_t>(total_extents_count);
+  // Directories are stored in the order of the set so random picks continue the same after load, a parent is referred
+  // to by its position in the list plus one (0 is the root) and may come after its children
+  std::unordered_map<const Node*, uint32_t> directory_index{{root.get(), 0}};
+  for (auto& directory : all_directories) {
+    directory_index.emplace(directory.get(), directory_index.size());
+  }
+  out.write<uint64_t>(all_directories.size());
+  for (auto& directory : all_directories) {
+    out.write<uint32_t>(directory_index.at(directory->parent.get()));
+    out.write(directory->name);
+  }
+  std::unordered_map<const Node*, uint32_t> file_index;
+  out.write<uint64_t>(all_files.size());
+  for (auto& file : all_files) {
+    out.write<uint32_t>(directory_index.at(file->parent.get()));
+    out.write(file->name);
+    out.write<int32_t>(file->fallocated_count);
+    out.write<uint32_t>(file->_sequence);
+    out.write<uint8_t>(file->_extents_valid);
+    // Pending dirty ranges aren't stored, such a file is simply rescanned completely after load
+    out.write<uint8_t>(!file->_dirty_ranges.empty());
+    out.write(file->_extents);
+    file_index.emplace(file.get(), file_index.size());
+  }
+  std::vector<uint32_t> punchable;
+  punchable.reserve(files_for_fallocate.size());
+  for (auto& file : files_for_fallocate) {
+    punchable.push_back(file_index.at(file.get()));
+  }
+  out.write(punchable);
+}
+
+void FileTree::load(CheckpointReader& in) {
+  if (!all_files.empty() || !all_directories.empty()) {
+    throw std::runtime_error("Checkpoint can be loaded only to an empty tree!");
+  }
+  int32_t next_directory_id = in.read<int32_t>();
+  int32_t next_file_id = in.read<int32_t>();
+  total_extents_count = in.read<int64_t>();
+  auto directory_count = in.read<uint64_t>();
+  std::vector<std::pair<uint32_t, std::string>> stored;
+  for (uint64_t i = 0; i < directory_count; i++) {
+    auto parent = in.read<uint32_t>();
+    stored.emplace_back(parent, in.readString());
+  }
+  std::vector<Nodeptr> directories(directory_count + 1);
+  directories[0] = root;
+  // Creates the missing parents first, a directory can't be its own ancestor
+  std::vector<uint32_t> chain;
+  for (uint32_t i = 1; i <= directory_count; i++) {
+    for (uint32_t index = i; directories[index] == nullptr; index = stored[index - 1].first) {
+      if (stored[index - 1].first > directory_count || chain.size() > directory_count) {
+        throw std::runtime_error("Checkpoint directory list is corrupted!");
+      }
+      chain.push_back(index);
+    }
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+      directories[*it] = addDirectory(directories[stored[*it - 1].first], stored[*it - 1].second);
+    }
+    chain.clear();
+  }
+  // Same order as when saved
+  all_directories.clear();
+  for (uint32_t i = 1; i <= directory_count; i++) {
+    all_directories.insert(directories[i]);
+  }
+  auto file_count = in.read<uint64_t>();
+  for (uint64_t i = 0; i < file_count; i++) {
+    auto parent = in.read<uint32_t>();
+    auto file = addFile(directories.at(parent), in.readString());
+    file->fallocated_count = in.read<int32_t>();
+    // Creation order survives, the extents estimator stratifies and zipf weighs by it
+    file->_sequence = in.read<uint32_t>();
+    _file_sequence = std::max(_file_sequence, file->_sequence + 1);
+    bool valid = in.read<uint8_t>();
+    bool dirty = in.read<uint8_t>();
+    file->setExtents(in.readVector<extents>());
+    file->_extents_valid = valid;
+    if (dirty) {
+      file->invalidateExtents();
+    }
+  }
+  files_for_fallocate.clear();
+  for (auto index : in.readVector<uint32_t>()) {
+    files_for_fallocate.insert(all_files.at(index));
+  }
+  directory_id = next_directory_id;
+  file_id = next_file_id;
+  // The punchable files came back in another order
+  rebuildWeights();
+}
+
+namespace {
+  std::runtime_error system_error(const std::string& message) { return std::runtime_error(fmt::format("{}: {}", message, strerror(errno))); }
+}  // namespace
+
+int FileTree::directoryFd(const Nodeptr& directory) {
+  trimDirectoryFds();
+  return cachedDirectoryFd(directory);
+}
+
+int FileTree::cachedDirectoryFd(const Nodeptr& directory) {
+  auto it = _directory_fds.find(directory.get());
+  if (it != _directory_fds.end()) {
+    _directory_lru.splice(_directory_lru.begin(), _directory_lru, it->second.second);
+    return it->second.first;
+  }
+  int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+  int fd = directory->parent == nullptr ? ::open(directory->name.c_str(), flags) : ::openat(cachedDirectoryFd(directory->parent), directory->name.c_str(), flags);
+  if (fd == -1) {
+    throw system_error(fmt::format("Cannot open directory {}", directory->path(true)));
+  }
+  _directory_lru.push_front(directory);
+  _directory_fds.emplace(directory.get(), std::make_pair(fd, _directory_lru.begin()));
+  return fd;
+}
+
+void FileTree::trimDirectoryFds() {
+  while (_directory_fds.size() > _directory_fd_limit) {
+    closeDirectoryFd(_directory_lru.back().get());
+  }
+}
+
+void FileTree::closeDirectoryFd(const Node* directory) {
+  auto it = _directory_fds.find(directory);
+  if (it == _directory_fds.end()) {
+    return;
+  }
+  ::close(it->second.first);
+  _directory_lru.erase(it->second.second);
+  _directory_fds.erase(it);
+}
+
+std::uintmax_t FileTree::fileSize(const Nodeptr& file) {
+  if (file->shadowKnown()) {
+    return file->_size;
+  }
+  struct stat file_stat;
+  if (fstatat(parentFd(file), file->name.c_str(), &file_stat, 0) != 0) {
+    throw system_error(fmt::format("Cannot stat {}", file->path(true)));
+  }
+  file->setShadowSize(file_stat.st_size);
+  return file_stat.st_size;
+}
+
+bool FileTree::exists(const Nodeptr& node, const char* suffix) {
+  struct stat node_stat;
+  return fstatat(parentFd(node), (node->name + suffix).c_str(), &node_stat, AT_SYMLINK_NOFOLLOW) == 0;
+}
+
+void FileTree::createDirectory(const Nodeptr& directory) {
+  if (mkdirat(parentFd(directory), directory->name.c_str(), 0777) != 0 && errno != EEXIST) {
+    throw system_error(fmt::format("Cannot create directory {}", directory->path(true)));
+  }
+}
+
+bool FileTree::unlink(const Nodeptr& node, const char* suffix) {
+  int flags = node->type == Type::DIRECTORY && *suffix == '\0' ? AT_REMOVEDIR : 0;
+  if (unlinkat(parentFd(node), (node->name + suffix).c_str(), flags) != 0) {
+    if (errno == ENOENT) {
+      return false;
+    }
+    throw system_error(fmt::format("Cannot remove {}{}", node->path(true), suffix));
+  }
+  return true;
+}
+
+void FileTree::renameFrom(const Nodeptr& old_parent, const std::string& old_name, const Nodeptr& file, const char* suffix) {
+  // Trimming first, the first descriptor mustn't be closed while resolving the second one
+  int from = directoryFd(old_parent);
+  int to = cachedDirectoryFd(file->parent);
+  if (renameat(from, (old_name + suffix).c_str(), to, (file->name + suffix).c_str()) != 0) {
+    throw system_error(fmt::format("Cannot rename {}/{}{} to {}{}", old_parent->path(true), old_name, suffix, file->path(true), suffix));
+  }
+}
@@ -0,0 +1,189 @@
+#include <fcntl.h>
+#include <filestorm/freespace_map.h>
+#include <filestorm/utils/logger.h>
+#include <fmt/format.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__linux__)
+#  include <linux/fs.h>
+#  include <linux/fsmap.h>
+#endif
+
+namespace {
+#if defined(__linux__)
+  constexpr long XFS_MAGIC = 0x58465342;
+  constexpr long EXT4_MAGIC = 0xEF53;
+
+  // First version of the XFS geometry, declared here so xfsprogs headers aren't needed. Its layout never changes.
+  struct xfs_fsop_geom_v1 {
+    uint32_t blocksize;
+    uint32_t rtextsize;
+    uint32_t agblocks;
+    uint32_t agcount;
+    uint32_t logblocks;
+    uint32_t sectsize;
+    uint32_t inodesize;
+    uint32_t imaxpct;
+    uint64_t datablocks;
+    uint64_t rtblocks;
+    uint64_t rtextents;
+    uint64_t logstart;
+    unsigned char uuid[16];
+    uint32_t sunit;
+    uint32_t swidth;
+    int32_t version;
+    uint32_t flags;
+    uint32_t logsectsize;
+    uint32_t rtsectsize;
+    uint32_t dirblocksize;
+  };
+#  define XFS_IOC_FSGEOMETRY_V1 _IOR('X', 100, struct xfs_fsop_geom_v1)
+
+  // Number of records fetched by one GETFSMAP call
+  constexpr unsigned int FSMAP_RECORDS = 1024;
+
+  // Group size in bytes, 0 when the filesystem has no groups we know of
+  uint64_t group_size(int fd, const struct statfs& fs) {
+    if (fs.f_type == XFS_MAGIC) {
+      struct xfs_fsop_geom_v1 geometry;
+      if (ioctl(fd, XFS_IOC_FSGEOMETRY_V1, &geometry) == 0) {
+        return uint64_t(geometry.agblocks) * geometry.blocksize;
+      }
+      logger.debug("XFS geometry isn't available: {}", strerror(errno));
+    } else if (fs.f_type == EXT4_MAGIC) {
+      // One block of the block bitmap covers a group, true unless mkfs was given -g or bigalloc
+      return uint64_t(fs.f_bsize) * 8 * fs.f_bsize;
+    }
+    return 0;
+  }
+#endif
+}  // namespace
+
+FreeSpaceMap::FreeSpaceMap(uint64_t block_size, uint64_t group_size, uint64_t chunk_size) : _block_size(std::max<uint64_t>(block_size, 1)), _group_size(group_size), _chunk_size(chunk_size) {}
+
+void FreeSpaceMap::addFreeExtent(uint64_t offset, uint64_t length) {
+  while (length > 0) {
+    uint64_t group = _group_size == 0 ? 0 : offset / _group_size;
+    uint64_t part = _group_size == 0 ? length : std::min(length, (group + 1) * _group_size - offset);
+    if (group >= _groups.size()) {
+      _groups.resize(group + 1);
+    }
+    auto& stats = _groups[group];
+    stats.free_bytes += part;
+    stats.free_extents++;
+    stats.largest_extent = std::max(stats.largest_extent, part);
+    if (part < _chunk_size) {
+      stats.small_bytes += part;
+    }
+    uint64_t blocks = std::max<uint64_t>(part / _block_size, 1);
+    int bucket = std::min(63 - __builtin_clzll(blocks), BUCKETS - 1);
+    _histogram[bucket].extents++;
+    _histogram[bucket].blocks += blocks;
+    offset += part;
+    length -= part;
+  }
+}
+
+FreeSpaceMap::Group FreeSpaceMap::total() const {
+  Group total;
+  for (auto& group : _groups) {
+    total.free_bytes += group.free_bytes;
+    total.free_extents += group.free_extents;
+    total.largest_extent = std::max(total.largest_extent, group.largest_extent);
+    total.small_bytes += group.small_bytes;
+  }
+  return total;
+}
+
+nlohmann::json FreeSpaceMap::toJson() const {
+  nlohmann::json json;
+  auto totals = total();
+  json["block_size"] = _block_size;
+  json["group_size"] = _group_size;
+  json["chunk_size"] = _chunk_size;
+  json["free_bytes"] = totals.free_bytes;
+  json["free_extents"] = totals.free_extents;
+  json["largest_extent"] = totals.largest_extent;
+  json["fragmentation_index"] = totals.fragmentation();
+  // Trailing empty buckets are left out
+  int used = BUCKETS;
+  while (used > 0 && _histogram[used - 1].extents == 0) {
+    used--;
+  }
+  json["histogram"] = nlohmann::json::array();
+  for (int i = 0; i < used; i++) {
+    json["histogram"].push_back({{"min_blocks", uint64_t(1) << i}, {"extents", _histogram[i].extents}, {"blocks", _histogram[i].blocks}});
+  }
+  json["groups"] = nlohmann::json::array();
+  for (auto& group : _groups) {
+    json["groups"].push_back({{"free_bytes", group.free_bytes}, {"free_extents", group.free_extents}, {"largest_extent", group.largest_extent}, {"fragmentation_index", group.fragmentation()}});
+  }
+  return json;
+}
+
+FreeSpaceMap FreeSpaceMap::collect(const std::string& path, uint64_t chunk_size) {
+#if defined(__linux__)
+  int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd == -1) {
+    throw std::runtime_error(fmt::format("Cannot open {} for the free space map: {}", path, strerror(errno)));
+  }
+  struct statfs fs;
+  if (fstatfs(fd, &fs) == -1) {
+    close(fd);
+    throw std::runtime_error(fmt::format("Cannot stat filesystem of {}: {}", path, strerror(errno)));
+  }
+  struct stat directory;
+  if (fstat(fd, &directory) == -1) {
+    close(fd);
+    throw std::runtime_error(fmt::format("Cannot stat {}: {}", path, strerror(errno)));
+  }
+  // GETFSMAP reports devices in the kernel's new_encode_dev() format, an XFS log or realtime device has another one
+  uint32_t data_device = (minor(directory.st_dev) & 0xff) | (major(directory.st_dev) << 8) | ((minor(directory.st_dev) & ~0xffu) << 12);
+  FreeSpaceMap map(fs.f_bsize, group_size(fd, fs), chunk_size);
+
+  std::vector<char> storage(fsmap_sizeof(FSMAP_RECORDS));
+  auto head = reinterpret_cast<struct fsmap_head*>(storage.data());
+  head->fmh_count = FSMAP_RECORDS;
+  // Low key stays zero, the high key covers everything
+  head->fmh_keys[1].fmr_device = UINT_MAX;
+  head->fmh_keys[1].fmr_flags = UINT_MAX;
+  head->fmh_keys[1].fmr_physical = ULLONG_MAX;
+  head->fmh_keys[1].fmr_owner = ULLONG_MAX;
+  head->fmh_keys[1].fmr_offset = ULLONG_MAX;
+  while (true) {
+    if (ioctl(fd, FS_IOC_GETFSMAP, head) == -1) {
+      int error = errno;
+      close(fd);
+      throw std::runtime_error(fmt::format("GETFSMAP on {} failed: {}{}", path, strerror(error), error == EPERM ? " (it needs CAP_SYS_ADMIN)" : ""));
+    }
+    if (head->fmh_entries == 0) {
+      break;
+    }
+    for (unsigned int i = 0; i < head->fmh_entries; i++) {
+      auto& record = head->fmh_recs[i];
+      if ((record.fmr_flags & FMR_OF_SPECIAL_OWNER) && record.fmr_owner == FMR_OWN_FREE && record.fmr_device == data_device) {
+        map.addFreeExtent(record.fmr_physical, record.fmr_length);
+      }
+    }
+    if (head->fmh_recs[head->fmh_entries - 1].fmr_flags & FMR_OF_LAST) {
+      break;
+    }
+    fsmap_advance(head);
+  }
+  close(fd);
+  return map;
+#else
+  (void)chunk_size;
+  throw std::runtime_error(fmt::format("GETFSMAP is supported only on Linux, can't map free space of {}", path));
+#endif
+}
@@ -0,0 +1,265 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <filestorm/filefrag.h>
+#include <filestorm/fs_profile.h>
+#include <filestorm/utils/logger.h>
+#include <fmt/format.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+  // Bytes listed by one getdents64 call
+  constexpr size_t DIRENT_BUFFER = 64 * 1024;
+
+  struct Dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+  };
+
+  struct Directory {
+    std::string path;
+    // Depth of the files inside
+    int depth;
+  };
+
+  // Directories waiting to be listed, the crawl is over when it is empty and no worker lists one (which may add more)
+  class CrawlQueue {
+  public:
+    void push(Directory directory) {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pending.push_back(std::move(directory));
+      }
+      _ready.notify_one();
+    }
+
+    bool pop(Directory& directory) {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _ready.wait(lock, [this] { return !_pending.empty() || _busy == 0; });
+      if (_pending.empty()) {
+        return false;
+      }
+      directory = std::move(_pending.front());
+      _pending.pop_front();
+      _busy++;
+      return true;
+    }
+
+    void done() {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (--_busy == 0 && _pending.empty()) {
+        _ready.notify_all();
+      }
+    }
+
+  private:
+    std::mutex _mutex;
+    std::condition_variable _ready;
+    std::deque<Directory> _pending;
+    size_t _busy = 0;
+  };
+
+  struct Entry {
+    mode_t mode;
+    uint64_t size;
+    dev_t device;
+  };
+
+  std::atomic<bool> statx_missing{false};
+
+  // Type, size and device of the entry without following links, false when it can't be stat'ed (e.g. it vanished)
+  bool stat_entry(int directory, const char* name, Entry& entry) {
+#if defined(STATX_TYPE)
+    if (!statx_missing.load(std::memory_order_relaxed)) {
+      struct statx st;
+      if (statx(directory, name, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, STATX_TYPE | STATX_SIZE, &st) == 0) {
+        entry = {st.stx_mode, st.stx_size, makedev(st.stx_dev_major, st.stx_dev_minor)};
+        return true;
+      }
+      if (errno != ENOSYS) {
+        return false;
+      }
+      statx_missing = true;
+    }
+#endif
+    struct stat st;
+    if (fstatat(directory, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+      return false;
+    }
+    entry = {st.st_mode, uint64_t(st.st_size), st.st_dev};
+    return true;
+  }
+
+  void list(const Directory& directory, dev_t device, const FsProfile::Options& options, std::vector<char>& buffer, FsProfile& profile, CrawlQueue& queue) {
+    int fd = open(directory.path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+      logger.warn("Cannot open directory {}: {}", directory.path, strerror(errno));
+      profile.addSkipped();
+      return;
+    }
+    uint64_t entries = 0;
+    while (true) {
+      long read = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+      if (read < 0) {
+        logger.warn("Cannot list directory {}: {}", directory.path, strerror(errno));
+        break;
+      }
+      if (read == 0) {
+        break;
+      }
+      for (long offset = 0; offset < read;) {
+        auto dirent = reinterpret_cast<const Dirent64*>(buffer.data() + offset);
+        offset += dirent->d_reclen;
+        const char* name = dirent->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+          continue;
+        }
+        entries++;
+        // Special files and links count only in the fan-out
+        if (dirent->d_type != DT_REG && dirent->d_type != DT_DIR && dirent->d_type != DT_UNKNOWN) {
+          continue;
+        }
+        Entry entry;
+        if (!stat_entry(fd, name, entry)) {
+          continue;
+        }
+        std::string path = fmt::format("{}/{}", directory.path, name);
+        if (S_ISDIR(entry.mode)) {
+          if (entry.device == device) {
+            queue.push({std::move(path), directory.depth + 1});
+          }
+        } else if (S_ISREG(entry.mode)) {
+          int64_t extents = -1;
+          if (options.extents && faccessat(fd, name, R_OK, 0) == 0) {
+            try {
+              extents = get_extents(path.c_str(), false).size();
+            } catch (const std::runtime_error& e) {
+              logger.debug("Cannot map extents of {}: {}", path, e.what());
+            }
+          }
+          profile.addFile(entry.size, directory.depth, extents);
+        }
+      }
+    }
+    close(fd);
+    profile.addDirectory(entries);
+  }
+
+  nlohmann::json histogram_json(const std::vector<uint64_t>& histogram, bool powers) {
+    auto last = std::find_if(histogram.rbegin(), histogram.rend(), [](uint64_t count) { return count > 0; });
+    nlohmann::json json = nlohmann::json::object();
+    for (size_t i = 0; i < size_t(histogram.rend() - last); i++) {
+      uint64_t bound = !powers ? i : i == 0 ? 0 : uint64_t(1) << (i - 1);
+      json[std::to_string(bound)] = histogram[i];
+    }
+    return json;
+  }
+}  // namespace
+
+FsProfile FsProfile::crawl(const std::string& root, const Options& options) {
+  struct stat st;
+  if (stat(root.c_str(), &st) != 0) {
+    throw std::runtime_error(fmt::format("Cannot profile {}: {}", root, strerror(errno)));
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    throw std::runtime_error(fmt::format("Cannot profile {}: not a directory", root));
+  }
+  unsigned workers = options.workers > 0 ? options.workers : std::max(1u, std::thread::hardware_concurrency());
+  CrawlQueue queue;
+  queue.push({root.size() > 1 && root.back() == '/' ? root.substr(0, root.size() - 1) : root, 0});
+
+  FsProfile profile;
+  std::mutex merge_mutex;
+  std::vector<std::thread> threads;
+  for (unsigned worker = 0; worker < workers; worker++) {
+    threads.emplace_back([&]() {
+      FsProfile local;
+      std::vector<char> buffer(DIRENT_BUFFER);
+      Directory directory;
+      while (queue.pop(directory)) {
+        list(directory, st.st_dev, options, buffer, local, queue);
+        queue.done();
+      }
+      std::lock_guard<std::mutex> lock(merge_mutex);
+      profile.merge(local);
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return profile;
+}
+
+int FsProfile::bucket(uint64_t value) { return value == 0 ? 0 : 64 - __builtin_clzll(value); }
+
+void FsProfile::addFile(uint64_t size, int depth, int64_t extents) {
+  _files++;
+  _bytes += size;
+  _sizes[bucket(size)]++;
+  if (extents >= 0) {
+    _extents[bucket(extents)]++;
+  }
+  if (size_t(depth) >= _depths.size()) {
+    _depths.resize(depth + 1, 0);
+  }
+  _depths[depth]++;
+}
+
+void FsProfile::addDirectory(uint64_t entries) {
+  _directories++;
+  _fanouts[bucket(entries)]++;
+}
+
+void FsProfile::merge(const FsProfile& other) {
+  _files += other._files;
+  _directories += other._directories;
+  _bytes += other._bytes;
+  _skipped += other._skipped;
+  for (int i = 0; i < BUCKETS; i++) {
+    _sizes[i] += other._sizes[i];
+    _extents[i] += other._extents[i];
+    _fanouts[i] += other._fanouts[i];
+  }
+  if (other._depths.size() > _depths.size()) {
+    _depths.resize(other._depths.size(), 0);
+  }
+  for (size_t i = 0; i < other._depths.size(); i++) {
+    _depths[i] += other._depths[i];
+  }
+}
+
+nlohmann::json FsProfile::toJson() const {
+  nlohmann::json json;
+  json["files"] = _files;
+  json["directories"] = _directories;
+  json["bytes"] = _bytes;
+  json["skipped"] = _skipped;
+  // Empty histograms are left out, an aging target can't compare against them
+  if (_files > 0) {
+    json["file_size"] = histogram_json(_sizes, true);
+    json["depth"] = histogram_json(_depths, false);
+  }
+  if (std::accumulate(_extents.begin(), _extents.end(), uint64_t(0)) > 0) {
+    json["extents_per_file"] = histogram_json(_extents, true);
+  }
+  if (_directories > 0) {
+    json["fanout"] = histogram_json(_fanouts, true);
+  }
+  return json;
+}
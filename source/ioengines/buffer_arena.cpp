@@ -0,0 +1,116 @@
+#include <filestorm/ioengines/buffer_arena.h>
+#include <filestorm/utils.h>
+#include <filestorm/utils/logger.h>
+#include <fmt/format.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+  size_t round_up(size_t value, size_t multiple) { return (value + multiple - 1) / multiple * multiple; }
+
+  // Anonymous mapping of size bytes starting at a multiple of alignment, nullptr when it fails
+  char* map_aligned(size_t size, size_t alignment) {
+    void* mapped = mmap(nullptr, size + alignment, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+      return nullptr;
+    }
+    auto start = reinterpret_cast<uintptr_t>(mapped);
+    auto aligned = round_up(start, alignment);
+    if (aligned > start) {
+      munmap(mapped, aligned - start);
+    }
+    munmap(reinterpret_cast<void*>(aligned + size), start + alignment - aligned);
+    return reinterpret_cast<char*>(aligned);
+  }
+}  // namespace
+
+BufferArena::HugePages BufferArena::parseHugePages(const std::string& value) {
+  auto lower = toLower(value);
+  if (lower == "none" || lower == "false") {
+    return HugePages::NONE;
+  }
+  if (lower == "thp") {
+    return HugePages::THP;
+  }
+  if (lower == "hugetlb") {
+    return HugePages::HUGETLB;
+  }
+  throw std::invalid_argument(fmt::format("Unknown hugepages mode {}, use none, thp or hugetlb", value));
+}
+
+const char* BufferArena::hugePagesName(HugePages huge_pages) {
+  switch (huge_pages) {
+    case HugePages::THP:
+      return "thp";
+    case HugePages::HUGETLB:
+      return "hugetlb";
+    default:
+      return "none";
+  }
+}
+
+BufferArena::BufferArena(size_t slot_size, size_t slots, HugePages huge_pages, bool lock)
+    : _slot_size(slot_size), _slots(std::max<size_t>(1, slots)), _stride(round_up(slot_size, ALIGNMENT)), _huge_pages(huge_pages) {
+  if (slot_size == 0) {
+    throw std::invalid_argument("Buffer arena slot size has to be positive");
+  }
+  size_t size = _stride * _slots;
+#if defined(__linux__)
+  if (_huge_pages == HugePages::HUGETLB) {
+    _mapped = round_up(size, HUGE_PAGE_SIZE);
+    void* mapped = mmap(nullptr, _mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mapped == MAP_FAILED) {
+      logger.warn("Hugetlb pages for {} kB of I/O buffers aren't available ({}), using transparent hugepages", _mapped / 1024, strerror(errno));
+      _huge_pages = HugePages::THP;
+    } else {
+      _memory = static_cast<char*>(mapped);
+    }
+  }
+  if (_huge_pages == HugePages::THP) {
+    _mapped = round_up(size, HUGE_PAGE_SIZE);
+    _memory = map_aligned(_mapped, HUGE_PAGE_SIZE);
+    if (_memory != nullptr && madvise(_memory, _mapped, MADV_HUGEPAGE) == -1) {
+      logger.warn("Transparent hugepages for I/O buffers aren't available: {}", strerror(errno));
+      _huge_pages = HugePages::NONE;
+    }
+  }
+#else
+  _huge_pages = HugePages::NONE;
+#endif
+  if (_memory == nullptr) {
+    _mapped = size;
+    _memory = map_aligned(_mapped, ALIGNMENT);
+  }
+  if (_memory == nullptr) {
+    throw std::runtime_error(fmt::format("Cannot map {} kB of I/O buffers: {}", size / 1024, strerror(errno)));
+  }
+  if (lock) {
+    if (mlock(_memory, _mapped) == 0) {
+      _locked = true;
+    } else {
+      logger.warn("Cannot lock {} kB of I/O buffers in memory: {}", _mapped / 1024, strerror(errno));
+    }
+  }
+  fill();
+}
+
+BufferArena::~BufferArena() {
+  if (_locked) {
+    munlock(_memory, _mapped);
+  }
+  munmap(_memory, _mapped);
+}
+
+void BufferArena::fill() { generate_random_chunk(_memory, _stride * _slots); }
+
+void BufferArena::refresh() {
+  _generation++;
+  for (size_t offset = 0; offset + sizeof(_generation) <= _stride * _slots; offset += ALIGNMENT) {
+    uint64_t stamp = _generation ^ offset;
+    memcpy(_memory + offset, &stamp, sizeof(stamp));
+  }
+}
@@ -0,0 +1,127 @@
+#include <fcntl.h>
+#include <filestorm/ioengines/engine_file.h>
+#include <filestorm/utils/logger.h>
+#include <fmt/format.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+EngineFile::EngineFile(IOEngine& engine, std::string path, int flags, bool direct_io) : _engine(engine), _path(std::move(path)) {
+  _fd = _engine.open_file(_path.c_str(), flags, direct_io);
+}
+
+EngineFile::EngineFile(IOEngine& engine, FileTree& tree, const FileTree::Nodeptr& file, int flags, bool direct_io) : _engine(engine), _file(file) {
+  try {
+    _fd = _engine.open_file(file->name.c_str(), flags, direct_io, tree.parentFd(file));
+  } catch (const std::runtime_error& e) {
+    throw std::runtime_error(fmt::format("{} in {}", e.what(), file->parent->path(true)));
+  }
+  if (flags & O_TRUNC) {
+    file->setShadowSize(0);
+  } else if (!file->shadowKnown()) {
+    struct stat file_stat;
+    if (fstat(_fd, &file_stat) == 0) {
+      file->setShadowSize(file_stat.st_size);
+    }
+  }
+}
+
+std::string EngineFile::path() const { return _file ? _file->path(true) : _path; }
+
+void EngineFile::failed(const std::string& message) {
+  // Nobody knows how much of the operation made it to the file
+  if (_file) {
+    _file->forgetShadow();
+  }
+  throw std::runtime_error(fmt::format("{}: {}", message, strerror(errno)));
+}
+
+namespace {
+  void check_block_size(const BufferArena& buffers, uint64_t block_size) {
+    if (block_size > buffers.slotSize()) {
+      throw std::invalid_argument(fmt::format("Block size {} is larger than the I/O buffers ({})", block_size, buffers.slotSize()));
+    }
+  }
+}  // namespace
+
+uint64_t EngineFile::write(BufferArena& buffers, uint64_t block_size, uint64_t offset, uint64_t end) {
+  check_block_size(buffers, block_size);
+  uint64_t start = offset;
+  uint64_t submitted = 0;
+  uint64_t written = 0;
+  for (; offset < end; offset += block_size) {
+    ssize_t bytes = _engine.write(_fd, buffers.next(), block_size, offset);
+    if (bytes == -1) {
+      failed(fmt::format("Error writing to file {}", path()));
+    }
+    submitted += block_size;
+    written += bytes;
+  }
+  written += _engine.complete();
+  if (written != submitted) {
+    logger.warn("Written bytes {} != submitted bytes {} in {}", written, submitted, path());
+    if (_file) {
+      _file->forgetShadow();
+    }
+  } else if (_file) {
+    _file->shadowWrite(start, offset);
+  }
+  return written;
+}
+
+uint64_t EngineFile::read(BufferArena& buffers, uint64_t block_size, uint64_t offset, uint64_t end) {
+  check_block_size(buffers, block_size);
+  uint64_t read = 0;
+  for (; offset < end; offset += block_size) {
+    ssize_t bytes = _engine.read(_fd, buffers.next(), block_size, offset);
+    if (bytes == -1) {
+      throw std::runtime_error(fmt::format("Error reading from file {}: {}", path(), strerror(errno)));
+    }
+    read += bytes;
+  }
+  return read + _engine.complete();
+}
+
+void EngineFile::fallocate(uint64_t offset, uint64_t length, bool punch_hole) {
+#if defined(__linux__)
+  if (::fallocate(_fd, punch_hole ? FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE : 0, offset, length) == -1) {
+    failed(fmt::format("Fallocate of {} failed", path()));
+  }
+#elif __APPLE__
+  // Without fallocate the file is only extended, sparse
+  if (punch_hole) {
+    throw std::runtime_error("FALLOCATE not supported on this system");
+  }
+  if (ftruncate(_fd, offset + length) == -1) {
+    failed(fmt::format("ftruncate of {} failed", path()));
+  }
+#else
+  throw std::runtime_error("FALLOCATE not supported on this system");
+#endif
+  if (_file) {
+    if (punch_hole) {
+      _file->shadowPunch(offset, offset + length);
+    } else {
+      _file->shadowAllocate(offset, offset + length);
+    }
+  }
+}
+
+void EngineFile::truncate(uint64_t size) {
+  if (ftruncate(_fd, size) == -1) {
+    failed(fmt::format("ftruncate of {} failed", path()));
+  }
+  if (_file) {
+    _file->shadowTruncate(size);
+  }
+}
+
+void EngineFile::close() {
+  if (_fd != -1) {
+    _engine.close(_fd);
+    _fd = -1;
+  }
+}
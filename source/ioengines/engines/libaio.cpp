@@ -20,6 +20,7 @@ public:
   ssize_t write(int fd, void* buf, size_t count, off_t offset) override;
   ssize_t read(int fd, void* buf, size_t count, off_t offset) override;
   ssize_t complete();
+  unsigned queue_depth() const override { return iodepth_; }
 
   std::string setup(int argc, char** argv) override;
 
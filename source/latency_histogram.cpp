@@ -0,0 +1,71 @@
+#include <filestorm/latency_histogram.h>
+
+#include <algorithm>
+#include <cmath>
+
+static constexpr uint64_t SUB_BUCKETS = uint64_t(1) << LatencyHistogram::SUB_BUCKET_BITS;
+
+LatencyHistogram::LatencyHistogram() : _counts((64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS, 0) {}
+
+size_t LatencyHistogram::index(uint64_t value) {
+  if (value < SUB_BUCKETS) {
+    return value;
+  }
+  int shift = 63 - __builtin_clzll(value) - SUB_BUCKET_BITS;
+  return (shift + 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+}
+
+uint64_t LatencyHistogram::upperBound(size_t index) {
+  if (index < SUB_BUCKETS) {
+    return index;
+  }
+  int shift = index / SUB_BUCKETS - 1;
+  uint64_t lower = (SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+  return lower + ((uint64_t(1) << shift) - 1);
+}
+
+void LatencyHistogram::record(uint64_t nanoseconds) {
+  _counts[index(nanoseconds)]++;
+  _count++;
+  _sum += nanoseconds;
+  _min = std::min(_min, nanoseconds);
+  _max = std::max(_max, nanoseconds);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+  for (size_t i = 0; i < _counts.size(); i++) {
+    _counts[i] += other._counts[i];
+  }
+  _count += other._count;
+  _sum += other._sum;
+  _min = std::min(_min, other._min);
+  _max = std::max(_max, other._max);
+}
+
+uint64_t LatencyHistogram::percentile(double percent) const {
+  if (_count == 0) {
+    return 0;
+  }
+  uint64_t rank = std::max<uint64_t>(1, uint64_t(std::ceil(std::clamp(percent, 0.0, 100.0) / 100.0 * _count)));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < _counts.size(); i++) {
+    seen += _counts[i];
+    if (seen >= rank) {
+      return std::clamp(upperBound(i), _min, _max);
+    }
+  }
+  return _max;
+}
+
+nlohmann::json LatencyHistogram::toJson() const {
+  nlohmann::json json;
+  json["count"] = _count;
+  json["mean"] = mean();
+  json["min"] = min();
+  json["p50"] = percentile(50);
+  json["p90"] = percentile(90);
+  json["p99"] = percentile(99);
+  json["p99.9"] = percentile(99.9);
+  json["max"] = _max;
+  return json;
+}
@@ -0,0 +1,194 @@
+#include <filestorm/op_log.h>
+#include <fmt/format.h>
+
+#include <cstring>
+#include <stdexcept>
+
+OpLogWriter::OpLogWriter(const std::string& path, uint64_t block_size) : _path(path), _out(path, std::ios::binary | std::ios::trunc) {
+  if (!_out.is_open()) {
+    throw std::runtime_error(fmt::format("Cannot create operation log {}", path));
+  }
+  _out.write(OP_LOG_MAGIC, sizeof(OP_LOG_MAGIC) - 1);
+  writeVarint(OP_LOG_VERSION);
+  writeVarint(block_size);
+}
+
+uint32_t OpLogWriter::id(const FileTree::Nodeptr& node) const {
+  if (node->parent == nullptr) {
+    return 0;
+  }
+  auto it = _ids.find(node.get());
+  if (it == _ids.end()) {
+    throw std::runtime_error(fmt::format("Operation log: {} wasn't created during the recorded run", node->path(true)));
+  }
+  return it->second;
+}
+
+void OpLogWriter::create(OpRecord::Type type, const FileTree::Nodeptr& node) {
+  uint32_t parent = id(node->parent);
+  _ids[node.get()] = _next_id;
+  _out.put(type);
+  writeVarint(_next_id++);
+  writeVarint(parent);
+  writeVarint(node->name.size());
+  _out.write(node->name.data(), node->name.size());
+  _count++;
+  _in_iteration = true;
+}
+
+void OpLogWriter::createDirectory(const FileTree::Nodeptr& directory) { create(OpRecord::CREATE_DIR, directory); }
+
+void OpLogWriter::createFile(OpRecord::Type type, const FileTree::Nodeptr& file, uint64_t size) {
+  create(type, file);
+  writeVarint(size);
+}
+
+void OpLogWriter::fileOperation(OpRecord::Type type, const FileTree::Nodeptr& file, uint64_t offset, uint64_t length) {
+  _out.put(type);
+  writeVarint(id(file));
+  switch (type) {
+    case OpRecord::ALTER_SMALLER_FALLOCATE:
+    case OpRecord::ALTER_BIGGER_FALLOCATE:
+    case OpRecord::ALTER_BIGGER_WRITE:
+    case OpRecord::XATTR_SET:
+    case OpRecord::XATTR_REMOVE:
+    case OpRecord::CHMOD:
+    case OpRecord::UTIMES:
+      writeVarint(offset);
+      break;
+    default:
+      break;
+  }
+  writeVarint(length);
+  _count++;
+  _in_iteration = true;
+}
+
+void OpLogWriter::deleteFile(const FileTree::Nodeptr& file) {
+  _out.put(OpRecord::DELETE_FILE);
+  writeVarint(id(file));
+  _ids.erase(file.get());
+  _count++;
+  _in_iteration = true;
+}
+
+void OpLogWriter::renameFile(const FileTree::Nodeptr& file) {
+  _out.put(OpRecord::RENAME);
+  writeVarint(id(file));
+  writeVarint(id(file->parent));
+  writeVarint(file->name.size());
+  _out.write(file->name.data(), file->name.size());
+  _count++;
+  _in_iteration = true;
+}
+
+void OpLogWriter::endIteration() {
+  _out.put(OpRecord::END);
+  _count++;
+  _in_iteration = false;
+  _out.flush();
+  if (!_out) {
+    throw std::runtime_error(fmt::format("Writing operation log {} failed", _path));
+  }
+}
+
+void OpLogWriter::finish() {
+  if (_in_iteration) {
+    endIteration();
+  }
+}
+
+void OpLogWriter::writeVarint(uint64_t value) {
+  while (value >= 0x80) {
+    _out.put(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  _out.put(static_cast<char>(value));
+}
+
+OpLogReader::OpLogReader(const std::string& path) : _path(path), _in(path, std::ios::binary) {
+  if (!_in.is_open()) {
+    throw std::runtime_error(fmt::format("Cannot open operation log {}", path));
+  }
+  char magic[sizeof(OP_LOG_MAGIC) - 1];
+  _in.read(magic, sizeof(magic));
+  if (!_in || std::memcmp(magic, OP_LOG_MAGIC, sizeof(magic)) != 0) {
+    throw std::runtime_error(fmt::format("{} is not a filestorm operation log", path));
+  }
+  auto version = readVarint();
+  if (version != OP_LOG_VERSION) {
+    throw std::runtime_error(fmt::format("Operation log {} has unsupported version {}, expected {}", path, version, OP_LOG_VERSION));
+  }
+  _block_size = readVarint();
+  if (!_in) {
+    throw std::runtime_error(fmt::format("Operation log {} is truncated", path));
+  }
+}
+
+bool OpLogReader::next(OpRecord& record) {
+  int type = _in.get();
+  if (type == std::char_traits<char>::eof()) {
+    return false;
+  }
+  if (type > OpRecord::END) {
+    throw std::runtime_error(fmt::format("Operation log {}: unknown operation {}", _path, type));
+  }
+  record = OpRecord();
+  record.type = static_cast<OpRecord::Type>(type);
+  switch (record.type) {
+    case OpRecord::END:
+      break;
+    case OpRecord::CREATE_DIR:
+    case OpRecord::CREATE_FILE:
+    case OpRecord::CREATE_FILE_FALLOCATE:
+    case OpRecord::RENAME: {
+      record.id = readVarint();
+      record.parent = readVarint();
+      record.name.resize(readVarint());
+      _in.read(record.name.data(), record.name.size());
+      if (record.type != OpRecord::CREATE_DIR && record.type != OpRecord::RENAME) {
+        record.length = readVarint();
+      }
+      break;
+    }
+    case OpRecord::DELETE_FILE:
+      record.id = readVarint();
+      break;
+    case OpRecord::ALTER_SMALLER_FALLOCATE:
+    case OpRecord::ALTER_BIGGER_FALLOCATE:
+    case OpRecord::ALTER_BIGGER_WRITE:
+    case OpRecord::XATTR_SET:
+    case OpRecord::XATTR_REMOVE:
+    case OpRecord::CHMOD:
+    case OpRecord::UTIMES:
+      record.id = readVarint();
+      record.offset = readVarint();
+      record.length = readVarint();
+      break;
+    default:
+      record.id = readVarint();
+      record.length = readVarint();
+      break;
+  }
+  if (!_in) {
+    // The recording run was killed while writing this record
+    _truncated = true;
+    return false;
+  }
+  return true;
+}
+
+uint64_t OpLogReader::readVarint() {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int byte = _in.get();
+    if (byte == std::char_traits<char>::eof()) {
+      return 0;  // next() finds the stream failed
+    }
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return value;
+    }
+  }
+  throw std::runtime_error(fmt::format("Operation log {}: invalid number", _path));
+}
@@ -0,0 +1,100 @@
+#include <fcntl.h>
+#include <filestorm/ioengines/engine_file.h>
+#include <filestorm/latency_histogram.h>
+#include <filestorm/performance_probe.h>
+#include <filestorm/utils.h>
+#include <filestorm/utils/random.h>
+#include <fmt/format.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+  double seconds_since(std::chrono::steady_clock::time_point start) { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); }
+
+  nlohmann::json rate(uint64_t bytes, double seconds) {
+    nlohmann::json json;
+    json["bytes"] = bytes;
+    json["seconds"] = seconds;
+    json["mb_per_second"] = seconds > 0 ? bytes / 1024.0 / 1024.0 / seconds : 0;
+    return json;
+  }
+}  // namespace
+
+nlohmann::json PerformanceProbe::run(IOEngine& ioengine, BufferArena& buffers, FileTree& tree, uint64_t available, uint32_t seed) const {
+  auto generator = Random::derive(Random::PROBE, seed);
+  std::vector<FileTree::Nodeptr> files;
+  for (int i = 0; i < _config.files && !tree.all_files.empty(); i++) {
+    files.push_back(tree.all_files[generator.below(tree.all_files.size())]);
+  }
+  auto drop_cache = [&](const EngineFile& file) {
+    if (!_config.direct_io) {
+      posix_fadvise(file.fd(), 0, 0, POSIX_FADV_DONTNEED);
+    }
+  };
+  nlohmann::json result;
+  result["files"] = files.size();
+
+  uint64_t read_bytes = 0;
+  double read_seconds = 0;
+  std::vector<std::pair<std::string, uint64_t>> readable;
+  for (auto& file : files) {
+    auto path = file->path(true);
+    uint64_t size = file->size();
+    EngineFile data(ioengine, path, O_RDONLY, _config.direct_io);
+    drop_cache(data);
+    auto start = std::chrono::steady_clock::now();
+    data.read(buffers, _config.block_size, 0, size);
+    read_seconds += seconds_since(start);
+    read_bytes += size;
+    if (size >= _config.read_size) {
+      readable.emplace_back(path, size);
+    }
+  }
+  result["sequential_read"] = rate(read_bytes, read_seconds);
+
+  LatencyHistogram latency;
+  if (!readable.empty()) {
+    std::vector<std::unique_ptr<EngineFile>> data;
+    for (auto& [path, size] : readable) {
+      data.push_back(std::make_unique<EngineFile>(ioengine, path, O_RDONLY, _config.direct_io));
+      drop_cache(*data.back());
+    }
+    for (int i = 0; i < _config.random_reads; i++) {
+      size_t file = generator.below(readable.size());
+      uint64_t offset = generator.below(readable[file].second / _config.read_size) * _config.read_size;
+      auto start = std::chrono::steady_clock::now();
+      data[file]->read(buffers, _config.read_size, offset, offset + _config.read_size);
+      latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+  }
+  double random_seconds = latency.count() * latency.mean() / 1e9;
+  result["random_read"] = {{"size", _config.read_size}, {"iops", random_seconds > 0 ? latency.count() / random_seconds : 0}, {"latency", latency.toJson()}};
+
+  if (available < _config.create_size) {
+    result["create"] = nullptr;
+    return result;
+  }
+  auto path = (std::filesystem::path(tree.getRoot()->path(true)) / "filestorm_probe").string();
+  buffers.refresh();
+  double create_seconds;
+  try {
+    EngineFile data(ioengine, path, O_WRONLY | O_CREAT | O_TRUNC, _config.direct_io);
+    auto start = std::chrono::steady_clock::now();
+    data.write(buffers, _config.block_size, 0, _config.create_size);
+    // Without the sync only the page cache would be measured
+    data.sync();
+    create_seconds = seconds_since(start);
+  } catch (...) {
+    std::filesystem::remove(path);
+    throw;
+  }
+  std::filesystem::remove(path);
+  result["create"] = rate(_config.create_size, create_seconds);
+  return result;
+}
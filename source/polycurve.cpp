@@ -174,3 +174,18 @@ float PolyCurve::slopeAngle() const {
   double angle_deg = angle_rad * 180.0 / M_PI;
   return static_cast<float>(angle_deg);
 }
+
+// Store the points, the subsampling buffer and the maximum which scales the x-axis.
+void PolyCurve::save(CheckpointWriter& out) const {
+  out.write(y_points);
+  out.write(y_subsample_buffer);
+  out.write(maximum_value);
+}
+
+// Load the points stored by save(), the coefficients are recomputed on the next fit.
+void PolyCurve::load(CheckpointReader& in) {
+  y_points = in.readVector<float>();
+  y_subsample_buffer = in.readVector<float>();
+  maximum_value = in.read<float>();
+  fitted = false;
+}
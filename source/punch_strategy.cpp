@@ -0,0 +1,231 @@
+#include <filestorm/punch_strategy.h>
+#include <filestorm/utils.h>
+#include <filestorm/utils/random.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+  using Range = FileTree::Node::Range;
+
+  class HalvingStrategy : public PunchStrategy {
+  public:
+    explicit HalvingStrategy(Config config) : PunchStrategy(Kind::HALVING, std::move(config)) {}
+
+    std::optional<Range> pick(FileTree::Node& file, uint64_t size) override {
+      if (!file.isPunchable(_config.block_size, size)) {
+        return std::nullopt;
+      }
+      auto [start, end] = file.getHoleAddress(_config.block_size, true, size);
+      return Range(start, end);
+    }
+
+    bool punchable(FileTree::Node& file, uint64_t size) const override { return file.isPunchable(_config.block_size, size); }
+  };
+
+  class RandomStrategy : public PunchStrategy {
+  public:
+    explicit RandomStrategy(Config config) : PunchStrategy(Kind::RANDOM, std::move(config)) {}
+
+    std::optional<Range> pick(FileTree::Node& file, uint64_t size) override {
+      for (int attempt = 0; attempt < ATTEMPTS; attempt++) {
+        if (auto hole = fit(file, size, randomOffset(size), randomLength())) {
+          return hole;
+        }
+      }
+      return std::nullopt;
+    }
+  };
+
+  class StrideStrategy : public PunchStrategy {
+  public:
+    explicit StrideStrategy(Config config) : PunchStrategy(Kind::STRIDE, std::move(config)) {}
+
+    std::optional<Range> pick(FileTree::Node& file, uint64_t size) override {
+      if (!punchable(file, size)) {
+        return std::nullopt;
+      }
+      // Slot k starts at k * stride, slot 0 would punch the first block
+      uint64_t slots = (size - 2 * _config.block_size) / _config.stride;
+      for (int attempt = 0; attempt < ATTEMPTS; attempt++) {
+        uint64_t slot = 1 + Random::below(Random::PUNCH, slots);
+        // Holes of neighbouring slots stay apart by at least a block
+        if (auto hole = fit(file, size, slot * _config.stride, std::min(randomLength(), _config.stride - _config.block_size))) {
+          return hole;
+        }
+      }
+      return std::nullopt;
+    }
+
+    bool punchable(FileTree::Node& file, uint64_t size) const override { return size >= _config.stride + 2 * _config.block_size && PunchStrategy::punchable(file, size); }
+  };
+
+  class ClusteredStrategy : public PunchStrategy {
+  public:
+    explicit ClusteredStrategy(Config config) : PunchStrategy(Kind::CLUSTERED, std::move(config)) {}
+
+    std::optional<Range> pick(FileTree::Node& file, uint64_t size) override {
+      auto holes = file.holes();
+      for (int attempt = 0; attempt < ATTEMPTS; attempt++) {
+        uint64_t start;
+        if (holes != nullptr && !holes->empty()) {
+          // A gap of one to four blocks after a random hole, the holes don't merge
+          auto& near = holes->ranges()[Random::below(Random::PUNCH, holes->size())];
+          start = near.end + (1 + Random::below(Random::PUNCH, 4)) * _config.block_size;
+        } else {
+          start = randomOffset(size);
+        }
+        if (auto hole = fit(file, size, start, randomLength())) {
+          return hole;
+        }
+      }
+      // All clusters are full, start a new one
+      return fit(file, size, randomOffset(size), randomLength());
+    }
+  };
+
+  class DistributionStrategy : public PunchStrategy {
+  public:
+    explicit DistributionStrategy(Config config) : PunchStrategy(Kind::DISTRIBUTION, std::move(config)), _shares(_config.lengths.normalized()) {
+      if (!_config.lengths.defined()) {
+        throw std::invalid_argument("Distribution punch strategy needs a hole size distribution");
+      }
+    }
+
+    std::optional<Range> pick(FileTree::Node& file, uint64_t size) override {
+      for (int attempt = 0; attempt < ATTEMPTS; attempt++) {
+        if (auto hole = fit(file, size, randomOffset(size), randomLength())) {
+          return hole;
+        }
+      }
+      return std::nullopt;
+    }
+
+  private:
+    uint64_t randomLength() const {
+      double draw = Random::unit(Random::PUNCH);
+      size_t bucket = 0;
+      while (bucket + 1 < _shares.size() && draw > _shares[bucket]) {
+        draw -= _shares[bucket++];
+      }
+      auto [from, to] = _config.lengths.range(bucket);
+      auto length = static_cast<uint64_t>(from + (to - from) * Random::unit(Random::PUNCH));
+      return std::max(_config.block_size, length / _config.block_size * _config.block_size);
+    }
+
+    std::vector<double> _shares;
+  };
+}  // namespace
+
+PunchStrategy::Kind PunchStrategy::parseKind(const std::string& name) {
+  auto lower = toLower(name);
+  if (lower == "halving") {
+    return Kind::HALVING;
+  }
+  if (lower == "random") {
+    return Kind::RANDOM;
+  }
+  if (lower == "stride") {
+    return Kind::STRIDE;
+  }
+  if (lower == "clustered") {
+    return Kind::CLUSTERED;
+  }
+  if (lower == "distribution") {
+    return Kind::DISTRIBUTION;
+  }
+  throw std::invalid_argument(fmt::format("Unknown punch strategy {}, use halving, random, stride, clustered or distribution", name));
+}
+
+const char* PunchStrategy::kindName(Kind kind) {
+  switch (kind) {
+    case Kind::RANDOM:
+      return "random";
+    case Kind::STRIDE:
+      return "stride";
+    case Kind::CLUSTERED:
+      return "clustered";
+    case Kind::DISTRIBUTION:
+      return "distribution";
+    default:
+      return "halving";
+  }
+}
+
+std::unique_ptr<PunchStrategy> PunchStrategy::create(Kind kind, Config config) {
+  switch (kind) {
+    case Kind::RANDOM:
+      return std::make_unique<RandomStrategy>(std::move(config));
+    case Kind::STRIDE:
+      return std::make_unique<StrideStrategy>(std::move(config));
+    case Kind::CLUSTERED:
+      return std::make_unique<ClusteredStrategy>(std::move(config));
+    case Kind::DISTRIBUTION:
+      return std::make_unique<DistributionStrategy>(std::move(config));
+    default:
+      return std::make_unique<HalvingStrategy>(std::move(config));
+  }
+}
+
+PunchStrategy::PunchStrategy(Kind kind, Config config) : _kind(kind), _config(std::move(config)) {
+  if (_config.block_size == 0) {
+    throw std::invalid_argument("Punch strategy block size has to be positive");
+  }
+  auto blocks = [&](uint64_t bytes) { return std::max(_config.block_size, (bytes + _config.block_size - 1) / _config.block_size * _config.block_size); };
+  _config.min_length = blocks(_config.min_length);
+  _config.max_length = blocks(_config.max_length);
+  if (_config.min_length > _config.max_length) {
+    throw std::invalid_argument(fmt::format("Minimal hole length {} is above the maximal {}", _config.min_length, _config.max_length));
+  }
+  _config.stride = _config.stride / _config.block_size * _config.block_size;
+  if (_kind == Kind::STRIDE && _config.stride < 2 * _config.block_size) {
+    throw std::invalid_argument(fmt::format("Punch stride has to be at least two blocks ({}), got {}", 2 * _config.block_size, _config.stride));
+  }
+}
+
+bool PunchStrategy::punchable(FileTree::Node& file, uint64_t size) const {
+  if (size < 3 * _config.block_size) {
+    return false;
+  }
+  // The holes may leave gaps shorter than a block, pick() finds out
+  auto holes = file.holes();
+  uint64_t covered = holes == nullptr ? 0 : holes->bytes(RangeSet::Kind::PUNCHED) + holes->bytes(RangeSet::Kind::UNWRITTEN);
+  return covered + 3 * _config.block_size <= size;
+}
+
+std::optional<FileTree::Node::Range> PunchStrategy::fit(const FileTree::Node& file, uint64_t size, uint64_t start, uint64_t length) const {
+  uint64_t block = _config.block_size;
+  start = std::max(block, (start + block - 1) / block * block);
+  // The last block (and the partial one) is kept
+  uint64_t limit = size / block * block;
+  limit = limit >= block ? limit - block : 0;
+  if (start >= limit) {
+    return std::nullopt;
+  }
+  uint64_t end = std::min(limit, start + length);
+  if (auto holes = file.holes()) {
+    if (holes->containing(start) != nullptr) {
+      return std::nullopt;
+    }
+    end = std::min(end, holes->nextStart(start));
+  }
+  end = end / block * block;
+  if (end <= start) {
+    return std::nullopt;
+  }
+  return Range(start, end);
+}
+
+uint64_t PunchStrategy::randomOffset(uint64_t size) const {
+  uint64_t blocks = size / _config.block_size;
+  if (blocks < 3) {
+    return _config.block_size;
+  }
+  return (1 + Random::below(Random::PUNCH, blocks - 2)) * _config.block_size;
+}
+
+uint64_t PunchStrategy::randomLength() const {
+  uint64_t lengths = (_config.max_length - _config.min_length) / _config.block_size + 1;
+  return _config.min_length + Random::below(Random::PUNCH, lengths) * _config.block_size;
+}
@@ -6,5 +6,7 @@ std::vector<BasicResult> BasicResult::results;
 
 std::map<std::string, std::string> Result::metas;
 
+std::map<std::string, std::vector<nlohmann::json>> Result::series;
+
 std::map<Result::Action, std::chrono::nanoseconds> Result::total_duration_per_action;
 std::map<Result::Action, DataSize<DataUnit::B>> Result::total_size_per_action;
\ No newline at end of file
@@ -1,29 +1,68 @@
 #include <fcntl.h>  // for open
 #include <filestorm/actions/actions.h>
+#include <filestorm/checkpoint.h>
 #include <filestorm/data_sizes.h>
+#include <filestorm/extents_accountant.h>
+#include <filestorm/extents_estimator.h>
 #include <filestorm/filetree.h>
+#include <filestorm/freespace_map.h>
+#include <filestorm/ioengines/engine_file.h>
+#include <filestorm/op_log.h>
+#include <filestorm/performance_probe.h>
+#include <filestorm/punch_strategy.h>
 #include <filestorm/result.h>
 #include <filestorm/scenarios/aging.h>
+#include <filestorm/scenarios/aging_profile.h>
 #include <filestorm/scenarios/register.h>
 #include <filestorm/utils.h>
 #include <filestorm/utils/fs.h>
 #include <filestorm/utils/logger.h>
+#include <filestorm/utils/metadata.h>
+#include <filestorm/utils/random.h>
 #include <fmt/format.h>
 #include <sys/stat.h>  // for S_IRWXU
 #include <sys/types.h>
 #include <unistd.h>  // for close
 
 #include <algorithm>
+#include <array>
+#include <cctype>
 #include <cerrno>  // for errno
 #include <chrono>
+#include <cmath>
 #include <cstring>  // for strerror
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <iostream>  // for std::cerr
 #include <memory>    // for std::unique_ptr
+#include <optional>
 #include <random>
 #include <string_view>
+#include <unordered_set>
+
+// Granularity in which the free space model assumes the filesystem allocates space
+static constexpr int64_t FREE_SPACE_ALLOCATION_UNIT = 4096;
+// ALTER_METADATA_XATTR works with user.filestorm.0 to user.filestorm.<count - 1>
+static constexpr int XATTR_NAME_COUNT = 8;
+static constexpr const char* XATTR_PREFIX = "user.filestorm.";
+
+// Whether the entry name is one filestorm creates (file_<n>, dir_<n>, their hardlinks and the probe file), only such
+// entries are removed when a checkpoint is reconciled with its directory
+static bool filestorm_name(const std::string& name) {
+  std::string_view rest = name;
+  std::string_view suffix = HARDLINK_SUFFIX;
+  if (rest.size() > suffix.size() && rest.substr(rest.size() - suffix.size()) == suffix) {
+    rest.remove_suffix(suffix.size());
+  }
+  for (std::string_view prefix : {"file_", "dir_"}) {
+    if (rest.size() > prefix.size() && rest.substr(0, prefix.size()) == prefix) {
+      rest.remove_prefix(prefix.size());
+      return std::all_of(rest.begin(), rest.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); });
+    }
+  }
+  return name == "filestorm_probe";
+}
 
 AgingScenario::AgingScenario() {
   _name = "aging";
@@ -34,7 +73,13 @@ AgingScenario::AgingScenario() {
   addParameter(Parameter("m", "fs-capacity", "Max overall filesystem size", "full"));  // TODO: add support for this
   addParameter(Parameter("S", "maxfsize", "Max file size", "1G"));
   addParameter(Parameter("s", "minfsize", "Min file size", "10KB"));
-  addParameter(Parameter("p", "sdist", "File size probabilistic distribution", "uniform"));
+  addParameter(Parameter("p", "sdist", "File size probabilistic distribution: uniform, normal, lognormal, pareto, bimodal or empirical", "uniform"));
+  addParameter(Parameter("", "sdist-median", "Median file size of the lognormal distribution", "64K"));
+  addParameter(Parameter("", "sdist-sigma", "Shape of the lognormal distribution and of both modes of the bimodal one", "1.0"));
+  addParameter(Parameter("", "sdist-alpha", "Shape of the pareto distribution (its scale is the min file size), the smaller the heavier the tail", "1.2"));
+  addParameter(Parameter("", "sdist-modes", "Comma separated medians of the two modes of the bimodal distribution", "4K,16M"));
+  addParameter(Parameter("", "sdist-mode-weight", "Share (0-1) of the files in the first mode of the bimodal distribution", "0.8"));
+  addParameter(Parameter("", "sdist-profile", "Profile (filestorm profile), aging target or {\"<lower bound>\": weight, ...} JSON with the file size histogram of the empirical distribution, the --target file if not set", ""));
   addParameter(Parameter("i", "iterations", "Iterations to run", "-1"));
   addParameter(Parameter("b", "blocksize", "RW operations blocksize", "64k"));
   addParameter(Parameter("y", "sync", "Sync after each write", "false"));
@@ -45,15 +90,56 @@ AgingScenario::AgingScenario() {
                          "process. downside of this is that you wont get the data performance for the for the initial aging stage.",
                          "false"));
 
+  addParameter(Parameter("", "profile", "JSON aging profile with states, transitions and probability expressions replacing the built-in state machine", ""));
+  addParameter(Parameter("", "checkpoint", "Periodically save the aging state to this file so an interrupted run can be continued with --resume", ""));
+  addParameter(Parameter("", "checkpoint-interval", "Time between two checkpoints", "10m"));
+  addParameter(Parameter("", "resume", "Continue the run saved in this checkpoint, the directory has to be the one the checkpoint was written for", ""));
+  addParameter(Parameter("", "base", "Start a new run from the aged state saved in this checkpoint (e.g. on a clone of an aged image), time, iterations and results start from zero", ""));
+  addParameter(Parameter("", "record", "Record every resolved operation to this binary log which the aging-replay scenario reproduces exactly", ""));
+  addParameter(Parameter("", "target", "JSON with target distributions (file sizes, extents per file, depth, fanout) and utilization, the run is steered towards them and stops once they are reached", ""));
+  addParameter(Parameter("", "target-interval", "Number of iterations between two comparisons of the tree with the target", "100"));
+  addParameter(Parameter("", "probe-interval", "Number of iterations between two performance probes (a fixed reference workload on the aged files), 0 disables the periodic probes", "0"));
+  addParameter(Parameter("", "probe-utilization", "Comma separated utilizations (0-1) at which a performance probe runs once when the filesystem fills up past them", ""));
+  addParameter(Parameter("", "probe-files", "Number of aged files a performance probe reads sequentially and randomly", "8"));
+  addParameter(Parameter("", "probe-random-reads", "Number of 4k random reads of a performance probe", "1000"));
+  addParameter(Parameter("", "probe-create-size", "Size of the file a performance probe creates and syncs", "64M"));
+  addParameter(Parameter("", "probe-direct", "Use direct IO for the performance probes, otherwise the page cache of the probed files is dropped", "true"));
+  addParameter(Parameter("", "buffers-hugepages", "Back the preallocated I/O buffers with 2 MB hugepages: none, thp (transparent hugepages) or hugetlb (reserved hugepages, falls back to thp)", "none"));
+  addParameter(Parameter("", "buffers-lock", "Lock the preallocated I/O buffers in memory (mlock)", "false"));
   addParameter(Parameter("", "create-dir", "If testing directory doesn't exists try to create it.", "false"));
+  addParameter(Parameter("", "placement", "Choice of the directory new files and directories go into: walk (random depth, then random subdirectories), uniform, depth (random level, then uniform in it), fanout or locality", "walk"));
+  addParameter(Parameter("", "placement-fanout", "Entries a directory gets at most with the fanout placement", "1000"));
+  addParameter(Parameter("", "placement-locality", "Probability (0-1) that the locality placement reuses one of the recently chosen directories", "0.8"));
+  addParameter(Parameter("", "placement-recent", "Number of recently chosen directories the locality placement reuses", "16"));
+  addParameter(Parameter("", "select", "Comma separated <state>=<policy> choosing the files of the alter_* and delete_file states (alter and delete stand for all of them): uniform, zipf, size, extents or lru", ""));
+  addParameter(Parameter("", "select-zipf", "Exponent of the zipf file selection", "1.0"));
+  addParameter(Parameter("", "directory-fds", "Number of directory descriptors kept open, files are opened, stat'ed and removed relative to their directory instead of by the full path", "256"));
+  addParameter(Parameter("", "metadata-xattr-size", "Max size of an extended attribute value set by ALTER_METADATA_XATTR", "2K"));
   addParameter(Parameter("", "features-punch-hole", "Whether to do hole punching in file", "true"));
+  addParameter(Parameter("", "punch-strategy", "Placement of punched holes: halving (middle half, then halves of the tail), random, stride, clustered or distribution", "halving"));
+  addParameter(Parameter("", "punch-min", "Minimal length of a hole punched by the random, stride and clustered strategies", "4K"));
+  addParameter(Parameter("", "punch-max", "Maximal length of a hole punched by the random, stride and clustered strategies", "1M"));
+  addParameter(Parameter("", "punch-stride", "Distance of the holes punched by the stride strategy", "1M"));
+  addParameter(Parameter("", "punch-distribution", "JSON with the distribution of hole lengths for the distribution strategy, {\"<lower bound>\": weight, ...}", ""));
   addParameter(Parameter("", "features-log-probs", "Should log probabilities", "false"));
   addParameter(Parameter("", "cleanup", "Should clean up files/folders after the test is done", "true"));
   addParameter(Parameter("", "rapid-aging-threshold", "Set threshold for rapid aging testing 90-0.where 90 is rapid aging essentially turned off and at 0  will probably never ends.", "37"));
   addParameter(Parameter("", "rapid-aging-min-time", "Minimal time to run rapid aging in seconds", "5s"));
   addParameter(Parameter("", "rapid-aging-max-time", "Maximal time to run rapid aging in seconds", ""));
   addParameter(Parameter("", "rapid-aging-max-extents", "Maximal number of extents for rapid aging", ""));
-
+  addParameter(Parameter("", "extents-workers", "Number of background threads scanning file extents. With 0 the files are scanned synchronously at the end of each iteration.", "1"));
+  addParameter(Parameter("", "extents-fiemap-sync", "Flush dirty data of a file before mapping its extents during the run (FIEMAP_FLAG_SYNC). It makes the counts exact but the writeback competes with the measured I/O, the final count always flushes.", "false"));
+  addParameter(Parameter("", "extents-interval", "Number of iterations between extent accounting batches. Files touched multiple times in between are scanned only once.", "1"));
+  addParameter(Parameter("", "extents-mode", "How the total extents count is obtained: exact (every touched file is scanned) or sample (estimated from a stratified random sample of files)", "exact"));
+  addParameter(Parameter("", "extents-sample-size", "Number of files scanned for one estimate in sample extents mode", "1000"));
+  addParameter(Parameter("", "extents-sample-strata", "Number of strata (slices of files ordered by creation) the sample is drawn from", "16"));
+  addParameter(Parameter("", "extents-sample-interval", "Number of iterations between estimates in sample extents mode", "100"));
+
+  addParameter(Parameter("", "freespace-reconcile-ops", "Free space is tracked from the issued operations and checked against the filesystem (statvfs) after this many operations", "100"));
+  addParameter(Parameter("", "freespace-reconcile-interval", "Maximal time in milliseconds between two free space checks against the filesystem", "1000"));
+  addParameter(Parameter("", "freespace-map-interval", "Number of iterations between two maps of the free space extents (GETFSMAP on XFS and ext4, needs root) stored in the results, 0 disables them", "0"));
+  addParameter(Parameter("", "freespace-map-chunk", "Free extents shorter than this count as fragmented free space in the free space fragmentation index", "1M"));
+  addParameter(Parameter("", "age-until-free-frag", "Stop once the free space fragmentation index (0-1) reaches this value, checked every freespace-map-interval iterations (100 if not set)", ""));
   addParameter(Parameter("", "settings-safe-margin",
                          "When new file is computed and there is not enough space the new file size is shrinked to available size but in some cases the fs has a file size overhead because of "
                          "metadata writes which are hard to predict and compute. So the safe margin is introduced which specify what is a minimal space amount that should be left available",
@@ -73,15 +159,217 @@ void AgingScenario::run(std::unique_ptr<IOEngine>& ioengine) {
   if (!std::filesystem::is_directory(getParameter("directory").get_string())) {
     throw std::runtime_error(fmt::format("{} is not a directory!", getParameter("directory").get_string()));
   }
-  if (!std::filesystem::is_empty(getParameter("directory").get_string())) {
+  bool resume = getParameter("resume").is_set();
+  bool base = getParameter("base").is_set();
+  if (resume && base) {
+    throw std::runtime_error("Options --resume and --base can't be used together");
+  }
+  // lost+found of a freshly created ext filesystem doesn't count
+  auto entries = std::filesystem::directory_iterator(getParameter("directory").get_string());
+  bool empty = std::all_of(std::filesystem::begin(entries), std::filesystem::end(entries), [](const auto& entry) { return entry.path().filename() == "lost+found"; });
+  if (!resume && !base && !empty) {
     logger.warn("Directory {} is not empty!", getParameter("directory").get_string());
     throw std::runtime_error(fmt::format("{} is not empty!", getParameter("directory").get_string()));
   }
+  // Reloaded around the overrides of profile states
+  load_settings();
   rapid_aging = getParameter("rapid-aging").get_bool();
 
   logger.debug("Rapid aging is: {}", rapid_aging);
 
   FileTree tree(getParameter("directory").get_string(), getParameter("depth").get_int());
+  tree.setDirectoryFdLimit(std::max(1, getParameter("directory-fds").get_int()));
+  FileTree::PlacementConfig placement;
+  placement.policy = FileTree::parsePlacement(getParameter("placement").get_string());
+  placement.fanout = std::max(1, getParameter("placement-fanout").get_int());
+  placement.locality = getParameter("placement-locality").get_double();
+  placement.recent = std::max(1, getParameter("placement-recent").get_int());
+  tree.setPlacement(placement);
+  // File selection of the alter and delete states, see FileTree::Selection
+  std::array<FileTree::Selection, END + 1> selection;
+  selection.fill(FileTree::Selection::UNIFORM);
+  tree.setZipfExponent(getParameter("select-zipf").get_double());
+  if (getParameter("select").is_set()) {
+    auto actions = profileActions();
+    for (auto& entry : split(getParameter("select").get_string(), ',')) {
+      auto assignment = split(strip(entry), '=');
+      if (assignment.size() != 2) {
+        throw std::runtime_error(fmt::format("Invalid file selection {}, expected <state>=<policy>", entry));
+      }
+      auto state = toLower(strip(assignment[0]));
+      auto policy = FileTree::parseSelection(strip(assignment[1]));
+      bool matched = false;
+      for (auto& [name, action] : actions) {
+        bool selects_files = name.rfind("alter_", 0) == 0 || name == "delete_file";
+        if (selects_files && (name == state || (state == "alter" && name.rfind("alter_", 0) == 0) || (state == "delete" && name == "delete_file"))) {
+          selection[action] = policy;
+          matched = true;
+        }
+      }
+      if (!matched) {
+        throw std::runtime_error(fmt::format("File selection for unknown state {}, use alter, delete or one of the alter_* states", assignment[0]));
+      }
+      tree.enableSelection(policy);
+    }
+  }
+  PolyCurve extents_curve(1, 10);
+  int iteration = 0;
+  auto elapsed = std::chrono::high_resolution_clock::duration::zero();
+  // State the psm continues from and files changed after the checkpoint was written, only used when resuming
+  int resume_state = -1;
+  std::vector<FileTree::Nodeptr> resume_changed;
+  // Extents count the loop works with, exact total or the last estimate
+  ExtentsEstimator::Estimate extents_estimate;
+  if (resume || base) {
+    // A base checkpoint only provides the aged tree, the run itself (clock, seed, state machine, results) starts fresh
+    std::string checkpoint = getParameter(resume ? "resume" : "base").get_string();
+    CheckpointReader in(checkpoint);
+    auto directory = in.readString();
+    if (resume && directory != std::filesystem::weakly_canonical(getParameter("directory").get_string()).string()) {
+      throw std::runtime_error(fmt::format("Checkpoint {} was written for directory {}", checkpoint, directory));
+    }
+    auto profile_path = in.readString();
+    if (resume && profile_path != getParameter("profile").get_string()) {
+      throw std::runtime_error(fmt::format("Checkpoint {} was written with profile \"{}\"", checkpoint, profile_path));
+    }
+    auto saved_iteration = in.read<int32_t>();
+    auto saved_elapsed = std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(std::chrono::nanoseconds(in.read<int64_t>()));
+    auto saved_at = in.read<int64_t>();
+    auto random_state = in.read<Random::State>();
+    auto saved_state = in.read<int32_t>();
+    bool saved_rapid_aging = in.read<uint8_t>();
+    extents_estimate = in.read<ExtentsEstimator::Estimate>();
+    tree.load(in);
+    if (resume) {
+      iteration = saved_iteration;
+      elapsed = saved_elapsed;
+      Random::restore(random_state);
+      resume_state = saved_state;
+      rapid_aging = saved_rapid_aging;
+      extents_curve.load(in);
+      Result::loadState(in);
+    }
+    resume_changed = reconcile_checkpoint(tree, saved_at, {checkpoint, getParameter("checkpoint").get_string()}, base);
+    if (resume) {
+      logger.info("Resuming from iteration {} after {} s with {} files, {} changed since the checkpoint", iteration, std::chrono::duration_cast<std::chrono::seconds>(elapsed).count(),
+                  tree.all_files.size(), resume_changed.size());
+    } else {
+      logger.info("Starting from the aged state of {} with {} files and {} directories", checkpoint, tree.all_files.size(), tree.all_directories.size());
+    }
+  }
+  free_space = std::make_unique<fs_utils::FreeSpaceModel>(getParameter("directory").get_string(), std::max(0, getParameter("freespace-reconcile-ops").get_int()),
+                                                          std::chrono::milliseconds(std::max(0, getParameter("freespace-reconcile-interval").get_int())));
+  xattrs = fs_utils::xattrs_supported(getParameter("directory").get_string());
+  if (!xattrs) {
+    logger.info("Filesystem of {} doesn't support user extended attributes, ALTER_METADATA_XATTR is disabled", getParameter("directory").get_string());
+  }
+  uint64_t xattr_max_size = std::max<uint64_t>(1, DataSize<DataUnit::B>::fromString(getParameter("metadata-xattr-size").get_string()).get_value());
+  // Space the filesystem allocates for the given number of bytes, used to keep the free space model close to reality
+  auto allocated = [](uint64_t bytes) -> int64_t { return (bytes + FREE_SPACE_ALLOCATION_UNIT - 1) / FREE_SPACE_ALLOCATION_UNIT * FREE_SPACE_ALLOCATION_UNIT; };
+  ExtentsAccountant accountant(tree, getParameter("extents-workers").get_int(), getParameter("extents-fiemap-sync").get_bool());
+  for (auto& file : resume_changed) {
+    accountant.markDirty(file);
+  }
+  int extents_interval = std::max(1, getParameter("extents-interval").get_int());
+  bool sample_extents = getParameter("extents-mode").get_string() == "sample";
+  if (!sample_extents && getParameter("extents-mode").get_string() != "exact") {
+    throw std::runtime_error(fmt::format("Unknown extents mode {}, use exact or sample", getParameter("extents-mode").get_string()));
+  }
+  ExtentsEstimator estimator(std::max(1, getParameter("extents-sample-size").get_int()), std::max(1, getParameter("extents-sample-strata").get_int()), getParameter("extents-fiemap-sync").get_bool());
+  int sample_interval = std::max(1, getParameter("extents-sample-interval").get_int());
+  std::unique_ptr<OpLogWriter> recorder;
+  if (getParameter("record").is_set()) {
+    if (resume || base) {
+      // Nodes from the checkpoint have no ids in the log, the replay couldn't refer to them
+      throw std::runtime_error("Only runs starting from an empty directory can be recorded");
+    }
+    recorder = std::make_unique<OpLogWriter>(getParameter("record").get_string(), get_block_size().get_value());
+  }
+  int freespace_map_interval = std::max(0, getParameter("freespace-map-interval").get_int());
+  uint64_t freespace_map_chunk = DataSize<DataUnit::B>::fromString(getParameter("freespace-map-chunk").get_string()).get_value();
+  double free_frag_target = -1;
+  if (getParameter("age-until-free-frag").is_set()) {
+    free_frag_target = getParameter("age-until-free-frag").get_double();
+    if (free_frag_target < 0 || free_frag_target > 1) {
+      throw std::runtime_error(fmt::format("Free space fragmentation index has to be between 0 and 1, got {}", free_frag_target));
+    }
+    if (freespace_map_interval == 0) {
+      freespace_map_interval = 100;
+    }
+  }
+  int probe_interval = std::max(0, getParameter("probe-interval").get_int());
+  std::vector<double> probe_utilizations;
+  if (getParameter("probe-utilization").is_set()) {
+    for (auto& value : split(getParameter("probe-utilization").get_string(), ',')) {
+      double utilization = std::stod(strip(value));
+      if (utilization <= 0 || utilization > 1) {
+        throw std::runtime_error(fmt::format("Probe utilization has to be between 0 and 1, got {}", utilization));
+      }
+      probe_utilizations.push_back(utilization);
+    }
+    std::sort(probe_utilizations.begin(), probe_utilizations.end());
+  }
+  PerformanceProbe::Config probe_config;
+  probe_config.files = std::max(1, getParameter("probe-files").get_int());
+  probe_config.random_reads = std::max(0, getParameter("probe-random-reads").get_int());
+  probe_config.block_size = get_block_size().get_value();
+  probe_config.create_size = DataSize<DataUnit::B>::fromString(getParameter("probe-create-size").get_string()).get_value();
+  probe_config.direct_io = getParameter("probe-direct").get_bool();
+  PerformanceProbe probe(probe_config);
+  PunchStrategy::Config punch_config;
+  punch_config.block_size = get_block_size().get_value();
+  punch_config.min_length = DataSize<DataUnit::B>::fromString(getParameter("punch-min").get_string()).get_value();
+  punch_config.max_length = DataSize<DataUnit::B>::fromString(getParameter("punch-max").get_string()).get_value();
+  punch_config.stride = DataSize<DataUnit::B>::fromString(getParameter("punch-stride").get_string()).get_value();
+  if (getParameter("punch-distribution").is_set()) {
+    std::ifstream lengths(getParameter("punch-distribution").get_string());
+    if (!lengths.is_open()) {
+      throw std::runtime_error(fmt::format("Cannot open hole length distribution {}", getParameter("punch-distribution").get_string()));
+    }
+    try {
+      punch_config.lengths = Distribution::fromJson(nlohmann::json::parse(lengths), true);
+    } catch (const nlohmann::json::exception& e) {
+      throw std::runtime_error(fmt::format("Invalid hole length distribution {}: {}", getParameter("punch-distribution").get_string(), e.what()));
+    }
+  }
+  auto punch = PunchStrategy::create(PunchStrategy::parseKind(getParameter("punch-strategy").get_string()), punch_config);
+  // Buffers of every data operation and the probes, allocated once so they don't add noise to the measured times
+  BufferArena buffers(std::max<uint64_t>(get_block_size().get_value(), probe_config.read_size), ioengine->queue_depth(), BufferArena::parseHugePages(getParameter("buffers-hugepages").get_string()),
+                      getParameter("buffers-lock").get_bool());
+  logger.debug("I/O buffers: {} slots of {} bytes, hugepages {}, locked {}", buffers.slots(), buffers.slotSize(), BufferArena::hugePagesName(buffers.hugePages()), buffers.locked());
+  // Set when the free space fragmentation or the target is reached
+  bool goal_reached = false;
+  int target_interval = std::max(1, getParameter("target-interval").get_int());
+  target.reset();
+  if (getParameter("target").is_set()) {
+    target = std::make_unique<AgingTarget>(AgingTarget::fromFile(getParameter("target").get_string()));
+    if (target->has(AgingTarget::EXTENTS_PER_FILE) && sample_extents) {
+      throw std::runtime_error("Extents per file target needs the exact extents mode");
+    }
+  }
+  SizeDistribution::Config size_config;
+  size_config.median = DataSize<DataUnit::B>::fromString(getParameter("sdist-median").get_string()).get_value();
+  size_config.sigma = getParameter("sdist-sigma").get_double();
+  size_config.alpha = getParameter("sdist-alpha").get_double();
+  auto modes = split(getParameter("sdist-modes").get_string(), ',');
+  if (modes.size() != 2) {
+    throw std::runtime_error(fmt::format("Bimodal distribution needs two modes, got {}", getParameter("sdist-modes").get_string()));
+  }
+  size_config.modes = {DataSize<DataUnit::B>::fromString(strip(modes[0])).get_value(), DataSize<DataUnit::B>::fromString(strip(modes[1])).get_value()};
+  size_config.mode_weight = getParameter("sdist-mode-weight").get_double();
+  auto size_kind = SizeDistribution::parseKind(getParameter("sdist").get_string());
+  if (size_kind == SizeDistribution::Kind::EMPIRICAL) {
+    if (!getParameter("sdist-profile").is_set() && !getParameter("target").is_set()) {
+      throw std::runtime_error("Empirical file size distribution needs --sdist-profile or --target");
+    }
+    size_config.histogram = SizeDistribution::loadHistogram(getParameter(getParameter("sdist-profile").is_set() ? "sdist-profile" : "target").get_string());
+  }
+  size_distribution = std::make_unique<SizeDistribution>(size_kind, size_config);
+  // Probabilities have to be steered again after each comparison with the target
+  bool steering_changed = false;
+  // Largest divergence from the target over the last comparisons, a flat line means the run doesn't get closer
+  PolyCurve divergence_curve(1);
+  bool divergence_stalled = false;
   std::map<std::string, Transition> transitions;
   transitions.emplace("S->CREATE", Transition(S, CREATE, "pC"));
   transitions.emplace("S->ALTER", Transition(S, ALTER, "pA"));
@@ -109,20 +397,44 @@ void AgingScenario::run(std::unique_ptr<IOEngine>& ioengine) {
   transitions.emplace("ALTER_BIGGER->ALTER_BIGGER_FALLOCATE", Transition(ALTER_BIGGER, ALTER_BIGGER_FALLOCATE, "pABF"));
   transitions.emplace("ALTER_BIGGER_WRITE->END", Transition(ALTER_BIGGER_WRITE, END, "p1"));
   transitions.emplace("ALTER_BIGGER_FALLOCATE->END", Transition(ALTER_BIGGER_FALLOCATE, END, "p1"));
-  transitions.emplace("ALTER_METADATA->END", Transition(ALTER_METADATA, END, "p1"));
+  transitions.emplace("ALTER_METADATA->ALTER_METADATA_XATTR", Transition(ALTER_METADATA, ALTER_METADATA_XATTR, "pAMX"));
+  transitions.emplace("ALTER_METADATA->ALTER_METADATA_RENAME", Transition(ALTER_METADATA, ALTER_METADATA_RENAME, "pAMR"));
+  transitions.emplace("ALTER_METADATA->ALTER_METADATA_LINK", Transition(ALTER_METADATA, ALTER_METADATA_LINK, "pAML"));
+  transitions.emplace("ALTER_METADATA->ALTER_METADATA_CHMOD", Transition(ALTER_METADATA, ALTER_METADATA_CHMOD, "pAMC"));
+  transitions.emplace("ALTER_METADATA->ALTER_METADATA_UTIMES", Transition(ALTER_METADATA, ALTER_METADATA_UTIMES, "pAMU"));
+  transitions.emplace("ALTER_METADATA_XATTR->END", Transition(ALTER_METADATA_XATTR, END, "p1"));
+  transitions.emplace("ALTER_METADATA_RENAME->END", Transition(ALTER_METADATA_RENAME, END, "p1"));
+  transitions.emplace("ALTER_METADATA_LINK->END", Transition(ALTER_METADATA_LINK, END, "p1"));
+  transitions.emplace("ALTER_METADATA_CHMOD->END", Transition(ALTER_METADATA_CHMOD, END, "p1"));
+  transitions.emplace("ALTER_METADATA_UTIMES->END", Transition(ALTER_METADATA_UTIMES, END, "p1"));
   transitions.emplace("DELETE_FILE->END", Transition(DELETE_FILE, END, "p1"));
   transitions.emplace("DELETE_DIR->END", Transition(DELETE_DIR, END, "p1"));
   transitions.emplace("END->S", Transition(END, S, "p1"));
 
-  int iteration = 0;
   std::chrono::seconds max_time = stringToChrono(getParameter("time").get_string());
-  auto start = std::chrono::high_resolution_clock::now();
+  // A resumed run continues the time it already spent
+  auto start = std::chrono::high_resolution_clock::now() - elapsed;
   // progressbar bar(getParameter("iterations").get_int());
 
   std::vector<Result> results;
-  ProbabilisticStateMachine psm(transitions, S);
-  std::map<std::string, double> probabilities;
+  std::optional<AgingProfile> profile;
+  if (getParameter("profile").is_set()) {
+    profile.emplace(AgingProfile::fromFile(getParameter("profile").get_string(), profileActions(), profileVariables()));
+    for (auto& state : profile->states()) {
+      for (auto& parameter : state.parameters) {
+        getParameter(parameter.first);  // Throws for unknown parameters before any work is done
+      }
+    }
+    logger.info("Using aging profile {} with {} states", getParameter("profile").get_string(), profile->states().size());
+  }
+  int initial_state = resume_state >= 0 ? resume_state : (profile ? profile->initialState() : S);
+  CompiledStateMachine psm = profile ? CompiledStateMachine(profile->transitions(), initial_state, profile->slotNames()) : CompiledStateMachine(transitions, initial_state, probabilityKeys());
+  Probabilities probabilities{};
+  probability_inputs = ProbabilityInputs();
+  reserved_space = DataSize<DataUnit::B>::fromString(getParameter("settings-safe-margin").get_string()).get_value() + get_block_size().get_value();
   std::vector<FileTree::Nodeptr> touched_files;
+  // File of the path in the result of the iteration, found among the touched files without comparing paths
+  FileTree::Nodeptr result_node;
   Result result;
 
   ///////// LOGGER settings
@@ -137,38 +449,159 @@ void AgingScenario::run(std::unique_ptr<IOEngine>& ioengine) {
   }
   logger.set_progress_bar(&bar);
 
-  PolyCurve extents_curve(1, 10);
-
-  while ((iteration < getParameter("iterations").get_int() || getParameter("iterations").get_int() == -1)
-         && (std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now() - start) < max_time || getParameter("iterations").get_int() != -1)) {
+  std::string checkpoint_path = getParameter("checkpoint").get_string();
+  auto checkpoint_interval = stringToChrono(getParameter("checkpoint-interval").get_string());
+  auto last_checkpoint = std::chrono::steady_clock::now();
+  auto save_checkpoint = [&]() {
+    auto checkpoint_start = std::chrono::steady_clock::now();
+    if (!sample_extents) {
+      // Stored extents have to be complete, scans still in flight would be lost
+      accountant.drain();
+      extents_estimate.total = tree.total_extents_count;
+    }
+    CheckpointWriter out(checkpoint_path);
+    out.write(std::filesystem::weakly_canonical(getParameter("directory").get_string()).string());
+    out.write(getParameter("profile").get_string());
+    out.write<int32_t>(iteration);
+    out.write<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count());
+    out.write<int64_t>(std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()));
+    out.write(Random::save());
+    out.write<int32_t>(psm.getCurrentState());
+    out.write<uint8_t>(rapid_aging);
+    out.write(extents_estimate);
+    tree.save(out);
+    extents_curve.save(out);
+    Result::saveState(out);
+    out.commit();
+    last_checkpoint = std::chrono::steady_clock::now();
+    logger.debug("Checkpoint of iteration {} saved to {} in {} ms", iteration, checkpoint_path, std::chrono::duration_cast<std::chrono::milliseconds>(last_checkpoint - checkpoint_start).count());
+  };
+
+  auto map_free_space = [&]() {
+    auto map_start = std::chrono::steady_clock::now();
+    auto map = FreeSpaceMap::collect(getParameter("directory").get_string(), freespace_map_chunk);
+    free_fragmentation = map.fragmentationIndex();
+    auto json = map.toJson();
+    json["iteration"] = iteration;
+    Result::addSample("freespace", json);
+    bar.set_meta("free-frag", fmt::format("{:.3f}", free_fragmentation));
+    logger.debug("Free space map: {} extents in {} groups, fragmentation index {:.3f}, taken in {} ms", map.total().free_extents, map.groups().size(), free_fragmentation,
+                 std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - map_start).count());
+    if (free_frag_target >= 0 && free_fragmentation >= free_frag_target) {
+      logger.info("Free space fragmentation index {:.3f} reached the target {} in iteration {}", free_fragmentation, free_frag_target, iteration);
+      goal_reached = true;
+    }
+  };
+  if (freespace_map_interval > 0 && iteration == 0) {
+    // Also fails early when GETFSMAP isn't available
+    map_free_space();
+  }
+  auto compare_with_target = [&]() {
+    auto fs_status = free_space->status();
+    double utilization = fs_status.capacity == 0 ? 1.0 : double(fs_status.capacity - fs_status.available) / double(fs_status.capacity);
+    auto& snapshot = target->evaluate(tree, utilization);
+    auto sample = target->snapshotJson();
+    sample["iteration"] = iteration;
+    Result::addSample("convergence", sample);
+    steering_changed = true;
+    double divergence = *std::max_element(snapshot.divergence.begin(), snapshot.divergence.end());
+    bar.set_meta("div", fmt::format("{:.3f}", divergence));
+    logger.debug("Target comparison: largest divergence {:.4f}, utilization {:.3f}", divergence, utilization);
+    if (snapshot.converged) {
+      logger.info("Target reached in iteration {}, largest divergence {:.4f}", iteration, divergence);
+      goal_reached = true;
+      return;
+    }
+    divergence_curve.addPoint(divergence);
+    if (divergence_curve.getPointCount() > 20) {
+      divergence_curve.popOldestPoint();
+      divergence_curve.fitPolyCurve();
+      if (!divergence_stalled && divergence_curve.slope() >= 0) {
+        logger.warn("Divergence from the target stopped decreasing at {:.4f}, it may be unreachable with the current parameters", divergence);
+        divergence_stalled = true;
+      }
+    }
+  };
+  if (target) {
+    compare_with_target();
+  }
+  auto current_utilization = [&]() {
+    auto fs_status = free_space->status();
+    return fs_status.capacity == 0 ? 1.0 : double(fs_status.capacity - fs_status.available) / double(fs_status.capacity);
+  };
+  // Thresholds already crossed (e.g. by a resumed or based run) don't trigger a probe
+  size_t next_probe_utilization = std::upper_bound(probe_utilizations.begin(), probe_utilizations.end(), current_utilization()) - probe_utilizations.begin();
+  auto run_probe = [&](const std::string& trigger) {
+    free_space->reconcile();
+    double utilization = current_utilization();
+    // Every probe reads other files, the aging's streams aren't advanced
+    auto sample = probe.run(*ioengine, buffers, tree, free_space->status().available > reserved_space ? free_space->status().available - reserved_space : 0, iteration);
+    sample["iteration"] = iteration;
+    sample["trigger"] = trigger;
+    sample["utilization"] = utilization;
+    sample["extents"] = std::llround(extents_estimate.total);
+    Result::addSample("probes", sample);
+    free_space->reconcile();
+    logger.info("Probe in iteration {} ({}) at utilization {:.3f}: sequential read {:.1f} MB/s, random read {:.0f} IOPS, create {}", iteration, trigger, utilization,
+                sample["sequential_read"]["mb_per_second"].get<double>(), sample["random_read"]["iops"].get<double>(),
+                sample["create"].is_null() ? "skipped" : fmt::format("{:.1f} MB/s", sample["create"]["mb_per_second"].get<double>()));
+  };
+
+  while ((iteration < settings.iterations || settings.iterations == -1)
+         && (std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now() - start) < max_time || settings.iterations != -1) && !goal_reached) {
     result.setIteration(iteration);
 
     if (rapid_aging) {
       if (extents_curve.getPointCount() > 10
-          && std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now() - start)
-                 > std::chrono::duration_cast<std::chrono::seconds>(stringToChrono(getParameter("rapid-aging-min-time").get_string()))) {
+          && std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now() - start) > settings.rapid_aging_min_time) {
         extents_curve.fitPolyCurve();
         logger.debug("Extents curve angle: {}", extents_curve.slopeAngle());
-        if (extents_curve.slopeAngle() < getParameter("rapid-aging-threshold").get_int()) {
+        if (extents_curve.slopeAngle() < settings.rapid_aging_threshold) {
           rapid_aging = false;
           logger.debug("Rapid aging - disabling");
         }
       }
-      if (getParameter("rapid-aging-max-time").is_set()
-          && std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now() - start)
-                 > std::chrono::duration_cast<std::chrono::seconds>(stringToChrono(getParameter("rapid-aging-max-time").get_string()))) {
+      if (settings.rapid_aging_max_time.count() >= 0
+          && std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now() - start) > settings.rapid_aging_max_time) {
         rapid_aging = false;
         logger.debug("Rapid aging - disabling because of max time");
       }
-      if (getParameter("rapid-aging-max-extents").is_set() && tree.total_extents_count > getParameter("rapid-aging-max-extents").get_int()) {
+      if (settings.rapid_aging_max_extents >= 0 && extents_estimate.total > settings.rapid_aging_max_extents) {
         rapid_aging = false;
         logger.debug("Rapid aging - disabling because of max extents");
       }
     }
 
-    compute_probabilities(probabilities, tree, extents_curve);
-    psm.performTransition(probabilities);
-    switch (psm.getCurrentState()) {
+    if (profile) {
+      if (profile->update(profile_variables(tree, iteration, extents_estimate.total))) {
+        psm.setProbabilities(profile->values());
+      }
+    } else if (compute_probabilities(probabilities, tree, extents_curve) || steering_changed) {
+      if (target) {
+        auto steered = probabilities;
+        steer_probabilities(steered, target->steering());
+        psm.setProbabilities(steered);
+      } else {
+        psm.setProbabilities(probabilities);
+      }
+      steering_changed = false;
+    }
+    psm.performTransition();
+    int action = psm.getCurrentState();
+    // Parameters overridden by the profile state, restored after its action
+    std::vector<std::pair<std::string, std::string>> overridden;
+    if (profile) {
+      auto& state = profile->states()[psm.getCurrentState()];
+      action = state.action;
+      for (auto& [name, value] : state.parameters) {
+        overridden.emplace_back(name, getParameter(name).get_string());
+        setParameter(name, value);
+      }
+      if (!overridden.empty()) {
+        load_settings();
+      }
+    }
+    switch (action) {
       case S:
         logger.debug("S");
         break;
@@ -184,60 +617,33 @@ void AgingScenario::run(std::unique_ptr<IOEngine>& ioengine) {
 
       case CREATE_FILE: {
         FileTree::Nodeptr file_node = tree.mkfile(tree.newFilePath());
-        logger.debug(fmt::format("CREATE_FILE {}", file_node->path(true)));
+        auto file_path = file_node->path(true);
+        logger.debug("CREATE_FILE {}", file_path);
 
         DataSize<DataUnit::B> file_size = get_file_size();
-        size_t block_size = get_block_size().convert<DataUnit::B>().get_value();
-
-        // Allocate aligned memory
-        void* aligned_buf = nullptr;
-        int alignment = 4096;  // Typically required for O_DIRECT
-        if (posix_memalign(&aligned_buf, alignment, block_size) != 0) {
-          throw std::runtime_error("posix_memalign failed for aligned buffer");
+        size_t block_size = settings.block_size;
+        if (recorder) {
+          recorder->createFile(OpRecord::CREATE_FILE, file_node, file_size.get_value());
         }
 
-        generate_random_chunk(static_cast<char*>(aligned_buf), block_size);
-
-        int fd = ioengine->open_file(file_node->path(true).c_str(), O_WRONLY | O_CREAT | O_TRUNC, getParameter("direct_io").get_bool());
-
-        MeasuredCBAction action([&]() {
-          off_t offset = 0;
-          uint64_t written_bytes_optimistic = 0;
-          uint64_t written_bytes_true = 0;
-
-          while (written_bytes_optimistic < file_size.get_value()) {
-            ssize_t _written_bytes = ioengine->write(fd, aligned_buf, block_size, offset);
-            if (_written_bytes == -1) {
-              perror("Error writing to file");
-              ioengine->close(fd);
-              free(aligned_buf);
-              throw std::runtime_error(fmt::format("Error writing to file {}", file_node->path(true)));
-            }
-            offset += _written_bytes;
-            written_bytes_optimistic += block_size;
-            written_bytes_true += _written_bytes;
-          }
-
-          written_bytes_true += ioengine->complete();
-
-          if (written_bytes_true != written_bytes_optimistic) {
-            logger.warn(fmt::format("Written bytes {} != written_bytes_optimistic {}", written_bytes_true, written_bytes_optimistic));
-          }
-        });
-
+        buffers.refresh();
+        EngineFile file(*ioengine, tree, file_node, O_WRONLY | O_CREAT | O_TRUNC, settings.direct_io);
+        MeasuredCBAction action([&]() { file.write(buffers, block_size, 0, file_size.get_value()); });
         auto duration = action.exec();
-        ioengine->close(fd);
-        free(aligned_buf);  // Free aligned memory
+        file.close();
 
         double speed_mb_s = (file_size.get_value() / 1024. / 1024.) / (duration.count() / 1000000000.0);
-        logger.debug(fmt::format("CREATE_FILE {} Wrote {} MB in {} ms | Speed {} MB/s", file_node->path(true), int(file_size.get_value() / 1024. / 1024.), duration.count() / 1000000.0, speed_mb_s));
+        logger.debug(fmt::format("CREATE_FILE {} Wrote {} MB in {} ms | Speed {} MB/s", file_path, int(file_size.get_value() / 1024. / 1024.), duration.count() / 1000000.0, speed_mb_s));
 
         bar.set_operation_speed("WRITE", speed_mb_s);
+        // The file is written in whole blocks
+        free_space->account(allocated((file_size.get_value() + block_size - 1) / block_size * block_size));
         touched_files.push_back(file_node);
 
         result.setAction(Result::Action::CREATE_FILE);
         result.setOperation(Result::Operation::WRITE);
-        result.setPath(file_node->path(true));
+        result.setPath(file_path);
+        result_node = file_node;
         result.setSize(file_size);
         result.setDuration(duration);
         break;
@@ -245,83 +651,54 @@ void AgingScenario::run(std::unique_ptr<IOEngine>& ioengine) {
 
       case CREATE_FILE_FALLOCATE: {
         FileTree::Nodeptr file_node = tree.mkfile(tree.newFilePath());
-        logger.debug(fmt::format("CREATE_FILE_FALLOCATE {}", file_node->path(true)));
+        auto file_path = file_node->path(true);
+        logger.debug("CREATE_FILE_FALLOCATE {}", file_path);
         DataSize<DataUnit::B> file_size = get_file_size();
+        if (recorder) {
+          recorder->createFile(OpRecord::CREATE_FILE_FALLOCATE, file_node, file_size.get_value());
+        }
 
-        int fd = ioengine->open_file(file_node->path(true).c_str(), O_RDWR | O_CREAT, getParameter("direct_io").get_bool());
-        MeasuredCBAction action([&]() {
-#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
-#  error "Windows is not supported"
-#elif __APPLE__
-          if (ftruncate(fd, file_size.get_value()) == -1) {
-            throw std::runtime_error(fmt::format("ftruncate failed: {}", strerror(errno)));
-          }
-#elif defined(__linux__)
-          if (fallocate(fd, 0, 0, file_size.get_value()) == -1) {
-            throw std::runtime_error(fmt::format("Fallocate failed: {}", strerror(errno)));
-          }
-#endif
-        });
+        EngineFile file(*ioengine, tree, file_node, O_RDWR | O_CREAT, settings.direct_io);
+        MeasuredCBAction action([&]() { file.fallocate(0, file_size.get_value()); });
         auto duration = action.exec();
-        ioengine->close(fd);
-        logger.debug(fmt::format("CREATE_FILE_FALLOCATE {} Wrote {} MB in {} ms | Speed {} MB/s", file_node->path(true), int(file_size.get_value() / 1024. / 1024.), duration.count() / 1000000.0,
+        file.close();
+        logger.debug(fmt::format("CREATE_FILE_FALLOCATE {} Wrote {} MB in {} ms | Speed {} MB/s", file_path, int(file_size.get_value() / 1024. / 1024.), duration.count() / 1000000.0,
                                  (file_size.get_value() / 1024. / 1024.) / (duration.count() / 1000000000.0)));
+        free_space->account(allocated(file_size.get_value()));
         touched_files.push_back(file_node);
 
         result.setAction(Result::Action::CREATE_FILE_FALLOCATE);
         result.setOperation(Result::Operation::FALLOCATE);
-        result.setPath(file_node->path(true));
+        result.setPath(file_path);
+        result_node = file_node;
         result.setSize(file_size);
         result.setDuration(duration);
         break;
       }
       case CREATE_FILE_OVERWRITE: {
+        if (touched_files.empty()) {
+          // Only reachable from aging profiles, the built-in machine always creates a file first
+          throw std::runtime_error("CREATE_FILE_OVERWRITE needs a file created in the same iteration");
+        }
         auto prev_file = touched_files.back();
         assert(prev_file != nullptr);
         assert(prev_file->getFallocationCount() == 0);
 
         auto prev_file_path = prev_file->path(true);
-        auto file_size = fs_utils::file_size(prev_file_path);
+        auto file_size = tree.fileSize(prev_file);
         logger.debug("CREATE_FILE_OVERWRITE {} size {}", prev_file_path, file_size);
-
-        size_t block_size = get_block_size().convert<DataUnit::B>().get_value();
-
-        // Allocate aligned memory for O_DIRECT
-        void* aligned_buf = nullptr;
-        int alignment = 4096;  // common page size for O_DIRECT, verify against your FS/ioengine
-        if (posix_memalign(&aligned_buf, alignment, block_size) != 0) {
-          throw std::runtime_error("posix_memalign failed for aligned buffer");
+        if (recorder) {
+          recorder->fileOperation(OpRecord::CREATE_FILE_OVERWRITE, prev_file, 0, file_size);
         }
+        prev_file->invalidateExtents();
 
-        generate_random_chunk(static_cast<char*>(aligned_buf), block_size);
-
-        int fd = ioengine->open_file(prev_file_path.c_str(), O_WRONLY, getParameter("direct_io").get_bool());
-
-        MeasuredCBAction action([&]() {
-          off_t offset = 0;
-          uint64_t written_bytes_optimistic = 0;
-          uint64_t written_bytes_true = 0;
-          while (written_bytes_optimistic < file_size) {
-            ssize_t written_bytes_ = ioengine->write(fd, aligned_buf, block_size, offset);
-            if (written_bytes_ == -1) {
-              perror("Error writing to file");
-              ioengine->close(fd);
-              free(aligned_buf);
-              throw std::runtime_error(fmt::format("Error writing to file {}", prev_file_path));
-            }
-            offset += written_bytes_;
-            written_bytes_optimistic += block_size;
-            written_bytes_true += written_bytes_;
-          }
-          written_bytes_true += ioengine->complete();
-          if (written_bytes_true != written_bytes_optimistic) {
-            logger.warn(fmt::format("Written bytes {} != file size {}", written_bytes_true, written_bytes_optimistic));
-          }
-        });
+        size_t block_size = settings.block_size;
 
+        buffers.refresh();
+        EngineFile file(*ioengine, tree, prev_file, O_WRONLY, settings.direct_io);
+        MeasuredCBAction action([&]() { file.write(buffers, block_size, 0, file_size); });
         auto duration = action.exec();
-        ioengine->close(fd);
-        free(aligned_buf);  // free aligned memory
+        file.close();
 
         double speed_mb_s = (file_size / 1024. / 1024.) / (duration.count() / 1000000000.0);
         logger.debug(fmt::format("CREATE_FILE_OVERWRITE {} Wrote {} MB in {} ms | Speed {} MB/s", prev_file_path, int(file_size / 1024. / 1024.), duration.count() / 1000000.0, speed_mb_s));
@@ -331,58 +708,36 @@ void AgingScenario::run(std::unique_ptr<IOEngine>& ioengine) {
         result.setAction(Result::Action::CREATE_FILE_OVERWRITE);
         result.setOperation(Result::Operation::OVERWRITE);
         result.setPath(prev_file_path);
+        result_node = prev_file;
         result.setSize(file_size);
         result.setDuration(duration);
         break;
       }
 
       case CREATE_FILE_READ: {
+        if (touched_files.empty()) {
+          // Only reachable from aging profiles, the built-in machine always creates a file first
+          throw std::runtime_error("CREATE_FILE_READ needs a file created in the same iteration");
+        }
         auto prev_file = touched_files.back();
         assert(prev_file != nullptr);
         assert(prev_file->getFallocationCount() == 0);
         auto prev_file_path = prev_file->path(true);
-        auto file_size = fs_utils::file_size(prev_file_path);
+        auto file_size = tree.fileSize(prev_file);
         logger.debug("CREATE_FILE_READ {} size {}", prev_file_path, file_size);
+        if (recorder) {
+          recorder->fileOperation(OpRecord::CREATE_FILE_READ, prev_file, 0, file_size);
+        }
 
-        int fd = ioengine->open_file(prev_file_path.c_str(), O_RDONLY, getParameter("direct_io").get_bool());
-
-        MeasuredCBAction action([&]() {
-          size_t block_size = get_block_size().convert<DataUnit::B>().get_value();
-
-          // Allocate aligned memory
-          void* aligned_buf = nullptr;
-          int alignment = 4096;  // Typically required for O_DIRECT
-          if (posix_memalign(&aligned_buf, alignment, block_size) != 0) {
-            throw std::runtime_error("posix_memalign failed for aligned buffer");
-          }
-
-          off_t offset = 0;
-          uint64_t read_bytes_optimistic = 0;
-          uint64_t read_bytes_true = 0;
-
-          while (read_bytes_optimistic < file_size) {
-            ssize_t read_bytes_ = ioengine->read(fd, aligned_buf, block_size, offset);
-            if (read_bytes_ == -1) {
-              perror("Error reading from file");
-              ioengine->close(fd);
-              free(aligned_buf);
-              throw std::runtime_error(fmt::format("Error reading from file {}", prev_file_path));
-            }
-            offset += read_bytes_;
-            read_bytes_optimistic += block_size;
-            read_bytes_true += read_bytes_;
-          }
-
-          read_bytes_true += ioengine->complete();
-          free(aligned_buf);  // Always free allocated memory
-
-          if (read_bytes_true != file_size) {
-            logger.warn(fmt::format("Read bytes {} != file size {}", read_bytes_true, file_size));
-          }
-        });
-
+        size_t block_size = settings.block_size;
+        EngineFile file(*ioengine, tree, prev_file, O_RDONLY, settings.direct_io);
+        uint64_t read_bytes = 0;
+        MeasuredCBAction action([&]() { read_bytes = file.read(buffers, block_size, 0, file_size); });
         auto duration = action.exec();
-        ioengine->close(fd);
+        file.close();
+        if (read_bytes != file_size) {
+          logger.warn("Read bytes {} != file size {}", read_bytes, file_size);
+        }
 
         double speed_mb_s = (file_size / 1024. / 1024.) / (duration.count() / 1000000000.0);
         logger.debug(fmt::format("CREATE_FILE_READ {} Read {} MB in {} ms | Speed {} MB/s", prev_file_path, int(file_size / 1024. / 1024.), duration.count() / 1000000.0, speed_mb_s));
@@ -392,6 +747,7 @@ void AgingScenario::run(std::unique_ptr<IOEngine>& ioengine) {
         result.setAction(Result::Action::CREATE_FILE_READ);
         result.setOperation(Result::Operation::READ);
         result.setPath(prev_file_path);
+        result_node = prev_file;
         result.setSize(DataSize<DataUnit::B>(file_size));
         result.setDuration(duration);
         break;
@@ -403,11 +759,16 @@ void AgingScenario::run(std::unique_ptr<IOEngine>& ioengine) {
         logger.debug("CREATE_DIR {}", new_dir_path);
         FileTree::Nodeptr dir_node = tree.mkdir(new_dir_path);
         auto dir_path = dir_node->path(true);
+        if (recorder) {
+          recorder->createDirectory(dir_node);
+        }
 
-        MeasuredCBAction action([&]() { std::filesystem::create_directory(dir_path); });
+        MeasuredCBAction action([&]() { tree.createDirectory(dir_node); });
         auto duration = action.exec();
+        free_space->account(FREE_SPACE_ALLOCATION_UNIT);
         result.setAction(Result::Action::CREATE_DIR);
         result.setPath(dir_path);
+        result_node = nullptr;
         result.setDuration(duration);
         break;
       }
@@ -417,23 +778,32 @@ void AgingScenario::run(std::unique_ptr<IOEngine>& ioengine) {
       }
       case ALTER_SMALLER_TRUNCATE: {
         logger.debug("ALTER_SMALLER_TRUNCATE");
-        auto random_file = tree.randomFile();
+        auto random_file = tree.randomFile(selection[ALTER_SMALLER_TRUNCATE]);
         auto random_file_path = random_file->path(true);
-        auto actual_file_size = fs_utils::file_size(random_file_path);
+        auto actual_file_size = tree.fileSize(random_file);
         // auto new_file_size = get_file_size(0, actual_file_size, false);
-        std::uintmax_t blocksize = get_block_size().convert<DataUnit::B>().get_value();
+        std::uintmax_t blocksize = settings.block_size;
         auto new_file_size = get_file_size(std::max(actual_file_size / 2, blocksize), actual_file_size, false);  // TODO check this for error, remove the magic constant
         logger.debug("ALTER_SMALLER_TRUNCATE {} from {} kB to {} kB ({})", random_file_path, actual_file_size / 1024, new_file_size.get_value() / 1024, new_file_size.get_value());
-        bool fallocatable = random_file->isPunchable(blocksize);
-        random_file->truncate(blocksize, new_file_size.get_value());
-        MeasuredCBAction action([&]() { truncate(random_file_path.c_str(), new_file_size.convert<DataUnit::B>().get_value()); });
+        bool fallocatable = punch->punchable(*random_file, actual_file_size);
+        auto allocated_before = random_file->allocatedBytes();
+        if (recorder) {
+          recorder->fileOperation(OpRecord::ALTER_SMALLER_TRUNCATE, random_file, 0, new_file_size.get_value());
+        }
+        random_file->truncate(blocksize, new_file_size.get_value(), actual_file_size);
+        random_file->markExtentsDirty(new_file_size.get_value());
+        EngineFile file(*ioengine, tree, random_file, O_WRONLY, false);
+        MeasuredCBAction action([&]() { file.truncate(new_file_size.get_value()); });
         touched_files.push_back(random_file);
         auto duration = action.exec();
-        if (fallocatable && !random_file->isPunchable(blocksize)) {
+        file.close();
+        free_space->account(allocated(random_file->allocatedBytes()) - allocated(allocated_before));
+        if (fallocatable && !punch->punchable(*random_file, new_file_size.get_value())) {
           tree.removeFromPunchableFiles(random_file);
         }
         result.setAction(Result::Action::ALTER_SMALLER_TRUNCATE);
         result.setPath(random_file_path);
+        result_node = random_file;
         result.setSize(new_file_size);
         result.setDuration(duration);
         break;
@@ -446,30 +816,37 @@ void AgingScenario::run(std::unique_ptr<IOEngine>& ioengine) {
 #  warning "FALLOCATE not supported on macOS"
         throw std::runtime_error("FALLOCATE not supported on this system");
 #elif __linux__ || __unix__ || defined(_POSIX_VERSION)
-        auto random_file = tree.randomPunchableFile();
+        auto random_file = tree.randomPunchableFile(selection[ALTER_SMALLER_FALLOCATE]);
         auto random_file_path = random_file->path(true);
-        auto block_size = get_block_size().convert<DataUnit::B>().get_value();
-        std::tuple<size_t, size_t> hole_address = random_file->getHoleAddress(block_size, true);
-        // Round to modulo blocksize
-        logger.debug("ALTER_SMALLER_FALLOCATE {} with size {} punched hole {} - {}", random_file_path, random_file->size(), std::get<0>(hole_address), std::get<1>(hole_address));
-        int fd = ioengine->open_file(random_file_path.c_str(), O_RDWR, false);
-        if (fd == -1) {
-          std::cerr << "Error opening file: " << strerror(errno) << std::endl;
-          throw std::runtime_error(fmt::format("Error opening file {}", random_file_path));
+        auto file_size = tree.fileSize(random_file);
+        auto hole = punch->pick(*random_file, file_size);
+        if (!hole) {
+          // No room left for the strategy, the profile picks another action next time
+          logger.debug("ALTER_SMALLER_FALLOCATE {} with size {} has no room for a {} hole", random_file_path, file_size, PunchStrategy::kindName(punch->kind()));
+          tree.removeFromPunchableFiles(random_file);
+          break;
         }
-        MeasuredCBAction action([&]() {
-          fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, std::get<0>(hole_address), std::get<1>(hole_address) - std::get<0>(hole_address));
-          ioengine->close(fd);
-        });
+        auto [hole_start, hole_end] = *hole;
+        logger.debug("ALTER_SMALLER_FALLOCATE {} with size {} punched hole {} - {}", random_file_path, file_size, hole_start, hole_end);
+        if (recorder) {
+          recorder->fileOperation(OpRecord::ALTER_SMALLER_FALLOCATE, random_file, hole_start, hole_end - hole_start);
+        }
+        EngineFile file(*ioengine, tree, random_file, O_RDWR, settings.direct_io);
+        MeasuredCBAction action([&]() { file.fallocate(hole_start, hole_end - hole_start, true); });
+        random_file->markExtentsDirty(hole_start, hole_end);
+        free_space->account(-static_cast<int64_t>(hole_end - hole_start));
         touched_files.push_back(random_file);
         auto duration = action.exec();
-        if (!random_file->isPunchable(block_size)) {
+        file.close();
+        // Punching keeps the size
+        if (!punch->punchable(*random_file, file_size)) {
           logger.debug("File {} is not punchable anymore", random_file_path);
           tree.removeFromPunchableFiles(random_file);
         }
         result.setAction(Result::Action::ALTER_SMALLER_FALLOCATE);
         result.setPath(random_file_path);
-        result.setSize(DataSize<DataUnit::B>(std::get<1>(hole_address) - std::get<0>(hole_address)));
+        result_node = random_file;
+        result.setSize(DataSize<DataUnit::B>(hole_end - hole_start));
         result.setDuration(duration);
 #else
         throw std::runtime_error("FALLOCATE not supported on this system");
@@ -482,36 +859,33 @@ void AgingScenario::run(std::unique_ptr<IOEngine>& ioengine) {
       }
       case ALTER_BIGGER_FALLOCATE: {
         logger.debug("ALTER_BIGGER_FALLOCATE");
-        auto random_file = tree.randomFile();
+        auto random_file = tree.randomFile(selection[ALTER_BIGGER_FALLOCATE]);
         auto random_file_path = random_file->path(true);
-        auto actual_file_size = fs_utils::file_size(random_file_path);
-        auto new_file_size = get_file_size(actual_file_size, DataSize<DataUnit::B>::fromString(getParameter("maxfsize").get_string()).convert<DataUnit::B>().get_value());
+        auto actual_file_size = tree.fileSize(random_file);
+        auto new_file_size = get_file_size(actual_file_size, settings.max_file_size);
         logger.debug("ALTER_BIGGER_FALLOCATE {} from {} to {}", random_file_path, actual_file_size, new_file_size);
-        int fd = ioengine->open_file(random_file_path.c_str(), O_RDWR, getParameter("direct_io").get_bool());
+        if (recorder) {
+          recorder->fileOperation(OpRecord::ALTER_BIGGER_FALLOCATE, random_file, actual_file_size, new_file_size.get_value() > actual_file_size ? new_file_size.get_value() - actual_file_size : 0);
+        }
+        EngineFile file(*ioengine, tree, random_file, O_RDWR, settings.direct_io);
         MeasuredCBAction action([&]() {
-#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
-#  error "Windows is not supported"
-#elif __APPLE__
-#  warning "FALLOCATE not supported on macOS"
-          throw std::runtime_error("FALLOCATE not supported on this system");
-
-#elif __linux__ || __unix__ || defined(_POSIX_VERSION)
           if (new_file_size.get_value() > actual_file_size) {  // Only expand, never shrink
-            if (fallocate(fd, 0, actual_file_size, new_file_size.get_value() - actual_file_size) == -1) {
-              perror("fallocate");
-              throw std::runtime_error("fallocate failed for file: " + random_file_path);
-            }
+            file.fallocate(actual_file_size, new_file_size.get_value() - actual_file_size);
           } else {
             logger.warn("File {} is already bigger ({}) than new size ({})", random_file_path, actual_file_size, new_file_size.get_value());
           }
-#endif
-          ioengine->close(fd);
         });
         auto duration = action.exec();
+        file.close();
+        random_file->markExtentsDirty(actual_file_size);
+        if (new_file_size.get_value() > actual_file_size) {
+          free_space->account(allocated(new_file_size.get_value()) - allocated(actual_file_size));
+        }
         touched_files.push_back(random_file);
         result.setAction(Result::Action::ALTER_BIGGER_FALLOCATE);
         result.setOperation(Result::Operation::FALLOCATE);
         result.setPath(random_file_path);
+        result_node = random_file;
         result.setSize(new_file_size - DataSize<DataUnit::B>(actual_file_size));
         result.setDuration(duration);
         break;
@@ -519,7 +893,7 @@ void AgingScenario::run(std::unique_ptr<IOEngine>& ioengine) {
       case ALTER_BIGGER_WRITE: {
         logger.debug("ALTER_BIGGER");
 
-        size_t block_size = get_block_size().convert<DataUnit::B>().get_value();
+        size_t block_size = settings.block_size;
         size_t alignment = 4096;  // Common alignment for O_DIRECT (check with `stat -f`)
 
         // Ensure block_size is aligned to 4096 bytes
@@ -528,36 +902,17 @@ void AgingScenario::run(std::unique_ptr<IOEngine>& ioengine) {
           logger.debug("Block size adjusted to {} for O_DIRECT", block_size);
         }
 
-        // Allocate aligned memory for O_DIRECT
-        void* buf = nullptr;
-        if (posix_memalign(&buf, alignment, block_size) != 0) {
-          throw std::runtime_error("Failed to allocate aligned memory");
-        }
-
-        generate_random_chunk(static_cast<char*>(buf), block_size);
+        buffers.refresh();
 
-        auto random_file = tree.randomFile();
+        auto random_file = tree.randomFile(selection[ALTER_BIGGER_WRITE]);
         auto random_file_path = random_file->path(true);
-        auto actual_file_size = fs_utils::file_size(random_file_path);
-        auto new_file_size = get_file_size(actual_file_size, DataSize<DataUnit::B>::fromString(getParameter("maxfsize").get_string()).convert<DataUnit::B>().get_value());
+        auto actual_file_size = tree.fileSize(random_file);
+        auto new_file_size = get_file_size(actual_file_size, settings.max_file_size);
 
         logger.debug("ALTER_BIGGER_WRITE {} from {} to {}", random_file_path, actual_file_size, new_file_size);
 
         // Open file without O_APPEND (O_APPEND conflicts with O_DIRECT)
-        int fd = ioengine->open_file(random_file_path.c_str(), O_WRONLY, getParameter("direct_io").get_bool());
-        if (fd == -1) {
-          perror("Error opening file with O_DIRECT");
-          free(buf);
-          throw std::runtime_error(fmt::format("Error opening file {}", random_file_path));
-        }
-
-        auto current_size = lseek(fd, 0, SEEK_END);
-        if (current_size == -1) {
-          perror("Error getting file size");
-          ioengine->close(fd);
-          free(buf);
-          throw std::runtime_error(fmt::format("Error getting file size {}", random_file_path));
-        }
+        EngineFile file(*ioengine, tree, random_file, O_WRONLY, settings.direct_io);
 
         // Ensure write offset is aligned
         uint64_t write_offset = actual_file_size;
@@ -565,33 +920,33 @@ void AgingScenario::run(std::unique_ptr<IOEngine>& ioengine) {
           write_offset = (write_offset / alignment) * alignment;  // Round down to nearest 4KB
           logger.debug("Aligning write offset to {}", write_offset);
         }
+        if (recorder) {
+          recorder->fileOperation(OpRecord::ALTER_BIGGER_WRITE, random_file, write_offset, new_file_size.get_value() > write_offset ? new_file_size.get_value() - write_offset : 0);
+        }
 
         MeasuredCBAction action([&]() {
-          for (; write_offset < new_file_size.get_value();) {
-            // Use pwrite() to avoid O_APPEND issues and ensure aligned writes
-            ssize_t written_bytes_ = pwrite(fd, buf, block_size, write_offset);  // todo use ioengine->write
-            if (written_bytes_ == -1) {
-              perror("Error writing to file");
-              ioengine->close(fd);
-              free(buf);
-              throw std::runtime_error(fmt::format("Error writing to file {}", random_file_path));
-            }
-            write_offset += written_bytes_;
+          uint64_t end = new_file_size.get_value();
+          if (write_offset < end) {
+            file.write(buffers, block_size, write_offset, end);
+            // Whole blocks are written, the file ends with the last one
+            write_offset += (end - write_offset + block_size - 1) / block_size * block_size;
           }
-          ioengine->close(fd);
         });
 
         auto duration = action.exec();
+        file.close();
 
         logger.debug("ALTER_BIGGER {} from {} to {} in {} ms | Speed {} MB/s", random_file_path, actual_file_size, new_file_size.get_value(), duration.count() / 1000000.0,
                      ((new_file_size.get_value() - actual_file_size) / 1024. / 1024.) / (duration.count() / 1000000000.0));
 
-        free(buf);  // Free aligned memory
-
+        // Writing starts at the aligned down offset, the last block of the file may have changed too
+        random_file->markExtentsDirty((actual_file_size / alignment) * alignment);
+        free_space->account(allocated(write_offset) - allocated(actual_file_size));
         touched_files.push_back(random_file);
         result.setAction(Result::Action::ALTER_BIGGER_WRITE);
         result.setOperation(Result::Operation::WRITE);
         result.setPath(random_file_path);
+        result_node = random_file;
         result.setSize(new_file_size - DataSize<DataUnit::B>(actual_file_size));
         result.setDuration(duration);
         break;
@@ -600,18 +955,161 @@ void AgingScenario::run(std::unique_ptr<IOEngine>& ioengine) {
       case ALTER_METADATA:
         logger.debug("ALTER_METADATA");
         break;
+      case ALTER_METADATA_XATTR: {
+        if (!xattrs) {
+          // Only reachable from aging profiles, the built-in machine doesn't enter it then
+          throw std::runtime_error(fmt::format("Filesystem of {} doesn't support user extended attributes", getParameter("directory").get_string()));
+        }
+        auto random_file = tree.randomFile(selection[ALTER_METADATA_XATTR]);
+        auto random_file_path = random_file->path(true);
+        auto names = fs_utils::list_xattrs(random_file_path, XATTR_PREFIX);
+        auto remove_xattr = [&]() {
+          auto name = names[Random::below(Random::METADATA, names.size())];
+          logger.debug("ALTER_METADATA_XATTR {} remove {}", random_file_path, name);
+          if (recorder) {
+            recorder->fileOperation(OpRecord::XATTR_REMOVE, random_file, std::stoul(name.substr(std::strlen(XATTR_PREFIX))), 0);
+          }
+          auto duration = MeasuredCBAction([&]() { fs_utils::remove_xattr(random_file_path, name); }).exec();
+          result.setAction(Result::Action::ALTER_METADATA_XATTR_REMOVE);
+          result.setPath(random_file_path);
+          result_node = random_file;
+          result.setSize(DataSize<DataUnit::B>(0));
+          result.setDuration(duration);
+        };
+        if (!names.empty() && Random::below(Random::METADATA, 2) == 0) {
+          remove_xattr();
+          break;
+        }
+        int index = Random::below(Random::METADATA, XATTR_NAME_COUNT);
+        auto name = fmt::format("{}{}", XATTR_PREFIX, index);
+        // Values of varying sizes make the filesystem move them between inline and external storage
+        std::string value(1 + Random::below(Random::METADATA, xattr_max_size), '\0');
+        generate_random_chunk(value.data(), value.size());
+        bool stored = false;
+        auto duration = MeasuredCBAction([&]() { stored = fs_utils::set_xattr(random_file_path, name, value); }).exec();
+        if (!stored) {
+          logger.debug("ALTER_METADATA_XATTR {} no room for {} of {} B", random_file_path, name, value.size());
+          if (!names.empty()) {
+            remove_xattr();
+          }
+          break;
+        }
+        logger.debug("ALTER_METADATA_XATTR {} set {} to {} B", random_file_path, name, value.size());
+        if (recorder) {
+          recorder->fileOperation(OpRecord::XATTR_SET, random_file, index, value.size());
+        }
+        result.setAction(Result::Action::ALTER_METADATA_XATTR_SET);
+        result.setPath(random_file_path);
+        result_node = random_file;
+        result.setSize(DataSize<DataUnit::B>(value.size()));
+        result.setDuration(duration);
+        break;
+      }
+      case ALTER_METADATA_RENAME: {
+        auto random_file = tree.randomFile(selection[ALTER_METADATA_RENAME]);
+        auto old_path = random_file->path(true);
+        auto old_parent = random_file->parent;
+        auto old_name = random_file->name;
+        bool linked = tree.exists(random_file, HARDLINK_SUFFIX);
+        tree.rename(random_file, tree.newFilePath());
+        auto new_path = random_file->path(true);
+        logger.debug("ALTER_METADATA_RENAME {} to {}", old_path, new_path);
+        if (recorder) {
+          recorder->renameFile(random_file);
+        }
+        auto duration = MeasuredCBAction([&]() { tree.renameFrom(old_parent, old_name, random_file); }).exec();
+        // The hardlink is found by its name, it has to follow the file
+        if (linked) {
+          tree.renameFrom(old_parent, old_name, random_file, HARDLINK_SUFFIX);
+        }
+        result.setAction(Result::Action::ALTER_METADATA_RENAME);
+        result.setPath(new_path);
+        result_node = random_file;
+        result.setSize(DataSize<DataUnit::B>(0));
+        result.setDuration(duration);
+        break;
+      }
+      case ALTER_METADATA_LINK: {
+        auto random_file = tree.randomFile(selection[ALTER_METADATA_LINK]);
+        auto random_file_path = random_file->path(true);
+        auto link_path = random_file_path + HARDLINK_SUFFIX;
+        bool linked = tree.exists(random_file, HARDLINK_SUFFIX);
+        logger.debug("ALTER_METADATA_LINK {} {}", linked ? "unlink" : "link", link_path);
+        if (recorder) {
+          recorder->fileOperation(linked ? OpRecord::UNLINK : OpRecord::LINK, random_file, 0, 0);
+        }
+        std::chrono::nanoseconds duration;
+        if (linked) {
+          duration = MeasuredCBAction([&]() { tree.unlink(random_file, HARDLINK_SUFFIX); }).exec();
+        } else {
+          duration = MeasuredCBAction([&]() { fs_utils::hard_link(random_file_path, link_path); }).exec();
+        }
+        result.setAction(linked ? Result::Action::ALTER_METADATA_UNLINK : Result::Action::ALTER_METADATA_LINK);
+        result.setPath(random_file_path);
+        result_node = random_file;
+        result.setSize(DataSize<DataUnit::B>(0));
+        result.setDuration(duration);
+        break;
+      }
+      case ALTER_METADATA_CHMOD: {
+        static constexpr mode_t modes[] = {0644, 0600, 0640, 0664};
+        auto random_file = tree.randomFile(selection[ALTER_METADATA_CHMOD]);
+        auto random_file_path = random_file->path(true);
+        mode_t mode = modes[Random::below(Random::METADATA, sizeof(modes) / sizeof(modes[0]))];
+        logger.debug("ALTER_METADATA_CHMOD {} to {:o}", random_file_path, mode);
+        if (recorder) {
+          recorder->fileOperation(OpRecord::CHMOD, random_file, mode, 0);
+        }
+        auto duration = MeasuredCBAction([&]() { fs_utils::change_mode(random_file_path, mode); }).exec();
+        result.setAction(Result::Action::ALTER_METADATA_CHMOD);
+        result.setPath(random_file_path);
+        result_node = random_file;
+        result.setSize(DataSize<DataUnit::B>(0));
+        result.setDuration(duration);
+        break;
+      }
+      case ALTER_METADATA_UTIMES: {
+        auto random_file = tree.randomFile(selection[ALTER_METADATA_UTIMES]);
+        auto random_file_path = random_file->path(true);
+        // Access time somewhere in the last year, the modification time moves to now so changes after a checkpoint
+        // are still recognized when resuming
+        int64_t access_time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()) - Random::below(Random::METADATA, 365 * 24 * 3600);
+        logger.debug("ALTER_METADATA_UTIMES {} access time {}", random_file_path, access_time);
+        if (recorder) {
+          recorder->fileOperation(OpRecord::UTIMES, random_file, access_time, 0);
+        }
+        auto duration = MeasuredCBAction([&]() { fs_utils::set_times(random_file_path, access_time); }).exec();
+        result.setAction(Result::Action::ALTER_METADATA_UTIMES);
+        result.setPath(random_file_path);
+        result_node = random_file;
+        result.setSize(DataSize<DataUnit::B>(0));
+        result.setDuration(duration);
+        break;
+      }
       case DELETE_FILE: {
-        auto random_file = tree.randomFile();
+        auto random_file = tree.randomFile(selection[DELETE_FILE]);
+        if (target) {
+          // Files of sizes the tree has too many of go first
+          for (int attempt = 0; attempt < 8 && !target->surplusSize(tree.fileSize(random_file)); attempt++) {
+            random_file = tree.randomFile(selection[DELETE_FILE]);
+          }
+        }
         auto random_file_path = random_file->path(true);
         logger.debug("DELETE_FILE {}", random_file_path);
-        auto file_extents = random_file->getExtents(true).size();
+        if (recorder) {
+          recorder->deleteFile(random_file);
+        }
+        accountant.forget(random_file);
+        // Punched holes are known from the shadow state of the file
+        free_space->account(-allocated(random_file->allocatedBytes()));
 
-        MeasuredCBAction action([&]() { std::filesystem::remove(random_file_path); });
+        MeasuredCBAction action([&]() { tree.unlink(random_file); });
         action.exec();
-        tree.rm(random_file->path(false));
+        tree.unlink(random_file, HARDLINK_SUFFIX);
+        tree.remove(random_file);
         result.setAction(Result::Action::DELETE_FILE);
         result.setPath(random_file_path);
-        tree.total_extents_count -= file_extents;
+        result_node = random_file;
         break;
       }
       case DELETE_DIR: {
@@ -624,172 +1122,320 @@ void AgingScenario::run(std::unique_ptr<IOEngine>& ioengine) {
       }
       case END:
         logger.debug("END");
-        if (getParameter("sync").get_bool()) {
+        if (settings.sync) {
           logger.debug("Syncing...");
           sync();
         }
-        for (auto& file : touched_files) {
-          auto original_extents = file->getExtents(false).size();
-          auto updated_extents = file->getExtents(true);
-          int updated_extents_size = updated_extents.size();
-
-          logger.debug("File {} extents: {} -> {}", file->path(true), original_extents, updated_extents_size);
-          tree.total_extents_count += updated_extents_size - original_extents;
-          if (!file->isPunchable(get_block_size().convert<DataUnit::B>().get_value())) {
-            tree.removeFromPunchableFiles(file);
+        {
+          // touched_files may contain the same file multiple times, account each file only once
+          std::unordered_set<FileTree::Node*> seen;
+          FileTree::Nodeptr result_file = nullptr;
+          for (auto& file : touched_files) {
+            // Aging profiles may delete a file touched earlier in the iteration
+            if (!seen.insert(file.get()).second || !tree.all_files.contains(file)) {
+              continue;
+            }
+            if (!sample_extents) {
+              accountant.markDirty(file);
+            }
+            if (!punch->punchable(*file, tree.fileSize(file))) {
+              tree.removeFromPunchableFiles(file);
+            }
+            tree.touch(file);
+            if (file == result_node) {
+              result_file = file;
+            }
           }
-          if (file->path(true) == result.getPath()) {
-            result.setFileExtentCount(updated_extents_size);
+          if (sample_extents) {
+            if (iteration % sample_interval == 0) {
+              extents_estimate = estimator.estimate(tree.all_files.items());
+              logger.debug("Estimated extents count: {:.0f} +- {:.0f} from {} of {} files", extents_estimate.total, extents_estimate.margin, extents_estimate.sampled, extents_estimate.population);
+            }
+          } else {
+            if ((iteration + 1) % extents_interval == 0) {
+              accountant.submit();
+            }
+            accountant.collect();
+            if (result_file != nullptr) {
+              // With background workers this is the last count known, the fresh one lands in one of the next iterations
+              result.setFileExtentCount(result_file->getExtentsCount(false));
+            }
+            extents_estimate.total = tree.total_extents_count;
           }
         }
-        logger.debug("Total extents count: {}, File Count {}, F avail files {}, free space {} MB", tree.total_extents_count, tree.all_files.size(), tree.files_for_fallocate.size(),
-                     fs_utils::get_fs_status(getParameter("directory").get_string()).available / 1024 / 1024);
-        result.setExtentsCount(tree.total_extents_count);
+        logger.debug("Total extents count: {:.0f}, File Count {}, F avail files {}, free space {} MB", extents_estimate.total, tree.all_files.size(), tree.files_for_fallocate.size(),
+                     free_space->status().available / 1024 / 1024);
+        result.setExtentsCount(std::llround(extents_estimate.total));
+        result.setExtentsCountMargin(extents_estimate.margin);
         result.commit();
         result = Result();
+        result_node = nullptr;
         if (tree.findNullPointer()) {
           throw std::runtime_error("Null pointer found");
         }
         iteration++;
-        bar.set_meta("extents", fmt::format("{}", tree.total_extents_count));
+        bar.set_meta("extents", fmt::format("{:.0f}", extents_estimate.total));
         bar.set_meta("f-count", fmt::format("{}", tree.all_files.size()));
         if (extents_curve.isFitted()) {
           bar.set_meta("slope", fmt::format("{:.3f}", extents_curve.slopeAngle()));
         }
-        if (getParameter("iterations").get_int() != -1) {
+        if (settings.iterations != -1) {
           bar.update(iteration);
         } else {
           bar.update(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now() - start));
         }
         if (touched_files.size() > 0) {
-          extents_curve.addPoint(tree.total_extents_count);
+          // In sample mode the last estimate is repeated until the next one, the curve keeps one point per iteration
+          extents_curve.addPoint(extents_estimate.total);
         }
         touched_files.clear();
+        if (recorder) {
+          recorder->endIteration();
+        }
+        if (freespace_map_interval > 0 && iteration % freespace_map_interval == 0) {
+          map_free_space();
+        }
+        if (target && iteration % target_interval == 0) {
+          compare_with_target();
+        }
+        if (probe_interval > 0 && iteration % probe_interval == 0) {
+          run_probe("interval");
+        } else if (next_probe_utilization < probe_utilizations.size() && current_utilization() >= probe_utilizations[next_probe_utilization]) {
+          // A jump over several thresholds runs a single probe
+          double utilization = current_utilization();
+          while (next_probe_utilization < probe_utilizations.size() && utilization >= probe_utilizations[next_probe_utilization]) {
+            next_probe_utilization++;
+          }
+          run_probe(fmt::format("utilization {}", probe_utilizations[next_probe_utilization - 1]));
+        }
+        if (!checkpoint_path.empty() && std::chrono::steady_clock::now() - last_checkpoint >= checkpoint_interval) {
+          save_checkpoint();
+        }
         break;
       default:
         break;
     }
+    for (auto& [name, value] : overridden) {
+      setParameter(name, value);
+    }
+    if (!overridden.empty()) {
+      load_settings();
+    }
   }
 
   // Count files and total extent count
 
-  int file_count = 0;
-  int total_extents = 0;
-  for (auto& file : tree.all_files) {
-    file_count++;
-    total_extents += file->getExtents().size();
-  }
+  int file_count = tree.all_files.size();
   logger.set_progress_bar(nullptr);
-  logger.info("File count: {}, total extents: {}", file_count, total_extents);
+  if (!checkpoint_path.empty() && !getParameter("cleanup").get_bool()) {
+    // The final state is what an aged image is reused from (see --base)
+    save_checkpoint();
+    logger.info("Final state saved to checkpoint {}", checkpoint_path);
+  }
+  free_space->reconcile();
+  logger.info("Free space model: {} reconciliations, max drift {} kB, final drift {} kB", free_space->reconcileCount(), free_space->maxDrift() / 1024, free_space->lastDrift() / 1024);
+  Result::addMeta("freespace_reconciles", std::to_string(free_space->reconcileCount()));
+  Result::addMeta("freespace_max_drift", std::to_string(free_space->maxDrift()));
+  if (target) {
+    Result::addMeta("target_reached", target->last().converged ? "true" : "false");
+  }
+  if (freespace_map_interval > 0) {
+    Result::addMeta("freespace_fragmentation_index", fmt::format("{:.4f}", free_fragmentation));
+  }
+  if (recorder) {
+    recorder->finish();
+    logger.info("Recorded {} operations to {}", recorder->count(), getParameter("record").get_string());
+  }
+  if (sample_extents) {
+    // Scanning the whole tree is exactly what sample mode avoids
+    extents_estimate = estimator.estimate(tree.all_files.items());
+    logger.info("File count: {}, total extents: {:.0f} +- {:.0f} (95% confidence, {} files scanned)", file_count, extents_estimate.total, extents_estimate.margin, extents_estimate.sampled);
+  } else {
+    int64_t total_extents = accountant.scanAll();
+    logger.info("File count: {}, total extents: {}", file_count, total_extents);
+  }
   if (getParameter("cleanup").get_bool()) {
     for (auto& file : tree.all_files) {
-      std::filesystem::remove(file->path(true));
+      tree.unlink(file);
+      tree.unlink(file, HARDLINK_SUFFIX);
     }
-    tree.bottomUpDirWalk(tree.getRoot(), [&](FileTree::Nodeptr dir) { std::filesystem::remove(dir->path(true)); });
+    tree.bottomUpDirWalk(tree.getRoot(), [&](FileTree::Nodeptr dir) { tree.unlink(dir); });
   } else {
     logger.info("Not cleaning up, files will remain in the directory");
   }
 }
 
-void AgingScenario::compute_probabilities(std::map<std::string, double>& probabilities, FileTree& tree, PolyCurve& curve) {
-  probabilities.clear();
-  auto fs_status = fs_utils::get_fs_status(getParameter("directory").get_string());
-
-  // double CAF(double x) { return sqrt(1 - (x * x)); }
-  // logger.debug("Capacity: {}, available: {}", fs_status.capacity, fs_status.available);
-  // logger.debug("CAF input: {}", ((float(fs_status.capacity - fs_status.available) / float(fs_status.capacity))));
-
+double AgingScenario::capacity_awareness(std::filesystem::space_info& fs_status) {
   // Handle case when available space is less than block size. If this happens, we can't write any more data. Even thought the drive isnt completely full.
-  auto safe_margin = DataSize<DataUnit::B>::fromString(getParameter("settings-safe-margin").get_string());
-
-  if (fs_status.available <= (safe_margin.get_value() + get_block_size().get_value())) {
+  if (fs_status.available <= reserved_space) {
     fs_status.available = 0;
   }
 
   double caf = CAF((float(fs_status.capacity - fs_status.available) / float(fs_status.capacity)));
-  caf = floorTo(caf, 3);
+  return floorTo(caf, 3);
+}
+
+std::map<std::string, int> AgingScenario::profileActions() {
+  return {{"none", S},
+          {"create_file", CREATE_FILE},
+          {"create_file_fallocate", CREATE_FILE_FALLOCATE},
+          {"create_file_overwrite", CREATE_FILE_OVERWRITE},
+          {"create_file_read", CREATE_FILE_READ},
+          {"create_dir", CREATE_DIR},
+          {"alter_smaller_truncate", ALTER_SMALLER_TRUNCATE},
+          {"alter_smaller_fallocate", ALTER_SMALLER_FALLOCATE},
+          {"alter_bigger_write", ALTER_BIGGER_WRITE},
+          {"alter_bigger_fallocate", ALTER_BIGGER_FALLOCATE},
+          {"alter_metadata", ALTER_METADATA},
+          {"alter_metadata_xattr", ALTER_METADATA_XATTR},
+          {"alter_metadata_rename", ALTER_METADATA_RENAME},
+          {"alter_metadata_link", ALTER_METADATA_LINK},
+          {"alter_metadata_chmod", ALTER_METADATA_CHMOD},
+          {"alter_metadata_utimes", ALTER_METADATA_UTIMES},
+          {"delete_file", DELETE_FILE},
+          {"delete_dir", DELETE_DIR},
+          {"end", END}};
+}
+
+std::vector<std::string> AgingScenario::profileVariables() { return {"utilization", "caf", "files", "directories", "ndirs", "extents", "punchable", "rapid_aging", "iteration", "free_frag", "xattrs"}; }
+
+std::vector<double> AgingScenario::profile_variables(FileTree& tree, int iteration, double extents) {
+  auto fs_status = free_space->status();
+  double caf = capacity_awareness(fs_status);
+  double utilization = fs_status.capacity == 0 ? 1.0 : double(fs_status.capacity - fs_status.available) / double(fs_status.capacity);
+#if __linux__
+  bool punchable = settings.punch_holes && tree.hasPunchableFiles();
+#else
+  bool punchable = false;
+#endif
+  return {utilization, caf, double(tree.getFileCount()), double(tree.getDirectoryCount()), double(settings.ndirs), extents, double(punchable), double(rapid_aging), double(iteration), free_fragmentation, double(xattrs)};
+}
+
+bool AgingScenario::compute_probabilities(Probabilities& probabilities, FileTree& tree, PolyCurve& curve) {
+  auto reconciles = free_space->reconcileCount();
+  auto fs_status = free_space->status();
+  if (free_space->reconcileCount() != reconciles) {
+    logger.debug("Free space model reconciled, drift {} kB", free_space->lastDrift() / 1024);
+  }
+
+  // double CAF(double x) { return sqrt(1 - (x * x)); }
+  // logger.debug("Capacity: {}, available: {}", fs_status.capacity, fs_status.available);
+  // logger.debug("CAF input: {}", ((float(fs_status.capacity - fs_status.available) / float(fs_status.capacity))));
+
+  double caf = capacity_awareness(fs_status);
 
   // When there is no files in the system, we must write first file
   // and then we can start to delete files. So we set pC to 1.0
   if (tree.getFileCount() == 0) {
     caf = 1.;
   }
-  probabilities["pC"] = caf;
-  probabilities["pD"] = 0.1 * (1.0 - caf);
-  probabilities["pA"] = 1 - caf - probabilities["pD"];
-  probabilities["pAM"] = 0.1;
-  probabilities["pAB"] = caf - probabilities["pAM"];
 
-  probabilities["pABF"] = 0;
-  probabilities["pABW"] = 1 - probabilities["pABF"];
+  ProbabilityInputs inputs;
+  inputs.caf = caf;
+  inputs.no_files = tree.getFileCount() == 0;
+  inputs.punchable = settings.punch_holes && tree.hasPunchableFiles();
+  inputs.directories = tree.getDirectoryCount();
+  inputs.rapid_aging = rapid_aging;
+  if (inputs == probability_inputs) {
+    return false;
+  }
+  probability_inputs = inputs;
 
-  probabilities["pAS"] = 1 - probabilities["pAM"] - probabilities["pAB"];
+  probabilities[pC] = caf;
+  probabilities[pD] = 0.1 * (1.0 - caf);
+  probabilities[pA] = 1 - caf - probabilities[pD];
+  probabilities[pAM] = 0.1;
+  probabilities[pAB] = caf - probabilities[pAM];
+
+  probabilities[pABF] = 0;
+  probabilities[pABW] = 1 - probabilities[pABF];
+
+  probabilities[pAS] = 1 - probabilities[pAM] - probabilities[pAB];
 #if __linux__
-  if (getParameter("features-punch-hole").get_bool() && tree.hasPunchableFiles()) {
-    probabilities["pAST"] = 0.1;
+  if (inputs.punchable) {
+    probabilities[pAST] = 0.1;
   } else {
-    probabilities["pAST"] = 1;
+    probabilities[pAST] = 1;
   }
-  probabilities["pASF"] = 1 - probabilities["pAST"];
+  probabilities[pASF] = 1 - probabilities[pAST];
 #else
-  probabilities["pAST"] = 1;
-  probabilities["pASF"] = 0;
+  probabilities[pAST] = 1;
+  probabilities[pASF] = 0;
 #endif
-  probabilities["pDD"] = 0.01;
-  probabilities["pDF"] = 1 - probabilities["pDD"];
-  probabilities["pCF"] = (tree.getDirectoryCount() / getParameter("ndirs").get_int());
-  probabilities["pCFF"] = 0;
+  // Metadata operations, extended attributes only where the filesystem has them
+  probabilities[pAMX] = xattrs ? 0.3 : 0;
+  probabilities[pAMR] = (1 - probabilities[pAMX]) * 2 / 7;
+  probabilities[pAML] = (1 - probabilities[pAMX]) * 2 / 7;
+  probabilities[pAMC] = (1 - probabilities[pAMX]) * 1.5 / 7;
+  probabilities[pAMU] = 1 - probabilities[pAMX] - probabilities[pAMR] - probabilities[pAML] - probabilities[pAMC];
+  probabilities[pDD] = 0.01;
+  probabilities[pDF] = 1 - probabilities[pDD];
+  probabilities[pCF] = (tree.getDirectoryCount() / settings.ndirs);
+  probabilities[pCFF] = 0;
   if (rapid_aging) {
-    probabilities["pCFF"] = probabilities["pCF"];
-    probabilities["pCF"] = 0;
-    probabilities["pABF"] = 1;
-    probabilities["pABW"] = 0;
-  }
-  probabilities["pCD"] = 1 - probabilities["pCF"] - probabilities["pCFF"];
-  probabilities["pCFO"] = 0.3;
-  probabilities["pCFR"] = 0.3;
-  probabilities["pCFE"] = 1 - probabilities["pCFO"] - probabilities["pCFR"];
-  probabilities["p1"] = 1.0;
-
-  if (getParameter("features-log-probs").get_bool()) {
+    probabilities[pCFF] = probabilities[pCF];
+    probabilities[pCF] = 0;
+    probabilities[pABF] = 1;
+    probabilities[pABW] = 0;
+  }
+  probabilities[pCD] = 1 - probabilities[pCF] - probabilities[pCFF];
+  probabilities[pCFO] = 0.3;
+  probabilities[pCFR] = 0.3;
+  probabilities[pCFE] = 1 - probabilities[pCFO] - probabilities[pCFR];
+  probabilities[p1] = 1.0;
+
+  if (settings.log_probabilities) {
     std::string logMessage
         = fmt::format("Capacity: {} MB | available: {} MB ({}) | pC: {:.4f}, pD: {:.4f}, pA: {:.4f}, sum p {:.4f} ", fs_status.capacity / 1024 / 1024, fs_status.available / 1024 / 1024,
-                      fs_status.available, probabilities["pC"], probabilities["pD"], probabilities["pA"], probabilities["pC"] + probabilities["pD"] + probabilities["pA"]);
+                      fs_status.available, probabilities[pC], probabilities[pD], probabilities[pA], probabilities[pC] + probabilities[pD] + probabilities[pA]);
     logMessage += fmt::format("Capacity: {} B | available: {} B ", fs_status.capacity, fs_status.available);
-    logMessage += fmt::format("pAM: {:.2f}, pAB: {:.2f}, pAS: {:.2f}, sum pA {:.2f} ", probabilities["pAM"], probabilities["pAB"], probabilities["pAS"],
-                              probabilities["pAM"] + probabilities["pAB"] + probabilities["pAS"]);
-    logMessage += fmt::format("pAST: {:.2f}, pASF: {:.2f}, sum pAS {:.2f} ", probabilities["pAST"], probabilities["pASF"], probabilities["pAST"] + probabilities["pASF"]);
-    logMessage += fmt::format("pDD: {:.2f}, pDF: {:.2f}, sum pD {:.2f} ", probabilities["pDD"], probabilities["pDF"], probabilities["pDD"] + probabilities["pDF"]);
-    logMessage += fmt::format("pCF: {:.2f}, pCD: {:.2f}, sum pC {:.2f} ", probabilities["pCF"], probabilities["pCD"], probabilities["pCF"] + probabilities["pCD"]);
+    logMessage += fmt::format("pAM: {:.2f}, pAB: {:.2f}, pAS: {:.2f}, sum pA {:.2f} ", probabilities[pAM], probabilities[pAB], probabilities[pAS],
+                              probabilities[pAM] + probabilities[pAB] + probabilities[pAS]);
+    logMessage += fmt::format("pAST: {:.2f}, pASF: {:.2f}, sum pAS {:.2f} ", probabilities[pAST], probabilities[pASF], probabilities[pAST] + probabilities[pASF]);
+    logMessage += fmt::format("pDD: {:.2f}, pDF: {:.2f}, sum pD {:.2f} ", probabilities[pDD], probabilities[pDF], probabilities[pDD] + probabilities[pDF]);
+    logMessage += fmt::format("pCF: {:.2f}, pCD: {:.2f}, sum pC {:.2f} ", probabilities[pCF], probabilities[pCD], probabilities[pCF] + probabilities[pCD]);
     logger.debug(logMessage);
   }
+  return true;
+}
+
+void AgingScenario::steer_probabilities(Probabilities& probabilities, const AgingTarget::Steering& steering) {
+  double create = probabilities[pC] * steering.create;
+  double remove = probabilities[pD] / steering.create;
+  double alter = probabilities[pA] * steering.alter;
+  double sum = create + remove + alter;
+  if (sum > 0) {
+    probabilities[pC] = create / sum;
+    probabilities[pD] = remove / sum;
+    probabilities[pA] = alter / sum;
+  }
+  // Growing and shrinking files moves the utilization as well
+  double bigger = probabilities[pAB] * steering.create;
+  double smaller = probabilities[pAS] / steering.create;
+  if (bigger + smaller > 0) {
+    double resize = probabilities[pAB] + probabilities[pAS];
+    probabilities[pAB] = bigger / (bigger + smaller) * resize;
+    probabilities[pAS] = smaller / (bigger + smaller) * resize;
+  }
+  if (steering.directories > 0) {
+    // Replaces the fill up to ndirs, the files keep their mutual ratio
+    double directories = steering.directories / (steering.directories + 19);
+    double files = probabilities[pCF] + probabilities[pCFF];
+    probabilities[pCF] = files > 0 ? probabilities[pCF] / files * (1 - directories) : 1 - directories;
+    probabilities[pCFF] = files > 0 ? probabilities[pCFF] / files * (1 - directories) : 0;
+    probabilities[pCD] = directories;
+  }
 }
 
 DataSize<DataUnit::B> AgingScenario::get_file_size(uint64_t range_from, uint64_t range_to, bool safe) {
   logger.debug("get_file_size({},{},{})", range_from, range_to, safe);
-  std::random_device rand_dev;
-  std::mt19937 generator(rand_dev());
-  DataSize<DataUnit::B> return_size(0);
-
-  if (getParameter("sdist").get_string() == "uniform") {
-    std::uniform_int_distribution<uint64_t> distr(range_from, range_to);
-    auto d = distr(generator);
-    return_size = DataSize<DataUnit::B>(d);
-  } else if (getParameter("sdist").get_string() == "normal") {
-    double mean = range_to / 2.0;
-    double stddev = mean / 2.0;
-    std::normal_distribution<double> distr(mean, stddev);
-    return_size = DataSize<DataUnit::B>(distr(generator));
-  } else {
-    throw std::runtime_error("Invalid file size distribution!");
-  }
+  DataSize<DataUnit::B> return_size(size_distribution->sample(range_from, range_to));
 
   if (safe) {
-    std::filesystem::space_info fs_status = fs_utils::get_fs_status(getParameter("directory").get_string());
-    auto block_size = get_block_size().convert<DataUnit::B>().get_value();
-    auto safe_margin = DataSize<DataUnit::B>::fromString(getParameter("settings-safe-margin").get_string());
+    std::filesystem::space_info fs_status = free_space->status();
+    auto block_size = settings.block_size;
     // Subtract one block as a safety margin from the available space.
-    uint64_t safe_available = (fs_status.available > safe_margin.get_value() ? fs_status.available - safe_margin.get_value() : 0);
+    uint64_t safe_available = (fs_status.available > settings.safe_margin ? fs_status.available - settings.safe_margin : 0);
 
     logger.debug("return size= {}, free space = {}, safe available = {}", return_size.get_value(), fs_status.available, safe_available);
 
@@ -805,9 +1451,120 @@ DataSize<DataUnit::B> AgingScenario::get_file_size(uint64_t range_from, uint64_t
 }
 
 DataSize<DataUnit::B> AgingScenario::get_file_size() {
-  auto max_size = DataSize<DataUnit::B>::fromString(getParameter("maxfsize").get_string()).convert<DataUnit::B>();
-  auto min_size = DataSize<DataUnit::B>::fromString(getParameter("minfsize").get_string()).convert<DataUnit::B>();
-  auto fsize = get_file_size(min_size.get_value(), max_size.get_value());
-  // logger.debug("get_file_size: {} - {} : {} ", min_size.get_value(), max_size.get_value(), fsize.get_value());
-  return fsize;
+  uint64_t from, to;
+  if (target && target->sizeRange(from, to)) {
+    return get_file_size(from, to);
+  }
+  return get_file_size(settings.min_file_size, settings.max_file_size);
+}
+
+void AgingScenario::load_settings() {
+  settings.iterations = getParameter("iterations").get_int();
+  settings.direct_io = getParameter("direct_io").get_bool();
+  settings.sync = getParameter("sync").get_bool();
+  settings.block_size = get_block_size().get_value();
+  settings.min_file_size = DataSize<DataUnit::B>::fromString(getParameter("minfsize").get_string()).get_value();
+  settings.max_file_size = DataSize<DataUnit::B>::fromString(getParameter("maxfsize").get_string()).get_value();
+  settings.safe_margin = DataSize<DataUnit::B>::fromString(getParameter("settings-safe-margin").get_string()).get_value();
+  settings.punch_holes = getParameter("features-punch-hole").get_bool();
+  settings.ndirs = getParameter("ndirs").get_int();
+  settings.log_probabilities = getParameter("features-log-probs").get_bool();
+  settings.rapid_aging_min_time = stringToChrono(getParameter("rapid-aging-min-time").get_string());
+  settings.rapid_aging_threshold = getParameter("rapid-aging-threshold").get_int();
+  settings.rapid_aging_max_time = getParameter("rapid-aging-max-time").is_set() ? stringToChrono(getParameter("rapid-aging-max-time").get_string()) : std::chrono::seconds(-1);
+  settings.rapid_aging_max_extents = getParameter("rapid-aging-max-extents").is_set() ? getParameter("rapid-aging-max-extents").get_int() : -1;
+}
+
+std::vector<FileTree::Nodeptr> AgingScenario::reconcile_checkpoint(FileTree& tree, int64_t saved_at, const std::vector<std::string>& keep, bool base) {
+  // Nodes whose files disappeared after the checkpoint was written
+  size_t checkpointed_files = tree.all_files.size();
+  if (base && checkpointed_files == 0) {
+    // Nothing tells whether the directory is the aged one
+    throw std::runtime_error("Base checkpoint has no files, it can't be matched with the directory");
+  }
+  size_t missing = 0;
+  auto files = tree.all_files.items();
+  auto directories = tree.all_directories.items();
+  for (auto& directory : directories) {
+    bool removed = directory->parent->folders.find(directory->name) == directory->parent->folders.end();
+    if (!removed && !std::filesystem::is_directory(directory->path(true))) {
+      logger.debug("Directory {} from the checkpoint is missing", directory->path(true));
+      tree.remove(directory);
+    }
+  }
+  std::vector<FileTree::Nodeptr> changed;
+  for (auto& file : files) {
+    if (file->parent->files.find(file->name) == file->parent->files.end()) {
+      // Removed with its directory
+      tree.total_extents_count -= file->getExtentsCount(false);
+      missing++;
+      continue;
+    }
+    struct stat file_stat;
+    if (stat(file->path(true).c_str(), &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+      tree.total_extents_count -= file->getExtentsCount(false);
+      tree.remove(file);
+      missing++;
+      continue;
+    }
+    // The run was interrupted in the middle of the next iterations, their changes have to be rescanned
+    if (file_stat.st_mtime >= saved_at) {
+      file->invalidateExtents();
+      changed.push_back(file);
+    }
+  }
+  if (missing * 2 > checkpointed_files) {
+    throw std::runtime_error(fmt::format("{} of {} files from the checkpoint are missing in {}, it doesn't belong to this directory", missing, checkpointed_files, tree.getRoot()->path(true)));
+  }
+  if (missing > 0) {
+    logger.warn("{} files from the checkpoint are missing", missing);
+  }
+
+  // Entries created after the checkpoint are unknown to the tree and would skew the run
+  std::vector<std::filesystem::path> kept;
+  for (auto& path : keep) {
+    if (!path.empty()) {
+      kept.push_back(std::filesystem::weakly_canonical(path));
+      kept.push_back(std::filesystem::weakly_canonical(path + ".tmp"));
+    }
+  }
+  std::filesystem::path root = tree.getRoot()->path(true);
+  kept.push_back(std::filesystem::weakly_canonical(root / "lost+found"));
+  std::vector<std::filesystem::path> unknown;
+  for (auto it = std::filesystem::recursive_directory_iterator(root); it != std::filesystem::recursive_directory_iterator(); ++it) {
+    if (std::find(kept.begin(), kept.end(), std::filesystem::weakly_canonical(it->path())) != kept.end()) {
+      continue;
+    }
+    std::string relative = std::filesystem::relative(it->path(), root).string();
+    std::string suffix = HARDLINK_SUFFIX;
+    if (relative.size() > suffix.size() && relative.compare(relative.size() - suffix.size(), suffix.size(), suffix) == 0) {
+      // Hardlink of a known file made by ALTER_METADATA_LINK
+      try {
+        if (tree.getNode(relative.substr(0, relative.size() - suffix.size()))->type == FileTree::Type::FILE) {
+          continue;
+        }
+      } catch (const std::runtime_error&) {
+      }
+    }
+    try {
+      auto node = tree.getNode(relative);
+      if ((node->type == FileTree::Type::DIRECTORY) == it->is_directory()) {
+        continue;
+      }
+    } catch (const std::runtime_error&) {
+    }
+    if (!filestorm_name(it->path().filename().string())) {
+      throw std::runtime_error(fmt::format("{} in {} wasn't created by filestorm, refusing to reconcile the checkpoint with the directory", it->path().string(), root.string()));
+    }
+    unknown.push_back(it->path());
+    it.disable_recursion_pending();
+  }
+  for (auto& path : unknown) {
+    logger.debug("Removing {} which isn't in the checkpoint", path.string());
+    std::filesystem::remove_all(path);
+  }
+  if (!unknown.empty()) {
+    logger.warn("Removed {} entries created after the checkpoint", unknown.size());
+  }
+  return changed;
 }
@@ -0,0 +1,146 @@
+#include <filestorm/scenarios/aging_profile.h>
+#include <fmt/format.h>
+
+#include <fstream>
+#include <stdexcept>
+
+AgingProfile::AgingProfile(const nlohmann::ordered_json& profile, const std::map<std::string, int>& actions, const std::vector<std::string>& variables) : _variables(variables.size()) {
+  for (auto& variable : variables) {
+    _slots[variable] = _slot_names.size();
+    _slot_names.push_back(variable);
+  }
+  if (profile.contains("probabilities")) {
+    for (auto& [name, source] : profile["probabilities"].items()) {
+      if (_slots.count(name)) {
+        throw std::runtime_error(fmt::format("Aging profile: probability {} is already defined or is a runtime variable", name));
+      }
+      addProbability(name, source.is_string() ? source.get<std::string>() : source.dump());
+    }
+  }
+
+  if (!profile.contains("states") || !profile["states"].is_object() || profile["states"].empty()) {
+    throw std::runtime_error("Aging profile: no states defined");
+  }
+  std::map<std::string, int> state_index;
+  bool has_end = false;
+  for (auto& [name, definition] : profile["states"].items()) {
+    State state{name, actions.at("none"), {}};
+    if (definition.contains("action")) {
+      auto action = actions.find(definition["action"].get<std::string>());
+      if (action == actions.end()) {
+        throw std::runtime_error(fmt::format("Aging profile: unknown action {} of state {}", definition["action"].get<std::string>(), name));
+      }
+      state.action = action->second;
+      has_end = has_end || action->first == "end";
+    }
+    if (definition.contains("parameters")) {
+      for (auto& [parameter, value] : definition["parameters"].items()) {
+        state.parameters.emplace_back(parameter, value.is_string() ? value.get<std::string>() : value.dump());
+      }
+    }
+    state_index[name] = _states.size();
+    _states.push_back(std::move(state));
+  }
+  if (!has_end) {
+    throw std::runtime_error("Aging profile: at least one state has to run the end action");
+  }
+  auto find_state = [&](const std::string& name) {
+    auto state = state_index.find(name);
+    if (state == state_index.end()) {
+      throw std::runtime_error(fmt::format("Aging profile: unknown state {}", name));
+    }
+    return state->second;
+  };
+  _initial = find_state(profile.value("initial", _states.front().name));
+
+  if (!profile.contains("transitions") || !profile["transitions"].is_array()) {
+    throw std::runtime_error("Aging profile: no transitions defined");
+  }
+  std::vector<bool> has_outgoing(_states.size(), false);
+  size_t index = 0;
+  for (auto& transition : profile["transitions"]) {
+    int from = find_state(transition.at("from").get<std::string>());
+    int to = find_state(transition.at("to").get<std::string>());
+    auto& probability = transition.at("probability");
+    std::string source = probability.is_string() ? probability.get<std::string>() : probability.dump();
+    // Inline expressions get their own slot named after the transition
+    std::string key = source;
+    if (!_slots.count(key)) {
+      key = fmt::format("{}->{}", _states[from].name, _states[to].name);
+      if (_slots.count(key)) {
+        key += fmt::format("#{}", index);
+      }
+      addProbability(key, source);
+    }
+    // Keys keep the order of the profile, which is the order transitions are tried in
+    _transitions.emplace(fmt::format("{:06}", index++), Transition(from, to, key));
+    has_outgoing[from] = true;
+  }
+  for (size_t state = 0; state < _states.size(); state++) {
+    if (!has_outgoing[state]) {
+      throw std::runtime_error(fmt::format("Aging profile: state {} has no outgoing transition", _states[state].name));
+    }
+  }
+  _values.assign(_slot_names.size(), 0.0);
+  _changed.assign(_slot_names.size(), 0);
+}
+
+AgingProfile AgingProfile::fromFile(const std::string& path, const std::map<std::string, int>& actions, const std::vector<std::string>& variables) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    throw std::runtime_error(fmt::format("Cannot open aging profile {}", path));
+  }
+  nlohmann::ordered_json profile;
+  try {
+    profile = nlohmann::ordered_json::parse(file);
+  } catch (const nlohmann::json::exception& e) {
+    throw std::runtime_error(fmt::format("Invalid aging profile {}: {}", path, e.what()));
+  }
+  return AgingProfile(profile, actions, variables);
+}
+
+size_t AgingProfile::addProbability(const std::string& name, const std::string& source) {
+  // Only runtime variables and probabilities defined so far can be used
+  try {
+    _expressions.push_back(Expression::compile(source, [this](const std::string& variable) {
+      auto slot = _slots.find(variable);
+      if (slot == _slots.end()) {
+        throw std::invalid_argument(fmt::format("unknown variable {}", variable));
+      }
+      return slot->second;
+    }));
+  } catch (const std::invalid_argument& e) {
+    throw std::runtime_error(fmt::format("Aging profile: probability {}: {}", name, e.what()));
+  }
+  size_t slot = _slot_names.size();
+  _slots[name] = slot;
+  _slot_names.push_back(name);
+  return slot;
+}
+
+bool AgingProfile::update(const std::vector<double>& variables) {
+  bool any_changed = !_evaluated;
+  for (size_t slot = 0; slot < _variables; slot++) {
+    _changed[slot] = !_evaluated || _values[slot] != variables[slot];
+    any_changed = any_changed || _changed[slot];
+    _values[slot] = variables[slot];
+  }
+  if (!any_changed) {
+    return false;
+  }
+  for (size_t i = 0; i < _expressions.size(); i++) {
+    size_t slot = _variables + i;
+    bool dirty = !_evaluated;
+    for (auto variable : _expressions[i].variables()) {
+      dirty = dirty || _changed[variable];
+    }
+    _changed[slot] = 0;
+    if (dirty) {
+      double value = _expressions[i].evaluate(_values);
+      _changed[slot] = value != _values[slot];
+      _values[slot] = value;
+    }
+  }
+  _evaluated = true;
+  return true;
+}
@@ -0,0 +1,324 @@
+#include <fcntl.h>
+#include <filestorm/actions/actions.h>
+#include <filestorm/data_sizes.h>
+#include <filestorm/extents_accountant.h>
+#include <filestorm/filetree.h>
+#include <filestorm/ioengines/buffer_arena.h>
+#include <filestorm/ioengines/engine_file.h>
+#include <filestorm/op_log.h>
+#include <filestorm/result.h>
+#include <filestorm/scenarios/aging_replay.h>
+#include <filestorm/utils.h>
+#include <filestorm/utils/logger.h>
+#include <filestorm/utils/metadata.h>
+#include <fmt/format.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <unordered_set>
+#include <vector>
+
+AgingReplayScenario::AgingReplayScenario() {
+  _name = "aging-replay";
+  _description = "Replay operations recorded by the aging scenario (--record) at full speed.";
+  addParameter(Parameter("d", "directory", "Set the target directory where the operations are replayed", "/tmp/filestorm/"));
+  addParameter(Parameter("", "log", "Operation log recorded by the aging scenario", "aging.oplog"));
+  addParameter(Parameter("b", "blocksize", "RW operations blocksize, the recorded one by default", ""));
+  addParameter(Parameter("y", "sync", "Sync after each iteration", "false"));
+  addParameter(Parameter("o", "direct_io", "Use direct IO", "false"));
+  addParameter(Parameter("", "buffers-hugepages", "Back the preallocated I/O buffers with 2 MB hugepages: none, thp (transparent hugepages) or hugetlb (reserved hugepages, falls back to thp)", "none"));
+  addParameter(Parameter("", "buffers-lock", "Lock the preallocated I/O buffers in memory (mlock)", "false"));
+  addParameter(Parameter("", "create-dir", "If testing directory doesn't exists try to create it.", "false"));
+  addParameter(Parameter("", "cleanup", "Should clean up files/folders after the replay is done", "true"));
+  addParameter(Parameter("", "extents-workers", "Number of background threads scanning file extents. With 0 the files are scanned synchronously at the end of each iteration.", "1"));
+  addParameter(Parameter("", "extents-fiemap-sync", "Flush dirty data of a file before mapping its extents during the replay (FIEMAP_FLAG_SYNC), the final count always flushes", "false"));
+}
+
+AgingReplayScenario::~AgingReplayScenario() {}
+
+void AgingReplayScenario::run(std::unique_ptr<IOEngine>& ioengine) {
+  std::string directory = getParameter("directory").get_string();
+  if (!std::filesystem::exists(directory)) {
+    if (getParameter("create-dir").get_bool()) {
+      std::filesystem::create_directories(directory);
+    } else {
+      throw std::runtime_error(fmt::format("Directory {} does not exist!", directory));
+    }
+  }
+  auto entries = std::filesystem::directory_iterator(directory);
+  if (!std::all_of(std::filesystem::begin(entries), std::filesystem::end(entries), [](const auto& entry) { return entry.path().filename() == "lost+found"; })) {
+    throw std::runtime_error(fmt::format("{} is not empty!", directory));
+  }
+
+  // Count iterations first for the progress bar
+  int total_iterations = 0;
+  {
+    OpLogReader counter(getParameter("log").get_string());
+    OpRecord record;
+    while (counter.next(record)) {
+      total_iterations += record.type == OpRecord::END;
+    }
+  }
+  OpLogReader reader(getParameter("log").get_string());
+  uint64_t block_size = getParameter("blocksize").is_set() ? DataSize<DataUnit::B>::fromString(getParameter("blocksize").get_string()).get_value() : reader.blockSize();
+  bool direct_io = getParameter("direct_io").get_bool();
+  logger.info("Replaying {} iterations from {} with block size {}", total_iterations, getParameter("log").get_string(), block_size);
+
+  FileTree tree(directory);
+  ExtentsAccountant accountant(tree, getParameter("extents-workers").get_int(), getParameter("extents-fiemap-sync").get_bool());
+  // Nodes by their id in the log
+  std::vector<FileTree::Nodeptr> nodes = {tree.getRoot()};
+  auto node = [&](uint32_t id) {
+    if (id >= nodes.size() || nodes[id] == nullptr) {
+      throw std::runtime_error(fmt::format("Operation log refers to unknown node {}", id));
+    }
+    return nodes[id];
+  };
+  auto add_node = [&](uint32_t id, FileTree::Nodeptr created) {
+    if (id >= nodes.size()) {
+      nodes.resize(id + 1);
+    }
+    nodes[id] = created;
+  };
+
+  BufferArena buffers(block_size, ioengine->queue_depth(), BufferArena::parseHugePages(getParameter("buffers-hugepages").get_string()), getParameter("buffers-lock").get_bool());
+
+  ProgressBar bar("Aging Replay");
+  bar.set_total(total_iterations);
+  logger.set_progress_bar(&bar);
+
+  int iteration = 0;
+  std::vector<OpRecord> pending;
+  OpRecord record;
+  while (reader.next(record)) {
+    if (record.type != OpRecord::END) {
+      // Operations of an iteration run only once it is complete in the log
+      pending.push_back(std::move(record));
+      continue;
+    }
+    Result result;
+    result.setIteration(iteration);
+    std::vector<FileTree::Nodeptr> touched_files;
+    // File of the path in the result, found among the touched files without comparing paths
+    FileTree::Nodeptr result_node;
+    for (auto& op : pending) {
+      std::chrono::nanoseconds duration(0);
+      FileTree::Nodeptr file;
+      switch (op.type) {
+        case OpRecord::CREATE_DIR: {
+          auto dir = tree.addDirectory(node(op.parent), op.name);
+          add_node(op.id, dir);
+          auto path = dir->path(true);
+          duration = MeasuredCBAction([&]() { tree.createDirectory(dir); }).exec();
+          result.setAction(Result::Action::CREATE_DIR);
+          result.setPath(path);
+          result_node = nullptr;
+          result.setSize(DataSize<DataUnit::B>(0));
+          result.setDuration(duration);
+          continue;
+        }
+        case OpRecord::CREATE_FILE:
+        case OpRecord::CREATE_FILE_FALLOCATE: {
+          file = tree.addFile(node(op.parent), op.name);
+          add_node(op.id, file);
+          if (op.type == OpRecord::CREATE_FILE) {
+            EngineFile data(*ioengine, tree, file, O_WRONLY | O_CREAT | O_TRUNC, direct_io);
+            buffers.refresh();
+            duration = MeasuredCBAction([&]() { data.write(buffers, block_size, 0, op.length); }).exec();
+            result.setAction(Result::Action::CREATE_FILE);
+            result.setOperation(Result::Operation::WRITE);
+          } else {
+            EngineFile data(*ioengine, tree, file, O_RDWR | O_CREAT, direct_io);
+            duration = MeasuredCBAction([&]() { data.fallocate(0, op.length); }).exec();
+            result.setAction(Result::Action::CREATE_FILE_FALLOCATE);
+            result.setOperation(Result::Operation::FALLOCATE);
+          }
+          break;
+        }
+        case OpRecord::CREATE_FILE_OVERWRITE: {
+          file = node(op.id);
+          file->invalidateExtents();
+          EngineFile data(*ioengine, tree, file, O_WRONLY, direct_io);
+          buffers.refresh();
+          duration = MeasuredCBAction([&]() { data.write(buffers, block_size, 0, op.length); }).exec();
+          result.setAction(Result::Action::CREATE_FILE_OVERWRITE);
+          result.setOperation(Result::Operation::OVERWRITE);
+          break;
+        }
+        case OpRecord::CREATE_FILE_READ: {
+          file = node(op.id);
+          EngineFile data(*ioengine, tree, file, O_RDONLY, direct_io);
+          duration = MeasuredCBAction([&]() { data.read(buffers, block_size, 0, op.length); }).exec();
+          result.setAction(Result::Action::CREATE_FILE_READ);
+          result.setOperation(Result::Operation::READ);
+          break;
+        }
+        case OpRecord::ALTER_SMALLER_TRUNCATE: {
+          file = node(op.id);
+          file->markExtentsDirty(op.length);
+          EngineFile data(*ioengine, tree, file, O_WRONLY, false);
+          duration = MeasuredCBAction([&]() { data.truncate(op.length); }).exec();
+          result.setAction(Result::Action::ALTER_SMALLER_TRUNCATE);
+          break;
+        }
+        case OpRecord::ALTER_SMALLER_FALLOCATE: {
+          file = node(op.id);
+          file->markExtentsDirty(op.offset, op.offset + op.length);
+          EngineFile data(*ioengine, tree, file, O_RDWR, direct_io);
+          duration = MeasuredCBAction([&]() { data.fallocate(op.offset, op.length, true); }).exec();
+          result.setAction(Result::Action::ALTER_SMALLER_FALLOCATE);
+          break;
+        }
+        case OpRecord::ALTER_BIGGER_FALLOCATE: {
+          file = node(op.id);
+          file->markExtentsDirty(op.offset);
+          if (op.length > 0) {
+            EngineFile data(*ioengine, tree, file, O_RDWR, direct_io);
+            duration = MeasuredCBAction([&]() { data.fallocate(op.offset, op.length); }).exec();
+          }
+          result.setAction(Result::Action::ALTER_BIGGER_FALLOCATE);
+          result.setOperation(Result::Operation::FALLOCATE);
+          break;
+        }
+        case OpRecord::ALTER_BIGGER_WRITE: {
+          file = node(op.id);
+          file->markExtentsDirty(op.offset);
+          EngineFile data(*ioengine, tree, file, O_WRONLY, direct_io);
+          buffers.refresh();
+          duration = MeasuredCBAction([&]() { data.write(buffers, block_size, op.offset, op.offset + op.length); }).exec();
+          result.setAction(Result::Action::ALTER_BIGGER_WRITE);
+          result.setOperation(Result::Operation::WRITE);
+          break;
+        }
+        case OpRecord::DELETE_FILE: {
+          auto deleted = node(op.id);
+          auto path = deleted->path(true);
+          accountant.forget(deleted);
+          MeasuredCBAction([&]() { tree.unlink(deleted); }).exec();
+          tree.unlink(deleted, HARDLINK_SUFFIX);
+          touched_files.erase(std::remove(touched_files.begin(), touched_files.end(), deleted), touched_files.end());
+          tree.remove(deleted);
+          nodes[op.id] = nullptr;
+          result.setAction(Result::Action::DELETE_FILE);
+          result.setPath(path);
+          result_node = nullptr;
+          continue;
+        }
+        case OpRecord::XATTR_SET:
+        case OpRecord::XATTR_REMOVE: {
+          auto path = node(op.id)->path(true);
+          auto name = fmt::format("user.filestorm.{}", op.offset);
+          if (op.type == OpRecord::XATTR_SET) {
+            std::string value(op.length, '\0');
+            generate_random_chunk(value.data(), value.size());
+            duration = MeasuredCBAction([&]() {
+                         if (!fs_utils::set_xattr(path, name, value)) {
+                           throw std::runtime_error(fmt::format("No room for extended attribute {} of {} B on {}", name, value.size(), path));
+                         }
+                       }).exec();
+            result.setAction(Result::Action::ALTER_METADATA_XATTR_SET);
+          } else {
+            duration = MeasuredCBAction([&]() { fs_utils::remove_xattr(path, name); }).exec();
+            result.setAction(Result::Action::ALTER_METADATA_XATTR_REMOVE);
+          }
+          result.setPath(path);
+          result_node = node(op.id);
+          result.setSize(DataSize<DataUnit::B>(op.length));
+          result.setDuration(duration);
+          continue;
+        }
+        case OpRecord::RENAME: {
+          auto renamed = node(op.id);
+          auto old_parent = renamed->parent;
+          auto old_name = renamed->name;
+          bool linked = tree.exists(renamed, HARDLINK_SUFFIX);
+          tree.rename(renamed, node(op.parent)->path(false) + "/" + op.name);
+          auto new_path = renamed->path(true);
+          duration = MeasuredCBAction([&]() { tree.renameFrom(old_parent, old_name, renamed); }).exec();
+          if (linked) {
+            tree.renameFrom(old_parent, old_name, renamed, HARDLINK_SUFFIX);
+          }
+          result.setAction(Result::Action::ALTER_METADATA_RENAME);
+          result.setPath(new_path);
+          result_node = renamed;
+          result.setSize(DataSize<DataUnit::B>(0));
+          result.setDuration(duration);
+          continue;
+        }
+        case OpRecord::LINK:
+        case OpRecord::UNLINK:
+        case OpRecord::CHMOD:
+        case OpRecord::UTIMES: {
+          auto path = node(op.id)->path(true);
+          if (op.type == OpRecord::LINK) {
+            duration = MeasuredCBAction([&]() { fs_utils::hard_link(path, path + HARDLINK_SUFFIX); }).exec();
+            result.setAction(Result::Action::ALTER_METADATA_LINK);
+          } else if (op.type == OpRecord::UNLINK) {
+            duration = MeasuredCBAction([&]() { std::filesystem::remove(path + HARDLINK_SUFFIX); }).exec();
+            result.setAction(Result::Action::ALTER_METADATA_UNLINK);
+          } else if (op.type == OpRecord::CHMOD) {
+            duration = MeasuredCBAction([&]() { fs_utils::change_mode(path, op.offset); }).exec();
+            result.setAction(Result::Action::ALTER_METADATA_CHMOD);
+          } else {
+            duration = MeasuredCBAction([&]() { fs_utils::set_times(path, op.offset); }).exec();
+            result.setAction(Result::Action::ALTER_METADATA_UTIMES);
+          }
+          result.setPath(path);
+          result_node = node(op.id);
+          result.setSize(DataSize<DataUnit::B>(0));
+          result.setDuration(duration);
+          continue;
+        }
+        case OpRecord::END:
+          break;
+      }
+      touched_files.push_back(file);
+      result.setPath(file->path(true));
+      result_node = file;
+      result.setSize(DataSize<DataUnit::B>(op.length));
+      result.setDuration(duration);
+    }
+    pending.clear();
+
+    if (getParameter("sync").get_bool()) {
+      sync();
+    }
+    std::unordered_set<FileTree::Node*> seen;
+    FileTree::Nodeptr result_file = nullptr;
+    for (auto& file : touched_files) {
+      if (seen.insert(file.get()).second) {
+        accountant.markDirty(file);
+        if (file == result_node) {
+          result_file = file;
+        }
+      }
+    }
+    accountant.submit();
+    accountant.collect();
+    if (result_file != nullptr) {
+      result.setFileExtentCount(result_file->getExtentsCount(false));
+    }
+    result.setExtentsCount(tree.total_extents_count);
+    result.commit();
+    iteration++;
+    bar.set_meta("extents", fmt::format("{}", tree.total_extents_count));
+    bar.set_meta("f-count", fmt::format("{}", tree.all_files.size()));
+    bar.update(iteration);
+  }
+  logger.set_progress_bar(nullptr);
+  if (reader.truncated() || !pending.empty()) {
+    logger.warn("Operation log ends in the middle of an iteration, its {} operations were skipped", pending.size());
+  }
+
+  int64_t total_extents = accountant.scanAll();
+  logger.info("Replayed {} iterations, file count: {}, total extents: {}", iteration, tree.all_files.size(), total_extents);
+  if (getParameter("cleanup").get_bool()) {
+    for (auto& file : tree.all_files) {
+      tree.unlink(file);
+      tree.unlink(file, HARDLINK_SUFFIX);
+    }
+    tree.bottomUpDirWalk(tree.getRoot(), [&](FileTree::Nodeptr dir) { tree.unlink(dir); });
+  }
+}
@@ -0,0 +1,278 @@
+#include <filestorm/data_sizes.h>
+#include <filestorm/scenarios/aging_target.h>
+#include <filestorm/utils/random.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+
+Distribution::Distribution(std::vector<double> bounds, std::vector<double> weights) : _bounds(std::move(bounds)), _weights(std::move(weights)) {
+  if (_bounds.size() != _weights.size()) {
+    throw std::invalid_argument("Distribution needs a weight for every bucket");
+  }
+  if (!std::is_sorted(_bounds.begin(), _bounds.end()) || std::adjacent_find(_bounds.begin(), _bounds.end()) != _bounds.end()) {
+    throw std::invalid_argument("Distribution bucket bounds have to be increasing");
+  }
+}
+
+Distribution Distribution::fromJson(const nlohmann::json& json, bool sizes) {
+  if (!json.is_object() || json.empty()) {
+    throw std::invalid_argument("distribution has to be a non-empty object of bucket lower bounds and weights");
+  }
+  std::vector<std::pair<double, double>> buckets;
+  for (auto& [key, value] : json.items()) {
+    if (!value.is_number() || value.get<double>() < 0) {
+      throw std::invalid_argument(fmt::format("weight of bucket {} has to be a non-negative number", key));
+    }
+    double bound;
+    try {
+      bool plain = std::all_of(key.begin(), key.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)) || c == '.'; });
+      bound = sizes && !plain ? double(DataSize<DataUnit::B>::fromString(key).get_value()) : std::stod(key);
+    } catch (const std::exception&) {
+      throw std::invalid_argument(fmt::format("invalid bucket bound {}", key));
+    }
+    buckets.emplace_back(bound, value.get<double>());
+  }
+  std::sort(buckets.begin(), buckets.end());
+  std::vector<double> bounds, weights;
+  for (auto& [bound, weight] : buckets) {
+    bounds.push_back(bound);
+    weights.push_back(weight);
+  }
+  return Distribution(bounds, weights);
+}
+
+nlohmann::json Distribution::toJson() const {
+  nlohmann::json json = nlohmann::json::object();
+  for (size_t i = 0; i < _bounds.size(); i++) {
+    json[fmt::format("{:.0f}", _bounds[i])] = _weights[i];
+  }
+  return json;
+}
+
+size_t Distribution::bucket(double value) const {
+  auto it = std::upper_bound(_bounds.begin(), _bounds.end(), value);
+  return it == _bounds.begin() ? 0 : std::distance(_bounds.begin(), it) - 1;
+}
+
+double Distribution::total() const { return std::accumulate(_weights.begin(), _weights.end(), 0.0); }
+
+std::vector<double> Distribution::normalized() const {
+  double sum = total();
+  std::vector<double> shares(_weights.size(), _weights.empty() ? 0 : 1.0 / _weights.size());
+  if (sum > 0) {
+    for (size_t i = 0; i < _weights.size(); i++) {
+      shares[i] = _weights[i] / sum;
+    }
+  }
+  return shares;
+}
+
+std::pair<double, double> Distribution::range(size_t i) const {
+  double to = i + 1 < _bounds.size() ? _bounds[i + 1] : std::max(2 * _bounds[i], _bounds[i] + 1);
+  return {_bounds[i], to};
+}
+
+double Distribution::kl(const Distribution& target, const Distribution& live) {
+  auto p = target.normalized();
+  // Additive smoothing by half an observation per bucket (Jeffreys prior)
+  double observations = live.total();
+  double divergence = 0;
+  for (size_t i = 0; i < p.size(); i++) {
+    if (p[i] > 0) {
+      double q = (live._weights[i] + 0.5) / (observations + 0.5 * p.size());
+      divergence += p[i] * std::log(p[i] / q);
+    }
+  }
+  return std::max(0.0, divergence);
+}
+
+double Distribution::emd(const Distribution& target, const Distribution& live) {
+  auto p = target.normalized();
+  auto q = live.normalized();
+  if (p.size() < 2) {
+    return 0;
+  }
+  // In one dimension the distance is the area between the two cumulative distributions
+  double cumulative = 0, distance = 0;
+  for (size_t i = 0; i + 1 < p.size(); i++) {
+    cumulative += p[i] - q[i];
+    distance += std::abs(cumulative);
+  }
+  return distance / (p.size() - 1);
+}
+
+AgingTarget::AgingTarget(const nlohmann::json& target) {
+  if (!target.is_object()) {
+    throw std::runtime_error("Aging target has to be a JSON object");
+  }
+  try {
+    for (int kind = 0; kind < KIND_COUNT; kind++) {
+      if (target.contains(kindName(Kind(kind)))) {
+        _target[kind] = Distribution::fromJson(target[kindName(Kind(kind))], kind == FILE_SIZE);
+      }
+    }
+  } catch (const std::invalid_argument& e) {
+    throw std::runtime_error(fmt::format("Aging target: {}", e.what()));
+  }
+  std::string metric = target.value("metric", "kl");
+  if (metric == "kl") {
+    _metric = Metric::KL;
+  } else if (metric == "emd") {
+    _metric = Metric::EMD;
+  } else {
+    throw std::runtime_error(fmt::format("Aging target: unknown metric {}, use kl or emd", metric));
+  }
+  _threshold = target.value("threshold", _threshold);
+  _utilization = target.value("utilization", _utilization);
+  _utilization_tolerance = target.value("utilization_tolerance", _utilization_tolerance);
+  if (_utilization > 1) {
+    throw std::runtime_error(fmt::format("Aging target: utilization {} is above 1", _utilization));
+  }
+  if (!hasUtilization() && std::none_of(_target.begin(), _target.end(), [](const Distribution& distribution) { return distribution.defined(); })) {
+    throw std::runtime_error("Aging target defines neither a distribution nor the utilization");
+  }
+}
+
+AgingTarget AgingTarget::fromFile(const std::string& path) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    throw std::runtime_error(fmt::format("Cannot open aging target {}", path));
+  }
+  try {
+    return AgingTarget(nlohmann::json::parse(file));
+  } catch (const nlohmann::json::exception& e) {
+    throw std::runtime_error(fmt::format("Invalid aging target {}: {}", path, e.what()));
+  }
+}
+
+double AgingTarget::divergence(const Distribution& target, const Distribution& live) const { return _metric == Metric::KL ? Distribution::kl(target, live) : Distribution::emd(target, live); }
+
+const AgingTarget::Snapshot& AgingTarget::evaluate(FileTree& tree, double utilization) {
+  Snapshot snapshot;
+  for (int kind = 0; kind < KIND_COUNT; kind++) {
+    snapshot.live[kind] = _target[kind].emptyCopy();
+  }
+  for (auto& file : tree.all_files) {
+    if (has(FILE_SIZE)) {
+      snapshot.live[FILE_SIZE].add(file->size());
+    }
+    if (has(EXTENTS_PER_FILE)) {
+      snapshot.live[EXTENTS_PER_FILE].add(file->getExtentsCount(false));
+    }
+    if (has(DEPTH)) {
+      int depth = 0;
+      for (auto parent = file->parent; parent != nullptr && parent->parent != nullptr; parent = parent->parent) {
+        depth++;
+      }
+      snapshot.live[DEPTH].add(depth);
+    }
+  }
+  if (has(FANOUT)) {
+    snapshot.live[FANOUT].add(tree.getRoot()->folders.size() + tree.getRoot()->files.size());
+    for (auto& directory : tree.all_directories) {
+      snapshot.live[FANOUT].add(directory->folders.size() + directory->files.size());
+    }
+  }
+  snapshot.utilization = utilization;
+  snapshot.converged = !tree.all_files.empty();
+  for (int kind = 0; kind < KIND_COUNT; kind++) {
+    if (has(Kind(kind))) {
+      snapshot.divergence[kind] = divergence(_target[kind], snapshot.live[kind]);
+      snapshot.converged = snapshot.converged && snapshot.divergence[kind] <= _threshold;
+    }
+  }
+  if (hasUtilization()) {
+    snapshot.converged = snapshot.converged && std::abs(utilization - _utilization) <= _utilization_tolerance;
+  }
+  _last = std::move(snapshot);
+  _evaluated = true;
+  return _last;
+}
+
+AgingTarget::Steering AgingTarget::steering() const {
+  Steering steering;
+  if (!_evaluated) {
+    return steering;
+  }
+  auto clamp = [](double factor) { return std::clamp(factor, 0.1, 10.0); };
+  // Shift of the live distribution against the target in buckets, positive when the target lies in higher buckets
+  auto shift = [&](Kind kind) {
+    if (!has(kind) || _last.live[kind].total() == 0) {
+      return 0.0;
+    }
+    auto p = _target[kind].normalized();
+    auto q = _last.live[kind].normalized();
+    double shift = 0;
+    for (size_t i = 0; i < p.size(); i++) {
+      shift += i * (p[i] - q[i]);
+    }
+    return shift;
+  };
+  if (hasUtilization()) {
+    // A run at 50% aiming at 60% creates e^2 times more often and deletes e^2 times less often
+    steering.create = std::clamp(std::exp(20 * (_utilization - _last.utilization)), 0.05, 20.0);
+  }
+  // More extents per file come from altering files in place
+  steering.alter = clamp(std::exp(shift(EXTENTS_PER_FILE)));
+  if (has(DEPTH) || has(FANOUT)) {
+    // Deeper trees need more directories, larger fanout fewer of them
+    steering.directories = clamp(std::exp(shift(DEPTH) - shift(FANOUT)));
+  }
+  return steering;
+}
+
+bool AgingTarget::sizeRange(uint64_t& from, uint64_t& to) const {
+  if (!has(FILE_SIZE)) {
+    return false;
+  }
+  auto p = _target[FILE_SIZE].normalized();
+  std::vector<double> deficit(p.size(), 0);
+  if (_evaluated && _last.live[FILE_SIZE].total() > 0) {
+    auto q = _last.live[FILE_SIZE].normalized();
+    for (size_t i = 0; i < p.size(); i++) {
+      deficit[i] = std::max(0.0, p[i] - q[i]);
+    }
+  } else {
+    deficit = p;
+  }
+  double sum = std::accumulate(deficit.begin(), deficit.end(), 0.0);
+  if (sum <= 0) {
+    return false;
+  }
+  double pick = Random::unit(Random::TARGET) * sum;
+  size_t bucket = 0;
+  while (bucket + 1 < deficit.size() && pick >= deficit[bucket]) {
+    pick -= deficit[bucket];
+    bucket++;
+  }
+  auto [low, high] = _target[FILE_SIZE].range(bucket);
+  from = uint64_t(low);
+  to = std::max<uint64_t>(from, uint64_t(high) - 1);
+  return true;
+}
+
+bool AgingTarget::surplusSize(uint64_t size) const {
+  if (!has(FILE_SIZE) || !_evaluated || _last.live[FILE_SIZE].total() == 0) {
+    return false;
+  }
+  size_t bucket = _target[FILE_SIZE].bucket(size);
+  return _last.live[FILE_SIZE].normalized()[bucket] > _target[FILE_SIZE].normalized()[bucket];
+}
+
+nlohmann::json AgingTarget::snapshotJson() const {
+  nlohmann::json json;
+  json["converged"] = _last.converged;
+  json["utilization"] = _last.utilization;
+  for (int kind = 0; kind < KIND_COUNT; kind++) {
+    if (has(Kind(kind))) {
+      json["divergence"][kindName(Kind(kind))] = _last.divergence[kind];
+      json["live"][kindName(Kind(kind))] = _last.live[kind].toJson();
+    }
+  }
+  return json;
+}
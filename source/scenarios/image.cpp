@@ -0,0 +1,130 @@
+#include <filestorm/config.h>
+#include <filestorm/data_sizes.h>
+#include <filestorm/result.h>
+#include <filestorm/scenarios/image.h>
+#include <filestorm/utils.h>
+#include <filestorm/utils/image.h>
+#include <filestorm/utils/logger.h>
+#include <fmt/format.h>
+
+#include <filesystem>
+#include <vector>
+
+ImageScenario::ImageScenario() {
+  _name = "image";
+  _description = "Age a filesystem image once (mode age) and run measurements on its clones (mode measure).";
+  addParameter(Parameter("", "mode", "age: create, format and age the image, measure: run the scenario on a clone of the aged image", "measure"));
+  addParameter(Parameter("", "image", "Image file, the aged file tree is stored next to it as <image>.tree", "/var/tmp/filestorm.img"));
+  addParameter(Parameter("", "fs", "Filesystem of the image (mkfs.<fs> is used to create it)", "xfs"));
+  addParameter(Parameter("", "size", "Size of the created image", "20G"));
+  addParameter(Parameter("", "mkfs-options", "Additional options passed to mkfs", ""));
+  addParameter(Parameter("", "mount", "Directory the image (or its clone) is mounted to", "/mnt/filestorm"));
+  addParameter(Parameter("", "mount-options", "Options of the mount", ""));
+  addParameter(Parameter("", "clone", "Clone of the image used for the measurement, <image>.clone by default", ""));
+  addParameter(Parameter("", "keep-clone", "Keep the clone after the measurement", "false"));
+  addParameter(Parameter("", "scenario", "Scenario run on the clone in measure mode", "aging"));
+  addParameter(Parameter("", "scenario-args", "Parameters of the scenario (the aging scenario in age mode) separated by spaces, e.g. \"-t 8h -S 1G\"", ""));
+}
+
+ImageScenario::~ImageScenario() {}
+
+void ImageScenario::setup_inner(const std::string& name, const std::map<std::string, std::string>& forced) {
+  if (name == _name) {
+    throw std::runtime_error("Image scenario can't run itself");
+  }
+  _inner = Config::instance().createScenario(name);
+  std::vector<std::string> args = {name};
+  for (auto& arg : split(getParameter("scenario-args").get_string(), ' ')) {
+    if (!arg.empty()) {
+      args.push_back(arg);
+    }
+  }
+  std::vector<char*> argv;
+  for (auto& arg : args) {
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  _inner->setup(argv.size(), argv.data());
+  for (auto& [parameter, value] : forced) {
+    if (_inner->hasParameter(parameter)) {
+      _inner->setParameter(parameter, value);
+    }
+  }
+  _inner->setParameter("save-to", getParameter("save-to").get_string());
+}
+
+void ImageScenario::run(std::unique_ptr<IOEngine>& ioengine) {
+  std::filesystem::path image = getParameter("image").get_string();
+  std::string mode = getParameter("mode").get_string();
+  std::string fs = getParameter("fs").get_string();
+  std::string mount_point = getParameter("mount").get_string();
+  Result::addMeta("image", image.string());
+  Result::addMeta("image_fs", fs);
+
+  if (mode == "age") {
+    if (std::filesystem::exists(image)) {
+      throw std::runtime_error(fmt::format("Image {} already exists, remove it to age a new one", image.string()));
+    }
+    setup_inner("aging", {{"directory", mount_point}, {"checkpoint", tree_path()}, {"cleanup", "false"}});
+    auto size = DataSize<DataUnit::B>::fromString(getParameter("size").get_string()).get_value();
+    logger.info("Creating {} image {} of {} MB", fs, image.string(), size / 1024 / 1024);
+    fs_utils::create_sparse_file(image, size);
+    try {
+      fs_utils::LoopDevice loop(image);
+      std::vector<std::string> mkfs = {"mkfs." + fs};
+      for (auto& option : split(getParameter("mkfs-options").get_string(), ' ')) {
+        if (!option.empty()) {
+          mkfs.push_back(option);
+        }
+      }
+      mkfs.push_back(loop.path());
+      fs_utils::run_command(mkfs);
+      fs_utils::Mount mounted(loop.path(), mount_point, fs, getParameter("mount-options").get_string());
+      _inner->run(ioengine);
+    } catch (...) {
+      // A half aged image is of no use. Catching also makes sure it is unmounted and detached first.
+      std::filesystem::remove(image);
+      std::filesystem::remove(tree_path());
+      throw;
+    }
+    logger.info("Aged image saved to {}, its file tree to {}", image.string(), tree_path());
+  } else if (mode == "measure") {
+    if (!std::filesystem::exists(image) || !std::filesystem::exists(tree_path())) {
+      throw std::runtime_error(fmt::format("Aged image {} or its file tree {} is missing, create them with --mode age", image.string(), tree_path()));
+    }
+    setup_inner(getParameter("scenario").get_string(), {{"directory", mount_point}, {"base", tree_path()}, {"cleanup", "false"}});
+    std::filesystem::path clone = getParameter("clone").is_set() ? getParameter("clone").get_string() : image.string() + ".clone";
+    auto clone_start = std::chrono::steady_clock::now();
+    auto method = fs_utils::clone_file(image, clone);
+    auto clone_duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - clone_start);
+    logger.info("Image cloned to {} by {} in {} ms", clone.string(), method == fs_utils::CloneMethod::REFLINK ? "reflink" : "sparse copy", clone_duration.count());
+    Result::addMeta("image_clone", method == fs_utils::CloneMethod::REFLINK ? "reflink" : "sparse_copy");
+    try {
+      fs_utils::LoopDevice loop(clone);
+      fs_utils::Mount mounted(loop.path(), mount_point, fs, getParameter("mount-options").get_string());
+      _inner->run(ioengine);
+    } catch (...) {
+      // Caught so the clone is unmounted and detached even when nobody handles the error
+      if (!getParameter("keep-clone").get_bool()) {
+        std::filesystem::remove(clone);
+      }
+      throw;
+    }
+    if (!getParameter("keep-clone").get_bool()) {
+      std::filesystem::remove(clone);
+    }
+  } else {
+    throw std::runtime_error(fmt::format("Unknown image mode {}, use age or measure", mode));
+  }
+}
+
+void ImageScenario::save() {
+  if (_inner) {
+    _inner->save();
+  }
+}
+
+void ImageScenario::print() {
+  if (_inner) {
+    _inner->print();
+  }
+}
@@ -0,0 +1,277 @@
+#include <fcntl.h>
+#include <filestorm/result.h>
+#include <filestorm/scenarios/metadata.h>
+#include <filestorm/utils.h>
+#include <filestorm/utils/logger.h>
+#include <fmt/format.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <filestorm/external/tabulate.hpp>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+static const std::vector<std::string> PHASES = {"create", "stat", "open", "rename", "unlink"};
+
+// Number of entries with an optional k or m suffix (powers of 1000)
+static uint64_t parse_count(const std::string& text) {
+  std::string value = strip(text);
+  uint64_t multiplier = 1;
+  if (!value.empty() && (value.back() == 'k' || value.back() == 'K')) {
+    multiplier = 1000;
+    value.pop_back();
+  } else if (!value.empty() && (value.back() == 'm' || value.back() == 'M')) {
+    multiplier = 1000000;
+    value.pop_back();
+  }
+  if (value.empty() || !std::all_of(value.begin(), value.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); })) {
+    throw std::runtime_error(fmt::format("Invalid number of entries {}", text));
+  }
+  return std::stoull(value) * multiplier;
+}
+
+static std::runtime_error system_error(const std::string& message) { return std::runtime_error(fmt::format("{}: {}", message, strerror(errno))); }
+
+MetadataScenario::MetadataScenario() {
+  _name = "metadata";
+  _description = "Metadata operations per second and latencies of parallel create, stat, open, rename and unlink (mdtest style).";
+  addParameter(Parameter("d", "directory", "Directory the test directories are created in", "/tmp/filestorm/"));
+  addParameter(Parameter("n", "threads", "Number of threads", "4"));
+  addParameter(Parameter("f", "files", "Files every thread creates in every round", "1000"));
+  addParameter(Parameter("s", "file-size", "Size of every created file (bytes or with a unit, e.g. 4K), 0 creates empty files", "0"));
+  addParameter(Parameter("", "layout", "shared: all threads work in one directory, unique: every thread in its own directory, both: shared and then unique", "both"));
+  addParameter(Parameter("", "phases", "Comma separated phases run in every round in this order: create, stat, open, rename, unlink", "create,stat,open,rename,unlink"));
+  addParameter(Parameter("", "entries", "Comma separated numbers of background entries (k and m suffixes) every directory is filled with before a round, e.g. 0,100k,1m", "0"));
+  addParameter(Parameter("", "create-dir", "If testing directory doesn't exists try to create it.", "false"));
+  addParameter(Parameter("", "cleanup", "Should clean up files/folders after the test is done", "true"));
+}
+
+MetadataScenario::~MetadataScenario() {}
+
+MetadataScenario::PhaseResult MetadataScenario::runThreads(int threads, const std::function<uint64_t(int, LatencyHistogram&)>& work) {
+  std::vector<LatencyHistogram> latencies(threads);
+  std::vector<uint64_t> ops(threads, 0);
+  std::vector<std::exception_ptr> errors(threads);
+  std::vector<std::thread> workers;
+  auto start = std::chrono::steady_clock::now();
+  for (int thread = 0; thread < threads; thread++) {
+    workers.emplace_back([&, thread]() {
+      try {
+        ops[thread] = work(thread, latencies[thread]);
+      } catch (...) {
+        errors[thread] = std::current_exception();
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  PhaseResult result;
+  result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  for (int thread = 0; thread < threads; thread++) {
+    if (errors[thread]) {
+      std::rethrow_exception(errors[thread]);
+    }
+    result.ops += ops[thread];
+    result.latency.merge(latencies[thread]);
+  }
+  return result;
+}
+
+void MetadataScenario::run(std::unique_ptr<IOEngine>& /*ioengine*/) {
+  std::filesystem::path directory = getParameter("directory").get_string();
+  if (!std::filesystem::exists(directory)) {
+    if (getParameter("create-dir").get_bool()) {
+      std::filesystem::create_directories(directory);
+    } else {
+      throw std::runtime_error(fmt::format("Directory {} does not exist!", directory.string()));
+    }
+  }
+  int threads = getParameter("threads").get_int();
+  int files = getParameter("files").get_int();
+  if (threads < 1 || files < 1) {
+    throw std::runtime_error("Metadata scenario needs at least one thread and one file");
+  }
+  std::string size_text = getParameter("file-size").get_string();
+  bool plain_bytes = !size_text.empty() && std::all_of(size_text.begin(), size_text.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); });
+  uint64_t file_size = plain_bytes ? std::stoull(size_text) : DataSize<DataUnit::B>::fromString(size_text).get_value();
+  std::vector<std::string> layouts;
+  std::string layout = getParameter("layout").get_string();
+  if (layout == "both") {
+    layouts = {"shared", "unique"};
+  } else if (layout == "shared" || layout == "unique") {
+    layouts = {layout};
+  } else {
+    throw std::runtime_error(fmt::format("Unknown layout {}, use shared, unique or both", layout));
+  }
+  std::vector<std::string> phases;
+  for (auto& phase : split(getParameter("phases").get_string(), ',')) {
+    auto name = strip(phase);
+    if (std::find(PHASES.begin(), PHASES.end(), name) == PHASES.end()) {
+      throw std::runtime_error(fmt::format("Unknown phase {}, use create, stat, open, rename or unlink", name));
+    }
+    phases.push_back(name);
+  }
+  if (phases.empty() || phases.front() != "create") {
+    throw std::runtime_error("The first phase has to be create, the other phases work with the created files");
+  }
+  std::vector<uint64_t> levels;
+  for (auto& level : split(getParameter("entries").get_string(), ',')) {
+    levels.push_back(parse_count(level));
+  }
+  std::sort(levels.begin(), levels.end());
+  Result::addMeta("metadata_threads", std::to_string(threads));
+  Result::addMeta("metadata_files", std::to_string(files));
+  Result::addMeta("metadata_file_size", std::to_string(file_size));
+  std::vector<char> content(file_size, 'f');
+
+  // Timed operation, failures end the run
+  auto timed = [](LatencyHistogram& latency, auto&& operation) {
+    auto start = std::chrono::steady_clock::now();
+    operation();
+    latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+  };
+  auto create = [&](const std::string& path) {
+    int fd = open(path.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+    if (fd == -1) {
+      throw system_error(fmt::format("Cannot create {}", path));
+    }
+    if (file_size > 0 && write(fd, content.data(), content.size()) != ssize_t(content.size())) {
+      close(fd);
+      throw system_error(fmt::format("Cannot write {}", path));
+    }
+    close(fd);
+  };
+  auto remove = [](const std::string& path) {
+    if (unlink(path.c_str()) != 0) {
+      throw system_error(fmt::format("Cannot unlink {}", path));
+    }
+  };
+
+  for (auto& current_layout : layouts) {
+    bool shared = current_layout == "shared";
+    std::vector<std::filesystem::path> directories;
+    if (shared) {
+      directories.push_back(directory / "shared");
+    } else {
+      for (int thread = 0; thread < threads; thread++) {
+        directories.push_back(directory / fmt::format("thread.{}", thread));
+      }
+    }
+    for (auto& dir : directories) {
+      if (!std::filesystem::create_directory(dir)) {
+        throw std::runtime_error(fmt::format("{} already exists", dir.string()));
+      }
+    }
+    auto dir_of = [&](int thread) { return shared ? directories[0] : directories[thread]; };
+    // Threads share the work on a shared directory, in unique directories every thread does all of it
+    auto my_indices = [&](int thread, uint64_t from, uint64_t to, auto&& action) {
+      uint64_t ops = 0;
+      for (uint64_t i = from + (shared ? thread : 0); i < to; i += shared ? threads : 1) {
+        action(i);
+        ops++;
+      }
+      return ops;
+    };
+    auto file_name = [&](int thread, int i, bool renamed) { return (dir_of(thread) / fmt::format("t{}.{}{}", thread, i, renamed ? ".r" : "")).string(); };
+
+    uint64_t background = 0;
+    for (auto level : levels) {
+      if (level > background) {
+        auto fill = runThreads(threads, [&](int thread, LatencyHistogram& latency) {
+          return my_indices(thread, background, level, [&](uint64_t i) { timed(latency, [&]() { create((dir_of(thread) / fmt::format("bg.{}", i)).string()); }); });
+        });
+        logger.info("{} directories filled from {} to {} entries at {:.0f} creates/s", current_layout, background, level, fill.ops / fill.seconds);
+        background = level;
+      }
+      bool renamed = false;
+      bool unlinked = false;
+      for (auto& phase : phases) {
+        auto phase_result = runThreads(threads, [&](int thread, LatencyHistogram& latency) {
+          for (int i = 0; i < files; i++) {
+            auto path = file_name(thread, i, renamed);
+            if (phase == "create") {
+              timed(latency, [&]() { create(path); });
+            } else if (phase == "stat") {
+              struct stat file_stat;
+              timed(latency, [&]() {
+                if (stat(path.c_str(), &file_stat) != 0) {
+                  throw system_error(fmt::format("Cannot stat {}", path));
+                }
+              });
+            } else if (phase == "open") {
+              timed(latency, [&]() {
+                int fd = open(path.c_str(), O_RDONLY);
+                if (fd == -1) {
+                  throw system_error(fmt::format("Cannot open {}", path));
+                }
+                close(fd);
+              });
+            } else if (phase == "rename") {
+              auto target = file_name(thread, i, !renamed);
+              timed(latency, [&]() {
+                if (rename(path.c_str(), target.c_str()) != 0) {
+                  throw system_error(fmt::format("Cannot rename {}", path));
+                }
+              });
+            } else {
+              timed(latency, [&]() { remove(path); });
+            }
+          }
+          return uint64_t(files);
+        });
+        renamed = renamed != (phase == "rename");
+        unlinked = unlinked || phase == "unlink";
+        double ops_per_second = phase_result.seconds > 0 ? phase_result.ops / phase_result.seconds : 0;
+        logger.info("{} {} with {} entries: {:.0f} ops/s, latency p50 {:.1f} us, p99 {:.1f} us", current_layout, phase, background, ops_per_second, phase_result.latency.percentile(50) / 1000.0,
+                    phase_result.latency.percentile(99) / 1000.0);
+        nlohmann::json sample;
+        sample["layout"] = current_layout;
+        sample["entries"] = background;
+        sample["phase"] = phase;
+        sample["threads"] = threads;
+        sample["ops"] = phase_result.ops;
+        sample["seconds"] = phase_result.seconds;
+        sample["ops_per_second"] = ops_per_second;
+        sample["latency"] = phase_result.latency.toJson();
+        Result::addSample("metadata", sample);
+      }
+      if (!unlinked) {
+        // The next round creates the same names again
+        runThreads(threads, [&](int thread, LatencyHistogram&) {
+          for (int i = 0; i < files; i++) {
+            remove(file_name(thread, i, renamed));
+          }
+          return uint64_t(files);
+        });
+      }
+    }
+    if (getParameter("cleanup").get_bool()) {
+      runThreads(threads, [&](int thread, LatencyHistogram&) { return my_indices(thread, 0, background, [&](uint64_t i) { remove((dir_of(thread) / fmt::format("bg.{}", i)).string()); }); });
+      for (auto& dir : directories) {
+        std::filesystem::remove(dir);
+      }
+    }
+  }
+}
+
+void MetadataScenario::print() {
+  tabulate::Table table;
+  table.add_row({"Layout", "Entries", "Phase", "Ops/s", "Mean (us)", "P50 (us)", "P99 (us)", "P99.9 (us)", "Max (us)"});
+  auto us = [](const nlohmann::json& nanoseconds) { return fmt::format("{:.1f}", nanoseconds.get<double>() / 1000); };
+  for (auto& sample : Result::series["metadata"]) {
+    auto& latency = sample["latency"];
+    table.add_row({sample["layout"].get<std::string>(), std::to_string(sample["entries"].get<uint64_t>()), sample["phase"].get<std::string>(), fmt::format("{:.0f}", sample["ops_per_second"].get<double>()),
+                   us(latency["mean"]), us(latency["p50"]), us(latency["p99"]), us(latency["p99.9"]), us(latency["max"])});
+  }
+  table.format().font_align(tabulate::FontAlign::center).border_left("|").border_right("|");
+  std::cout << table << std::endl;
+}
@@ -62,6 +62,25 @@ Parameter Scenario::getParameter(const std::string& name) const {
   throw std::invalid_argument(fmt::format("Parameter {} not found.", name));
 }
 
+bool Scenario::hasParameter(const std::string& name) const {
+  for (auto& parameter : _parameters) {
+    if (parameter.long_name() == name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Scenario::setParameter(const std::string& name, const std::string& value) {
+  for (auto& parameter : _parameters) {
+    if (parameter.long_name() == name) {
+      parameter.value(value);
+      return;
+    }
+  }
+  throw std::invalid_argument(fmt::format("Parameter {} not found.", name));
+}
+
 void Scenario::addParameter(Parameter parameter) {
   for (auto& p : _parameters) {
     if (p.long_name() == parameter.long_name() || (p.short_name() == parameter.short_name() && !p.short_name().empty())) {
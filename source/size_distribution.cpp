@@ -0,0 +1,158 @@
+#include <filestorm/size_distribution.h>
+#include <filestorm/utils.h>
+#include <filestorm/utils/random.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+SizeDistribution::Kind SizeDistribution::parseKind(const std::string& name) {
+  auto lower = toLower(name);
+  if (lower == "uniform") {
+    return Kind::UNIFORM;
+  }
+  if (lower == "normal") {
+    return Kind::NORMAL;
+  }
+  if (lower == "lognormal") {
+    return Kind::LOGNORMAL;
+  }
+  if (lower == "pareto") {
+    return Kind::PARETO;
+  }
+  if (lower == "bimodal") {
+    return Kind::BIMODAL;
+  }
+  if (lower == "empirical") {
+    return Kind::EMPIRICAL;
+  }
+  throw std::invalid_argument(fmt::format("Unknown file size distribution {}, use uniform, normal, lognormal, pareto, bimodal or empirical", name));
+}
+
+const char* SizeDistribution::kindName(Kind kind) {
+  switch (kind) {
+    case Kind::NORMAL:
+      return "normal";
+    case Kind::LOGNORMAL:
+      return "lognormal";
+    case Kind::PARETO:
+      return "pareto";
+    case Kind::BIMODAL:
+      return "bimodal";
+    case Kind::EMPIRICAL:
+      return "empirical";
+    default:
+      return "uniform";
+  }
+}
+
+Distribution SizeDistribution::loadHistogram(const std::string& path) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    throw std::runtime_error(fmt::format("Cannot open file size histogram {}", path));
+  }
+  try {
+    auto json = nlohmann::json::parse(file);
+    return Distribution::fromJson(json.contains("file_size") ? json["file_size"] : json, true);
+  } catch (const nlohmann::json::exception& e) {
+    throw std::runtime_error(fmt::format("Invalid file size histogram {}: {}", path, e.what()));
+  } catch (const std::invalid_argument& e) {
+    throw std::runtime_error(fmt::format("Invalid file size histogram {}: {}", path, e.what()));
+  }
+}
+
+SizeDistribution::SizeDistribution(Kind kind, Config config) : _kind(kind), _config(std::move(config)) {
+  if (_config.median == 0 || _config.modes.first == 0 || _config.modes.second == 0) {
+    throw std::invalid_argument("File size medians and modes have to be positive");
+  }
+  if (_config.sigma <= 0 || _config.alpha <= 0) {
+    throw std::invalid_argument(fmt::format("File size sigma ({}) and alpha ({}) have to be positive", _config.sigma, _config.alpha));
+  }
+  if (_config.mode_weight < 0 || _config.mode_weight > 1) {
+    throw std::invalid_argument(fmt::format("Share of the first mode {} is not in 0-1", _config.mode_weight));
+  }
+  if (_kind == Kind::EMPIRICAL && (!_config.histogram.defined() || _config.histogram.total() <= 0)) {
+    throw std::invalid_argument("Empirical file size distribution needs a histogram with some weight");
+  }
+}
+
+uint64_t SizeDistribution::sample(uint64_t from, uint64_t to) const {
+  if (from >= to) {
+    return to;
+  }
+  if (_kind == Kind::UNIFORM) {
+    return from + Random::below(Random::FILE_SIZE, to - from + 1);
+  }
+  if (_kind == Kind::EMPIRICAL) {
+    return empirical(from, to);
+  }
+  double size = 0;
+  for (int attempt = 0; attempt < ATTEMPTS; attempt++) {
+    size = draw(from, to);
+    if (size >= double(from) && size <= double(to)) {
+      break;
+    }
+  }
+  return static_cast<uint64_t>(std::clamp(size, double(from), double(to)));
+}
+
+double SizeDistribution::draw(uint64_t from, uint64_t to) const {
+  auto& generator = Random::get(Random::FILE_SIZE);
+  switch (_kind) {
+    case Kind::NORMAL: {
+      double mean = to / 2.0;
+      return std::normal_distribution<double>(mean, mean / 2.0)(generator);
+    }
+    case Kind::LOGNORMAL:
+      return std::lognormal_distribution<double>(std::log(double(_config.median)), _config.sigma)(generator);
+    case Kind::PARETO: {
+      // Inverse of the CDF, 1 - unit() is in (0, 1]
+      double scale = std::max<double>(from, 1);
+      return scale / std::pow(1 - generator.unit(), 1 / _config.alpha);
+    }
+    case Kind::BIMODAL: {
+      uint64_t median = generator.unit() < _config.mode_weight ? _config.modes.first : _config.modes.second;
+      return std::lognormal_distribution<double>(std::log(double(median)), _config.sigma)(generator);
+    }
+    default:
+      return from;
+  }
+}
+
+uint64_t SizeDistribution::empirical(uint64_t from, uint64_t to) const {
+  auto& histogram = _config.histogram;
+  // Weight of every bucket scaled by the share of its values inside [from, to]
+  std::vector<double> weights(histogram.size(), 0);
+  double total = 0;
+  for (size_t i = 0; i < histogram.size(); i++) {
+    auto [low, high] = histogram.range(i);
+    double overlap = std::min(high, double(to) + 1) - std::max(low, double(from));
+    if (overlap > 0) {
+      weights[i] = histogram.weights()[i] * overlap / (high - low);
+      total += weights[i];
+    }
+  }
+  bool inside = total > 0;
+  if (!inside) {
+    // The range misses the histogram, the draw is clamped to it
+    weights = histogram.weights();
+    total = histogram.total();
+  }
+  double pick = Random::unit(Random::FILE_SIZE) * total;
+  size_t bucket = 0;
+  while (bucket + 1 < weights.size() && (weights[bucket] == 0 || pick >= weights[bucket])) {
+    pick -= weights[bucket++];
+  }
+  auto [low, high] = histogram.range(bucket);
+  if (inside) {
+    low = std::max(low, double(from));
+    high = std::min(high, double(to) + 1);
+  }
+  auto first = static_cast<uint64_t>(std::ceil(low));
+  auto last = static_cast<uint64_t>(std::ceil(high));
+  uint64_t size = first + Random::below(Random::FILE_SIZE, last > first ? last - first : 1);
+  return std::clamp(size, from, to);
+}
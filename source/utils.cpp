@@ -1,6 +1,8 @@
 #include <filestorm/utils.h>
+#include <filestorm/utils/random.h>
 
 #include <algorithm>
+#include <cstring>
 #include <sstream>
 
 std::vector<std::string> split(const std::string& str, char delimiter) {
@@ -91,13 +93,19 @@ std::chrono::seconds stringToChrono(const std::string& timeString) {
 
 double d_rand(double dMin, double dMax) {
   // Generate a random double between dMin and dMax
-  return dMin + (dMax - dMin) * (std::rand() / (RAND_MAX + 1.0));
+  return dMin + (dMax - dMin) * Random::unit(Random::GENERAL);
 }
 
 void generate_random_chunk(char* chunk, size_t size) {
-  static std::random_device rd;
-  static std::mt19937 gen(rd());
-  static std::uniform_int_distribution<> dis(0, 255);
-
-  std::generate_n(chunk, size, []() { return dis(gen); });
+  // Eight bytes per draw
+  auto& generator = Random::get(Random::DATA);
+  size_t offset = 0;
+  for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t)) {
+    uint64_t word = generator();
+    std::memcpy(chunk + offset, &word, sizeof(word));
+  }
+  if (offset < size) {
+    uint64_t word = generator();
+    std::memcpy(chunk + offset, &word, size - offset);
+  }
 }
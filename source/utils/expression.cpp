@@ -0,0 +1,296 @@
+#include <filestorm/utils/expression.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+
+namespace {
+  // Entry of the operator stack used while converting infix to postfix (shunting-yard)
+  struct Pending {
+    enum Kind { OPERATOR, PAREN, FUNCTION } kind;
+    int op;
+    int precedence = 0;
+    bool right_assoc = false;
+    size_t args = 1;
+  };
+
+  struct Function {
+    int op;
+    size_t arity;
+  };
+}  // namespace
+
+Expression Expression::compile(const std::string& source, const Resolver& resolve) {
+  Expression expression;
+  expression._source = source;
+  auto& code = expression._code;
+  auto error = [&](size_t pos, const std::string& message) { return std::invalid_argument(fmt::format("Expression \"{}\" at {}: {}", source, pos, message)); };
+
+  const std::map<std::string, Function> functions = {{"min", {(int)Op::MIN, 2}},     {"max", {(int)Op::MAX, 2}},     {"sqrt", {(int)Op::SQRT, 1}}, {"abs", {(int)Op::ABS, 1}},
+                                                     {"floor", {(int)Op::FLOOR, 1}}, {"ceil", {(int)Op::CEIL, 1}}, {"if", {(int)Op::IF, 3}}};
+  // Binary operators with their precedence, longer tokens first so "<=" isn't read as "<"
+  const std::vector<std::tuple<std::string, Op, int>> binary = {{"||", Op::OR, 1}, {"&&", Op::AND, 2}, {"==", Op::EQ, 3}, {"!=", Op::NE, 3}, {"<=", Op::LE, 4}, {">=", Op::GE, 4}, {"<", Op::LT, 4},
+                                                                {">", Op::GT, 4},  {"+", Op::ADD, 5},  {"-", Op::SUB, 5}, {"*", Op::MUL, 6},  {"/", Op::DIV, 6},  {"^", Op::POW, 8}};
+  const int UNARY_PRECEDENCE = 7;
+
+  std::vector<Pending> stack;
+  auto emit = [&](const Pending& pending) { code.push_back({static_cast<Op>(pending.op), 0, 0}); };
+
+  bool expect_operand = true;
+  size_t pos = 0;
+  while (pos < source.size()) {
+    char c = source[pos];
+    if (std::isspace(static_cast<unsigned char>(c))) {
+      pos++;
+      continue;
+    }
+    if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+      if (!expect_operand) {
+        throw error(pos, "unexpected number");
+      }
+      char* end = nullptr;
+      double value = std::strtod(source.c_str() + pos, &end);
+      if (end == source.c_str() + pos) {
+        throw error(pos, "invalid number");
+      }
+      code.push_back({Op::CONST, value, 0});
+      pos = end - source.c_str();
+      expect_operand = false;
+      continue;
+    }
+    if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+      if (!expect_operand) {
+        throw error(pos, "unexpected identifier");
+      }
+      size_t begin = pos;
+      while (pos < source.size() && (std::isalnum(static_cast<unsigned char>(source[pos])) || source[pos] == '_')) {
+        pos++;
+      }
+      std::string name = source.substr(begin, pos - begin);
+      size_t next = pos;
+      while (next < source.size() && std::isspace(static_cast<unsigned char>(source[next]))) {
+        next++;
+      }
+      if (next < source.size() && source[next] == '(') {
+        auto function = functions.find(name);
+        if (function == functions.end()) {
+          throw error(begin, fmt::format("unknown function {}", name));
+        }
+        stack.push_back({Pending::FUNCTION, function->second.op, 0, false, function->second.arity});
+        stack.push_back({Pending::PAREN, 0});
+        pos = next + 1;
+        continue;
+      }
+      size_t slot;
+      try {
+        slot = resolve(name);
+      } catch (const std::exception& e) {
+        throw error(begin, e.what());
+      }
+      code.push_back({Op::VAR, 0, slot});
+      if (std::find(expression._variables.begin(), expression._variables.end(), slot) == expression._variables.end()) {
+        expression._variables.push_back(slot);
+      }
+      expect_operand = false;
+      continue;
+    }
+    if (c == '(') {
+      if (!expect_operand) {
+        throw error(pos, "unexpected (");
+      }
+      stack.push_back({Pending::PAREN, 0});
+      pos++;
+      continue;
+    }
+    if (c == ',' || c == ')') {
+      if (expect_operand) {
+        throw error(pos, "missing operand");
+      }
+      while (!stack.empty() && stack.back().kind == Pending::OPERATOR) {
+        emit(stack.back());
+        stack.pop_back();
+      }
+      if (stack.empty()) {
+        throw error(pos, fmt::format("unexpected {}", c));
+      }
+      if (c == ',') {
+        stack.back().args++;
+        expect_operand = true;
+      } else {
+        size_t args = stack.back().args;
+        stack.pop_back();
+        if (!stack.empty() && stack.back().kind == Pending::FUNCTION) {
+          if (stack.back().args != args) {
+            throw error(pos, fmt::format("function expects {} arguments, got {}", stack.back().args, args));
+          }
+          emit(stack.back());
+          stack.pop_back();
+        } else if (args != 1) {
+          throw error(pos, "unexpected ,");
+        }
+      }
+      pos++;
+      continue;
+    }
+    if (expect_operand) {
+      if (c == '-' || c == '!') {
+        stack.push_back({Pending::OPERATOR, (int)(c == '-' ? Op::NEG : Op::NOT), UNARY_PRECEDENCE, true});
+        pos++;
+        continue;
+      }
+      if (c == '+') {
+        pos++;
+        continue;
+      }
+      throw error(pos, fmt::format("unexpected {}", c));
+    }
+    auto op = std::find_if(binary.begin(), binary.end(), [&](const auto& candidate) { return source.compare(pos, std::get<0>(candidate).size(), std::get<0>(candidate)) == 0; });
+    if (op == binary.end()) {
+      throw error(pos, fmt::format("unexpected {}", c));
+    }
+    int precedence = std::get<2>(*op);
+    bool right_assoc = std::get<1>(*op) == Op::POW;
+    while (!stack.empty() && stack.back().kind == Pending::OPERATOR && (stack.back().precedence > precedence || (stack.back().precedence == precedence && !right_assoc))) {
+      emit(stack.back());
+      stack.pop_back();
+    }
+    stack.push_back({Pending::OPERATOR, (int)std::get<1>(*op), precedence, right_assoc});
+    pos += std::get<0>(*op).size();
+    expect_operand = true;
+  }
+  if (expect_operand) {
+    throw error(pos, "missing operand");
+  }
+  while (!stack.empty()) {
+    if (stack.back().kind != Pending::OPERATOR) {
+      throw error(pos, "missing )");
+    }
+    emit(stack.back());
+    stack.pop_back();
+  }
+
+  // The evaluation stack has a fixed size, check the program fits in it
+  size_t depth = 0, max_depth = 0;
+  for (auto& instruction : code) {
+    switch (instruction.op) {
+      case Op::CONST:
+      case Op::VAR:
+        depth++;
+        break;
+      case Op::NEG:
+      case Op::NOT:
+      case Op::SQRT:
+      case Op::ABS:
+      case Op::FLOOR:
+      case Op::CEIL:
+        break;
+      case Op::IF:
+        depth -= 2;
+        break;
+      default:
+        depth--;
+        break;
+    }
+    max_depth = std::max(max_depth, depth);
+  }
+  if (max_depth > MAX_STACK) {
+    throw error(0, "expression is too deeply nested");
+  }
+  return expression;
+}
+
+double Expression::evaluate(const double* variables) const {
+  double stack[MAX_STACK];
+  size_t top = 0;
+  for (auto& instruction : _code) {
+    switch (instruction.op) {
+      case Op::CONST:
+        stack[top++] = instruction.value;
+        continue;
+      case Op::VAR:
+        stack[top++] = variables[instruction.slot];
+        continue;
+      case Op::NEG:
+        stack[top - 1] = -stack[top - 1];
+        continue;
+      case Op::NOT:
+        stack[top - 1] = stack[top - 1] == 0 ? 1 : 0;
+        continue;
+      case Op::SQRT:
+        stack[top - 1] = std::sqrt(stack[top - 1]);
+        continue;
+      case Op::ABS:
+        stack[top - 1] = std::fabs(stack[top - 1]);
+        continue;
+      case Op::FLOOR:
+        stack[top - 1] = std::floor(stack[top - 1]);
+        continue;
+      case Op::CEIL:
+        stack[top - 1] = std::ceil(stack[top - 1]);
+        continue;
+      case Op::IF:
+        top -= 2;
+        stack[top - 1] = stack[top - 1] != 0 ? stack[top] : stack[top + 1];
+        continue;
+      default:
+        break;
+    }
+    double b = stack[--top];
+    double& a = stack[top - 1];
+    switch (instruction.op) {
+      case Op::ADD:
+        a += b;
+        break;
+      case Op::SUB:
+        a -= b;
+        break;
+      case Op::MUL:
+        a *= b;
+        break;
+      case Op::DIV:
+        a /= b;
+        break;
+      case Op::POW:
+        a = std::pow(a, b);
+        break;
+      case Op::LT:
+        a = a < b;
+        break;
+      case Op::LE:
+        a = a <= b;
+        break;
+      case Op::GT:
+        a = a > b;
+        break;
+      case Op::GE:
+        a = a >= b;
+        break;
+      case Op::EQ:
+        a = a == b;
+        break;
+      case Op::NE:
+        a = a != b;
+        break;
+      case Op::AND:
+        a = a != 0 && b != 0;
+        break;
+      case Op::OR:
+        a = a != 0 || b != 0;
+        break;
+      case Op::MIN:
+        a = std::min(a, b);
+        break;
+      case Op::MAX:
+        a = std::max(a, b);
+        break;
+      default:
+        throw std::logic_error("Invalid expression instruction");
+    }
+  }
+  return stack[0];
+}
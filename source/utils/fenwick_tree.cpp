@@ -0,0 +1,63 @@
+#include <filestorm/utils/fenwick_tree.h>
+
+namespace {
+  size_t lowbit(size_t i) { return i & (~i + 1); }
+}  // namespace
+
+void FenwickTree::push_back(uint64_t weight) {
+  size_t i = _weights.size() + 1;
+  _weights.push_back(weight);
+  _tree.push_back(weight + prefix(i - 1) - prefix(i - lowbit(i)));
+  _total += weight;
+}
+
+void FenwickTree::pop_back() {
+  // No other node covers the last item
+  _total -= _weights.back();
+  _weights.pop_back();
+  _tree.pop_back();
+}
+
+void FenwickTree::set(size_t index, uint64_t weight) {
+  // Unsigned wrap-around gives the right sums for decreases too
+  uint64_t delta = weight - _weights[index];
+  _weights[index] = weight;
+  _total += delta;
+  for (size_t i = index + 1; i < _tree.size(); i += lowbit(i)) {
+    _tree[i] += delta;
+  }
+}
+
+void FenwickTree::clear() {
+  _tree.assign(1, 0);
+  _weights.clear();
+  _total = 0;
+}
+
+void FenwickTree::reserve(size_t size) {
+  _tree.reserve(size + 1);
+  _weights.reserve(size);
+}
+
+uint64_t FenwickTree::prefix(size_t index) const {
+  uint64_t sum = 0;
+  for (size_t i = index; i > 0; i -= lowbit(i)) {
+    sum += _tree[i];
+  }
+  return sum;
+}
+
+size_t FenwickTree::find(uint64_t value) const {
+  size_t position = 0;
+  size_t step = 1;
+  while (step * 2 < _tree.size()) {
+    step *= 2;
+  }
+  for (; step > 0; step /= 2) {
+    if (position + step < _tree.size() && _tree[position + step] <= value) {
+      position += step;
+      value -= _tree[position];
+    }
+  }
+  return position;
+}
@@ -1,6 +1,7 @@
 #include <filestorm/data_sizes.h>
 #include <filestorm/utils/fs.h>
 
+#include <cstdlib>
 #include <filesystem>
 
 namespace fs_utils {
@@ -15,4 +16,49 @@ namespace fs_utils {
   }
 
   std::uintmax_t file_size(const std::filesystem::path& path) { return std::filesystem::file_size(path); }
+
+  FreeSpaceModel::FreeSpaceModel(std::filesystem::path path, uint64_t reconcile_ops, std::chrono::milliseconds reconcile_interval, Probe probe)
+      : _path(std::move(path)), _reconcile_ops(reconcile_ops), _reconcile_interval(reconcile_interval), _probe(std::move(probe)) {
+    _status = _probe(_path);
+    _reconciled_at = std::chrono::steady_clock::now();
+  }
+
+  std::filesystem::space_info FreeSpaceModel::status() {
+    if ((_reconcile_ops > 0 && _ops_since_reconcile >= _reconcile_ops) || std::chrono::steady_clock::now() - _reconciled_at >= _reconcile_interval) {
+      reconcile();
+    }
+    return _status;
+  }
+
+  void FreeSpaceModel::account(int64_t bytes) {
+    _ops_since_reconcile++;
+    auto apply = [bytes](std::uintmax_t& value) {
+      if (bytes > 0) {
+        value = value > static_cast<std::uintmax_t>(bytes) ? value - bytes : 0;
+      } else {
+        value += static_cast<std::uintmax_t>(-bytes);
+      }
+    };
+    apply(_status.free);
+    apply(_status.available);
+    if (_status.free > _status.capacity) {
+      _status.free = _status.capacity;
+    }
+    if (_status.available > _status.capacity) {
+      _status.available = _status.capacity;
+    }
+  }
+
+  int64_t FreeSpaceModel::reconcile() {
+    auto real = _probe(_path);
+    _last_drift = static_cast<int64_t>(_status.available) - static_cast<int64_t>(real.available);
+    if (std::llabs(_last_drift) > _max_drift) {
+      _max_drift = std::llabs(_last_drift);
+    }
+    _status = real;
+    _ops_since_reconcile = 0;
+    _reconciled_at = std::chrono::steady_clock::now();
+    _reconciles++;
+    return _last_drift;
+  }
 }  // namespace fs_utils
@@ -0,0 +1,217 @@
+#include <fcntl.h>
+#include <filestorm/utils/image.h>
+#include <filestorm/utils/logger.h>
+#include <fmt/format.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__linux__)
+#  include <linux/fs.h>
+#  include <linux/loop.h>
+#  include <sys/mount.h>
+#endif
+
+namespace fs_utils {
+  namespace {
+    std::runtime_error system_error(const std::string& message) { return std::runtime_error(fmt::format("{}: {}", message, strerror(errno))); }
+
+    // Descriptor closed when leaving the scope
+    class FileDescriptor {
+    public:
+      FileDescriptor(const std::string& path, int flags, mode_t mode = 0644) : _fd(open(path.c_str(), flags, mode)) {
+        if (_fd == -1) {
+          throw system_error(fmt::format("Cannot open {}", path));
+        }
+      }
+      ~FileDescriptor() { close(_fd); }
+      FileDescriptor(const FileDescriptor&) = delete;
+      FileDescriptor& operator=(const FileDescriptor&) = delete;
+      operator int() const { return _fd; }
+
+    private:
+      int _fd;
+    };
+
+    void write_all(int fd, const char* data, size_t length, off_t offset, const std::string& path) {
+      while (length > 0) {
+        ssize_t written = pwrite(fd, data, length, offset);
+        if (written == -1) {
+          throw system_error(fmt::format("Error writing to {}", path));
+        }
+        data += written;
+        length -= written;
+        offset += written;
+      }
+    }
+  }  // namespace
+
+  void create_sparse_file(const std::filesystem::path& path, uint64_t size) {
+    FileDescriptor fd(path.string(), O_WRONLY | O_CREAT | O_TRUNC);
+    if (ftruncate(fd, size) == -1) {
+      throw system_error(fmt::format("Cannot resize {} to {} bytes", path.string(), size));
+    }
+  }
+
+  CloneMethod clone_file(const std::filesystem::path& source, const std::filesystem::path& destination) {
+    FileDescriptor in(source.string(), O_RDONLY);
+    FileDescriptor out(destination.string(), O_WRONLY | O_CREAT | O_TRUNC);
+#if defined(__linux__)
+    if (ioctl(out, FICLONE, static_cast<int>(in)) == 0) {
+      return CloneMethod::REFLINK;
+    }
+    logger.debug("Reflink of {} is not possible ({}), copying the data ranges", source.string(), strerror(errno));
+#endif
+    struct stat source_stat;
+    if (fstat(in, &source_stat) == -1) {
+      throw system_error(fmt::format("Cannot stat {}", source.string()));
+    }
+    off_t size = source_stat.st_size;
+    // Holes are left out, the final ftruncate restores the size when the file ends with one
+    std::vector<char> buffer(1 << 20);
+    off_t offset = 0;
+    while (offset < size) {
+      off_t data = lseek(in, offset, SEEK_DATA);
+      if (data == -1) {
+        if (errno == ENXIO) {
+          break;  // Only a hole remains
+        }
+        throw system_error(fmt::format("Cannot find data in {}", source.string()));
+      }
+      off_t hole = lseek(in, data, SEEK_HOLE);
+      if (hole == -1) {
+        hole = size;
+      }
+      for (offset = data; offset < hole;) {
+        ssize_t count = pread(in, buffer.data(), std::min<off_t>(buffer.size(), hole - offset), offset);
+        if (count == -1) {
+          throw system_error(fmt::format("Error reading {}", source.string()));
+        }
+        if (count == 0) {
+          break;
+        }
+        write_all(out, buffer.data(), count, offset, destination.string());
+        offset += count;
+      }
+      offset = hole;
+    }
+    if (ftruncate(out, size) == -1) {
+      throw system_error(fmt::format("Cannot resize {}", destination.string()));
+    }
+    if (fsync(out) == -1) {
+      throw system_error(fmt::format("Cannot sync {}", destination.string()));
+    }
+    return CloneMethod::SPARSE_COPY;
+  }
+
+  void run_command(const std::vector<std::string>& args) {
+    if (args.empty()) {
+      throw std::invalid_argument("Empty command");
+    }
+    std::string command_line;
+    std::vector<char*> argv;
+    for (auto& arg : args) {
+      command_line += (command_line.empty() ? "" : " ") + arg;
+      argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    logger.debug("Running {}", command_line);
+    pid_t pid = fork();
+    if (pid == -1) {
+      throw system_error(fmt::format("Cannot run {}", command_line));
+    }
+    if (pid == 0) {
+      execvp(argv[0], argv.data());
+      _exit(127);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) == -1) {
+      if (errno != EINTR) {
+        throw system_error(fmt::format("Waiting for {} failed", command_line));
+      }
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      throw std::runtime_error(fmt::format("Command {} failed with status {}", command_line, WIFEXITED(status) ? WEXITSTATUS(status) : -1));
+    }
+  }
+
+#if defined(__linux__)
+  LoopDevice::LoopDevice(const std::filesystem::path& image) {
+    FileDescriptor backing(image.string(), O_RDWR);
+    FileDescriptor control("/dev/loop-control", O_RDWR);
+    // Another process may grab the free device between the two calls, then the next free one is tried
+    for (int attempt = 0; attempt < 10 && _fd == -1; attempt++) {
+      int number = ioctl(control, LOOP_CTL_GET_FREE);
+      if (number == -1) {
+        throw system_error("No free loop device");
+      }
+      _path = fmt::format("/dev/loop{}", number);
+      _fd = open(_path.c_str(), O_RDWR);
+      if (_fd == -1) {
+        throw system_error(fmt::format("Cannot open {}", _path));
+      }
+      if (ioctl(_fd, LOOP_SET_FD, static_cast<int>(backing)) == -1) {
+        close(_fd);
+        _fd = -1;
+        if (errno != EBUSY) {
+          throw system_error(fmt::format("Cannot attach {} to {}", image.string(), _path));
+        }
+      }
+    }
+    if (_fd == -1) {
+      throw std::runtime_error(fmt::format("Cannot attach {} to a loop device, all candidates were busy", image.string()));
+    }
+    struct loop_info64 info;
+    memset(&info, 0, sizeof(info));
+    strncpy(reinterpret_cast<char*>(info.lo_file_name), image.c_str(), LO_NAME_SIZE - 1);
+    if (ioctl(_fd, LOOP_SET_STATUS64, &info) == -1) {
+      logger.warn("Cannot set the backing file name of {}: {}", _path, strerror(errno));
+    }
+    logger.debug("Image {} attached to {}", image.string(), _path);
+  }
+
+  LoopDevice::~LoopDevice() {
+    if (ioctl(_fd, LOOP_CLR_FD, 0) == -1) {
+      logger.warn("Cannot detach {}: {}", _path, strerror(errno));
+    }
+    close(_fd);
+  }
+
+  Mount::Mount(const std::string& device, const std::filesystem::path& target, const std::string& fs_type, const std::string& options) : _target(target) {
+    std::filesystem::create_directories(target);
+    if (mount(device.c_str(), target.c_str(), fs_type.c_str(), 0, options.empty() ? nullptr : options.c_str()) == -1) {
+      throw system_error(fmt::format("Cannot mount {} ({}) to {}", device, fs_type, target.string()));
+    }
+    logger.debug("{} mounted to {}", device, target.string());
+  }
+
+  Mount::~Mount() {
+    // Writers may still hold the filesystem for a moment (e.g. extents workers), retry before giving up
+    for (int attempt = 0; attempt < 10; attempt++) {
+      if (umount2(_target.c_str(), 0) == 0) {
+        return;
+      }
+      if (errno != EBUSY) {
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    logger.warn("Cannot unmount {}: {}", _target.string(), strerror(errno));
+  }
+#else
+  LoopDevice::LoopDevice(const std::filesystem::path& image) { throw std::runtime_error(fmt::format("Loop devices are supported only on Linux, can't attach {}", image.string())); }
+  LoopDevice::~LoopDevice() {}
+  Mount::Mount(const std::string& device, const std::filesystem::path& target, const std::string& fs_type, const std::string& options) : _target(target) {
+    (void)fs_type;
+    (void)options;
+    throw std::runtime_error(fmt::format("Mounting is supported only on Linux, can't mount {}", device));
+  }
+  Mount::~Mount() {}
+#endif
+}  // namespace fs_utils
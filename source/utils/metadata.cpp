@@ -0,0 +1,94 @@
+#include <fcntl.h>
+#include <filestorm/utils/metadata.h>
+#include <fmt/format.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace fs_utils {
+  namespace {
+    std::runtime_error system_error(const std::string& message) { return std::runtime_error(fmt::format("{}: {}", message, strerror(errno))); }
+  }  // namespace
+
+  bool xattrs_supported(const std::filesystem::path& directory) {
+    const char* name = "user.filestorm.probe";
+    if (setxattr(directory.c_str(), name, "", 0, 0) != 0) {
+      return false;
+    }
+    removexattr(directory.c_str(), name);
+    return true;
+  }
+
+  bool set_xattr(const std::filesystem::path& path, const std::string& name, const std::string& value) {
+    if (setxattr(path.c_str(), name.c_str(), value.data(), value.size(), 0) != 0) {
+      if (errno == ENOSPC || errno == E2BIG) {
+        return false;
+      }
+      throw system_error(fmt::format("Cannot set extended attribute {} of {}", name, path.string()));
+    }
+    return true;
+  }
+
+  void remove_xattr(const std::filesystem::path& path, const std::string& name) {
+    if (removexattr(path.c_str(), name.c_str()) != 0) {
+      throw system_error(fmt::format("Cannot remove extended attribute {} of {}", name, path.string()));
+    }
+  }
+
+  std::vector<std::string> list_xattrs(const std::filesystem::path& path, const std::string& prefix) {
+    std::vector<std::string> names;
+    ssize_t size = listxattr(path.c_str(), nullptr, 0);
+    if (size < 0) {
+      throw system_error(fmt::format("Cannot list extended attributes of {}", path.string()));
+    }
+    std::string buffer(size, '\0');
+    size = listxattr(path.c_str(), buffer.data(), buffer.size());
+    if (size < 0) {
+      throw system_error(fmt::format("Cannot list extended attributes of {}", path.string()));
+    }
+    // The names are separated by zero bytes
+    for (size_t start = 0; start < size_t(size);) {
+      std::string name(buffer.data() + start);
+      if (name.compare(0, prefix.size(), prefix) == 0) {
+        names.push_back(name);
+      }
+      start += name.size() + 1;
+    }
+    return names;
+  }
+
+  void hard_link(const std::filesystem::path& target, const std::filesystem::path& link) {
+    if (::link(target.c_str(), link.c_str()) != 0) {
+      throw system_error(fmt::format("Cannot link {} to {}", link.string(), target.string()));
+    }
+  }
+
+  uint64_t link_count(const std::filesystem::path& path) {
+    struct stat file_stat;
+    if (stat(path.c_str(), &file_stat) != 0) {
+      throw system_error(fmt::format("Cannot stat {}", path.string()));
+    }
+    return file_stat.st_nlink;
+  }
+
+  void change_mode(const std::filesystem::path& path, mode_t mode) {
+    if (chmod(path.c_str(), mode) != 0) {
+      throw system_error(fmt::format("Cannot change mode of {}", path.string()));
+    }
+  }
+
+  void set_times(const std::filesystem::path& path, int64_t access_time) {
+    struct timespec times[2];
+    times[0].tv_sec = access_time;
+    times[0].tv_nsec = 0;
+    times[1].tv_sec = 0;
+    times[1].tv_nsec = UTIME_NOW;
+    if (utimensat(AT_FDCWD, path.c_str(), times, 0) != 0) {
+      throw system_error(fmt::format("Cannot set times of {}", path.string()));
+    }
+  }
+}  // namespace fs_utils
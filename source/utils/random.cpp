@@ -0,0 +1,89 @@
+#include <filestorm/utils/random.h>
+
+#include <atomic>
+
+namespace {
+  std::atomic<uint64_t> master_seed{42};
+  // Increased by every seed(), threads reseed their streams lazily when they see a new one
+  std::atomic<uint64_t> seed_generation{1};
+  std::atomic<uint32_t> next_worker{0};
+
+  struct ThreadStreams {
+    uint64_t generation = 0;
+    uint32_t worker = 0;
+    bool has_worker = false;
+    std::array<Xoshiro256, Random::STREAM_COUNT> streams;
+  };
+  thread_local ThreadStreams local;
+
+  void reseedLocal(uint64_t generation) {
+    if (!local.has_worker) {
+      local.worker = next_worker++;
+      local.has_worker = true;
+    }
+    for (int stream = 0; stream < Random::STREAM_COUNT; stream++) {
+      local.streams[stream] = Random::derive(Random::Stream(stream), local.worker);
+    }
+    local.generation = generation;
+  }
+
+  ThreadStreams& streams() {
+    auto generation = seed_generation.load(std::memory_order_acquire);
+    if (local.generation != generation) {
+      reseedLocal(generation);
+    }
+    return local;
+  }
+}  // namespace
+
+uint64_t Xoshiro256::splitmix64(uint64_t& x) {
+  uint64_t z = (x += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+void Xoshiro256::reseed(uint64_t seed) {
+  for (auto& word : _state) {
+    word = splitmix64(seed);
+  }
+}
+
+void Random::seed(uint64_t master) {
+  master_seed.store(master, std::memory_order_relaxed);
+  seed_generation.fetch_add(1, std::memory_order_release);
+}
+
+uint64_t Random::masterSeed() { return master_seed.load(std::memory_order_relaxed); }
+
+Xoshiro256& Random::get(Stream stream) { return streams().streams[stream]; }
+
+void Random::setWorker(uint32_t worker) {
+  local.worker = worker;
+  local.has_worker = true;
+  reseedLocal(seed_generation.load(std::memory_order_acquire));
+}
+
+Xoshiro256 Random::derive(Stream stream, uint64_t worker) {
+  // Each of the master seed, the stream and the worker goes through splitmix64, neighbouring values give unrelated keys
+  uint64_t key = masterSeed();
+  key = Xoshiro256::splitmix64(key) ^ (stream + 1);
+  key = Xoshiro256::splitmix64(key) ^ worker;
+  return Xoshiro256(Xoshiro256::splitmix64(key));
+}
+
+Random::State Random::save() {
+  State state;
+  auto& current = streams();
+  for (int stream = 0; stream < STREAM_COUNT; stream++) {
+    state[stream] = current.streams[stream].state();
+  }
+  return state;
+}
+
+void Random::restore(const State& state) {
+  auto& current = streams();
+  for (int stream = 0; stream < STREAM_COUNT; stream++) {
+    current.streams[stream].setState(state[stream]);
+  }
+}
@@ -0,0 +1,90 @@
+#include <filestorm/utils/range_set.h>
+
+#include <algorithm>
+
+void RangeSet::assign(uint64_t start, uint64_t end, Kind kind) {
+  if (start >= end) {
+    return;
+  }
+  std::vector<Range> result;
+  result.reserve(_ranges.size() + 2);
+  bool inserted = false;
+  auto append = [&](Range range) {
+    if (!result.empty() && result.back().kind == range.kind && result.back().end == range.start) {
+      result.back().end = range.end;
+    } else {
+      result.push_back(range);
+    }
+  };
+  auto insert = [&]() {
+    if (!inserted && kind != Kind::DATA) {
+      append({start, end, kind});
+    }
+    inserted = true;
+  };
+  for (auto& range : _ranges) {
+    if (range.end <= start) {
+      append(range);
+      continue;
+    }
+    if (range.start >= end) {
+      insert();
+      append(range);
+      continue;
+    }
+    // Overlapping, the parts outside of [start, end) are kept
+    if (range.start < start) {
+      append({range.start, start, range.kind});
+    }
+    insert();
+    if (range.end > end) {
+      append({end, range.end, range.kind});
+    }
+  }
+  insert();
+  _ranges.swap(result);
+}
+
+void RangeSet::replace(uint64_t start, uint64_t end, Kind from, Kind to) {
+  std::vector<Range> changed;
+  for (auto& range : _ranges) {
+    if (range.kind == from && range.start < end && range.end > start) {
+      changed.push_back({std::max(range.start, start), std::min(range.end, end), to});
+    }
+  }
+  for (auto& range : changed) {
+    assign(range.start, range.end, range.kind);
+  }
+}
+
+void RangeSet::truncate(uint64_t size) {
+  while (!_ranges.empty() && _ranges.back().start >= size) {
+    _ranges.pop_back();
+  }
+  if (!_ranges.empty() && _ranges.back().end > size) {
+    _ranges.back().end = size;
+  }
+}
+
+uint64_t RangeSet::bytes(Kind kind) const {
+  uint64_t total = 0;
+  for (auto& range : _ranges) {
+    if (range.kind == kind) {
+      total += range.end - range.start;
+    }
+  }
+  return total;
+}
+
+const RangeSet::Range* RangeSet::containing(uint64_t position) const {
+  auto it = std::upper_bound(_ranges.begin(), _ranges.end(), position, [](uint64_t value, const Range& range) { return value < range.end; });
+  if (it == _ranges.end() || it->start > position) {
+    return nullptr;
+  }
+  return &*it;
+}
+
+uint64_t RangeSet::nextStart(uint64_t position) const {
+  auto it = std::lower_bound(_ranges.begin(), _ranges.end(), position, [](const Range& range, uint64_t value) { return range.start < value; });
+  return it == _ranges.end() ? UINT64_MAX : it->start;
+}
@@ -2,16 +2,21 @@
 #include <filestorm/actions/rw_actions.h>
 #include <filestorm/config.h>
 #include <filestorm/data_sizes.h>
+#include <filestorm/fs_profile.h>
 #include <filestorm/ioengines/factory.h>
 #include <filestorm/result.h>
 #include <filestorm/utils/logger.h>
+#include <filestorm/utils/random.h>
 #include <filestorm/version.h>
 #include <getopt.h>
 #include <spdlog/spdlog.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <chrono>
 #include <csignal>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -19,7 +24,8 @@
 #include "interupts.h"
 
 void displayHelp() {
-  std::cout << "Usage: filestorm [-hvls] IOENGINE [engine params] SCENARIO [scenario params]\n\n"
+  std::cout << "Usage: filestorm [-hvls] IOENGINE [engine params] SCENARIO [scenario params]\n"
+            << "       filestorm [-hvls] profile [profile params] DIRECTORY\n\n"
             << "  IOENGINE: The IO engine to use, available:" << std::endl;
 
   for (const auto& scenario : IOEngineFactory::instance().listEngines()) {
@@ -44,7 +50,58 @@ void displayHelp() {
             << "  -h, --help     Display this help message\n"
             << "  -v, --version  Display version information\n"
             << "  -l, --log level     Set the log level (trace, debug, info, warn, error, critical, off) (default info)\n"
-            << "  -s, --seed seed     Set the seed for the random number generator (default 42)" << std::endl;
+            << "  -s, --seed seed     Set the seed for the random number generator (default 42)\n"
+            << "\nprofile: Write the shape of an existing directory tree (file size, extents per file, depth and fan-out histograms)\n"
+            << "         as JSON the aging scenario takes as --target and --sdist-profile\n"
+            << "  -o, --output file   File the profile is written to (default profile.json)\n"
+            << "  -j, --workers n     Number of crawling threads (default the number of CPUs)\n"
+            << "  -E, --no-extents    Don't count the extents of the files" << std::endl;
+}
+
+int runProfile(int argc, char** argv) {
+  const struct option long_options[] = {{"output", required_argument, NULL, 'o'}, {"workers", required_argument, NULL, 'j'}, {"no-extents", no_argument, NULL, 'E'}, {NULL, 0, NULL, 0}};
+  std::string output = "profile.json";
+  FsProfile::Options options;
+  // Restart getopt for the arguments of the subcommand
+  optind = 0;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "+o:j:E", long_options, nullptr)) != -1) {
+    switch (opt) {
+      case 'o':
+        output = optarg;
+        break;
+      case 'j':
+        options.workers = std::strtoul(optarg, nullptr, 10);
+        break;
+      case 'E':
+        options.extents = false;
+        break;
+      default:
+        displayHelp();
+        return 1;
+    }
+  }
+  if (optind + 1 != argc) {
+    logger.error("profile needs exactly one DIRECTORY");
+    displayHelp();
+    return 1;
+  }
+  std::string root = argv[optind];
+  auto start = std::chrono::steady_clock::now();
+  auto profile = FsProfile::crawl(root, options);
+  auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  logger.info("Profiled {} files and {} directories ({} bytes) of {} in {:.2f} s, {} directories skipped", profile.files(), profile.directories(), profile.bytes(), root, elapsed, profile.skipped());
+
+  auto json = profile.toJson();
+  json["root"] = root;
+  std::ofstream file(output);
+  if (!file.is_open()) {
+    logger.error("Cannot write the profile to {}", output);
+    return 1;
+  }
+  file << json.dump(2) << std::endl;
+  logger.info("Profile saved to {}", output);
+  return 0;
 }
 
 void displayVersion() { std::cout << FILESTORM_VERSION << std::endl; }
@@ -67,7 +124,7 @@ auto main(int argc, char** argv) -> int {
         spdlog::set_level(spdlog::level::from_str(optarg));
         break;
       case 's':
-        srand(std::atoi(optarg));
+        Random::seed(std::strtoull(optarg, nullptr, 10));
         break;
       case '?': /* unknown global, fall through */
         break;
@@ -76,6 +133,15 @@ auto main(int argc, char** argv) -> int {
     }
   }
 
+  if (optind < argc && std::string(argv[optind]) == "profile") {
+    try {
+      return runProfile(argc - optind, argv + optind);
+    } catch (const std::exception& e) {
+      logger.error("{}", e.what());
+      return 1;
+    }
+  }
+
   // 2) make lists of valid names
   auto engineNames = IOEngineFactory::instance().listEngines();
   auto scenarioNames = Config::instance().listScenarios();
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdlib.h>
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+// New empty directory <temp>/<prefix>_XXXXXX, the name is unique so tests running in parallel never share one
+inline std::string make_temp_dir(const std::string& prefix) {
+  auto path = (std::filesystem::temp_directory_path() / (prefix + "_XXXXXX")).string();
+  if (mkdtemp(path.data()) == nullptr) {
+    throw std::runtime_error("Cannot create temporary directory " + path + ": " + strerror(errno));
+  }
+  return path;
+}
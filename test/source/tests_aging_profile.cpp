@@ -0,0 +1,83 @@
+#include <doctest/doctest.h>
+#include <filestorm/scenarios/aging_profile.h>
+
+#include <stdexcept>
+
+static const std::map<std::string, int> actions = {{"none", 0}, {"create_file", 1}, {"delete_file", 2}, {"end", 3}};
+static const std::vector<std::string> variables = {"utilization", "files"};
+
+static nlohmann::ordered_json simple_profile() {
+  return nlohmann::ordered_json::parse(R"json({
+    "initial": "S",
+    "probabilities": { "pC": "if(files == 0, 1, 1 - utilization)", "pD": "1 - pC" },
+    "states": {
+      "S": {},
+      "CREATE": { "action": "create_file", "parameters": { "maxfsize": "1M" } },
+      "DELETE": { "action": "delete_file" },
+      "END": { "action": "end" }
+    },
+    "transitions": [
+      { "from": "S", "to": "CREATE", "probability": "pC" },
+      { "from": "S", "to": "DELETE", "probability": "pD" },
+      { "from": "CREATE", "to": "END", "probability": 1 },
+      { "from": "DELETE", "to": "END", "probability": "1" },
+      { "from": "END", "to": "S", "probability": "1" }
+    ]
+  })json");
+}
+
+TEST_CASE("AgingProfile compiles states and probabilities") {
+  AgingProfile profile(simple_profile(), actions, variables);
+  REQUIRE(profile.states().size() == 4);
+  CHECK(profile.initialState() == 0);
+  CHECK(profile.states()[1].action == 1);
+  CHECK(profile.states()[0].action == 0);
+  REQUIRE(profile.states()[1].parameters.size() == 1);
+  CHECK(profile.states()[1].parameters[0].second == "1M");
+  CHECK(profile.transitions().size() == 5);
+
+  // Slots: variables, named probabilities, then the inline ones
+  CHECK(profile.slotNames()[2] == "pC");
+  CHECK(profile.slotNames()[3] == "pD");
+
+  CHECK(profile.update({0.25, 0}));
+  CHECK(profile.values()[2] == doctest::Approx(1));
+  CHECK(profile.values()[3] == doctest::Approx(0));
+  CHECK(profile.update({0.25, 10}));
+  CHECK(profile.values()[2] == doctest::Approx(0.75));
+  CHECK(profile.values()[3] == doctest::Approx(0.25));
+  // Nothing changed, nothing is evaluated
+  CHECK_FALSE(profile.update({0.25, 10}));
+
+  // The compiled profile drives the state machine
+  CompiledStateMachine psm(profile.transitions(), profile.initialState(), profile.slotNames());
+  psm.setProbabilities(profile.values());
+  psm.performTransition();
+  CHECK((psm.getCurrentState() == 1 || psm.getCurrentState() == 2));
+  psm.performTransition();
+  CHECK(psm.getCurrentState() == 3);
+}
+
+TEST_CASE("AgingProfile validates the definition") {
+  auto profile = simple_profile();
+  profile["states"]["CREATE"]["action"] = "explode";
+  CHECK_THROWS_AS(AgingProfile(profile, actions, variables), std::runtime_error);
+
+  profile = simple_profile();
+  profile["probabilities"]["pD"] = "1 - unknown";
+  CHECK_THROWS_AS(AgingProfile(profile, actions, variables), std::runtime_error);
+
+  profile = simple_profile();
+  profile["transitions"].erase(4);
+  CHECK_THROWS_AS(AgingProfile(profile, actions, variables), std::runtime_error);
+
+  profile = simple_profile();
+  profile["transitions"][0]["to"] = "NOWHERE";
+  CHECK_THROWS_AS(AgingProfile(profile, actions, variables), std::runtime_error);
+
+  profile = simple_profile();
+  profile["states"]["END"]["action"] = "none";
+  CHECK_THROWS_AS(AgingProfile(profile, actions, variables), std::runtime_error);
+
+  CHECK_THROWS_AS(AgingProfile::fromFile("/nonexistent/profile.json", actions, variables), std::runtime_error);
+}
@@ -0,0 +1,85 @@
+#include <doctest/doctest.h>
+#include <filestorm/filetree.h>
+#include <filestorm/scenarios/aging_target.h>
+#include <filestorm/utils/random.h>
+
+#include <cmath>
+#include <stdexcept>
+
+TEST_CASE("Distribution buckets and divergences") {
+  auto sizes = Distribution::fromJson(nlohmann::json::parse(R"({"1M": 0.5, "0": 0.25, "4K": 0.25})"), true);
+  REQUIRE(sizes.size() == 3);
+  CHECK(sizes.bounds()[1] == 4096);
+  CHECK(sizes.bucket(100) == 0);
+  CHECK(sizes.bucket(4096) == 1);
+  CHECK(sizes.bucket(5 << 20) == 2);
+  CHECK(sizes.range(1) == std::pair<double, double>(4096, 1 << 20));
+  CHECK(sizes.range(2).second == 2 << 20);
+
+  auto live = sizes.emptyCopy();
+  CHECK(live.total() == 0);
+  live.add(10, 100);
+  live.add(10000, 100);
+  live.add(2 << 20, 200);
+  CHECK(Distribution::emd(sizes, live) == doctest::Approx(0));
+  CHECK(Distribution::kl(sizes, live) == doctest::Approx(0).epsilon(0.01));
+
+  auto skewed = sizes.emptyCopy();
+  skewed.add(10, 400);
+  CHECK(Distribution::emd(sizes, skewed) == doctest::Approx((0.75 + 0.5) / 2));
+  CHECK(Distribution::kl(sizes, skewed) > 1);
+
+  CHECK_THROWS_AS(Distribution::fromJson(nlohmann::json::parse(R"({"x": 1})"), false), std::invalid_argument);
+  CHECK_THROWS_AS(Distribution::fromJson(nlohmann::json::parse(R"({"1": -1})"), false), std::invalid_argument);
+}
+
+TEST_CASE("AgingTarget compares the tree and steers towards the target") {
+  CHECK_THROWS_AS(AgingTarget(nlohmann::json::parse(R"({"metric": "kl"})")), std::runtime_error);
+  CHECK_THROWS_AS(AgingTarget(nlohmann::json::parse(R"({"metric": "l2", "utilization": 0.5})")), std::runtime_error);
+
+  AgingTarget target(nlohmann::json::parse(R"({"metric": "emd", "threshold": 0.1, "utilization": 0.5, "depth": {"0": 0.5, "1": 0.5}, "fanout": {"0": 0.5, "2": 0.5}})"));
+  FileTree tree("/tmp/filestorm_target");
+  // Steering is neutral until the first comparison
+  CHECK(target.steering().create == 1);
+
+  auto dir = tree.addDirectory(tree.getRoot(), "dir");
+  tree.addFile(tree.getRoot(), "a");
+  tree.addFile(dir, "b");
+  tree.addFile(dir, "c");
+  auto& snapshot = target.evaluate(tree, 0.3);
+  // Files at depth 0 and 1, fanout 2 of both directories
+  CHECK(snapshot.live[AgingTarget::DEPTH].weights() == std::vector<double>{1, 2});
+  CHECK(snapshot.live[AgingTarget::FANOUT].weights() == std::vector<double>{0, 2});
+  CHECK(snapshot.divergence[AgingTarget::DEPTH] == doctest::Approx(1.0 / 6));
+  CHECK(snapshot.divergence[AgingTarget::FANOUT] == doctest::Approx(0.5));
+  CHECK_FALSE(snapshot.converged);
+
+  auto steering = target.steering();
+  CHECK(steering.create > 1);
+  CHECK(steering.alter == 1);
+  // Directories are fuller than the target asks for, which outweighs files being slightly too deep
+  CHECK(steering.directories == doctest::Approx(std::exp(-1.0 / 6 + 0.5)));
+
+  uint64_t from, to;
+  CHECK_FALSE(target.sizeRange(from, to));
+  CHECK_FALSE(target.surplusSize(4096));
+
+  AgingTarget reached(nlohmann::json::parse(R"({"utilization": 0.5, "utilization_tolerance": 0.05})"));
+  CHECK(reached.evaluate(tree, 0.52).converged);
+  CHECK(reached.steering().directories == 0);
+}
+
+TEST_CASE("AgingTarget draws sizes from the missing buckets") {
+  AgingTarget target(nlohmann::json::parse(R"({"file_size": {"0": 0.5, "1M": 0.5}})"));
+  uint64_t from, to;
+  Random::seed(7);
+  int large = 0;
+  for (int i = 0; i < 1000; i++) {
+    REQUIRE(target.sizeRange(from, to));
+    CHECK(from <= to);
+    large += from == 1 << 20;
+  }
+  // Without a comparison the target itself is sampled
+  CHECK(large > 400);
+  CHECK(large < 600);
+}
@@ -0,0 +1,58 @@
+#include <doctest/doctest.h>
+#include <filestorm/ioengines/buffer_arena.h>
+
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <string>
+
+TEST_CASE("Buffer arena hands out aligned slots round robin") {
+  BufferArena arena(10000, 3);
+  CHECK(arena.slots() == 3);
+  CHECK(arena.slotSize() == 10000);
+  CHECK(arena.hugePages() == BufferArena::HugePages::NONE);
+  std::set<void*> slots;
+  for (size_t i = 0; i < 3; i++) {
+    CHECK(reinterpret_cast<uintptr_t>(arena.slot(i)) % BufferArena::ALIGNMENT == 0);
+    slots.insert(arena.slot(i));
+  }
+  CHECK(slots.size() == 3);
+  CHECK(arena.next() == arena.slot(0));
+  CHECK(arena.next() == arena.slot(1));
+  CHECK(arena.next() == arena.slot(2));
+  CHECK(arena.next() == arena.slot(0));
+  // Every byte of the slots is writable
+  memset(arena.slot(2), 0, arena.slotSize());
+}
+
+TEST_CASE("Buffer arena refresh changes every 4 KiB block") {
+  BufferArena arena(8192, 1);
+  std::string before(static_cast<char*>(arena.slot(0)), 8192);
+  arena.refresh();
+  std::string after(static_cast<char*>(arena.slot(0)), 8192);
+  CHECK(before.substr(0, 8) != after.substr(0, 8));
+  CHECK(before.substr(4096, 8) != after.substr(4096, 8));
+  // The rest of the data is kept
+  CHECK(before.substr(8, 4088) == after.substr(8, 4088));
+  arena.refresh();
+  CHECK(std::string(static_cast<char*>(arena.slot(0)), 8) != after.substr(0, 8));
+}
+
+TEST_CASE("Buffer arena hugepages") {
+  CHECK(BufferArena::parseHugePages("none") == BufferArena::HugePages::NONE);
+  CHECK(BufferArena::parseHugePages("THP") == BufferArena::HugePages::THP);
+  CHECK(BufferArena::parseHugePages("hugetlb") == BufferArena::HugePages::HUGETLB);
+  CHECK_THROWS_AS(BufferArena::parseHugePages("huge"), std::invalid_argument);
+  CHECK(std::string(BufferArena::hugePagesName(BufferArena::HugePages::THP)) == "thp");
+
+  // Without reserved hugepages the arena falls back, it is usable either way
+  BufferArena arena(64 * 1024, 4, BufferArena::HugePages::HUGETLB, true);
+  CHECK(reinterpret_cast<uintptr_t>(arena.slot(0)) % BufferArena::ALIGNMENT == 0);
+  memset(arena.slot(3), 1, arena.slotSize());
+  BufferArena thp(64 * 1024, 4, BufferArena::HugePages::THP);
+  if (thp.hugePages() == BufferArena::HugePages::THP) {
+    CHECK(reinterpret_cast<uintptr_t>(thp.slot(0)) % BufferArena::HUGE_PAGE_SIZE == 0);
+  }
+}
+
+TEST_CASE("Buffer arena needs a slot size") { CHECK_THROWS_AS(BufferArena(0, 1), std::invalid_argument); }
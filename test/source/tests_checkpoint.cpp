@@ -0,0 +1,198 @@
+#include <doctest/doctest.h>
+#include <filestorm/checkpoint.h>
+#include <filestorm/filetree.h>
+#include <filestorm/polycurve.h>
+#include <filestorm/result.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace {
+  std::string checkpoint_path(const std::string& name) {
+    auto path = std::filesystem::temp_directory_path() / name;
+    std::filesystem::remove(path);
+    return path.string();
+  }
+}  // namespace
+
+TEST_CASE("Checkpoint round trip of values") {
+  auto path = checkpoint_path("filestorm_checkpoint_values");
+  {
+    CheckpointWriter out(path);
+    out.write<int32_t>(-7);
+    out.write(std::string("aging"));
+    out.write(std::vector<double>{1.5, 2.5});
+    // Nothing is visible before commit
+    CHECK_FALSE(std::filesystem::exists(path));
+    out.commit();
+  }
+  CHECK(std::filesystem::exists(path));
+  CHECK_FALSE(std::filesystem::exists(path + ".tmp"));
+
+  CheckpointReader in(path);
+  CHECK(in.read<int32_t>() == -7);
+  CHECK(in.readString() == "aging");
+  CHECK(in.readVector<double>() == std::vector<double>{1.5, 2.5});
+  CHECK_THROWS_AS(in.read<int64_t>(), std::runtime_error);
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Checkpoint rejects lengths beyond the end of the file") {
+  auto path = checkpoint_path("filestorm_checkpoint_lengths");
+  {
+    CheckpointWriter out(path);
+    out.write<uint64_t>(uint64_t(1) << 62);
+    out.write<uint64_t>(3);
+    out.write(std::string("ab"));
+    out.commit();
+  }
+  CheckpointReader in(path);
+  CHECK_THROWS_WITH_AS(in.readString(), doctest::Contains("corrupt length"), std::runtime_error);
+  CHECK_THROWS_WITH_AS(in.readVector<double>(), doctest::Contains("corrupt length"), std::runtime_error);
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Checkpoint keeps the previous version until commit") {
+  auto path = checkpoint_path("filestorm_checkpoint_atomic");
+  {
+    CheckpointWriter out(path);
+    out.write<int32_t>(1);
+    out.commit();
+  }
+  {
+    // Interrupted writer, e.g. an exception while saving
+    CheckpointWriter out(path);
+    out.write<int32_t>(2);
+  }
+  CHECK_FALSE(std::filesystem::exists(path + ".tmp"));
+  CheckpointReader in(path);
+  CHECK(in.read<int32_t>() == 1);
+
+  std::ofstream(path) << "garbage";
+  CHECK_THROWS_AS(CheckpointReader(path), std::runtime_error);
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Checkpoint round trip of FileTree") {
+  auto path = checkpoint_path("filestorm_checkpoint_tree");
+  FileTree tree("/tmp/checkpoint_root", 3);
+  tree.mkdir("a");
+  tree.mkdir("a/b");
+  tree.mkdir("c");
+  auto first = tree.mkfile("a/b/f1");
+  auto second = tree.mkfile("c/f2");
+  tree.mkfile("f3");
+  tree.rm("c/f2");
+  first->fallocated_count = 2;
+  first->setExtents({{0, 4096, 0}, {8192, 4096, 1}});
+  tree.removeFromPunchableFiles(first);
+  tree.total_extents_count = 2;
+  FileTree::file_id = 42;
+  {
+    CheckpointWriter out(path);
+    tree.save(out);
+    out.commit();
+  }
+
+  FileTree::file_id = 0;
+  FileTree loaded("/tmp/checkpoint_root", 3);
+  CheckpointReader in(path);
+  loaded.load(in);
+  CHECK(FileTree::file_id == 42);
+  CHECK(loaded.total_extents_count == 2);
+  CHECK(loaded.all_directories.size() == 3);
+  CHECK(loaded.all_files.size() == 2);
+  auto node = loaded.getNode("a/b/f1");
+  CHECK(node->path(true) == "/tmp/checkpoint_root/a/b/f1");
+  CHECK(node->fallocated_count == 2);
+  CHECK_FALSE(node->extentsDirty());
+  REQUIRE(node->getExtentsCount(false) == 2);
+  CHECK(node->getExtents(false)[1].start == 8192);
+  CHECK(loaded.getNode("f3")->extentsDirty());
+  CHECK_THROWS(loaded.getNode("c/f2"));
+  REQUIRE(loaded.files_for_fallocate.size() == 1);
+  CHECK(loaded.files_for_fallocate[0]->name == "f3");
+  // Creation order is kept, new files continue after it
+  CHECK(node->_sequence == 0);
+  CHECK(loaded.getNode("f3")->_sequence == 2);
+  CHECK(loaded.mkfile("f4")->_sequence == 3);
+
+  // Only an empty tree can be loaded
+  CheckpointReader again(path);
+  CHECK_THROWS_AS(loaded.load(again), std::runtime_error);
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Checkpoint keeps the order of directories with parents after their children") {
+  auto path = checkpoint_path("filestorm_checkpoint_order");
+  FileTree tree("/tmp/checkpoint_root", 3);
+  tree.mkdir("a");
+  tree.mkdir("b");
+  tree.mkdir("c");
+  tree.mkdir("c/d");
+  tree.mkdir("c/d/e");
+  tree.mkfile("c/d/e/f");
+  // c/d/e moves into the gap of a, it now precedes its parents
+  tree.rm("a");
+  REQUIRE(tree.all_directories[0]->name == "e");
+  {
+    CheckpointWriter out(path);
+    tree.save(out);
+    out.commit();
+  }
+  FileTree loaded("/tmp/checkpoint_root", 3);
+  CheckpointReader in(path);
+  loaded.load(in);
+  REQUIRE(loaded.all_directories.size() == tree.all_directories.size());
+  for (size_t i = 0; i < tree.all_directories.size(); i++) {
+    CHECK(loaded.all_directories[i]->path() == tree.all_directories[i]->path());
+  }
+  CHECK(loaded.getNode("c/d/e/f")->type == FileTree::Type::FILE);
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Checkpoint round trip of PolyCurve and results") {
+  auto path = checkpoint_path("filestorm_checkpoint_curve");
+  PolyCurve curve(1, 2);
+  for (int i = 0; i < 9; i++) {
+    curve.addPoint(i);
+  }
+  Result::clear();
+  Result::clearMetas();
+  Result(3, Result::CREATE_FILE, Result::WRITE, "/tmp/x", DataSize<DataUnit::B>(4096), std::chrono::nanoseconds(10), 5, 1).commit();
+  Result::addMeta("key", "value");
+  Result::addSample("freespace", {{"iteration", 3}, {"fragmentation_index", 0.25}});
+  {
+    CheckpointWriter out(path);
+    curve.save(out);
+    Result::saveState(out);
+    out.commit();
+  }
+  Result::clear();
+  Result::clearMetas();
+
+  PolyCurve loaded(1, 2);
+  CheckpointReader in(path);
+  loaded.load(in);
+  Result::loadState(in);
+  CHECK(loaded.getPointCount() == 4);
+  // The buffered ninth point completes the fifth average
+  loaded.addPoint(9);
+  curve.addPoint(9);
+  curve.fitPolyCurve();
+  loaded.fitPolyCurve();
+  CHECK(loaded.slope() == doctest::Approx(curve.slope()));
+
+  REQUIRE(Result::results.size() == 1);
+  CHECK(Result::results[0].getIteration() == 3);
+  CHECK(Result::results[0].getPath() == "/tmp/x");
+  CHECK(Result::results[0].getExtentsCount() == 5);
+  CHECK(Result::total_size_per_action[Result::CREATE_FILE].get_value() == 4096);
+  CHECK(Result::getMeta("key") == "value");
+  REQUIRE(Result::series["freespace"].size() == 1);
+  CHECK(Result::series["freespace"][0]["fragmentation_index"] == 0.25);
+  Result::clear();
+  Result::clearMetas();
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,111 @@
+#include <doctest/doctest.h>
+#include <filestorm/ioengines/engine_file.h>
+#include <filestorm/ioengines/factory.h>
+#include <filestorm/utils/fs.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "temp_dir.h"
+
+static void check_engine(const std::string& name) {
+  auto engine = IOEngineFactory::instance().create(name);
+  if (engine == nullptr) {
+    MESSAGE("IO engine " << name << " isn't built, skipping");
+    return;
+  }
+  auto root = make_temp_dir("filestorm_engine_file_test");
+  char program[] = "filestorm";
+  char* argv[] = {program};
+  engine->setup(1, argv);
+
+  auto path = root + "/data";
+  const uint64_t block_size = 4096;
+  BufferArena buffers(block_size, engine->queue_depth());
+  for (size_t i = 0; i < buffers.slots(); i++) {
+    memset(buffers.slot(i), 'a', block_size);
+  }
+  {
+    EngineFile file(*engine, path, O_WRONLY | O_CREAT | O_TRUNC, false);
+    // Whole blocks are written, the last one reaches past the end
+    CHECK(file.write(buffers, block_size, 0, 10 * block_size + 1) == 11 * block_size);
+    for (size_t i = 0; i < buffers.slots(); i++) {
+      memset(buffers.slot(i), 'b', block_size);
+    }
+    CHECK(file.write(buffers, block_size, 11 * block_size, 13 * block_size) == 2 * block_size);
+  }
+  CHECK(fs_utils::file_size(path) == 13 * block_size);
+  // Every block landed at its own offset
+  std::ifstream in(path, std::ios::binary);
+  std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  CHECK(content.substr(0, 11 * block_size) == std::string(11 * block_size, 'a'));
+  CHECK(content.substr(11 * block_size) == std::string(2 * block_size, 'b'));
+
+  EngineFile file(*engine, path, O_RDWR, false);
+  CHECK(file.read(buffers, block_size, 0, 13 * block_size) == 13 * block_size);
+  file.fallocate(13 * block_size, 3 * block_size);
+  CHECK(fs_utils::file_size(path) == 16 * block_size);
+  file.close();
+  CHECK(file.fd() == -1);
+  std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Engine file with the sync engine") {
+  REQUIRE(IOEngineFactory::instance().create("sync") != nullptr);
+  check_engine("sync");
+}
+
+TEST_CASE("Engine file with the libaio engine") { check_engine("libaio"); }
+
+TEST_CASE("Engine file rejects blocks larger than the buffers") {
+  auto root = make_temp_dir("filestorm_engine_file_test");
+  auto engine = IOEngineFactory::instance().create("sync");
+  BufferArena buffers(4096, 1);
+  EngineFile file(*engine, root + "/data", O_WRONLY | O_CREAT, false);
+  CHECK_THROWS_AS(file.write(buffers, 8192, 0, 8192), std::invalid_argument);
+  file.close();
+  std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Engine file fails to open a missing file") {
+  auto engine = IOEngineFactory::instance().create("sync");
+  auto root = make_temp_dir("filestorm_engine_file_test");
+  CHECK_THROWS_AS(EngineFile(*engine, root + "/missing/file", O_RDONLY, false), std::runtime_error);
+  std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Engine file keeps the shadow state of a tree node") {
+  auto engine = IOEngineFactory::instance().create("sync");
+  REQUIRE(engine != nullptr);
+  auto root = make_temp_dir("filestorm_engine_file_test");
+  FileTree tree(root);
+  auto node = tree.mkfile("data");
+  const uint64_t block_size = 4096;
+  BufferArena buffers(block_size, 1);
+  {
+    EngineFile file(*engine, tree, node, O_RDWR | O_CREAT | O_TRUNC, false);
+    CHECK(node->shadowKnown());
+    file.write(buffers, block_size, 0, 8 * block_size);
+    file.fallocate(2 * block_size, 2 * block_size, true);
+    file.fallocate(8 * block_size, 4 * block_size);
+  }
+  CHECK(node->size() == 12 * block_size);
+  CHECK(node->allocatedBytes() == 10 * block_size);
+  REQUIRE(node->holes() != nullptr);
+  CHECK(node->holes()->bytes(RangeSet::Kind::UNWRITTEN) == 4 * block_size);
+  CHECK(fs_utils::file_size(root + "/data") == node->size());
+
+  // Unknown shadow state is reconciled when the file is opened
+  node->forgetShadow();
+  {
+    EngineFile file(*engine, tree, node, O_RDWR, false);
+    CHECK(node->shadowKnown());
+    file.truncate(3 * block_size);
+  }
+  CHECK(tree.fileSize(node) == 3 * block_size);
+  // The punched hole is cut at the new end
+  CHECK(node->allocatedBytes() == 2 * block_size);
+  std::filesystem::remove_all(root);
+}
@@ -0,0 +1,73 @@
+#include <doctest/doctest.h>
+#include <filestorm/extents_accountant.h>
+#include <filestorm/filetree.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "temp_dir.h"
+
+static void write_file(const std::string& path, size_t size) {
+  std::ofstream out(path, std::ios::binary);
+  std::string data(size, 'x');
+  out << data;
+}
+
+static void check_accountant(unsigned int workers) {
+  auto root = make_temp_dir("filestorm_accountant_test");
+  FileTree tree(root);
+  ExtentsAccountant accountant(tree, workers);
+  CHECK(accountant.workers() == workers);
+
+  auto file_a = tree.mkfile("a");
+  auto file_b = tree.mkfile("b");
+  write_file(file_a->path(true), 8192);
+  write_file(file_b->path(true), 8192);
+
+  // Repeatedly touched files are scanned only once
+  accountant.markDirty(file_a);
+  accountant.markDirty(file_a);
+  accountant.markDirty(file_b);
+  CHECK(accountant.pendingCount() == 2);
+  accountant.drain();
+  CHECK(accountant.pendingCount() == 0);
+  CHECK(file_a->getExtentsCount(false) >= 1);
+  CHECK(tree.total_extents_count == file_a->getExtentsCount(false) + file_b->getExtentsCount(false));
+
+  // Forgotten files are subtracted and their pending scans dropped
+  auto b_extents = file_b->getExtentsCount(false);
+  accountant.markDirty(file_a);
+  accountant.submit();
+  accountant.forget(file_a);
+  std::filesystem::remove(file_a->path(true));
+  tree.remove(file_a);
+  accountant.drain();
+  CHECK(tree.total_extents_count == b_extents);
+
+  // scanAll returns the exact count of the whole tree
+  CHECK(accountant.scanAll() == b_extents);
+
+  std::filesystem::remove_all(root);
+}
+
+#if defined(__linux__)
+TEST_CASE("ExtentsAccountant scanning synchronously") { check_accountant(0); }
+
+TEST_CASE("ExtentsAccountant scanning on background workers") { check_accountant(2); }
+
+TEST_CASE("ExtentsAccountant flushes the final scan without fiemap sync") {
+  auto root = make_temp_dir("filestorm_accountant_test");
+  FileTree tree(root);
+  ExtentsAccountant accountant(tree, 1, false);
+  auto file = tree.mkfile("a");
+  // Dirty data not written back yet, a scan without sync may report it as delayed allocation
+  write_file(file->path(true), 3 * 65536);
+  accountant.markDirty(file);
+  accountant.drain();
+  CHECK(tree.total_extents_count == file->getExtentsCount(false));
+  CHECK(accountant.scanAll() >= 1);
+  CHECK(tree.total_extents_count == file->getExtentsCount(false));
+  std::filesystem::remove_all(root);
+}
+#endif
@@ -0,0 +1,88 @@
+#include <doctest/doctest.h>
+#include <filestorm/extents_estimator.h>
+#include <filestorm/filetree.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "temp_dir.h"
+
+TEST_CASE("ExtentsEstimator combines strata") {
+  // Fully scanned strata give the exact total without any uncertainty
+  std::vector<ExtentsEstimator::Stratum> strata = {{3, {1, 2, 3}}, {2, {5, 5}}};
+  auto exact = ExtentsEstimator::combine(strata);
+  CHECK(exact.total == doctest::Approx(16));
+  CHECK(exact.margin == doctest::Approx(0));
+  CHECK(exact.exact());
+
+  // Sampled stratum scales the mean to its population and adds the variance of the estimate
+  strata = {{100, {1, 3}}, {10, {2}}};
+  auto sampled = ExtentsEstimator::combine(strata);
+  CHECK(sampled.total == doctest::Approx(220));
+  CHECK(sampled.sampled == 3);
+  CHECK(sampled.population == 110);
+  CHECK_FALSE(sampled.exact());
+  // N^2 * (1 - n/N) * s^2 / n = 10000 * 0.98 * 2 / 2
+  CHECK(sampled.margin == doctest::Approx(1.959964 * std::sqrt(9800.0)));
+}
+
+TEST_CASE("ExtentsEstimator rejects empty sample") { CHECK_THROWS_AS(ExtentsEstimator(0, 4), std::invalid_argument); }
+
+#if defined(__linux__)
+TEST_CASE("ExtentsEstimator estimate of a small tree") {
+  std::filesystem::path root = make_temp_dir("filestorm_estimator_test");
+  FileTree tree(root.string());
+  for (int i = 0; i < 20; i++) {
+    auto file = tree.mkfile("file" + std::to_string(i));
+    std::ofstream out(file->path(true), std::ios::binary);
+    out << std::string(4096, 'x');
+  }
+
+  // Sample bigger than the tree scans every file
+  ExtentsEstimator full(100, 4);
+  auto estimate = full.estimate(tree.all_files.items());
+  CHECK(estimate.exact());
+  CHECK(estimate.total == doctest::Approx(20));
+
+  ExtentsEstimator sampled(8, 4);
+  estimate = sampled.estimate(tree.all_files.items());
+  CHECK(estimate.sampled == 8);
+  CHECK(estimate.population == 20);
+  // Every file has one extent so there is no variance
+  CHECK(estimate.total == doctest::Approx(20));
+  CHECK(estimate.margin == doctest::Approx(0));
+
+  std::filesystem::remove_all(root);
+}
+
+TEST_CASE("ExtentsEstimator stratifies by creation order") {
+  std::filesystem::path root = make_temp_dir("filestorm_estimator_order_test");
+  FileTree tree(root.string());
+  // The older half is empty (no extents), the newer half has one extent each
+  std::vector<FileTree::Nodeptr> files;
+  for (int i = 0; i < 20; i++) {
+    auto file = tree.mkfile("file" + std::to_string(i));
+    std::ofstream out(file->path(true), std::ios::binary);
+    if (i >= 10) {
+      out << std::string(4096, 'x');
+    }
+    files.push_back(file);
+  }
+  // Interleaved like after many removals, strata by position would mix old and new files
+  std::vector<FileTree::Nodeptr> scrambled;
+  for (int i = 0; i < 10; i++) {
+    scrambled.push_back(files[i]);
+    scrambled.push_back(files[19 - i]);
+  }
+
+  ExtentsEstimator sampled(4, 2);
+  auto estimate = sampled.estimate(scrambled);
+  CHECK(estimate.sampled == 4);
+  CHECK(estimate.total == doctest::Approx(10));
+  CHECK(estimate.margin == doctest::Approx(0));
+
+  std::filesystem::remove_all(root);
+}
+#endif
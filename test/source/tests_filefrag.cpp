@@ -110,3 +110,27 @@ TEST_CASE("Non-linux platforms: get_extents returns an empty vector") {
   CHECK(extents_list.empty());
 }
 #endif
+
+#if defined(__linux__)
+TEST_CASE("get_extents limited to a range skips extents outside of it") {
+  std::string path = create_temp_file("");
+  int fd = open(path.c_str(), O_WRONLY);
+  REQUIRE(fd != -1);
+  std::string block(4096, 'x');
+  // Two separate extents with a hole in between
+  CHECK(pwrite(fd, block.data(), block.size(), 0) == static_cast<ssize_t>(block.size()));
+  CHECK(pwrite(fd, block.data(), block.size(), 1024 * 1024) == static_cast<ssize_t>(block.size()));
+  close(fd);
+
+  auto whole = get_extents(path.c_str());
+  auto tail = get_extents(path.c_str(), 1024 * 1024, 4096);
+  auto unsynced = get_extents(path.c_str(), 0, 4096, false);
+  unlink(path.c_str());
+
+  REQUIRE(whole.size() == 2);
+  REQUIRE(tail.size() == 1);
+  CHECK(tail[0].start == whole[1].start);
+  REQUIRE(unsynced.size() == 1);
+  CHECK(unsynced[0].start == 0);
+}
+#endif
@@ -1,10 +1,16 @@
 #include <doctest/doctest.h>
 #include <filestorm/filetree.h>
+#include <filestorm/utils/random.h>
 
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <map>
 #include <sstream>
 #include <string>
 
+#include "temp_dir.h"
+
 TEST_CASE("Testing FileTree") {
   FileTree tree("root");
 
@@ -192,6 +198,34 @@ TEST_CASE("FileTree rm") {
   }
 }
 
+TEST_CASE("FileTree rename") {
+  FileTree fileTree("root");
+  fileTree.mkdir("a");
+  fileTree.mkdir("b");
+  auto file = fileTree.mkfile("a/file.txt");
+
+  SUBCASE("Move file to another directory") {
+    fileTree.rename(file, "/b/moved.txt");
+    CHECK(file->path(true) == "root/b/moved.txt");
+    CHECK(fileTree.getNode("b/moved.txt") == file);
+    CHECK(fileTree.getNode("a")->files.empty());
+    CHECK(fileTree.all_files.size() == 1);
+  }
+
+  SUBCASE("Move file to the root") {
+    fileTree.rename(file, "top.txt");
+    CHECK(file->parent == fileTree.getRoot());
+    CHECK(file->path() == "/top.txt");
+  }
+
+  SUBCASE("Occupied or missing targets are rejected") {
+    fileTree.mkfile("b/taken.txt");
+    CHECK_THROWS_WITH_AS(fileTree.rename(file, "b/taken.txt"), "Rename target already exists!", std::runtime_error);
+    CHECK_THROWS_AS(fileTree.rename(file, "missing/file.txt"), std::runtime_error);
+    CHECK(file->path() == "/a/file.txt");
+  }
+}
+
 TEST_CASE("getExtentsCount for folder node") {
   // Setup: Create a folder node (folders should not have extents)
   FileTree::Node folderNode("folder", FileTree::Type::DIRECTORY, nullptr);
@@ -495,3 +529,241 @@ TEST_CASE("Testing punchable file functions") {
     CHECK_FALSE(tree.hasPunchableFiles());
   }
 }
+
+TEST_CASE("Node extents cache rescans only dirty ranges") {
+  FileTree::Node file("file", FileTree::Type::FILE, nullptr);
+
+  // Nothing scanned yet, whole file has to be mapped
+  auto ranges = file.takeRescanRanges();
+  REQUIRE(ranges.size() == 1);
+  CHECK(ranges[0] == FileTree::Node::Range(0, UINT64_MAX));
+
+  file.setExtents({{0, 4096, 0}, {8192, 4096, 0}, {65536, 4096, 0}});
+  CHECK_FALSE(file.extentsDirty());
+
+  // Dirty range is extended over the touching cached extent, overlapping ranges are merged
+  file.markExtentsDirty(10000, 12000);
+  file.markExtentsDirty(11000, 20000);
+  ranges = file.takeRescanRanges();
+  REQUIRE(ranges.size() == 1);
+  CHECK(ranges[0] == FileTree::Node::Range(8192, 20000));
+  CHECK_FALSE(file.extentsDirty());
+
+  // Extents in the range are replaced, the rest of the cache is kept in order
+  std::vector<std::vector<extents>> rescanned = {{{8192, 2048, 0}, {16384, 4096, 0}}};
+  file.applyRescan(ranges, rescanned);
+  auto cached = file.getExtents(false);
+  REQUIRE(cached.size() == 4);
+  CHECK(cached[0].start == 0);
+  CHECK(cached[1].start == 8192);
+  CHECK(cached[2].start == 16384);
+  CHECK(cached[3].start == 65536);
+
+  // Truncation drops everything behind the new end
+  file.markExtentsDirty(10000);
+  ranges = file.takeRescanRanges();
+  rescanned = {{}};
+  file.applyRescan(ranges, rescanned);
+  CHECK(file.getExtentsCount(false) == 1);
+}
+
+TEST_CASE("Children are kept sorted by name") {
+  FileTree tree("/tmp/filestorm_children");
+  auto root = tree.getRoot();
+  for (auto name : {"dir_2", "dir_10", "dir_1"}) {
+    tree.addDirectory(root, name);
+  }
+  REQUIRE(root->folders.size() == 3);
+  CHECK(root->folders[0]->name == "dir_1");
+  CHECK(root->folders[1]->name == "dir_10");
+  CHECK(root->folders[2]->name == "dir_2");
+  CHECK(root->folders.get("dir_10") == root->folders[1]);
+  CHECK(root->folders.get("dir_3") == nullptr);
+  CHECK_FALSE(root->folders.insert(FileTree::makeNode("dir_2", FileTree::Type::DIRECTORY, root)));
+
+  // A renamed file moves to its place under the new name
+  auto file = tree.mkfile("dir_1/file_a");
+  tree.mkfile("dir_1/file_m");
+  tree.rename(file, "dir_1/file_z");
+  auto dir = tree.getNode("dir_1");
+  CHECK(dir->files[0]->name == "file_m");
+  CHECK(dir->files[1] == file);
+  CHECK(tree.getNode("dir_1/file_z") == file);
+  CHECK(dir->files.find("file_a") == dir->files.end());
+
+  tree.rm("dir_1", true);
+  CHECK(root->folders.count("dir_1") == 0);
+  CHECK(root->folders.size() == 2);
+  CHECK(tree.all_files.empty());
+}
+
+TEST_CASE("Node paths") {
+  FileTree tree("/tmp/filestorm_paths");
+  auto file = tree.mkfile(tree.mkdir("a/bb/ccc", true)->path() + "/file_1");
+  CHECK(file->path() == "/a/bb/ccc/file_1");
+  CHECK(file->path(true) == "/tmp/filestorm_paths/a/bb/ccc/file_1");
+  CHECK(tree.getRoot()->path() == "");
+  CHECK(tree.getRoot()->path(true) == "/tmp/filestorm_paths");
+}
+
+TEST_CASE("Filesystem operations relative to cached directory descriptors") {
+  std::filesystem::path root = make_temp_dir("filestorm_directory_fds");
+  {
+    FileTree tree(root.string());
+    tree.setDirectoryFdLimit(2);
+    auto a = tree.mkdir("a");
+    auto b = tree.mkdir("a/b");
+    auto c = tree.mkdir("c");
+    for (auto& directory : {a, b, c}) {
+      tree.createDirectory(directory);
+    }
+    CHECK(std::filesystem::is_directory(root / "a" / "b"));
+    CHECK(std::filesystem::is_directory(root / "c"));
+    // The limit is enforced before an operation, it may open a whole chain of directories
+    CHECK(tree.directoryFdCount() <= 3);
+
+    auto file = tree.mkfile("a/b/file_1");
+    std::ofstream(root / "a" / "b" / "file_1") << "12345";
+    CHECK(tree.fileSize(file) == 5);
+    CHECK(tree.exists(file));
+    CHECK_FALSE(tree.exists(file, ".lnk"));
+    CHECK_THROWS_AS(tree.fileSize(tree.mkfile("c/missing")), std::runtime_error);
+
+    std::filesystem::create_hard_link(root / "a" / "b" / "file_1", root / "a" / "b" / "file_1.lnk");
+    auto old_parent = file->parent;
+    auto old_name = file->name;
+    tree.rename(file, "c/file_2");
+    tree.renameFrom(old_parent, old_name, file);
+    tree.renameFrom(old_parent, old_name, file, ".lnk");
+    CHECK(std::filesystem::exists(root / "c" / "file_2"));
+    CHECK(std::filesystem::exists(root / "c" / "file_2.lnk"));
+    CHECK_FALSE(std::filesystem::exists(root / "a" / "b" / "file_1"));
+
+    CHECK(tree.unlink(file, ".lnk"));
+    CHECK_FALSE(tree.unlink(file, ".lnk"));
+    CHECK(tree.unlink(file));
+    tree.remove(file);
+    CHECK(tree.unlink(b));
+    tree.remove(b);
+    CHECK_FALSE(std::filesystem::exists(root / "a" / "b"));
+  }
+  std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Placement policies") {
+  Random::seed(11);
+  FileTree tree("root", 2);
+  auto a = tree.addDirectory(tree.getRoot(), "a");
+  auto b = tree.addDirectory(tree.getRoot(), "b");
+  auto deep = tree.addDirectory(a, "deep");
+  CHECK(tree.levelSize(0) == 1);
+  CHECK(tree.levelSize(1) == 2);
+  CHECK(tree.levelSize(2) == 1);
+
+  CHECK(FileTree::parsePlacement("Uniform") == FileTree::Placement::UNIFORM);
+  CHECK(FileTree::placementName(FileTree::parsePlacement("locality")) == std::string("locality"));
+  CHECK_THROWS_AS(FileTree::parsePlacement("spread"), std::invalid_argument);
+  CHECK_THROWS_AS(tree.setPlacement({FileTree::Placement::LOCALITY, 10, 1.5, 4}), std::invalid_argument);
+
+  SUBCASE("Uniform and depth stay above the maximal depth") {
+    for (auto policy : {FileTree::Placement::UNIFORM, FileTree::Placement::DEPTH}) {
+      tree.setPlacement({policy});
+      std::map<std::string, int> counts;
+      for (int i = 0; i < 3000; i++) {
+        counts[tree.placementDirectory()->name]++;
+      }
+      CHECK(counts.size() == 3);
+      CHECK(counts.count("deep") == 0);
+      if (policy == FileTree::Placement::UNIFORM) {
+        CHECK(counts["root"] > 800);
+      } else {
+        // Half of the picks go to the only directory of level 0
+        CHECK(counts["root"] > 1300);
+      }
+    }
+  }
+
+  SUBCASE("Fanout avoids full directories") {
+    // a holds deep and the two files
+    tree.setPlacement({FileTree::Placement::FANOUT, 3});
+    tree.addFile(a, "f1");
+    tree.addFile(a, "f2");
+    for (int i = 0; i < 100; i++) {
+      CHECK(tree.placementDirectory() != a);
+    }
+  }
+
+  SUBCASE("Locality reuses recent directories") {
+    tree.setPlacement({FileTree::Placement::LOCALITY, 1000, 1.0, 1});
+    auto first = tree.placementDirectory();
+    for (int i = 0; i < 20; i++) {
+      CHECK(tree.placementDirectory() == first);
+    }
+    if (first != tree.getRoot()) {
+      tree.remove(first);
+      CHECK(tree.placementDirectory() != first);
+    }
+  }
+
+  SUBCASE("Removed directories leave their level") {
+    tree.remove(a);
+    CHECK(tree.levelSize(1) == 1);
+    CHECK(tree.levelSize(2) == 0);
+    tree.setPlacement({FileTree::Placement::DEPTH});
+    for (int i = 0; i < 50; i++) {
+      auto directory = tree.placementDirectory();
+      CHECK((directory == b || directory == tree.getRoot()));
+    }
+  }
+  (void)deep;
+}
+
+TEST_CASE("Weighted file selection") {
+  Random::seed(5);
+  FileTree tree("root");
+  std::vector<FileTree::Nodeptr> files;
+  for (int i = 0; i < 50; i++) {
+    files.push_back(tree.addFile(tree.getRoot(), fmt::format("file_{}", i)));
+  }
+  CHECK(FileTree::parseSelection("ZIPF") == FileTree::Selection::ZIPF);
+  CHECK(FileTree::selectionName(FileTree::Selection::LRU) == std::string("lru"));
+  CHECK_THROWS_AS(FileTree::parseSelection("hot"), std::invalid_argument);
+  CHECK_THROWS_AS(tree.randomFile(FileTree::Selection::SIZE), std::runtime_error);
+
+  tree.setZipfExponent(2);
+  tree.enableSelection(FileTree::Selection::ZIPF);
+  tree.enableSelection(FileTree::Selection::SIZE);
+  CHECK_THROWS_AS(tree.setZipfExponent(1), std::runtime_error);
+
+  // The first file has 1 / (1 + 1/4 + 1/9 + ...) = 0.6 of the zipf weight
+  int first = 0;
+  for (int i = 0; i < 1000; i++) {
+    first += tree.randomFile(FileTree::Selection::ZIPF) == files[0];
+  }
+  CHECK(first > 500);
+  CHECK(first < 700);
+
+  // Only the touched file has a size, removals keep the weights of the others in place
+  files[7]->setShadowSize(1 << 20);
+  tree.touch(files[7]);
+  tree.remove(files[0]);
+  tree.remove(files[49]);
+  tree.removeFromPunchableFiles(files[3]);
+  int sized = 0;
+  for (int i = 0; i < 1000; i++) {
+    sized += tree.randomFile(FileTree::Selection::SIZE) == files[7];
+    CHECK(tree.randomPunchableFile(FileTree::Selection::SIZE) != files[3]);
+  }
+  CHECK(sized > 990);
+
+  // Files touched last are picked by lru only when all samples hit them
+  for (size_t i = 1; i < 40; i++) {
+    tree.touch(files[i]);
+  }
+  int old = 0;
+  for (int i = 0; i < 1000; i++) {
+    auto file = tree.randomFile(FileTree::Selection::LRU);
+    old += file->_sequence >= 40;
+  }
+  CHECK(old > 700);
+}
@@ -0,0 +1,43 @@
+#include <doctest/doctest.h>
+#include <filestorm/freespace_map.h>
+
+TEST_CASE("Free space map statistics") {
+  // 4k blocks, 1 MiB groups, extents shorter than 256k are fragmented
+  FreeSpaceMap map(4096, 1 << 20, 256 * 1024);
+  map.addFreeExtent(0, 4096);
+  map.addFreeExtent(8192, 3 * 4096);
+  // Crosses into the second group, counted as 512k in each
+  map.addFreeExtent(512 * 1024, 1 << 20);
+
+  REQUIRE(map.groups().size() == 2);
+  CHECK(map.groups()[0].free_extents == 3);
+  CHECK(map.groups()[0].free_bytes == 4 * 4096 + 512 * 1024);
+  CHECK(map.groups()[0].largest_extent == 512 * 1024);
+  CHECK(map.groups()[0].fragmentation() == doctest::Approx(4.0 * 4096 / (4 * 4096 + 512 * 1024)));
+  CHECK(map.groups()[1].fragmentation() == 0);
+
+  auto& histogram = map.histogram();
+  CHECK(histogram[0].extents == 1);  // 1 block
+  CHECK(histogram[1].extents == 1);  // 3 blocks
+  CHECK(histogram[1].blocks == 3);
+  CHECK(histogram[7].extents == 2);  // 128 blocks each
+  CHECK(histogram[7].blocks == 256);
+
+  auto total = map.total();
+  CHECK(total.free_extents == 4);
+  CHECK(total.free_bytes == 4 * 4096 + (1 << 20));
+  CHECK(map.fragmentationIndex() == doctest::Approx(4.0 * 4096 / (4 * 4096 + (1 << 20))));
+
+  auto json = map.toJson();
+  CHECK(json["histogram"].size() == 8);
+  CHECK(json["groups"].size() == 2);
+  CHECK(json["free_extents"] == 4);
+}
+
+TEST_CASE("Free space map without groups") {
+  FreeSpaceMap map(4096, 0, 1 << 20);
+  CHECK(map.fragmentationIndex() == 0);
+  map.addFreeExtent(uint64_t(5) << 40, 4096);
+  REQUIRE(map.groups().size() == 1);
+  CHECK(map.fragmentationIndex() == 1);
+}
@@ -0,0 +1,68 @@
+#include <doctest/doctest.h>
+#include <filestorm/fs_profile.h>
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "temp_dir.h"
+
+TEST_CASE("Profile histograms") {
+  CHECK(FsProfile::bucket(0) == 0);
+  CHECK(FsProfile::bucket(1) == 1);
+  CHECK(FsProfile::bucket(4095) == 12);
+  CHECK(FsProfile::bucket(4096) == 13);
+  CHECK(FsProfile::bucket(UINT64_MAX) == 64);
+
+  FsProfile profile;
+  profile.addFile(0, 0, 0);
+  profile.addFile(4096, 2, 1);
+  profile.addDirectory(3);
+  FsProfile other;
+  other.addFile(5000, 1, -1);
+  other.addDirectory(0);
+  profile.merge(other);
+  CHECK(profile.files() == 3);
+  CHECK(profile.directories() == 2);
+  CHECK(profile.bytes() == 9096);
+
+  auto json = profile.toJson();
+  CHECK(json["file_size"].size() == 14);
+  CHECK(json["file_size"]["0"] == 1);
+  CHECK(json["file_size"]["4096"] == 2);
+  CHECK(json["depth"] == nlohmann::json({{"0", 1}, {"1", 1}, {"2", 1}}));
+  // Only the files whose extents were counted
+  CHECK(json["extents_per_file"] == nlohmann::json({{"0", 1}, {"1", 1}}));
+  CHECK(json["fanout"] == nlohmann::json({{"0", 1}, {"1", 0}, {"2", 1}}));
+}
+
+TEST_CASE("Profile of a directory tree") {
+  std::filesystem::path root = make_temp_dir("filestorm_profile_test");
+  std::filesystem::create_directories(root / "a" / "b");
+  std::filesystem::create_directories(root / "c");
+  auto write = [](const std::filesystem::path& path, size_t size) { std::ofstream(path) << std::string(size, 'x'); };
+  write(root / "top", 100);
+  write(root / "a" / "one", 4096);
+  write(root / "a" / "b" / "deep", 10000);
+  write(root / "a" / "b" / "empty", 0);
+  std::filesystem::create_symlink(root / "top", root / "c" / "link");
+
+  for (unsigned workers : {1u, 4u}) {
+    FsProfile::Options options;
+    options.workers = workers;
+    auto profile = FsProfile::crawl(root.string() + "/", options);
+    CHECK(profile.files() == 4);
+    CHECK(profile.directories() == 4);
+    CHECK(profile.bytes() == 100 + 4096 + 10000);
+    CHECK(profile.skipped() == 0);
+    CHECK(profile.depths() == std::vector<uint64_t>{1, 1, 2});
+    // root: top, a, c; a: one, b; b: deep, empty; c: link
+    CHECK(profile.fanouts()[FsProfile::bucket(2)] == 3);
+    CHECK(profile.fanouts()[FsProfile::bucket(1)] == 1);
+    CHECK(profile.sizes()[0] == 1);
+  }
+
+  std::filesystem::remove_all(root);
+  CHECK_THROWS_AS(FsProfile::crawl(root.string(), {}), std::runtime_error);
+}
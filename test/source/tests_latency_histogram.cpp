@@ -0,0 +1,38 @@
+#include <doctest/doctest.h>
+#include <filestorm/latency_histogram.h>
+
+TEST_CASE("Latency histogram percentiles") {
+  LatencyHistogram histogram;
+  CHECK(histogram.percentile(50) == 0);
+  for (uint64_t value = 1; value <= 1000; value++) {
+    histogram.record(value * 1000);
+  }
+  CHECK(histogram.count() == 1000);
+  CHECK(histogram.min() == 1000);
+  CHECK(histogram.max() == 1000000);
+  CHECK(histogram.mean() == doctest::Approx(500500));
+  // Reported values are never below the real ones and at most 1/32 above them
+  for (double percent : {1.0, 50.0, 90.0, 99.0, 99.9}) {
+    double real = percent * 10 * 1000;
+    CHECK(histogram.percentile(percent) >= real);
+    CHECK(histogram.percentile(percent) <= real * (1 + 1.0 / 32));
+  }
+  CHECK(histogram.percentile(100) == 1000000);
+}
+
+TEST_CASE("Latency histogram counts small values exactly and merges") {
+  LatencyHistogram first, second;
+  first.record(3);
+  first.record(7);
+  second.record(31);
+  second.record(UINT64_MAX);
+  first.merge(second);
+  CHECK(first.count() == 4);
+  CHECK(first.percentile(25) == 3);
+  CHECK(first.percentile(50) == 7);
+  CHECK(first.percentile(75) == 31);
+  CHECK(first.percentile(100) == UINT64_MAX);
+  auto json = first.toJson();
+  CHECK(json["count"] == 4);
+  CHECK(json["min"] == 3);
+}
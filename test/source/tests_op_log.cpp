@@ -0,0 +1,118 @@
+#include <doctest/doctest.h>
+#include <filestorm/filetree.h>
+#include <filestorm/op_log.h>
+
+#include <filesystem>
+#include <string>
+
+TEST_CASE("Operation log round trip") {
+  auto path = (std::filesystem::temp_directory_path() / "filestorm_test.oplog").string();
+  FileTree tree("/tmp/filestorm_oplog");
+  {
+    OpLogWriter writer(path, 4096);
+    auto dir = tree.addDirectory(tree.getRoot(), "dir");
+    writer.createDirectory(dir);
+    auto file = tree.addFile(dir, "file");
+    writer.createFile(OpRecord::CREATE_FILE, file, 1 << 20);
+    writer.fileOperation(OpRecord::ALTER_BIGGER_WRITE, file, 1 << 20, 300000);
+    writer.fileOperation(OpRecord::ALTER_SMALLER_TRUNCATE, file, 0, 4096);
+    writer.endIteration();
+    writer.deleteFile(file);
+    writer.endIteration();
+    CHECK(writer.count() == 7);
+  }
+
+  OpLogReader reader(path);
+  CHECK(reader.blockSize() == 4096);
+  OpRecord record;
+  REQUIRE(reader.next(record));
+  CHECK(record.type == OpRecord::CREATE_DIR);
+  CHECK(record.id == 1);
+  CHECK(record.parent == 0);
+  CHECK(record.name == "dir");
+  REQUIRE(reader.next(record));
+  CHECK(record.type == OpRecord::CREATE_FILE);
+  CHECK(record.id == 2);
+  CHECK(record.parent == 1);
+  CHECK(record.name == "file");
+  CHECK(record.length == 1 << 20);
+  REQUIRE(reader.next(record));
+  CHECK(record.type == OpRecord::ALTER_BIGGER_WRITE);
+  CHECK(record.id == 2);
+  CHECK(record.offset == 1 << 20);
+  CHECK(record.length == 300000);
+  REQUIRE(reader.next(record));
+  CHECK(record.type == OpRecord::ALTER_SMALLER_TRUNCATE);
+  CHECK(record.length == 4096);
+  REQUIRE(reader.next(record));
+  CHECK(record.type == OpRecord::END);
+  REQUIRE(reader.next(record));
+  CHECK(record.type == OpRecord::DELETE_FILE);
+  CHECK(record.id == 2);
+  REQUIRE(reader.next(record));
+  CHECK(record.type == OpRecord::END);
+  CHECK_FALSE(reader.next(record));
+  CHECK_FALSE(reader.truncated());
+
+  SUBCASE("Truncated log ends at the last complete record") {
+    // Cuts the id of DELETE_FILE and the last END
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 2);
+    OpLogReader cut(path);
+    int records = 0;
+    while (cut.next(record)) {
+      records++;
+    }
+    CHECK(records == 5);
+    CHECK(cut.truncated());
+  }
+
+  SUBCASE("Unknown nodes are rejected") {
+    OpLogWriter writer(path, 4096);
+    auto stray = tree.addFile(tree.getRoot(), "stray");
+    CHECK_THROWS_AS(writer.deleteFile(stray), std::runtime_error);
+  }
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Operation log metadata records") {
+  auto path = (std::filesystem::temp_directory_path() / "filestorm_test_metadata.oplog").string();
+  FileTree tree("/tmp/filestorm_oplog");
+  {
+    OpLogWriter writer(path, 4096);
+    auto dir = tree.addDirectory(tree.getRoot(), "dir");
+    writer.createDirectory(dir);
+    auto file = tree.addFile(tree.getRoot(), "file");
+    writer.createFile(OpRecord::CREATE_FILE, file, 4096);
+    writer.fileOperation(OpRecord::XATTR_SET, file, 3, 1500);
+    writer.fileOperation(OpRecord::CHMOD, file, 0640, 0);
+    tree.rename(file, "dir/renamed");
+    writer.renameFile(file);
+    writer.fileOperation(OpRecord::LINK, file, 0, 0);
+    writer.endIteration();
+  }
+
+  OpLogReader reader(path);
+  OpRecord record;
+  REQUIRE(reader.next(record));
+  REQUIRE(reader.next(record));
+  REQUIRE(reader.next(record));
+  CHECK(record.type == OpRecord::XATTR_SET);
+  CHECK(record.id == 2);
+  CHECK(record.offset == 3);
+  CHECK(record.length == 1500);
+  REQUIRE(reader.next(record));
+  CHECK(record.type == OpRecord::CHMOD);
+  CHECK(record.offset == 0640);
+  REQUIRE(reader.next(record));
+  CHECK(record.type == OpRecord::RENAME);
+  CHECK(record.id == 2);
+  CHECK(record.parent == 1);
+  CHECK(record.name == "renamed");
+  REQUIRE(reader.next(record));
+  CHECK(record.type == OpRecord::LINK);
+  CHECK(record.id == 2);
+  REQUIRE(reader.next(record));
+  CHECK(record.type == OpRecord::END);
+  CHECK_FALSE(reader.next(record));
+  std::filesystem::remove(path);
+}
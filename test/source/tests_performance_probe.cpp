@@ -0,0 +1,53 @@
+#include <doctest/doctest.h>
+#include <filestorm/filetree.h>
+#include <filestorm/ioengines/factory.h>
+#include <filestorm/performance_probe.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "temp_dir.h"
+
+TEST_CASE("Performance probe runs the reference workload") {
+  auto root = make_temp_dir("filestorm_probe_test");
+  FileTree tree(root);
+  for (auto name : {"a", "b", "c"}) {
+    auto file = tree.mkfile(name);
+    std::ofstream out(file->path(true), std::ios::binary);
+    out << std::string(64 * 1024, 'x');
+  }
+  auto ioengine = IOEngineFactory::instance().create("sync");
+  REQUIRE(ioengine != nullptr);
+  PerformanceProbe::Config config;
+  config.files = 4;
+  config.random_reads = 50;
+  config.block_size = 16 * 1024;
+  config.create_size = 256 * 1024;
+  PerformanceProbe probe(config);
+  BufferArena buffers(config.block_size, ioengine->queue_depth());
+
+  auto result = probe.run(*ioengine, buffers, tree, 1024 * 1024, 1);
+  CHECK(result["files"] == 4);
+  // Files are drawn with repetition
+  CHECK(result["sequential_read"]["bytes"] == 4 * 64 * 1024);
+  CHECK(result["random_read"]["latency"]["count"] == 50);
+  CHECK(result["random_read"]["iops"].get<double>() > 0);
+  CHECK(result["create"]["bytes"] == 256 * 1024);
+  // The created file is removed again
+  CHECK(!std::filesystem::exists(std::filesystem::path(root) / "filestorm_probe"));
+
+  SUBCASE("Create is skipped without enough space") {
+    auto skipped = probe.run(*ioengine, buffers, tree, 128 * 1024, 1);
+    CHECK(skipped["create"].is_null());
+  }
+  SUBCASE("Empty tree") {
+    auto empty_root = root + "/empty";
+    std::filesystem::create_directories(empty_root);
+    FileTree empty(empty_root);
+    auto empty_result = probe.run(*ioengine, buffers, empty, 0, 1);
+    CHECK(empty_result["files"] == 0);
+    CHECK(empty_result["random_read"]["latency"]["count"] == 0);
+  }
+  std::filesystem::remove_all(root);
+}
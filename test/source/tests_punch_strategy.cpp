@@ -0,0 +1,95 @@
+#include <doctest/doctest.h>
+#include <filestorm/punch_strategy.h>
+#include <filestorm/utils/random.h>
+
+#include <stdexcept>
+
+namespace {
+  constexpr uint64_t BLOCK = 4096;
+
+  PunchStrategy::Config config() {
+    PunchStrategy::Config config;
+    config.block_size = BLOCK;
+    config.min_length = BLOCK;
+    config.max_length = 4 * BLOCK;
+    config.stride = 8 * BLOCK;
+    return config;
+  }
+
+  // Punch holes until the strategy finds no room, checks each hole and returns their number
+  int punchAll(PunchStrategy& strategy, FileTree::Node& file, uint64_t size) {
+    int holes = 0;
+    while (auto hole = strategy.pick(file, size)) {
+      auto [start, end] = *hole;
+      CHECK(start % BLOCK == 0);
+      CHECK(end % BLOCK == 0);
+      CHECK(start >= BLOCK);
+      CHECK(end <= size - BLOCK);
+      CHECK(start < end);
+      // Holes don't overlap the earlier ones
+      if (file.holes() != nullptr) {
+        CHECK(file.holes()->containing(start) == nullptr);
+        CHECK(file.holes()->nextStart(start) >= end);
+      }
+      file.shadowPunch(start, end);
+      REQUIRE(++holes < 10000);
+    }
+    return holes;
+  }
+}  // namespace
+
+TEST_CASE("Punch strategy names") {
+  CHECK(PunchStrategy::parseKind("Random") == PunchStrategy::Kind::RANDOM);
+  CHECK(PunchStrategy::kindName(PunchStrategy::parseKind("clustered")) == std::string("clustered"));
+  CHECK_THROWS_AS(PunchStrategy::parseKind("spiral"), std::invalid_argument);
+  auto stride = config();
+  stride.stride = BLOCK;
+  CHECK_THROWS_AS(PunchStrategy::create(PunchStrategy::Kind::STRIDE, stride), std::invalid_argument);
+  CHECK_THROWS_AS(PunchStrategy::create(PunchStrategy::Kind::DISTRIBUTION, config()), std::invalid_argument);
+}
+
+TEST_CASE("Punch strategies place valid holes") {
+  Random::seed(7);
+  const uint64_t size = 256 * BLOCK + 100;
+  auto distribution = config();
+  distribution.lengths = Distribution({4096, 16384}, {1, 1});
+  for (auto kind : {PunchStrategy::Kind::RANDOM, PunchStrategy::Kind::STRIDE, PunchStrategy::Kind::CLUSTERED, PunchStrategy::Kind::DISTRIBUTION}) {
+    auto strategy = PunchStrategy::create(kind, distribution);
+    FileTree tree("root");
+    auto file = tree.addFile(tree.getRoot(), "file");
+    file->setShadowSize(size);
+    CHECK(strategy->punchable(*file, size));
+    CHECK(punchAll(*strategy, *file, size) > 0);
+    CHECK(file->allocatedBytes() >= 2 * BLOCK);
+  }
+}
+
+TEST_CASE("Stride strategy punches at multiples of the stride") {
+  Random::seed(3);
+  auto strategy = PunchStrategy::create(PunchStrategy::Kind::STRIDE, config());
+  FileTree tree("root");
+  auto file = tree.addFile(tree.getRoot(), "file");
+  const uint64_t size = 64 * BLOCK;
+  file->setShadowSize(size);
+  punchAll(*strategy, *file, size);
+  for (auto& range : file->holes()->ranges()) {
+    CHECK(range.start % (8 * BLOCK) == 0);
+    CHECK(range.end - range.start <= 4 * BLOCK);
+  }
+  CHECK_FALSE(strategy->punchable(*file, 9 * BLOCK));
+}
+
+TEST_CASE("Halving strategy keeps the halving pattern") {
+  auto strategy = PunchStrategy::create(PunchStrategy::Kind::HALVING, config());
+  FileTree tree("root");
+  auto file = tree.addFile(tree.getRoot(), "file");
+  const uint64_t size = 64 * BLOCK;
+  file->setShadowSize(size);
+  auto hole = strategy->pick(*file, size);
+  REQUIRE(hole);
+  CHECK(hole->first == BLOCK);
+  CHECK(hole->second == 31 * BLOCK);
+  CHECK(file->getFallocationCount() == 1);
+  CHECK_FALSE(strategy->punchable(*file, 2 * BLOCK));
+  CHECK_FALSE(strategy->pick(*file, 2 * BLOCK));
+}
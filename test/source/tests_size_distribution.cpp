@@ -0,0 +1,105 @@
+#include <doctest/doctest.h>
+#include <filestorm/size_distribution.h>
+#include <filestorm/utils/random.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+  std::vector<uint64_t> draws(const SizeDistribution& distribution, uint64_t from, uint64_t to, int count = 10000) {
+    std::vector<uint64_t> sizes;
+    for (int i = 0; i < count; i++) {
+      auto size = distribution.sample(from, to);
+      REQUIRE(size >= from);
+      REQUIRE(size <= to);
+      sizes.push_back(size);
+    }
+    std::sort(sizes.begin(), sizes.end());
+    return sizes;
+  }
+}  // namespace
+
+TEST_CASE("File size distributions") {
+  Random::seed(7);
+  CHECK(SizeDistribution::kindName(SizeDistribution::parseKind("LogNormal")) == std::string("lognormal"));
+  CHECK_THROWS_AS(SizeDistribution::parseKind("zipf"), std::invalid_argument);
+  CHECK_THROWS_AS(SizeDistribution(SizeDistribution::Kind::EMPIRICAL, {}), std::invalid_argument);
+  SizeDistribution::Config invalid;
+  invalid.sigma = 0;
+  CHECK_THROWS_AS(SizeDistribution(SizeDistribution::Kind::LOGNORMAL, invalid), std::invalid_argument);
+
+  SUBCASE("lognormal is centered at the median") {
+    SizeDistribution::Config config;
+    config.median = 64 * 1024;
+    auto sizes = draws(SizeDistribution(SizeDistribution::Kind::LOGNORMAL, config), 0, 1ull << 40);
+    CHECK(sizes[sizes.size() / 2] > 56 * 1024);
+    CHECK(sizes[sizes.size() / 2] < 72 * 1024);
+    // Truncated to a range far from the median the draws still stay in it
+    draws(SizeDistribution(SizeDistribution::Kind::LOGNORMAL, config), 1 << 30, (1 << 30) + 4096, 100);
+  }
+
+  SUBCASE("pareto starts at the lower bound") {
+    SizeDistribution::Config config;
+    config.alpha = 1;
+    auto sizes = draws(SizeDistribution(SizeDistribution::Kind::PARETO, config), 4096, 1ull << 40);
+    CHECK(sizes.front() >= 4096);
+    // P(X > 2 * scale) = 1/2 for alpha 1
+    CHECK(sizes[sizes.size() / 2] > 7000);
+    CHECK(sizes[sizes.size() / 2] < 9500);
+  }
+
+  SUBCASE("bimodal draws around both modes") {
+    SizeDistribution::Config config;
+    config.sigma = 0.2;
+    config.modes = {4096, 1 << 24};
+    config.mode_weight = 0.75;
+    auto sizes = draws(SizeDistribution(SizeDistribution::Kind::BIMODAL, config), 0, 1ull << 40);
+    auto small = std::count_if(sizes.begin(), sizes.end(), [](uint64_t size) { return size < (1 << 18); });
+    CHECK(small > 7000);
+    CHECK(small < 8000);
+  }
+
+  SUBCASE("empirical follows the histogram within the range") {
+    SizeDistribution::Config config;
+    config.histogram = Distribution({0, 4096, 65536}, {1, 3, 0});
+    auto sizes = draws(SizeDistribution(SizeDistribution::Kind::EMPIRICAL, config), 0, 1 << 20);
+    auto small = std::count_if(sizes.begin(), sizes.end(), [](uint64_t size) { return size < 4096; });
+    CHECK(small > 2200);
+    CHECK(small < 2800);
+    CHECK(sizes.back() < 65536);
+    // Only the overlapping part of the buckets is drawn from
+    sizes = draws(SizeDistribution(SizeDistribution::Kind::EMPIRICAL, config), 8192, 16384, 1000);
+    CHECK(sizes.front() >= 8192);
+    // A range the histogram doesn't cover gets clamped draws
+    draws(SizeDistribution(SizeDistribution::Kind::EMPIRICAL, config), 1 << 20, 1 << 21, 100);
+  }
+
+  SUBCASE("same seed, same sizes") {
+    SizeDistribution distribution(SizeDistribution::Kind::LOGNORMAL, {});
+    Random::seed(11);
+    auto first = draws(distribution, 0, 1 << 30, 100);
+    Random::seed(11);
+    CHECK(draws(distribution, 0, 1 << 30, 100) == first);
+  }
+}
+
+TEST_CASE("File size histogram from a profile") {
+  auto path = std::filesystem::temp_directory_path() / "filestorm_size_histogram.json";
+  {
+    std::ofstream file(path);
+    file << R"({"files": 4, "file_size": {"0": 1, "4K": 3}, "depth": {"0": 4}})";
+  }
+  auto histogram = SizeDistribution::loadHistogram(path.string());
+  REQUIRE(histogram.size() == 2);
+  CHECK(histogram.bounds()[1] == 4096);
+  {
+    std::ofstream file(path);
+    file << R"({"0": 1, "1M": 1})";
+  }
+  CHECK(SizeDistribution::loadHistogram(path.string()).bounds()[1] == 1 << 20);
+  std::filesystem::remove(path);
+  CHECK_THROWS_AS(SizeDistribution::loadHistogram(path.string()), std::runtime_error);
+}
@@ -0,0 +1,58 @@
+#include <doctest/doctest.h>
+#include <filestorm/utils/expression.h>
+
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static Expression compile(const std::string& source) {
+  static const std::map<std::string, size_t> slots = {{"x", 0}, {"y", 1}, {"files", 2}};
+  return Expression::compile(source, [](const std::string& name) {
+    auto slot = slots.find(name);
+    if (slot == slots.end()) {
+      throw std::invalid_argument("unknown variable " + name);
+    }
+    return slot->second;
+  });
+}
+
+TEST_CASE("Expression evaluates arithmetic with precedence") {
+  std::vector<double> vars = {2, 3, 0};
+  CHECK(compile("1 + 2 * 3").evaluate(vars) == doctest::Approx(7));
+  CHECK(compile("(1 + 2) * 3").evaluate(vars) == doctest::Approx(9));
+  CHECK(compile("2 ^ 3 ^ 2").evaluate(vars) == doctest::Approx(512));
+  CHECK(compile("-x ^ 2").evaluate(vars) == doctest::Approx(-4));
+  CHECK(compile("2 ^ -1").evaluate(vars) == doctest::Approx(0.5));
+  CHECK(compile("10 - 4 - 3").evaluate(vars) == doctest::Approx(3));
+  CHECK(compile("x * y / 4").evaluate(vars) == doctest::Approx(1.5));
+  CHECK(compile("1e-2 + .5").evaluate(vars) == doctest::Approx(0.51));
+}
+
+TEST_CASE("Expression functions and logic") {
+  std::vector<double> vars = {0.6, 3, 0};
+  CHECK(compile("sqrt(1 - x * x)").evaluate(vars) == doctest::Approx(0.8));
+  CHECK(compile("min(x, y) + max(x, y)").evaluate(vars) == doctest::Approx(3.6));
+  CHECK(compile("if(files == 0, 1, x)").evaluate(vars) == doctest::Approx(1));
+  CHECK(compile("floor(y / 2) + ceil(x) + abs(-2)").evaluate(vars) == doctest::Approx(4));
+  CHECK(compile("x > 0.5 && y <= 3 || !1").evaluate(vars) == doctest::Approx(1));
+  CHECK(compile("x != 0.6").evaluate(vars) == doctest::Approx(0));
+}
+
+TEST_CASE("Expression records used variables") {
+  auto expression = compile("x + x * files");
+  CHECK(expression.variables() == std::vector<size_t>{0, 2});
+  CHECK(compile("1 + 2").variables().empty());
+}
+
+TEST_CASE("Expression rejects invalid input") {
+  CHECK_THROWS_AS(compile("1 +"), std::invalid_argument);
+  CHECK_THROWS_AS(compile("(1 + 2"), std::invalid_argument);
+  CHECK_THROWS_AS(compile("1 + 2)"), std::invalid_argument);
+  CHECK_THROWS_AS(compile("unknown + 1"), std::invalid_argument);
+  CHECK_THROWS_AS(compile("foo(1)"), std::invalid_argument);
+  CHECK_THROWS_AS(compile("min(1)"), std::invalid_argument);
+  CHECK_THROWS_AS(compile("(1, 2)"), std::invalid_argument);
+  CHECK_THROWS_AS(compile("x = 1"), std::invalid_argument);
+  CHECK_THROWS_AS(compile("x y"), std::invalid_argument);
+}
@@ -0,0 +1,51 @@
+#include <doctest/doctest.h>
+#include <filestorm/utils/fenwick_tree.h>
+
+#include <cstdint>
+#include <vector>
+
+TEST_CASE("FenwickTree prefix sums and updates") {
+  FenwickTree tree;
+  std::vector<uint64_t> weights = {3, 0, 5, 1, 7, 2, 4};
+  for (auto weight : weights) {
+    tree.push_back(weight);
+  }
+  REQUIRE(tree.size() == weights.size());
+  CHECK(tree.total() == 22);
+  uint64_t sum = 0;
+  for (size_t i = 0; i <= weights.size(); i++) {
+    CHECK(tree.prefix(i) == sum);
+    if (i < weights.size()) {
+      sum += weights[i];
+    }
+  }
+
+  tree.set(4, 1);
+  tree.set(1, 2);
+  CHECK(tree.total() == 18);
+  CHECK(tree.prefix(5) == 3 + 2 + 5 + 1 + 1);
+  CHECK(tree.weight(4) == 1);
+
+  tree.pop_back();
+  CHECK(tree.total() == 14);
+  tree.push_back(10);
+  CHECK(tree.prefix(7) == 24);
+}
+
+TEST_CASE("FenwickTree find covers every value once") {
+  FenwickTree tree;
+  std::vector<uint64_t> weights = {2, 0, 3, 1, 0, 4};
+  for (auto weight : weights) {
+    tree.push_back(weight);
+  }
+  std::vector<uint64_t> hits(weights.size(), 0);
+  for (uint64_t value = 0; value < tree.total(); value++) {
+    hits[tree.find(value)]++;
+  }
+  CHECK(hits == weights);
+
+  tree.clear();
+  CHECK(tree.empty());
+  tree.push_back(5);
+  CHECK(tree.find(4) == 0);
+}
@@ -37,3 +37,48 @@ TEST_CASE("Testing fs_utils functions") {
     CHECK_FALSE(info.capacity < info.available);
   }
 }
+
+TEST_CASE("FreeSpaceModel tracks operations and reconciles") {
+  std::filesystem::space_info real{1000000, 500000, 400000};
+  int probes = 0;
+  auto probe = [&](const std::filesystem::path&) {
+    probes++;
+    return real;
+  };
+  fs_utils::FreeSpaceModel model("/", 3, std::chrono::hours(1), probe);
+  CHECK(probes == 1);
+
+  // Operations update the model without touching the filesystem
+  model.account(100000);
+  model.account(-20000);
+  CHECK(model.status().available == 320000);
+  CHECK(model.status().free == 420000);
+  CHECK(probes == 1);
+
+  // Third operation makes the next status query reconcile, drift is what the model missed
+  real.available = 300000;
+  model.account(10000);
+  CHECK(model.status().available == 300000);
+  CHECK(probes == 2);
+  CHECK(model.reconcileCount() == 1);
+  CHECK(model.lastDrift() == 10000);
+  CHECK(model.maxDrift() == 10000);
+
+  // Space never goes below zero or above capacity
+  model.account(5000000);
+  CHECK(model.status().available == 0);
+  model.account(-5000000);
+  CHECK(model.status().available == 1000000);
+}
+
+TEST_CASE("FreeSpaceModel reconciles after interval") {
+  int probes = 0;
+  auto probe = [&](const std::filesystem::path&) {
+    probes++;
+    return std::filesystem::space_info{1000, 500, 500};
+  };
+  fs_utils::FreeSpaceModel model("/", 0, std::chrono::milliseconds(0), probe);
+  model.status();
+  model.status();
+  CHECK(probes == 3);
+}
@@ -0,0 +1,47 @@
+#include <doctest/doctest.h>
+#include <filestorm/utils/image.h>
+#include <sys/stat.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+TEST_CASE("Testing image helpers") {
+  const std::filesystem::path temp_dir = std::filesystem::temp_directory_path();
+  const std::filesystem::path image = temp_dir / "filestorm_test.img";
+  const std::filesystem::path clone = temp_dir / "filestorm_test.img.clone";
+
+  SUBCASE("create_sparse_file allocates nothing") {
+    fs_utils::create_sparse_file(image, 64 * 1024 * 1024);
+    CHECK(std::filesystem::file_size(image) == 64 * 1024 * 1024);
+    struct stat image_stat;
+    REQUIRE(stat(image.c_str(), &image_stat) == 0);
+    CHECK(image_stat.st_blocks * 512 < 1024 * 1024);
+    std::filesystem::remove(image);
+  }
+
+  SUBCASE("clone_file keeps content and size") {
+    fs_utils::create_sparse_file(image, 8 * 1024 * 1024);
+    {
+      std::fstream out(image, std::ios::in | std::ios::out | std::ios::binary);
+      out.seekp(4 * 1024 * 1024);
+      out << "aged";
+    }
+    auto method = fs_utils::clone_file(image, clone);
+    CHECK((method == fs_utils::CloneMethod::REFLINK || method == fs_utils::CloneMethod::SPARSE_COPY));
+    CHECK(std::filesystem::file_size(clone) == 8 * 1024 * 1024);
+    std::ifstream in(clone, std::ios::binary);
+    in.seekg(4 * 1024 * 1024);
+    std::string content(4, '\0');
+    in.read(content.data(), content.size());
+    CHECK(content == "aged");
+    std::filesystem::remove(image);
+    std::filesystem::remove(clone);
+  }
+
+  SUBCASE("run_command reports failures") {
+    CHECK_NOTHROW(fs_utils::run_command({"true"}));
+    CHECK_THROWS_AS(fs_utils::run_command({"false"}), std::runtime_error);
+    CHECK_THROWS_AS(fs_utils::run_command({"filestorm-nonexistent-command"}), std::runtime_error);
+  }
+}
@@ -0,0 +1,77 @@
+#include <doctest/doctest.h>
+#include <filestorm/utils/indexed_set.h>
+
+#include <array>
+#include <memory>
+
+namespace {
+  struct Item {
+    int value;
+    std::array<IndexedSet<std::shared_ptr<Item>>::Position, 2> set_positions{IndexedSet<std::shared_ptr<Item>>::NPOS, IndexedSet<std::shared_ptr<Item>>::NPOS};
+  };
+  using Itemptr = std::shared_ptr<Item>;
+}  // namespace
+
+TEST_CASE("IndexedSet insert and swap removal") {
+  IndexedSet<Itemptr> set(0);
+  std::vector<Itemptr> items;
+  for (int i = 0; i < 5; i++) {
+    items.push_back(std::make_shared<Item>(Item{i}));
+    CHECK(set.insert(items.back()));
+  }
+  CHECK_FALSE(set.insert(items[2]));
+  CHECK(set.size() == 5);
+  CHECK(set[3] == items[3]);
+
+  // The last item takes the place of the removed one
+  CHECK(set.erase(items[1]));
+  CHECK(set.size() == 4);
+  CHECK(set[1] == items[4]);
+  CHECK(items[4]->set_positions[0] == 1);
+  CHECK_FALSE(set.contains(items[1]));
+  CHECK_FALSE(set.erase(items[1]));
+
+  CHECK(set.erase(items[4]));
+  CHECK(set.erase(items[3]));
+  CHECK(set.size() == 2);
+  CHECK(set.contains(items[0]));
+  CHECK(set.contains(items[2]));
+  for (auto& item : set) {
+    CHECK(set[item->set_positions[0]] == item);
+  }
+
+  set.clear();
+  CHECK(set.empty());
+  CHECK(items[0]->set_positions[0] == IndexedSet<Itemptr>::NPOS);
+}
+
+TEST_CASE("IndexedSet items in several sets") {
+  IndexedSet<Itemptr> all(0);
+  IndexedSet<Itemptr> some(1);
+  auto a = std::make_shared<Item>(Item{1});
+  auto b = std::make_shared<Item>(Item{2});
+  all.insert(a);
+  all.insert(b);
+  some.insert(b);
+  CHECK(b->set_positions[0] == 1);
+  CHECK(b->set_positions[1] == 0);
+  CHECK_FALSE(some.contains(a));
+  all.erase(a);
+  CHECK(some.contains(b));
+  CHECK(all[0] == b);
+  CHECK(b->set_positions[0] == 0);
+  CHECK(b->set_positions[1] == 0);
+}
+
+TEST_CASE("IndexedSet doesn't take a position of another set for its own") {
+  IndexedSet<Itemptr> first(0);
+  IndexedSet<Itemptr> second(0);
+  auto a = std::make_shared<Item>(Item{1});
+  auto b = std::make_shared<Item>(Item{2});
+  first.insert(a);
+  second.insert(b);
+  // a claims position 0 in slot 0, but second holds b there
+  CHECK_FALSE(second.contains(a));
+  CHECK_FALSE(second.erase(a));
+  CHECK(second.size() == 1);
+}
@@ -0,0 +1,48 @@
+#include <doctest/doctest.h>
+#include <filestorm/utils/metadata.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+TEST_CASE("Testing metadata helpers") {
+  const std::filesystem::path file = std::filesystem::temp_directory_path() / "filestorm_test_metadata";
+  const std::filesystem::path link = std::filesystem::temp_directory_path() / "filestorm_test_metadata.lnk";
+  std::ofstream(file) << "metadata";
+
+  SUBCASE("hard_link adds a name of the same file") {
+    fs_utils::hard_link(file, link);
+    struct stat file_stat;
+    REQUIRE(stat(file.c_str(), &file_stat) == 0);
+    CHECK(file_stat.st_nlink == 2);
+    CHECK(std::filesystem::equivalent(file, link));
+    CHECK_THROWS_AS(fs_utils::hard_link(file, link), std::runtime_error);
+    std::filesystem::remove(link);
+  }
+
+  SUBCASE("change_mode and set_times") {
+    fs_utils::change_mode(file, 0640);
+    fs_utils::set_times(file, 1000000000);
+    struct stat file_stat;
+    REQUIRE(stat(file.c_str(), &file_stat) == 0);
+    CHECK((file_stat.st_mode & 0777) == 0640);
+    CHECK(file_stat.st_atime == 1000000000);
+    CHECK(file_stat.st_mtime > 1000000000);
+  }
+
+  SUBCASE("Extended attributes") {
+    if (!fs_utils::xattrs_supported(std::filesystem::temp_directory_path())) {
+      MESSAGE("Temporary directory doesn't support user extended attributes");
+      return;
+    }
+    CHECK(fs_utils::set_xattr(file, "user.filestorm.1", "value"));
+    CHECK(fs_utils::set_xattr(file, "user.other", "value"));
+    auto names = fs_utils::list_xattrs(file, "user.filestorm.");
+    CHECK(names == std::vector<std::string>{"user.filestorm.1"});
+    fs_utils::remove_xattr(file, "user.filestorm.1");
+    CHECK(fs_utils::list_xattrs(file, "user.filestorm.").empty());
+    CHECK_THROWS_AS(fs_utils::remove_xattr(file, "user.filestorm.1"), std::runtime_error);
+  }
+  std::filesystem::remove(file);
+}
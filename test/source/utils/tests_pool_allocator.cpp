@@ -0,0 +1,44 @@
+#include <doctest/doctest.h>
+#include <filestorm/utils/pool_allocator.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace {
+  struct Block {
+    uint64_t values[5];
+  };
+}  // namespace
+
+TEST_CASE("PoolAllocator reuses freed blocks") {
+  PoolAllocator<Block> allocator;
+  auto* first = allocator.allocate(1);
+  auto* second = allocator.allocate(1);
+  CHECK(first != second);
+  CHECK(reinterpret_cast<uintptr_t>(first) % alignof(Block) == 0);
+  allocator.deallocate(first, 1);
+  CHECK(allocator.allocate(1) == first);
+  allocator.deallocate(first, 1);
+  allocator.deallocate(second, 1);
+
+  // Arrays don't come from the pool
+  auto* array = allocator.allocate(3);
+  array[2].values[4] = 1;
+  allocator.deallocate(array, 3);
+}
+
+TEST_CASE("PoolAllocator with allocate_shared") {
+  std::vector<std::shared_ptr<Block>> blocks;
+  for (int i = 0; i < 100000; i++) {
+    blocks.push_back(std::allocate_shared<Block>(PoolAllocator<Block>(), Block{{uint64_t(i), 0, 0, 0, uint64_t(i)}}));
+  }
+  bool intact = true;
+  for (int i = 0; i < 100000; i++) {
+    intact = intact && blocks[i]->values[0] == uint64_t(i) && blocks[i]->values[4] == uint64_t(i);
+  }
+  CHECK(intact);
+  blocks.clear();
+  auto block = std::allocate_shared<Block>(PoolAllocator<Block>(), Block{{7, 0, 0, 0, 0}});
+  CHECK(block->values[0] == 7);
+}
@@ -24,7 +24,7 @@ TEST_CASE("Testing ProbabilisticStateMachine") {
 
   SUBCASE("performTransition correctly updates the current state based on probabilities") {
     // Seed rand to make the test deterministic
-    srand(123);  // Use a fixed seed for reproducibility
+    Random::seed(123);  // Use a fixed seed for reproducibility
 
     psm.performTransition(probabilities);
     CHECK(psm.getCurrentState() == 2);
@@ -42,8 +42,56 @@ TEST_CASE("Testing ProbabilisticStateMachine") {
     CHECK(psm.getCurrentState() == 1);  // Initial state
 
     // Perform a valid transition and check state again
-    srand(123);  // Ensure deterministic behavior
+    Random::seed(123);  // Ensure deterministic behavior
     psm.performTransition(probabilities);
     CHECK(psm.getCurrentState() == 2);
   }
 }
+
+TEST_CASE("CompiledStateMachine walks the same path as ProbabilisticStateMachine") {
+  std::map<std::string, Transition> transitions = {{"0->1", Transition(0, 1, "pA")}, {"0->2", Transition(0, 2, "pB")}, {"1->0", Transition(1, 0, "p1")},
+                                                   {"2->0", Transition(2, 0, "pC")}, {"2->1", Transition(2, 1, "pD")}};
+  std::map<std::string, double> probabilities = {{"pA", 0.3}, {"pB", 0.7}, {"pC", 0.5}, {"pD", 0.5}, {"p1", 1.0}};
+  std::vector<std::string> keys = {"pA", "pB", "pC", "pD", "p1"};
+
+  ProbabilisticStateMachine reference(transitions, 0);
+  CompiledStateMachine compiled(transitions, 0, keys);
+  for (size_t slot = 0; slot < keys.size(); slot++) {
+    compiled.setProbability(slot, probabilities[keys[slot]]);
+  }
+
+  Random::seed(42);
+  std::vector<int> reference_path;
+  for (int i = 0; i < 200; i++) {
+    reference.performTransition(probabilities);
+    reference_path.push_back(reference.getCurrentState());
+  }
+  Random::seed(42);
+  std::vector<int> compiled_path;
+  for (int i = 0; i < 200; i++) {
+    compiled.performTransition();
+    compiled_path.push_back(compiled.getCurrentState());
+  }
+  CHECK(reference_path == compiled_path);
+}
+
+TEST_CASE("CompiledStateMachine recomputes changed probabilities") {
+  std::map<std::string, Transition> transitions = {{"t1", Transition(0, 1, "pA")}, {"t2", Transition(0, 2, "pB")}, {"t3", Transition(1, 0, "p1")}, {"t4", Transition(2, 0, "p1")}};
+  CompiledStateMachine psm(transitions, 0, {"pA", "pB", "p1"});
+  psm.setProbabilities(std::vector<double>{1.0, 0.0, 1.0});
+  psm.performTransition();
+  CHECK(psm.getCurrentState() == 1);
+  psm.performTransition();
+  CHECK(psm.getCurrentState() == 0);
+
+  psm.setProbabilities(std::vector<double>{0.0, 1.0, 1.0});
+  CHECK(psm.getProbability(1) == 1.0);
+  psm.performTransition();
+  CHECK(psm.getCurrentState() == 2);
+
+  // No probability left for any transition
+  psm.setProbability(2, 0.0);
+  CHECK_THROWS_AS(psm.performTransition(), std::runtime_error);
+
+  CHECK_THROWS_AS(CompiledStateMachine(transitions, 0, {"pA"}), std::runtime_error);
+}
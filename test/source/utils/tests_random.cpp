@@ -0,0 +1,82 @@
+#include <doctest/doctest.h>
+#include <filestorm/utils/random.h>
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace {
+  std::vector<uint64_t> draw(Random::Stream stream, int count) {
+    std::vector<uint64_t> values;
+    for (int i = 0; i < count; i++) {
+      values.push_back(Random::get(stream)());
+    }
+    return values;
+  }
+}  // namespace
+
+TEST_CASE("Xoshiro256 matches the reference sequence") {
+  // First outputs of xoshiro256** for the state {1, 2, 3, 4}
+  Xoshiro256 generator;
+  generator.setState({1, 2, 3, 4});
+  CHECK(generator() == 11520);
+  CHECK(generator() == 0);
+  CHECK(generator() == 1509978240);
+  CHECK(generator() == 1215971899390074240ull);
+
+  Xoshiro256 seeded(5);
+  for (int i = 0; i < 1000; i++) {
+    CHECK(seeded.below(10) < 10);
+    double unit = seeded.unit();
+    CHECK(unit >= 0);
+    CHECK(unit < 1);
+  }
+  CHECK(seeded.below(0) == 0);
+}
+
+TEST_CASE("Random streams follow the master seed") {
+  Random::seed(99);
+  CHECK(Random::masterSeed() == 99);
+  auto first = draw(Random::TREE, 10);
+  auto other = draw(Random::FILE_SIZE, 10);
+  CHECK(first != other);
+
+  // Draws from one stream don't shift another
+  Random::seed(99);
+  draw(Random::FILE_SIZE, 3);
+  CHECK(draw(Random::TREE, 10) == first);
+
+  Random::seed(100);
+  CHECK(draw(Random::TREE, 10) != first);
+
+  Random::seed(99);
+  draw(Random::TREE, 5);
+  auto state = Random::save();
+  auto rest = draw(Random::TREE, 5);
+  Random::restore(state);
+  CHECK(draw(Random::TREE, 5) == rest);
+  CHECK(std::vector<uint64_t>(first.begin() + 5, first.end()) == rest);
+}
+
+TEST_CASE("Random streams of workers are independent") {
+  Random::seed(7);
+  auto main_values = draw(Random::OFFSETS, 8);
+  CHECK(Random::derive(Random::OFFSETS, 1)() != Random::derive(Random::OFFSETS, 2)());
+  CHECK(Random::derive(Random::OFFSETS, 3)() == Random::derive(Random::OFFSETS, 3)());
+
+  std::vector<std::vector<uint64_t>> worker_values(2);
+  std::vector<std::thread> threads;
+  for (uint32_t worker = 0; worker < 2; worker++) {
+    threads.emplace_back([&, worker]() {
+      Random::setWorker(worker + 1);
+      worker_values[worker] = draw(Random::OFFSETS, 8);
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  CHECK(worker_values[0] != worker_values[1]);
+  CHECK(worker_values[0] != main_values);
+  auto expected = Random::derive(Random::OFFSETS, 2);
+  CHECK(worker_values[1][0] == expected());
+}
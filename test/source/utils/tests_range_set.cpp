@@ -0,0 +1,63 @@
+#include <doctest/doctest.h>
+#include <filestorm/utils/range_set.h>
+
+using Kind = RangeSet::Kind;
+
+TEST_CASE("RangeSet assign splits and merges ranges") {
+  RangeSet set;
+  set.assign(10, 20, Kind::PUNCHED);
+  set.assign(20, 30, Kind::PUNCHED);
+  REQUIRE(set.size() == 1);
+  CHECK(set.ranges()[0] == RangeSet::Range{10, 30, Kind::PUNCHED});
+
+  // Data in the middle splits the range
+  set.assign(15, 18, Kind::DATA);
+  REQUIRE(set.size() == 2);
+  CHECK(set.ranges()[0] == RangeSet::Range{10, 15, Kind::PUNCHED});
+  CHECK(set.ranges()[1] == RangeSet::Range{18, 30, Kind::PUNCHED});
+
+  set.assign(25, 40, Kind::UNWRITTEN);
+  REQUIRE(set.size() == 3);
+  CHECK(set.ranges()[1] == RangeSet::Range{18, 25, Kind::PUNCHED});
+  CHECK(set.ranges()[2] == RangeSet::Range{25, 40, Kind::UNWRITTEN});
+  CHECK(set.bytes(Kind::PUNCHED) == 12);
+  CHECK(set.bytes(Kind::UNWRITTEN) == 15);
+
+  set.assign(0, 100, Kind::DATA);
+  CHECK(set.empty());
+}
+
+TEST_CASE("RangeSet replace and truncate") {
+  RangeSet set;
+  set.assign(0, 10, Kind::PUNCHED);
+  set.assign(20, 30, Kind::PUNCHED);
+  set.assign(30, 40, Kind::UNWRITTEN);
+  set.replace(5, 25, Kind::PUNCHED, Kind::UNWRITTEN);
+  REQUIRE(set.size() == 5);
+  CHECK(set.ranges()[0] == RangeSet::Range{0, 5, Kind::PUNCHED});
+  CHECK(set.ranges()[1] == RangeSet::Range{5, 10, Kind::UNWRITTEN});
+  CHECK(set.ranges()[2] == RangeSet::Range{20, 25, Kind::UNWRITTEN});
+  CHECK(set.ranges()[3] == RangeSet::Range{25, 30, Kind::PUNCHED});
+  CHECK(set.bytes(Kind::UNWRITTEN) == 20);
+
+  set.truncate(27);
+  REQUIRE(set.size() == 4);
+  CHECK(set.ranges()[3] == RangeSet::Range{25, 27, Kind::PUNCHED});
+  set.truncate(0);
+  CHECK(set.empty());
+}
+
+TEST_CASE("RangeSet lookups") {
+  RangeSet set;
+  set.assign(10, 20, Kind::PUNCHED);
+  set.assign(30, 40, Kind::UNWRITTEN);
+  CHECK(set.containing(5) == nullptr);
+  REQUIRE(set.containing(10) != nullptr);
+  CHECK(*set.containing(19) == RangeSet::Range{10, 20, Kind::PUNCHED});
+  CHECK(set.containing(20) == nullptr);
+  CHECK(set.containing(35)->kind == Kind::UNWRITTEN);
+  CHECK(set.nextStart(0) == 10);
+  CHECK(set.nextStart(10) == 10);
+  CHECK(set.nextStart(11) == 30);
+  CHECK(set.nextStart(31) == UINT64_MAX);
+}